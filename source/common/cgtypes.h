@@ -120,8 +120,12 @@ typedef struct
 
 #define CGBoxIsOverlap(a, b)   ((a).Xmin<(b).Xmax && (a).Ymin<(b).Ymax && (b).Xmin<(a).Xmax && (b).Ymin<(a).Ymax)
 
+#define CGBoxIsTouched(a, b)   ((a).Xmin<=(b).Xmax && (a).Ymin<=(b).Ymax && (b).Xmin<=(a).Xmax && (b).Ymin<=(a).Ymax)
+
 #define CGBoxInflate(box, d)   do { box.Xmin -= d; box.Ymin -= d; box.Xmax += d; box.Ymax += d; } while(0)
 
+#define CGBoxIsInside(a, b)    ((a).Xmin>=(b).Xmin && (a).Ymin>=(b).Ymin && (a).Xmax<=(b).Xmax && (a).Ymax<=(b).Ymax)
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,382 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file clippath.c
+ * @brief clip rings and lines to a box before path emission.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-28 09:15:40
+ * @date 2024-11-28 17:32:06
+ *
+ * @note
+ */
+#include "clippath.h"
+
+
+// edges of box: inside is x >= Xmin, x <= Xmax, y >= Ymin, y <= Ymax
+typedef enum
+{
+    clip_edge_left = 0,
+    clip_edge_right,
+    clip_edge_bottom,
+    clip_edge_top
+} clip_edge_t;
+
+
+void ClipPathInit (ClipPath *clip, mem_arena_t *arena)
+{
+    memset(clip, 0, sizeof(*clip));
+    clip->arena = arena;
+}
+
+
+void ClipPathReset (ClipPath *clip)
+{
+    clip->numPoints = 0;
+    clip->numParts = 0;
+}
+
+
+static void clip_reserve_points (ClipPath *clip, int count)
+{
+    if (clip->numPoints + count > clip->maxPoints) {
+        int maxPoints = CG_MAX(clip->numPoints + count, clip->maxPoints * 2);
+        clip->points = (double *) mem_arena_realloc(clip->arena, clip->points,
+            sizeof(double) * 2 * clip->maxPoints, sizeof(double) * 2 * maxPoints);
+        clip->maxPoints = maxPoints;
+    }
+}
+
+
+static void clip_add_part (ClipPath *clip, int start)
+{
+    // partStart has numParts + 1 entries
+    if (clip->numParts + 2 > clip->maxParts) {
+        int maxParts = CG_MAX(clip->numParts + 2, clip->maxParts * 2);
+        clip->partStart = (int *) mem_arena_realloc(clip->arena, clip->partStart,
+            sizeof(int) * clip->maxParts, sizeof(int) * maxParts);
+        clip->maxParts = maxParts;
+    }
+    clip->partStart[clip->numParts++] = start;
+    clip->partStart[clip->numParts] = clip->numPoints;
+}
+
+
+/**
+ * make room of stages for output of n points in *in, which is kept if it
+ *   is a stage. returns the other stage for output
+ */
+static double * clip_reserve_stages (ClipPath *clip, const double **in, int n)
+{
+    // a stage keeps points inside and adds one at most per point outside
+    if (2 * n > clip->maxStage) {
+        int maxStage = CG_MAX(2 * n, clip->maxStage * 2);
+        double *stage0 = (double *) mem_arena_alloc(clip->arena, sizeof(double) * 2 * maxStage);
+        double *stage1 = (double *) mem_arena_alloc(clip->arena, sizeof(double) * 2 * maxStage);
+
+        if (*in == clip->stage[0] || *in == clip->stage[1]) {
+            memcpy(stage0, *in, sizeof(double) * 2 * n);
+            *in = stage0;
+        }
+        clip->stage[0] = stage0;
+        clip->stage[1] = stage1;
+        clip->maxStage = maxStage;
+    }
+    return (*in == clip->stage[0]? clip->stage[1] : clip->stage[0]);
+}
+
+
+static void clip_bounds (const double *xy, int count, CGBox2D *bounds)
+{
+    int i;
+    bounds->Xmin = bounds->Xmax = xy[0];
+    bounds->Ymin = bounds->Ymax = xy[1];
+    for (i = 1; i < count; i++) {
+        const double *pt = &xy[2 * i];
+        if (pt[0] < bounds->Xmin) bounds->Xmin = pt[0];
+        if (pt[0] > bounds->Xmax) bounds->Xmax = pt[0];
+        if (pt[1] < bounds->Ymin) bounds->Ymin = pt[1];
+        if (pt[1] > bounds->Ymax) bounds->Ymax = pt[1];
+    }
+}
+
+
+STATIC_INLINE int clip_inside (const double *pt, clip_edge_t edge, double v)
+{
+    switch (edge) {
+    case clip_edge_left:   return pt[0] >= v;
+    case clip_edge_right:  return pt[0] <= v;
+    case clip_edge_bottom: return pt[1] >= v;
+    default:               return pt[1] <= v;
+    }
+}
+
+
+// bits of the box edges pt is outside of
+STATIC_INLINE int clip_outcode (const CGBox2D *box, const double *pt)
+{
+    return (pt[0] < box->Xmin) | ((pt[0] > box->Xmax) << 1) | ((pt[1] < box->Ymin) << 2) | ((pt[1] > box->Ymax) << 3);
+}
+
+
+/**
+ * keep only the first and last points of each run outside the same edges.
+ *   stages drop such points and their segments anyway, so the clipped
+ *   ring is the same. returns points of out (room for n points)
+ */
+static int clip_ring_reduce (const CGBox2D *box, const double *in, int n, double *out)
+{
+    int i, k = 0, code, prevCode = -1, runLen = 0;
+
+    for (i = 0; i < n; i++) {
+        const double *pt = &in[2 * i];
+        code = clip_outcode(box, pt);
+
+        if (code && code == prevCode) {
+            if (runLen++ > 1) {
+                // replace the last point of the run
+                k--;
+            }
+        } else {
+            runLen = 1;
+        }
+
+        out[2 * k] = pt[0];
+        out[2 * k + 1] = pt[1];
+        k++;
+
+        prevCode = code;
+    }
+    return k;
+}
+
+
+/**
+ * one Sutherland-Hodgman stage: keep part of ring in[n] inside edge.
+ *   out has room for 2 * n points. returns points of out
+ */
+static int clip_ring_edge (const double *in, int n, double *out, clip_edge_t edge, double v)
+{
+    int i, k = 0;
+    const double *prev = &in[2 * (n - 1)];
+    int prevIn = clip_inside(prev, edge, v);
+
+    for (i = 0; i < n; i++) {
+        const double *cur = &in[2 * i];
+        int curIn = clip_inside(cur, edge, v);
+
+        if (curIn != prevIn) {
+            // crossing: endpoints differ on the edge axis
+            if (edge == clip_edge_left || edge == clip_edge_right) {
+                out[2 * k] = v;
+                out[2 * k + 1] = prev[1] + (v - prev[0]) / (cur[0] - prev[0]) * (cur[1] - prev[1]);
+            } else {
+                out[2 * k] = prev[0] + (v - prev[1]) / (cur[1] - prev[1]) * (cur[0] - prev[0]);
+                out[2 * k + 1] = v;
+            }
+            k++;
+        }
+        if (curIn) {
+            out[2 * k] = cur[0];
+            out[2 * k + 1] = cur[1];
+            k++;
+        }
+
+        prev = cur;
+        prevIn = curIn;
+    }
+    return k;
+}
+
+
+int ClipPathAddRing (ClipPath *clip, const CGBox2D *box, const double *xy, int count)
+{
+    int e, n, start = clip->numPoints;
+    const double *in = xy;
+    CGBox2D bounds;
+
+    // drop closing point
+    if (count > 1 && xy[0] == xy[2 * count - 2] && xy[1] == xy[2 * count - 1]) {
+        count--;
+    }
+    if (count < 3) {
+        return 0;
+    }
+
+    clip_bounds(xy, count, &bounds);
+    if (! CGBoxIsOverlap(bounds, *box)) {
+        return 0;
+    }
+
+    if (CGBoxIsInside(bounds, *box)) {
+        clip_reserve_points(clip, count);
+        memcpy(&clip->points[2 * start], xy, sizeof(double) * 2 * count);
+        clip->numPoints += count;
+        clip_add_part(clip, start);
+        return count;
+    }
+
+    in = clip_reserve_stages(clip, &in, count);
+    n = clip_ring_reduce(box, xy, count, (double *) in);
+    if (n < 3) {
+        return 0;
+    }
+
+    for (e = clip_edge_left; e <= clip_edge_top; e++) {
+        double v;
+        double *out;
+
+        switch (e) {
+        case clip_edge_left:
+            if (bounds.Xmin >= box->Xmin) continue;
+            v = box->Xmin;
+            break;
+        case clip_edge_right:
+            if (bounds.Xmax <= box->Xmax) continue;
+            v = box->Xmax;
+            break;
+        case clip_edge_bottom:
+            if (bounds.Ymin >= box->Ymin) continue;
+            v = box->Ymin;
+            break;
+        default:
+            if (bounds.Ymax <= box->Ymax) continue;
+            v = box->Ymax;
+            break;
+        }
+
+        out = clip_reserve_stages(clip, &in, n);
+
+        n = clip_ring_edge(in, n, out, (clip_edge_t) e, v);
+        if (n < 3) {
+            return 0;
+        }
+        in = out;
+    }
+
+    clip_reserve_points(clip, n);
+    memcpy(&clip->points[2 * start], in, sizeof(double) * 2 * n);
+    clip->numPoints += n;
+    clip_add_part(clip, start);
+    return n;
+}
+
+
+/**
+ * Liang-Barsky: clip segment p0-p1 to box.
+ *   returns 0 if outside, or 1 with parameters t0 <= t1 of visible piece
+ */
+static int clip_segment (const CGBox2D *box, const double *p0, const double *p1, double *t0, double *t1)
+{
+    int i;
+    double dx = p1[0] - p0[0];
+    double dy = p1[1] - p0[1];
+
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {p0[0] - box->Xmin, box->Xmax - p0[0], p0[1] - box->Ymin, box->Ymax - p0[1]};
+
+    *t0 = 0;
+    *t1 = 1;
+
+    for (i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            // parallel to edge
+            if (q[i] < 0) {
+                return 0;
+            }
+        } else {
+            double t = q[i] / p[i];
+            if (p[i] < 0) {
+                if (t > *t1) return 0;
+                if (t > *t0) *t0 = t;
+            } else {
+                if (t < *t0) return 0;
+                if (t < *t1) *t1 = t;
+            }
+        }
+    }
+    return 1;
+}
+
+
+int ClipPathAddLine (ClipPath *clip, const CGBox2D *box, const double *xy, int count)
+{
+    int i, open = 0, numParts = clip->numParts;
+    CGBox2D bounds;
+
+    if (count < 2) {
+        return 0;
+    }
+
+    clip_bounds(xy, count, &bounds);
+    if (bounds.Xmax < box->Xmin || bounds.Xmin > box->Xmax || bounds.Ymax < box->Ymin || bounds.Ymin > box->Ymax) {
+        return 0;
+    }
+
+    if (CGBoxIsInside(bounds, *box)) {
+        int start = clip->numPoints;
+        clip_reserve_points(clip, count);
+        memcpy(&clip->points[2 * start], xy, sizeof(double) * 2 * count);
+        clip->numPoints += count;
+        clip_add_part(clip, start);
+        return 1;
+    }
+
+    for (i = 1; i < count; i++) {
+        const double *p0 = &xy[2 * (i - 1)], *p1 = &xy[2 * i];
+        double t0, t1, *pt;
+
+        if ((clip_outcode(box, p0) & clip_outcode(box, p1)) || ! clip_segment(box, p0, p1, &t0, &t1)) {
+            open = 0;
+            continue;
+        }
+
+        clip_reserve_points(clip, 2);
+
+        if (! open) {
+            // piece starts: at p0 or where segment enters box
+            pt = &clip->points[2 * clip->numPoints++];
+            pt[0] = p0[0] + t0 * (p1[0] - p0[0]);
+            pt[1] = p0[1] + t0 * (p1[1] - p0[1]);
+            clip_add_part(clip, clip->numPoints - 1);
+        }
+
+        pt = &clip->points[2 * clip->numPoints++];
+        if (t1 < 1) {
+            pt[0] = p0[0] + t1 * (p1[0] - p0[0]);
+            pt[1] = p0[1] + t1 * (p1[1] - p0[1]);
+        } else {
+            pt[0] = p1[0];
+            pt[1] = p1[1];
+        }
+        clip->partStart[clip->numParts] = clip->numPoints;
+
+        // piece goes on if p1 is inside
+        open = (t1 >= 1);
+    }
+
+    return clip->numParts - numParts;
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file clippath.h
+ * @brief clip rings and lines to a box before path emission.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-28 09:15:40
+ * @date 2024-11-28 17:32:06
+ *
+ * @note
+ *   环 (多边形的每个环单独裁剪) 用 Sutherland-Hodgman, 线用 Liang-Barsky.
+ *   裁剪框比画布大一些 (线宽以外), 裁剪产生的沿框的边不会被画出来.
+ *   结果在 arena 上, 填充和描边共用, 收回 arena 后失效.
+ */
+#ifndef CLIP_PATH_H__
+#define CLIP_PATH_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include "cgtypes.h"
+#include "memapi.h"
+
+
+typedef struct
+{
+    mem_arena_t *arena;
+
+    // x, y pairs of clipped parts. part i is [partStart[i], partStart[i+1])
+    double *points;
+    int numPoints;
+    int maxPoints;
+
+    int *partStart;
+    int numParts;
+    int maxParts;
+
+    // buffers between Sutherland-Hodgman stages
+    double *stage[2];
+    int maxStage;
+} ClipPath;
+
+
+extern void ClipPathInit (ClipPath *clip, mem_arena_t *arena);
+
+// clear parts, buffers are kept
+extern void ClipPathReset (ClipPath *clip);
+
+/**
+ * ClipPathAddRing
+ *   clip ring xy[count] (x, y pairs, closed or not) to box and add the
+ *   result as one part (not closed). ring with bounds inside box is added
+ *   as it is.
+ * Returns:
+ *   points of part added, 0 if ring is outside box
+ */
+extern int ClipPathAddRing (ClipPath *clip, const CGBox2D *box, const double *xy, int count);
+
+/**
+ * ClipPathAddLine
+ *   clip line xy[count] to box and add its visible pieces as parts.
+ * Returns:
+ *   number of parts added
+ */
+extern int ClipPathAddLine (ClipPath *clip, const CGBox2D *box, const double *xy, int count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CLIP_PATH_H__ */
@@ -0,0 +1,407 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file crsproj.c
+ * @brief reproject coordinate arrays between coordinate reference systems.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-29 09:30:18
+ * @date 2024-11-29 09:30:18
+ *
+ * @note
+ */
+#include "crsproj.h"
+
+#include <proj.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#   define strcasecmp   stricmp
+#   define strncasecmp  strnicmp
+#else
+#   include <strings.h>
+#endif
+
+
+#define CRS_PI       3.14159265358979323846
+#define CRS_DEG2RAD  (CRS_PI / 180.0)
+#define CRS_RAD2DEG  (180.0 / CRS_PI)
+
+
+/**
+ * value of +key=value in proj4def. returns length of value, -1 if not found
+ */
+static int crs_param (const char *proj4def, const char *key, const char **value)
+{
+    int keylen = (int) strlen(key);
+    const char *p = proj4def;
+
+    while ((p = strchr(p, '+')) != 0) {
+        p++;
+        if (! strncasecmp(p, key, keylen) && (p[keylen] == '=' || p[keylen] == ' ' || p[keylen] == 0)) {
+            if (p[keylen] != '=') {
+                *value = p + keylen;
+                return 0;
+            }
+            *value = p + keylen + 1;
+            return (int) strcspn(*value, " \t");
+        }
+    }
+    return -1;
+}
+
+
+// +key=value as number, dflt if not found
+static double crs_param_number (const char *proj4def, const char *key, double dflt)
+{
+    const char *value;
+    if (crs_param(proj4def, key, &value) > 0) {
+        return atof(value);
+    }
+    return dflt;
+}
+
+
+static int crs_param_is (const char *proj4def, const char *key, const char *str)
+{
+    const char *value;
+    int len = crs_param(proj4def, key, &value);
+    return (len == (int) strlen(str) && ! strncasecmp(value, str, len));
+}
+
+
+// sphere or ellipsoid of built-in transforms: WGS84 a or R = 6378137
+static int crs_param_earth (const char *proj4def)
+{
+    const char *value;
+
+    if (crs_param(proj4def, "R", &value) > 0) {
+        return atof(value) == CRS_EARTH_RADIUS;
+    }
+    if (crs_param(proj4def, "a", &value) > 0) {
+        return atof(value) == CRS_EARTH_RADIUS && crs_param_number(proj4def, "b", CRS_EARTH_RADIUS) == CRS_EARTH_RADIUS;
+    }
+    return (crs_param(proj4def, "datum", &value) < 0 || crs_param_is(proj4def, "datum", "WGS84")) &&
+        (crs_param(proj4def, "ellps", &value) < 0 || crs_param_is(proj4def, "ellps", "WGS84"));
+}
+
+
+static CRSKind crs_parse_epsg (CRSDef *crs, int code)
+{
+    switch (code) {
+    case 4326:
+        crs->kind = crs_kind_lonlat;
+        break;
+    case 3857:
+    case 3785:
+    case 900913:
+    case 102100:
+        crs->kind = crs_kind_webmerc;
+        break;
+    case 4087:
+    case 32662:
+        crs->kind = crs_kind_eqc;
+        break;
+    default:
+        crs->kind = crs_kind_proj;
+        break;
+    }
+    return crs->kind;
+}
+
+
+static CRSKind crs_parse_proj4 (CRSDef *crs, const char *proj4def)
+{
+    const char *value;
+
+    crs->kind = crs_kind_proj;
+
+    // units other than meter, axis order, towgs84 shifts: left to PROJ
+    if ((crs_param(proj4def, "units", &value) >= 0 && ! crs_param_is(proj4def, "units", "m")) ||
+        crs_param(proj4def, "axis", &value) >= 0 || crs_param(proj4def, "towgs84", &value) >= 0 ||
+        crs_param(proj4def, "pm", &value) >= 0 || ! crs_param_earth(proj4def)) {
+        return crs->kind;
+    }
+
+    if (crs_param_is(proj4def, "proj", "longlat") || crs_param_is(proj4def, "proj", "latlong") || crs_param_is(proj4def, "proj", "lonlat")) {
+        crs->kind = crs_kind_lonlat;
+    } else if (crs_param_is(proj4def, "proj", "merc")) {
+        // spherical only: +a=6378137 +b=6378137 or +R=6378137
+        if ((crs_param(proj4def, "R", &value) > 0 || crs_param(proj4def, "a", &value) > 0) &&
+            crs_param_number(proj4def, "lat_ts", 0) == 0 && crs_param_number(proj4def, "lon_0", 0) == 0 &&
+            crs_param_number(proj4def, "x_0", 0) == 0 && crs_param_number(proj4def, "y_0", 0) == 0 &&
+            crs_param_number(proj4def, "k", 1) == 1 && crs_param_number(proj4def, "k_0", 1) == 1) {
+            crs->kind = crs_kind_webmerc;
+        }
+    } else if (crs_param_is(proj4def, "proj", "eqc")) {
+        crs->kind = crs_kind_eqc;
+        crs->lon0 = crs_param_number(proj4def, "lon_0", 0);
+        crs->latts = crs_param_number(proj4def, "lat_ts", 0);
+        crs->x0 = crs_param_number(proj4def, "x_0", 0);
+        crs->y0 = crs_param_number(proj4def, "y_0", 0);
+
+        if (fabs(crs->latts) >= 90 || crs_param_number(proj4def, "lat_0", 0) != 0) {
+            crs->kind = crs_kind_proj;
+        }
+    }
+    return crs->kind;
+}
+
+
+CRSKind CRSDefParse (CRSDef *crs, const char *proj4def)
+{
+    memset(crs, 0, sizeof(*crs));
+
+    if (! proj4def) {
+        return crs_kind_none;
+    }
+    proj4def += strspn(proj4def, " \t");
+    if (! *proj4def) {
+        return crs_kind_none;
+    }
+
+    if (! strncasecmp(proj4def, "EPSG:", 5)) {
+        return crs_parse_epsg(crs, atoi(proj4def + 5));
+    }
+    if (! strncasecmp(proj4def, "+init=epsg:", 11)) {
+        return crs_parse_epsg(crs, atoi(proj4def + 11));
+    }
+    if (! strcasecmp(proj4def, "OGC:CRS84")) {
+        crs->kind = crs_kind_lonlat;
+        return crs->kind;
+    }
+    if (*proj4def == '+') {
+        return crs_parse_proj4(crs, proj4def);
+    }
+
+    crs->kind = crs_kind_proj;
+    return crs->kind;
+}
+
+
+static int crs_def_equal (const CRSDef *a, const CRSDef *b)
+{
+    return a->kind == b->kind && a->lon0 == b->lon0 && a->latts == b->latts && a->x0 == b->x0 && a->y0 == b->y0;
+}
+
+
+int CRSTransformInit (CRSTransform *trans, const char *srcdef, const char *dstdef)
+{
+    memset(trans, 0, sizeof(*trans));
+
+    CRSDefParse(&trans->src, srcdef);
+    CRSDefParse(&trans->dst, dstdef);
+
+    if (trans->src.kind == crs_kind_none || trans->dst.kind == crs_kind_none) {
+        trans->identity = 1;
+        return 0;
+    }
+
+    if (trans->src.kind != crs_kind_proj && trans->dst.kind != crs_kind_proj) {
+        trans->identity = crs_def_equal(&trans->src, &trans->dst);
+        return 0;
+    }
+
+    if (! strcmp(srcdef, dstdef)) {
+        trans->identity = 1;
+        return 0;
+    }
+
+    trans->pjctx = proj_context_create();
+    if (trans->pjctx) {
+        PJ *pj = proj_create_crs_to_crs((PJ_CONTEXT *) trans->pjctx, srcdef, dstdef, 0);
+        if (pj) {
+            // x, y as longitude, latitude for geographic crs
+            trans->pj = proj_normalize_for_visualization((PJ_CONTEXT *) trans->pjctx, pj);
+            proj_destroy(pj);
+        }
+    }
+
+    if (! trans->pj) {
+        printf("Error: proj_create_crs_to_crs failed: %s => %s\n", srcdef, dstdef);
+        CRSTransformFinal(trans);
+        trans->identity = 1;
+        return -1;
+    }
+
+    pthread_mutex_init(&trans->lock, 0);
+    return 0;
+}
+
+
+void CRSTransformFinal (CRSTransform *trans)
+{
+    if (trans->pj) {
+        proj_destroy((PJ *) trans->pj);
+        pthread_mutex_destroy(&trans->lock);
+    }
+    if (trans->pjctx) {
+        proj_context_destroy((PJ_CONTEXT *) trans->pjctx);
+    }
+    trans->pj = 0;
+    trans->pjctx = 0;
+}
+
+
+static void crs_webmerc_fwd (double *xy, int count)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        double lat = xy[2 * i + 1];
+        if (lat > CRS_WEBMERC_MAXLAT) {
+            lat = CRS_WEBMERC_MAXLAT;
+        } else if (lat < -CRS_WEBMERC_MAXLAT) {
+            lat = -CRS_WEBMERC_MAXLAT;
+        }
+        xy[2 * i] = CRS_EARTH_RADIUS * CRS_DEG2RAD * xy[2 * i];
+        xy[2 * i + 1] = CRS_EARTH_RADIUS * asinh(tan(CRS_DEG2RAD * lat));
+    }
+}
+
+
+static void crs_webmerc_inv (double *xy, int count)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        xy[2 * i] = CRS_RAD2DEG / CRS_EARTH_RADIUS * xy[2 * i];
+        xy[2 * i + 1] = CRS_RAD2DEG * atan(sinh(xy[2 * i + 1] / CRS_EARTH_RADIUS));
+    }
+}
+
+
+static void crs_eqc_fwd (const CRSDef *crs, double *xy, int count)
+{
+    int i;
+    double kx = CRS_EARTH_RADIUS * CRS_DEG2RAD * cos(CRS_DEG2RAD * crs->latts);
+    double ky = CRS_EARTH_RADIUS * CRS_DEG2RAD;
+
+    for (i = 0; i < count; i++) {
+        xy[2 * i] = kx * (xy[2 * i] - crs->lon0) + crs->x0;
+        xy[2 * i + 1] = ky * xy[2 * i + 1] + crs->y0;
+    }
+}
+
+
+static void crs_eqc_inv (const CRSDef *crs, double *xy, int count)
+{
+    int i;
+    double kx = 1 / (CRS_EARTH_RADIUS * CRS_DEG2RAD * cos(CRS_DEG2RAD * crs->latts));
+    double ky = 1 / (CRS_EARTH_RADIUS * CRS_DEG2RAD);
+
+    for (i = 0; i < count; i++) {
+        xy[2 * i] = kx * (xy[2 * i] - crs->x0) + crs->lon0;
+        xy[2 * i + 1] = ky * (xy[2 * i + 1] - crs->y0);
+    }
+}
+
+
+void CRSTransformPoints (CRSTransform *trans, double *xy, int count)
+{
+    if (trans->identity || count <= 0) {
+        return;
+    }
+
+    if (trans->pj) {
+        pthread_mutex_lock(&trans->lock);
+        proj_trans_generic((PJ *) trans->pj, PJ_FWD, &xy[0], sizeof(double) * 2, count, &xy[1], sizeof(double) * 2, count, 0, 0, 0, 0, 0, 0);
+        pthread_mutex_unlock(&trans->lock);
+        return;
+    }
+
+    // built-in: src => lonlat => dst
+    if (trans->src.kind == crs_kind_webmerc) {
+        crs_webmerc_inv(xy, count);
+    } else if (trans->src.kind == crs_kind_eqc) {
+        crs_eqc_inv(&trans->src, xy, count);
+    }
+
+    if (trans->dst.kind == crs_kind_webmerc) {
+        crs_webmerc_fwd(xy, count);
+    } else if (trans->dst.kind == crs_kind_eqc) {
+        crs_eqc_fwd(&trans->dst, xy, count);
+    }
+}
+
+
+void CRSTransformBox (CRSTransform *trans, const CGBox2D *box, CGBox2D *out)
+{
+    int i, k;
+    double xy[8 * CRS_BOX_DENSIFY];
+
+    if (trans->identity) {
+        *out = *box;
+        return;
+    }
+
+    if (! trans->pj) {
+        // built-in transforms are monotone in each axis
+        xy[0] = box->Xmin;
+        xy[1] = box->Ymin;
+        xy[2] = box->Xmax;
+        xy[3] = box->Ymax;
+        CRSTransformPoints(trans, xy, 2);
+
+        out->Xmin = xy[0];
+        out->Ymin = xy[1];
+        out->Xmax = xy[2];
+        out->Ymax = xy[3];
+        return;
+    }
+
+    // points along the sides
+    for (i = 0; i < CRS_BOX_DENSIFY; i++) {
+        double t = (double) i / (CRS_BOX_DENSIFY - 1);
+        double x = box->Xmin + t * (box->Xmax - box->Xmin);
+        double y = box->Ymin + t * (box->Ymax - box->Ymin);
+
+        xy[8 * i + 0] = x;
+        xy[8 * i + 1] = box->Ymin;
+        xy[8 * i + 2] = x;
+        xy[8 * i + 3] = box->Ymax;
+        xy[8 * i + 4] = box->Xmin;
+        xy[8 * i + 5] = y;
+        xy[8 * i + 6] = box->Xmax;
+        xy[8 * i + 7] = y;
+    }
+    CRSTransformPoints(trans, xy, 4 * CRS_BOX_DENSIFY);
+
+    out->Xmin = out->Ymin = HUGE_VAL;
+    out->Xmax = out->Ymax = -HUGE_VAL;
+
+    for (k = 0; k < 4 * CRS_BOX_DENSIFY; k++) {
+        const double *pt = &xy[2 * k];
+        if (isfinite(pt[0]) && isfinite(pt[1]) && pt[0] != HUGE_VAL) {
+            out->Xmin = fmin(out->Xmin, pt[0]);
+            out->Ymin = fmin(out->Ymin, pt[1]);
+            out->Xmax = fmax(out->Xmax, pt[0]);
+            out->Ymax = fmax(out->Ymax, pt[1]);
+        }
+    }
+}
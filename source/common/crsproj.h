@@ -0,0 +1,133 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file crsproj.h
+ * @brief reproject coordinate arrays between coordinate reference systems.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-29 09:30:18
+ * @date 2024-11-29 09:30:18
+ *
+ * @note
+ *   经纬度 (EPSG:4326), web 墨卡托 (EPSG:3857) 和等距圆柱 (+proj=eqc) 之间
+ *   用内置的变换, 不需要 PROJ. 其他坐标系交给 PROJ (proj_trans_generic).
+ *   都是对整个坐标数组 (x, y 交错) 原地变换.
+ *   内置变换的 x 只与 x 有关, y 只与 y 有关, 且都是单调增, 外接矩形变换
+ *   两个角点即可; PROJ 变换沿矩形的边取点.
+ */
+#ifndef CRS_PROJ_H__
+#define CRS_PROJ_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include "cgtypes.h"
+
+#include <pthread.h>
+
+
+// earth radius of web mercator and equirectangular (WGS84 a)
+#define CRS_EARTH_RADIUS      6378137.0
+
+// max latitude of web mercator
+#define CRS_WEBMERC_MAXLAT    85.0511287798066
+
+// points on each side of box transformed by PROJ
+#define CRS_BOX_DENSIFY       21
+
+
+typedef enum
+{
+    crs_kind_none = 0,      // not given
+    crs_kind_lonlat,        // longitude, latitude in degrees (EPSG:4326)
+    crs_kind_webmerc,       // spherical mercator (EPSG:3857)
+    crs_kind_eqc,           // equirectangular (EPSG:4087, EPSG:32662, +proj=eqc)
+    crs_kind_proj           // others by PROJ
+} CRSKind;
+
+
+typedef struct
+{
+    CRSKind kind;
+
+    // crs_kind_eqc: x = R*(lon - lon0)*cos(latts) + x0, y = R*lat + y0
+    double lon0;
+    double latts;
+    double x0;
+    double y0;
+} CRSDef;
+
+
+typedef struct
+{
+    CRSDef src;
+    CRSDef dst;
+
+    // 1: points are not changed
+    int identity;
+
+    // PJ_CONTEXT and PJ if src or dst is crs_kind_proj. not thread safe: lock
+    void *pjctx;
+    void *pj;
+    pthread_mutex_t lock;
+} CRSTransform;
+
+
+#define CRSTransformIsIdentity(trans)  ((trans)->identity)
+
+
+/**
+ * CRSDefParse
+ *   parse proj4def: "EPSG:3857", "+proj=longlat +datum=WGS84", ...
+ *   NULL or empty for crs_kind_none.
+ * Returns:
+ *   kind of def
+ */
+extern CRSKind CRSDefParse (CRSDef *crs, const char *proj4def);
+
+/**
+ * CRSTransformInit
+ *   transform from srcdef to dstdef. identity if either is not given or
+ *   both are the same.
+ * Returns:
+ *   0 if success, -1 if PROJ can not make the transform (trans is identity)
+ */
+extern int CRSTransformInit (CRSTransform *trans, const char *srcdef, const char *dstdef);
+
+extern void CRSTransformFinal (CRSTransform *trans);
+
+// transform xy[count] (x, y pairs) in place
+extern void CRSTransformPoints (CRSTransform *trans, double *xy, int count);
+
+// bounds of box after transform
+extern void CRSTransformBox (CRSTransform *trans, const CGBox2D *box, CGBox2D *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CRS_PROJ_H__ */
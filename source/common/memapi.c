@@ -0,0 +1,62 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file memapi.c
+ * @brief default arena of threads for memapi.h.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-27 10:12:36
+ * @date 2024-11-27 16:40:08
+ *
+ * @note
+ *   每个线程一个默认 arena, 首次使用时初始化.
+ *   单个请求内的临时块 (图层的图形 id, 渲染的瓦片槽等) 从这里分配,
+ *   请求前 mark, 请求后 rewind, 大块内存在线程内复用.
+ */
+#include "memapi.h"
+
+
+static MEMAPI_THREAD_LOCAL mem_arena_t thread_arena;
+
+static MEMAPI_THREAD_LOCAL int thread_arena_inited;
+
+
+mem_arena_t * mem_arena_default (void)
+{
+    if (! thread_arena_inited) {
+        mem_arena_init(&thread_arena, 0);
+        thread_arena_inited = 1;
+    }
+    return &thread_arena;
+}
+
+
+void mem_arena_default_final (void)
+{
+    if (thread_arena_inited) {
+        mem_arena_final(&thread_arena);
+    }
+}
@@ -50,6 +50,7 @@ extern "C"
 #include <stdbool.h> /* memset */
 #include <ctype.h>
 #include <stdlib.h>  /* malloc, alloc */
+#include <stdint.h>  /* uintptr_t */
 #include <malloc.h>  /* alloca */
 #include <errno.h>
 
@@ -227,6 +228,221 @@ STATIC_INLINE void mem_free_s (void **pptr)
 }
 
 
+/**
+ * mem_arena_t: bump allocator for blocks living in one request (a tile, a
+ *  config file, a shape). blocks are not freed one by one: memory is taken
+ *  back by mem_arena_rewind() to a mem_arena_mark() or by mem_arena_reset().
+ *  chunks taken back are kept for reuse until mem_arena_final().
+ *  an arena must be used by one thread at a time.
+ */
+#ifndef MEMAPI_ARENA_CHUNKSIZE
+    # define MEMAPI_ARENA_CHUNKSIZE  65536
+#endif
+
+/* default alignment of arena blocks: enough for double and SSE vectors */
+#define MEMAPI_ARENA_ALIGN  16
+
+#if defined(_MSC_VER)
+    # define MEMAPI_THREAD_LOCAL  __declspec(thread)
+#else
+    # define MEMAPI_THREAD_LOCAL  __thread
+#endif
+
+#define memapi_align_ptr(p, alignsize)  \
+        ((void *) memapi_align_bsize((uintptr_t)(p), alignsize))
+
+
+typedef struct _mem_arena_chunk_t {
+    struct _mem_arena_chunk_t *prev;
+    size_t size;
+    size_t used;
+    char data[0];
+} mem_arena_chunk_t;
+
+
+typedef struct _mem_arena_t {
+    mem_arena_chunk_t *chunk;  /* current chunk, NULL if none */
+    mem_arena_chunk_t *spare;  /* chunks taken back */
+    size_t chunksize;
+} mem_arena_t;
+
+
+typedef struct {
+    mem_arena_chunk_t *chunk;
+    size_t used;
+} mem_arena_mark_t;
+
+
+STATIC_INLINE void mem_arena_init (mem_arena_t *arena, size_t chunksize)
+{
+    arena->chunk = 0;
+    arena->spare = 0;
+    arena->chunksize = (chunksize? chunksize : MEMAPI_ARENA_CHUNKSIZE);
+}
+
+
+/* start a chunk of bsize bytes at least, from spare chunks if one is big enough */
+STATIC_INLINE void mem_arena_grow (mem_arena_t *arena, size_t bsize)
+{
+    mem_arena_chunk_t *chunk, **pspare = &arena->spare;
+
+    while ((chunk = *pspare) != 0 && chunk->size < bsize) {
+        pspare = &chunk->prev;
+    }
+
+    if (chunk) {
+        *pspare = chunk->prev;
+    } else {
+        size_t size = memapi_align_bsize(bsize, arena->chunksize);
+        chunk = (mem_arena_chunk_t *) mem_alloc_unset(sizeof(mem_arena_chunk_t) + size);
+        chunk->size = size;
+    }
+
+    chunk->used = 0;
+    chunk->prev = arena->chunk;
+    arena->chunk = chunk;
+}
+
+
+/**
+ * mem_arena_alloc_align() allocates size bytes aligned at alignsize (power
+ *  of 2) from arena. THE MEMORY IS NOT INITIALIZED.
+ */
+STATIC_INLINE void * mem_arena_alloc_align (mem_arena_t *arena, size_t size, size_t alignsize)
+{
+    mem_arena_chunk_t *chunk = arena->chunk;
+    char *p;
+
+    if (chunk) {
+        p = (char *) memapi_align_ptr(chunk->data + chunk->used, alignsize);
+        if (p + size <= chunk->data + chunk->size) {
+            chunk->used = (size_t)(p + size - chunk->data);
+            return p;
+        }
+    }
+
+    mem_arena_grow(arena, size + alignsize);
+
+    chunk = arena->chunk;
+    p = (char *) memapi_align_ptr(chunk->data, alignsize);
+    chunk->used = (size_t)(p + size - chunk->data);
+    return p;
+}
+
+
+STATIC_INLINE void * mem_arena_alloc (mem_arena_t *arena, size_t size)
+{
+    return mem_arena_alloc_align(arena, size, MEMAPI_ARENA_ALIGN);
+}
+
+
+STATIC_INLINE void * mem_arena_alloc_zero (mem_arena_t *arena, int nmemb, size_t size)
+{
+    void *p = mem_arena_alloc(arena, nmemb * size);
+    memset(p, 0, nmemb * size);
+    return p;
+}
+
+
+/**
+ * mem_arena_realloc() grows or shrinks block ptr of oldsize bytes allocated
+ *  from arena. the last block of arena is resized in place, others are
+ *  copied into a new block (the old one is taken back by rewind).
+ *  ptr NULL: same as mem_arena_alloc().
+ */
+STATIC_INLINE void * mem_arena_realloc (mem_arena_t *arena, void *ptr, size_t oldsize, size_t size)
+{
+    mem_arena_chunk_t *chunk = arena->chunk;
+    void *np;
+
+    if (! ptr) {
+        return mem_arena_alloc(arena, size);
+    }
+
+    if ((char *) ptr + oldsize == chunk->data + chunk->used && (char *) ptr + size <= chunk->data + chunk->size) {
+        chunk->used = (size_t)((char *) ptr + size - chunk->data);
+        return ptr;
+    }
+
+    np = mem_arena_alloc(arena, size);
+    memcpy(np, ptr, (oldsize < size? oldsize : size));
+    return np;
+}
+
+
+STATIC_INLINE char * mem_arena_strdup_len (mem_arena_t *arena, const char *s, int len)
+{
+    char *dst;
+    if (len < 0) {
+        len = (int)(s? strlen(s) : 0);
+    }
+    dst = (char *) mem_arena_alloc_align(arena, len + sizeof(char), sizeof(char));
+    if (len > 0) {
+        memcpy(dst, s, len);
+    }
+    dst[len] = '\0';
+    return dst;
+}
+
+
+/**
+ * mem_arena_mark() remembers the top of arena, and mem_arena_rewind() takes
+ *  back all blocks allocated after it. marks are rewound in reverse order.
+ */
+STATIC_INLINE void mem_arena_mark (mem_arena_t *arena, mem_arena_mark_t *mark)
+{
+    mark->chunk = arena->chunk;
+    mark->used = (arena->chunk? arena->chunk->used : 0);
+}
+
+
+STATIC_INLINE void mem_arena_rewind (mem_arena_t *arena, const mem_arena_mark_t *mark)
+{
+    while (arena->chunk != mark->chunk) {
+        mem_arena_chunk_t *chunk = arena->chunk;
+        arena->chunk = chunk->prev;
+
+        chunk->prev = arena->spare;
+        arena->spare = chunk;
+    }
+
+    if (arena->chunk) {
+        arena->chunk->used = mark->used;
+    }
+}
+
+
+STATIC_INLINE void mem_arena_reset (mem_arena_t *arena)
+{
+    mem_arena_mark_t mark = {0, 0};
+    mem_arena_rewind(arena, &mark);
+}
+
+
+/* frees all chunks of arena. arena can be used again */
+STATIC_INLINE void mem_arena_final (mem_arena_t *arena)
+{
+    mem_arena_reset(arena);
+
+    while (arena->spare) {
+        mem_arena_chunk_t *chunk = arena->spare;
+        arena->spare = chunk->prev;
+        mem_free(chunk);
+    }
+}
+
+
+/**
+ * mem_arena_default() returns arena of calling thread, for blocks of one
+ *  call which are taken back by mark and rewind. threads call
+ *  mem_arena_default_final() before exit to free its chunks.
+ *  see memapi.c
+ */
+extern mem_arena_t * mem_arena_default (void);
+
+extern void mem_arena_default_final (void);
+
+
 typedef struct {
     void (*freebufcb)(void *);
     size_t bufsize;
@@ -69,6 +69,7 @@ extern "C"
     # include <sys/time.h>
     # include <fcntl.h>
     # include <unistd.h>    /* usleep() */
+    # include <sys/mman.h>  /* mmap() */
 
     # if defined(__CYGWIN__)
         #   include <Windows.h>
@@ -340,6 +341,19 @@ sb8 file_seek(filehandle_t hf, sb8 distance, int fseekpos)
     #endif
 }
 
+NOWARNING_UNUSED(static)
+sb8 file_size(filehandle_t hf)
+{
+    struct stat st;
+    if (fstat(hf, &st) == 0) {
+        /* success */
+        return (sb8)st.st_size;
+    }
+
+    /* error */
+    return (sb8)(-1);
+}
+
 NOWARNING_UNUSED(static)
 int file_readbytes(filehandle_t hf, char *bytesbuf, ub4 sizebuf)
 {
@@ -416,6 +430,74 @@ int pathfile_move(const char *pathnameOld, const char *pathnameNew)
 #endif
 
 
+/**
+ * read only memory map of whole file
+ */
+typedef struct {
+    const char *addr;
+    sb8 size;
+#if defined(WIN32API)
+    HANDLE hmap;
+#endif
+} filemap_t;
+
+
+/* returns 0 on success. an empty file maps to addr NULL, size 0 */
+NOWARNING_UNUSED(static)
+int file_mmap_read(const char *pathname, filemap_t *fm)
+{
+    filehandle_t hf = file_open_read(pathname);
+
+    memset(fm, 0, sizeof(*fm));
+    if (hf == filehandle_invalid) {
+        return (-1);
+    }
+
+    fm->size = file_size(hf);
+    if (fm->size > 0) {
+#if defined(WIN32API)
+        fm->hmap = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (fm->hmap) {
+            fm->addr = (const char *) MapViewOfFile(fm->hmap, FILE_MAP_READ, 0, 0, 0);
+            if (! fm->addr) {
+                CloseHandle(fm->hmap);
+                fm->hmap = NULL;
+            }
+        }
+#else
+        void *addr = mmap(NULL, (size_t)fm->size, PROT_READ, MAP_PRIVATE, hf, 0);
+        if (addr != MAP_FAILED) {
+            fm->addr = (const char *) addr;
+        }
+#endif
+    }
+
+    /* mapping stays valid after the file closed */
+    file_close(&hf);
+
+    if (fm->size < 0 || (fm->size > 0 && ! fm->addr)) {
+        memset(fm, 0, sizeof(*fm));
+        return (-1);
+    }
+    return 0;
+}
+
+
+NOWARNING_UNUSED(static)
+void file_munmap(filemap_t *fm)
+{
+    if (fm->addr) {
+#if defined(WIN32API)
+        UnmapViewOfFile(fm->addr);
+        CloseHandle(fm->hmap);
+#else
+        munmap((void *) fm->addr, (size_t)fm->size);
+#endif
+    }
+    memset(fm, 0, sizeof(*fm));
+}
+
+
 NOWARNING_UNUSED(static)
 int getenv_with_prefix(const char *varName, const char *prefix, char *valBuf, size_t valBufSize)
 {
@@ -38,6 +38,8 @@
 
 #include "readconf.h"
 
+#include "uthash/uthash.h"
+
 
 # if defined (_MSC_VER)
     # pragma warning(disable:4996)
@@ -61,6 +63,42 @@ typedef struct _conf_position_t
 } conf_position_t;
 
 
+typedef struct _conf_parsed_key_t
+{
+    UT_hash_handle hh;
+
+    char *value;
+    int vallen;
+
+    int keylen;
+    char key[1];
+} conf_parsed_key_t;
+
+
+typedef struct _conf_parsed_sec_t
+{
+    UT_hash_handle hh;
+
+    /* keys in file order */
+    conf_parsed_key_t *keys;
+
+    int seclen;
+    char name[1];
+} conf_parsed_sec_t;
+
+
+typedef struct _conf_parsed_t
+{
+    /* sections in file order */
+    conf_parsed_sec_t *sections;
+
+    /* resolved variables of varsSection */
+    ConfVariables vars;
+
+    char encode[16];
+} conf_parsed_t;
+
+
 NOWARNING_UNUSED(static) char * trim(char *s, char c)
 {
     return (*s==0)?s:(((*s!=c)?(((trim(s+1,c)-1)==s)?s:(*(trim(s+1,c)-1)=*s,*s=c,trim(s+1,c))):trim(s+1,c)));
@@ -547,8 +585,6 @@ int ConfReadSectionVariables(const char* confFile, const char* sectionName, Conf
     // 第一次取得获得元素
     int number = 0;
 
-    char keypattern[READCONF_MAX_KEYLEN + 4];
-
     char **keys = ConfStringArrayNew((int)count);
     int* keylens = ConfMemAlloc((int)count, sizeof(int));
 
@@ -585,34 +621,65 @@ int ConfReadSectionVariables(const char* confFile, const char* sectionName, Conf
         return -1;
     }
 
-    for (int i = 0; i < number; i++) {
-        int patternlen = snprintf(keypattern, sizeof(keypattern), "$(%.*s)", keylens[i], keys[i]);
-        char* replacement = values[i];
-        int replacelen = valuelens[i];
+    // set output
+    outVars->keys = keys;
+    outVars->keylens = keylens;
+    outVars->values = values;
+    outVars->valuelens = valuelens;
+    outVars->count = (int)count;
+
+    ConfVariablesResolve(outVars);
+
+    return (int) count;
+}
+
+
+int ConfVariablesAdd(ConfVariables* vars, const char* key, int keylen, const char* value, int vallen)
+{
+    int n = vars->count;
+
+    if (keylen > READCONF_MAX_KEYLEN) {
+        return -1;
+    }
+
+    vars->keys = (char **) ConfMemRealloc(vars->keys, (int)sizeof(char *) * n, (int)sizeof(char *) * (n + 1));
+    vars->keylens = (int *) ConfMemRealloc(vars->keylens, (int)sizeof(int) * n, (int)sizeof(int) * (n + 1));
+    vars->values = (char **) ConfMemRealloc(vars->values, (int)sizeof(char *) * n, (int)sizeof(char *) * (n + 1));
+    vars->valuelens = (int *) ConfMemRealloc(vars->valuelens, (int)sizeof(int) * n, (int)sizeof(int) * (n + 1));
+
+    vars->keys[n] = ConfMemCopyString(key, keylen);
+    vars->keylens[n] = keylen;
+    vars->values[n] = ConfMemCopyString(value, vallen);
+    vars->valuelens[n] = vallen;
+
+    vars->count = n + 1;
+    return vars->count;
+}
+
 
-        for (int j = 0; j < number; j++) {
+void ConfVariablesResolve(ConfVariables* vars)
+{
+    char keypattern[READCONF_MAX_KEYLEN + 4];
+
+    for (int i = 0; i < vars->count; i++) {
+        int patternlen = snprintf(keypattern, sizeof(keypattern), "$(%.*s)", vars->keylens[i], vars->keys[i]);
+        char* replacement = vars->values[i];
+        int replacelen = vars->valuelens[i];
+
+        for (int j = 0; j < vars->count; j++) {
             if (i != j) {
                 // replace $(KEY) in values[j] with KEY's value
                 char* result = 0;
-                int reslen = StringReplaceOutputNew(values[j], valuelens[j], keypattern, patternlen, replacement, replacelen, &result);
+                int reslen = StringReplaceOutputNew(vars->values[j], vars->valuelens[j], keypattern, patternlen, replacement, replacelen, &result);
                 if (reslen > 0) {
-                    ConfMemFree(values[j]);
-                    values[j] = ConfMemCopyString(result, reslen);
-                    valuelens[j] = reslen;
+                    ConfMemFree(vars->values[j]);
+                    vars->values[j] = ConfMemCopyString(result, reslen);
+                    vars->valuelens[j] = reslen;
                     free(result);
                 }
             }
         }
     }
-
-    // set output
-    outVars->keys = keys;
-    outVars->keylens = keylens;
-    outVars->values = values;
-    outVars->valuelens = valuelens;
-    outVars->count = (int)count;
-
-    return (int) count;
 }
 
 
@@ -797,6 +864,288 @@ int ConfSectionParse (char *sectionName, char **family, char **qualifier)
 }
 
 
+static conf_parsed_sec_t * ConfParsedSectionAdd (CONF_parsed parsed, const char *name, int seclen)
+{
+    conf_parsed_sec_t *sec = 0;
+
+    HASH_FIND(hh, parsed->sections, name, seclen, sec);
+    if (! sec) {
+        sec = (conf_parsed_sec_t *) ConfMemAlloc(1, (int)sizeof(conf_parsed_sec_t) + seclen);
+        memcpy(sec->name, name, seclen);
+        sec->seclen = seclen;
+        HASH_ADD(hh, parsed->sections, name[0], seclen, sec);
+    }
+    return sec;
+}
+
+
+/* 同一 section 内重复的 key 以第一个为准 (同 ConfReadValue). value 的所有权转移 */
+static void ConfParsedKeyAdd (conf_parsed_sec_t *sec, const char *key, int keylen, char *value, int vallen)
+{
+    conf_parsed_key_t *kv = 0;
+
+    HASH_FIND(hh, sec->keys, key, keylen, kv);
+    if (kv) {
+        ConfMemFree(value);
+        return;
+    }
+
+    kv = (conf_parsed_key_t *) ConfMemAlloc(1, (int)sizeof(conf_parsed_key_t) + keylen);
+    memcpy(kv->key, key, keylen);
+    kv->keylen = keylen;
+    kv->value = value;
+    kv->vallen = vallen;
+    HASH_ADD(hh, sec->keys, key[0], keylen, kv);
+}
+
+
+/**
+ * 一遍读完 confFile, 续行规则同 ConfReadValue:
+ *   value 以 '\' 结尾时, 其后以 '+' 开头的行接续到该 value.
+ * varsSection 中的变量先互相替换, 再替换其他所有 section 的 value 中的 $(KEY).
+ */
+CONF_parsed ConfParseFile (const char *confFile, const char *varsSection)
+{
+    char *start, *key, *val;
+    int nch;
+
+    conf_parsed_sec_t *sec = 0;
+
+    /* current value waiting for '+' lines */
+    char *pendkey = 0, *pendval = 0;
+    int pendkeylen = 0, pendvallen = 0;
+
+    CONF_position cpos = ConfOpenFile(confFile);
+    if (! cpos) {
+        return 0;
+    }
+
+    CONF_parsed parsed = (CONF_parsed) ConfMemAlloc(1, sizeof(conf_parsed_t));
+    memcpy(parsed->encode, cpos->encode, sizeof(parsed->encode));
+
+    while ((nch = readln(cpos->_fp, cpos->_linebuf, READCONF_MAX_LINESIZE)) >= 0) {
+        start = dtrim(dtrim(cpos->_linebuf, 32), 9);
+        if (*start == READCONF_NOTE_CHAR) { /* # */
+            continue;
+        }
+
+        if (pendval) {
+            int cont = (*start == '+');
+
+            if (cont) {
+                start = dtrim(dtrim(start+1, 32), 9);
+                nch = (int) strlen(start);
+
+                /* overwrite the ending '\' */
+                pendval = (char *) ConfMemRealloc(pendval, pendvallen + 1, pendvallen + nch);
+                memcpy(pendval + pendvallen - 1, start, nch);
+                pendvallen = pendvallen - 1 + nch;
+                pendval[pendvallen] = 0;
+
+                if (nch > 0 && start[nch - 1] == '\\') {
+                    continue;
+                }
+            } else {
+                /* end of val */
+                pendval[--pendvallen] = 0;
+            }
+
+            ConfParsedKeyAdd(sec, pendkey, pendkeylen, pendval, pendvallen);
+            ConfMemFree(pendkey);
+            pendkey = pendval = 0;
+
+            if (cont) {
+                continue;
+            }
+        }
+
+        nch = (int) strlen(start);
+        if (nch > 2) {
+            if (nch <= READCONF_MAX_SECNAME && *start==READCONF_SEC_BEGIN && *(start+nch-1)==READCONF_SEC_END) {
+                /* find a section */
+                sec = ConfParsedSectionAdd(parsed, start+1, nch-2);
+                continue;
+            }
+
+            if (splitpair(start, READCONF_SEPARATOR, &key, &val)==READCONF_TRUE) {
+                int keylen = (int) strlen(key);
+                int vallen = val? (int) strlen(val) : 0;
+
+                if (! sec) {
+                    sec = ConfParsedSectionAdd(parsed, "", 0);
+                }
+
+                if (vallen > 0 && val[vallen - 1] == '\\') {
+                    pendkey = ConfMemCopyString(key, keylen);
+                    pendkeylen = keylen;
+                    pendval = ConfMemCopyString(val, vallen);
+                    pendvallen = vallen;
+                } else {
+                    ConfParsedKeyAdd(sec, key, keylen, ConfMemCopyString(val? val : "", vallen), vallen);
+                }
+            }
+        }
+    }
+
+    if (pendval) {
+        /* end of file: keep the '\' */
+        ConfParsedKeyAdd(sec, pendkey, pendkeylen, pendval, pendvallen);
+        ConfMemFree(pendkey);
+    }
+
+    ConfCloseFile(cpos);
+
+    if (varsSection) {
+        conf_parsed_sec_t *varsec = 0;
+
+        HASH_FIND(hh, parsed->sections, varsSection, (unsigned) strlen(varsSection), varsec);
+        if (varsec && HASH_COUNT(varsec->keys) > 0) {
+            ConfVariables *vars = &parsed->vars;
+            conf_parsed_key_t *kv, *tmp;
+            int count = (int) HASH_COUNT(varsec->keys);
+
+            vars->keys = ConfStringArrayNew(count);
+            vars->keylens = ConfMemAlloc(count, sizeof(int));
+            vars->values = ConfStringArrayNew(count);
+            vars->valuelens = ConfMemAlloc(count, sizeof(int));
+
+            HASH_ITER(hh, varsec->keys, kv, tmp) {
+                if (kv->keylen <= READCONF_MAX_KEYLEN) {
+                    vars->keys[vars->count] = ConfMemCopyString(kv->key, kv->keylen);
+                    vars->keylens[vars->count] = kv->keylen;
+                    vars->values[vars->count] = ConfMemCopyString(kv->value, kv->vallen);
+                    vars->valuelens[vars->count] = kv->vallen;
+                    vars->count++;
+                }
+            }
+
+            ConfVariablesResolve(vars);
+
+            int i = 0;
+            HASH_ITER(hh, varsec->keys, kv, tmp) {
+                if (kv->keylen <= READCONF_MAX_KEYLEN) {
+                    ConfMemFree(kv->value);
+                    kv->value = ConfMemCopyString(vars->values[i], vars->valuelens[i]);
+                    kv->vallen = vars->valuelens[i];
+                    i++;
+                }
+            }
+
+            conf_parsed_sec_t *s, *stmp;
+            HASH_ITER(hh, parsed->sections, s, stmp) {
+                if (s == varsec) {
+                    continue;
+                }
+                HASH_ITER(hh, s->keys, kv, tmp) {
+                    if (kv->vallen > 2 && strstr(kv->value, "$(")) {
+                        char *output = 0;
+                        int outlen = ConfVariablesReplace(kv->value, kv->vallen, vars, &output);
+                        ConfMemFree(kv->value);
+                        kv->value = output;
+                        kv->vallen = outlen;
+                    }
+                }
+            }
+        }
+    }
+
+    return parsed;
+}
+
+
+void ConfParsedFree (CONF_parsed parsed)
+{
+    if (parsed) {
+        conf_parsed_sec_t *sec, *stmp;
+        conf_parsed_key_t *kv, *tmp;
+
+        HASH_ITER(hh, parsed->sections, sec, stmp) {
+            HASH_ITER(hh, sec->keys, kv, tmp) {
+                HASH_DEL(sec->keys, kv);
+                ConfMemFree(kv->value);
+                ConfMemFree(kv);
+            }
+            HASH_DEL(parsed->sections, sec);
+            ConfMemFree(sec);
+        }
+
+        ConfVariablesClear(&parsed->vars);
+        ConfMemFree(parsed);
+    }
+}
+
+
+const char * ConfParsedGetEncode (CONF_parsed parsed)
+{
+    return parsed->encode;
+}
+
+
+const ConfVariables * ConfParsedGetVariables (CONF_parsed parsed)
+{
+    return &parsed->vars;
+}
+
+
+int ConfParsedGetSections (CONF_parsed parsed)
+{
+    return (int) HASH_COUNT(parsed->sections);
+}
+
+
+static conf_parsed_sec_t * ConfParsedFindSection2 (CONF_parsed parsed, const char *family, const char *qualifier, int qualifierlen)
+{
+    conf_parsed_sec_t *sec = 0;
+
+    if (! qualifier) {
+        HASH_FIND(hh, parsed->sections, family, (unsigned) strlen(family), sec);
+    } else {
+        char section[READCONF_MAX_SECNAME + READCONF_MAX_KEYLEN + 4];
+        int qlen = (int) (qualifierlen == -1 ? strnlen(qualifier, READCONF_MAX_KEYLEN) : qualifierlen);
+        int seclen = snprintf(section, sizeof(section), "%s:%.*s", family, qlen, qualifier);
+        if (seclen > 0 && seclen < (int) sizeof(section)) {
+            HASH_FIND(hh, parsed->sections, section, seclen, sec);
+        }
+    }
+    return sec;
+}
+
+
+READCONF_BOOL ConfParsedHasSection2 (CONF_parsed parsed, const char *family, const char *qualifier, int qualifierlen)
+{
+    return ConfParsedFindSection2(parsed, family, qualifier, qualifierlen)? READCONF_TRUE : READCONF_FALSE;
+}
+
+
+const char * ConfParsedGetValue (CONF_parsed parsed, const char *sectionName, const char *keyName, int *vallen)
+{
+    return ConfParsedGetValue2(parsed, sectionName, 0, 0, keyName, vallen);
+}
+
+
+const char * ConfParsedGetValue2 (CONF_parsed parsed, const char *family, const char *qualifier, int qualifierlen, const char *keyName, int *vallen)
+{
+    conf_parsed_key_t *kv = 0;
+    conf_parsed_sec_t *sec = ConfParsedFindSection2(parsed, family, qualifier, qualifierlen);
+
+    if (sec) {
+        HASH_FIND(hh, sec->keys, keyName, (unsigned) strlen(keyName), kv);
+    }
+
+    if (! kv) {
+        if (vallen) {
+            *vallen = 0;
+        }
+        return 0;
+    }
+
+    if (vallen) {
+        *vallen = kv->vallen;
+    }
+    return kv->value;
+}
+
+
 /**
  * 1  true
  * 0  false
@@ -84,6 +84,12 @@ typedef int READCONF_RESULT;
 
 typedef struct _conf_position_t* CONF_position;
 
+/**
+ * 一次读入整个配置文件: section -> key -> value 哈希表.
+ * 变量 $(KEY) 在读入时即已替换, 之后的查找都是 O(1).
+ */
+typedef struct _conf_parsed_t* CONF_parsed;
+
 
 typedef struct {
     int count;
@@ -126,6 +132,11 @@ extern READCONF_RESULT ConfCopySection (CONF_position cpos, char *secName);
 
 extern int ConfReadSectionVariables (const char* confFile, const char* sectionName, ConfVariables *outVars);
 
+extern int ConfVariablesAdd (ConfVariables* vars, const char* key, int keylen, const char* value, int vallen);
+
+// replace $(KEY) in values of variables with each other
+extern void ConfVariablesResolve (ConfVariables* vars);
+
 extern int ConfVariablesReplace (const char* input, int inlen, const ConfVariables* variables, char** output);
 
 extern int ConfReadValue (const char *confFile, const char *sectionName, const char *keyName, char *valbuf, size_t maxbufsize);
@@ -150,6 +161,22 @@ extern READCONF_BOOL ConfSectionGetQualifier (const char *sectionName, char *qua
 
 extern int ConfSectionParse (char *sectionName, char **family, char **qualifier);
 
+extern CONF_parsed ConfParseFile (const char *confFile, const char *varsSection);
+
+extern void ConfParsedFree (CONF_parsed parsed);
+
+extern const char * ConfParsedGetEncode (CONF_parsed parsed);
+
+extern const ConfVariables * ConfParsedGetVariables (CONF_parsed parsed);
+
+extern int ConfParsedGetSections (CONF_parsed parsed);
+
+extern READCONF_BOOL ConfParsedHasSection2 (CONF_parsed parsed, const char *family, const char *qualifier, int qualifierlen);
+
+extern const char * ConfParsedGetValue (CONF_parsed parsed, const char *sectionName, const char *keyName, int *vallen);
+
+extern const char * ConfParsedGetValue2 (CONF_parsed parsed, const char *family, const char *qualifier, int qualifierlen, const char *keyName, int *vallen);
+
 extern int ConfParseBoolValue (const char *value, int defvalue);
 
 extern double ConfParseSizeBytesValue (char *valuebuf, double defvalue, int *base, int *exponent);
@@ -27,7 +27,7 @@
  *
  * @version 1.0.1
  * @create     2013-04-24
- * @date 2024-10-28 21:10:29
+ * @date 2024-11-07 10:26:45
  */
 #include "geodb_attr.h"
 
@@ -41,5 +41,119 @@ int geodb_attr_new(geodb_attr *attr)
 
 void geodb_attr_free(geodb_attr attr)
 {
-    mem_free(attr);
-}
\ No newline at end of file
+    if (attr) {
+        memset(attr->key, 0, sizeof(attr->key));
+        mem_free(attr);
+    }
+}
+
+
+int geodb_attr_set_integer(geodb_attr attr, geodb_attr_name name, int64_t value)
+{
+    switch (name) {
+    case conn_attr_cache_size:
+        attr->cache_size = value;
+        return GEODB_RES_SOK;
+    case conn_attr_mmap_size:
+        attr->mmap_size = value;
+        return GEODB_RES_SOK;
+    case conn_attr_pin_index:
+        attr->pin_index = value? 1 : 0;
+        return GEODB_RES_SOK;
+    default:
+        break;
+    }
+
+    printf("Error: not integer attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
+
+
+int geodb_attr_get_integer(geodb_attr attr, geodb_attr_name name, int64_t *value)
+{
+    switch (name) {
+    case conn_attr_cache_size:
+        *value = attr->cache_size;
+        return GEODB_RES_SOK;
+    case conn_attr_mmap_size:
+        *value = attr->mmap_size;
+        return GEODB_RES_SOK;
+    case conn_attr_pin_index:
+        *value = attr->pin_index;
+        return GEODB_RES_SOK;
+    default:
+        break;
+    }
+
+    printf("Error: not integer attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
+
+
+int geodb_attr_set_real(geodb_attr attr, geodb_attr_name name, double value)
+{
+    printf("Error: not real attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
+
+
+int geodb_attr_get_real(geodb_attr attr, geodb_attr_name name, double *value)
+{
+    printf("Error: not real attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
+
+
+int geodb_attr_set_bytes(geodb_attr attr, geodb_attr_name name, const char *inbuf, int bufsize)
+{
+    if (bufsize < 0) {
+        bufsize = inbuf? (int) strlen(inbuf) : 0;
+    }
+
+    switch (name) {
+    case conn_attr_cipher:
+        if (bufsize > GEODB_NAMELEN_MAX) {
+            printf("Error: cipher name too long\n");
+            return GEODB_RES_ERR;
+        }
+        memset(attr->cipher, 0, sizeof(attr->cipher));
+        memcpy(attr->cipher, inbuf, bufsize);
+        return GEODB_RES_SOK;
+    case conn_attr_key:
+        if (bufsize > GEODB_KEYLEN_MAX) {
+            printf("Error: key too long (GEODB_KEYLEN_MAX=%d)\n", GEODB_KEYLEN_MAX);
+            return GEODB_RES_ERR;
+        }
+        memset(attr->key, 0, sizeof(attr->key));
+        memcpy(attr->key, inbuf, bufsize);
+        attr->keylen = bufsize;
+        return GEODB_RES_SOK;
+    default:
+        break;
+    }
+
+    printf("Error: not bytes attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
+
+
+/**
+ * returns bytes copied, or GEODB_RES_ERR. key is never returned
+ */
+int geodb_attr_get_bytes(geodb_attr attr, geodb_attr_name name, char *outbuf, int bufsize)
+{
+    int len;
+
+    if (name == conn_attr_cipher) {
+        len = (int) strlen(attr->cipher);
+        if (len >= bufsize) {
+            printf("Error: insufficient buffer\n");
+            return GEODB_RES_ERR;
+        }
+        memcpy(outbuf, attr->cipher, len + 1);
+        return len;
+    }
+
+    printf("Error: not readable bytes attr: %d\n", (int) name);
+    return GEODB_RES_ERR;
+}
@@ -27,7 +27,7 @@
  *
  * @version 1.0.1
  * @create     2013-04-24
- * @date 2024-10-28 21:08:19
+ * @date 2024-11-07 10:26:45
  */
 #ifndef GEODB_ATTR_H__
 #define GEODB_ATTR_H__
@@ -40,9 +40,28 @@ extern "C" {
 
 #include "geodbapi.h"
 
+// passphrase max bytes
+#define GEODB_KEYLEN_MAX    128
+
+
 typedef struct geodb_attr_t
 {
-    int a;
+    // cipher of SQLite3 Multiple Ciphers: chacha20, aes128cbc, aes256cbc, sqlcipher, rc4, ascon128.
+    //   empty for default cipher (chacha20)
+    char cipher[GEODB_NAMELEN_MAX + 1];
+
+    // passphrase. keylen = 0: unencrypted database, sqlite3_key_v2 never called
+    int keylen;
+    char key[GEODB_KEYLEN_MAX];
+
+    // page cache in KB for each connection (PRAGMA cache_size = -KB). 0 for sqlite default
+    int64_t cache_size;
+
+    // bytes of memory-mapped I/O (PRAGMA mmap_size). works only for unencrypted database
+    int64_t mmap_size;
+
+    // 1: load spatial index pages into page cache when a read connection opens
+    int pin_index;
 } * geodb_attr;
 
 
@@ -0,0 +1,534 @@
+/**
+ * Copyright © 2024 MapAware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * @file geodb_conn.c
+ * @author 350137278@qq.com
+ * @brief geodb_conn
+ *
+ * @version 1.0.0
+ * @since 2024-11-04 09:20:16
+ * @date 2024-11-07 11:40:03
+ */
+#include "geodb_conn.h"
+#include "geodb_layer.h"
+
+#include <stdarg.h>
+
+
+static pthread_once_t geodb_library_once = PTHREAD_ONCE_INIT;
+
+static void geodb_library_init(void)
+{
+    // threading mode is given by flags of each sqlite3_open_v2, not by global
+    // sqlite3_config (SQLITE_MISUSE once library initialized by any open):
+    //   writer: SQLITE_OPEN_FULLMUTEX, reader: SQLITE_OPEN_NOMUTEX (one thread only)
+    if (! sqlite3_threadsafe()) {
+        printf("Error: sqlite3 built with SQLITE_THREADSAFE=0\n");
+    }
+    if (sqlite3_initialize() != SQLITE_OK) {
+        printf("Error: sqlite3_initialize failed\n");
+    }
+}
+
+
+static int db_execf(sqlite3 *db, const char *fmt, ...)
+{
+    int rc;
+    char *sql, *errmsg = 0;
+    va_list args;
+
+    va_start(args, fmt);
+    sql = sqlite3_vmprintf(fmt, args);
+    va_end(args);
+
+    if (! sql) {
+        printf("Error: out of memory\n");
+        return GEODB_RES_ERR;
+    }
+
+    rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
+    if (rc != SQLITE_OK) {
+        printf("Error: sqlite3_exec(%s): %s\n", sql, errmsg? errmsg : sqlite3_errmsg(db));
+        sqlite3_free(errmsg);
+    }
+
+    sqlite3_free(sql);
+    return (rc == SQLITE_OK)? GEODB_RES_SOK : GEODB_RES_ERR;
+}
+
+
+/**
+ * 按 geodb_attr 设置新打开的连接: 密钥必须在任何读写之前设置.
+ */
+static int db_apply_attr(sqlite3 *db, const struct geodb_attr_t *attr)
+{
+    if (attr->keylen > 0) {
+        if (attr->cipher[0] && db_execf(db, "PRAGMA cipher = '%q'", attr->cipher)) {
+            return GEODB_RES_ERR;
+        }
+
+        if (sqlite3_key_v2(db, "main", attr->key, attr->keylen) != SQLITE_OK) {
+            printf("Error: sqlite3_key_v2: %s\n", sqlite3_errmsg(db));
+            return GEODB_RES_ERR;
+        }
+
+        // the first read fails if key is wrong
+        if (sqlite3_exec(db, "SELECT COUNT(*) FROM sqlite_master", 0, 0, 0) != SQLITE_OK) {
+            printf("Error: wrong key or not a geodb: %s\n", sqlite3_errmsg(db));
+            return GEODB_RES_ERR;
+        }
+    }
+
+    if (attr->cache_size > 0 && db_execf(db, "PRAGMA cache_size = -%lld", (long long) attr->cache_size)) {
+        return GEODB_RES_ERR;
+    }
+
+    if (attr->mmap_size > 0) {
+        if (attr->keylen > 0) {
+            // codec reads pages through its own buffer
+            printf("Warn: mmap_size ignored for encrypted database\n");
+        } else if (db_execf(db, "PRAGMA mmap_size = %lld", (long long) attr->mmap_size)) {
+            return GEODB_RES_ERR;
+        }
+    }
+
+    return GEODB_RES_SOK;
+}
+
+
+/**
+ * 读取所有图层的空间索引页到本连接的页缓存 (cache_size 须足够大, 否则会被换出)
+ */
+static void reader_pin_index(geodb_reader_t *reader)
+{
+    sqlite3_stmt *stmt = 0;
+
+    if (sqlite3_prepare_v2(reader->db, "SELECT index_table, level_min, level_max FROM geodb_layers", -1, &stmt, 0) != SQLITE_OK) {
+        printf("Warn: pin index: %s\n", sqlite3_errmsg(reader->db));
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *index_table = (const char *) sqlite3_column_text(stmt, 0);
+        int level, level_min = sqlite3_column_int(stmt, 1), level_max = sqlite3_column_int(stmt, 2);
+
+        if (! index_table) {
+            continue;
+        }
+
+        if (! strncmp(index_table, GEODB_TABLE_RTREE_PREFIX, sizeof(GEODB_TABLE_RTREE_PREFIX) - 1)) {
+            db_execf(reader->db, "SELECT COUNT(*) FROM \"%w_node\"", index_table);
+            db_execf(reader->db, "SELECT COUNT(*) FROM \"%w_rowid\"", index_table);
+        } else {
+            for (level = level_min; level <= level_max; level++) {
+                db_execf(reader->db, "SELECT COUNT(*) FROM \"%w_%d\" INDEXED BY \"%w_%d_uk\"", index_table, level, index_table, level);
+            }
+        }
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+
+static void reader_free_stmts(geodb_reader_t *reader)
+{
+    geodb_stmt stmt, tmp;
+
+    HASH_ITER(hh, reader->stmts, stmt, tmp) {
+        HASH_DEL(reader->stmts, stmt);
+        sqlite3_finalize(stmt->stmt);
+        mem_free(stmt);
+    }
+    reader->numstmts = 0;
+}
+
+
+static void reader_close(geodb_reader_t *reader)
+{
+    reader_free_stmts(reader);
+
+    if (reader->db) {
+        sqlite3_close_v2(reader->db);
+        reader->db = 0;
+    }
+    reader->inuse = 0;
+}
+
+
+/**
+ * pthread_key destructor: give back reader at thread exit
+ */
+static void reader_on_thread_exit(void *value)
+{
+    geodb_reader_t *reader = (geodb_reader_t *) value;
+    geodb_conn conn = reader->conn;
+
+    pthread_mutex_lock(&conn->poollock);
+    if (reader->inuse && pthread_equal(reader->owner, pthread_self())) {
+        reader->inuse = 0;
+    }
+    pthread_mutex_unlock(&conn->poollock);
+}
+
+
+static geodb_reader_t * geodb_conn_get_reader(geodb_conn conn)
+{
+    int i, rc;
+    geodb_reader_t *reader = (geodb_reader_t *) pthread_getspecific(conn->readerkey);
+
+    if (reader && reader->inuse && pthread_equal(reader->owner, pthread_self())) {
+        // fast path: no lock
+        return reader;
+    }
+
+    if (! conn->dbfile) {
+        printf("Error: geodb_conn not open\n");
+        return 0;
+    }
+
+    reader = 0;
+
+    pthread_mutex_lock(&conn->poollock);
+    for (i = 0; i < conn->numreaders; i++) {
+        if (! conn->readers[i].inuse) {
+            reader = &conn->readers[i];
+            // prefer opened one which has statements cached
+            if (reader->db) {
+                break;
+            }
+        }
+    }
+    if (! reader && conn->numreaders < GEODB_READERS_MAX) {
+        reader = &conn->readers[conn->numreaders++];
+    }
+    if (reader) {
+        reader->conn = conn;
+        reader->inuse = 1;
+        reader->owner = pthread_self();
+    }
+    pthread_mutex_unlock(&conn->poollock);
+
+    if (! reader) {
+        printf("Error: too many reader threads (GEODB_READERS_MAX=%d)\n", GEODB_READERS_MAX);
+        return 0;
+    }
+
+    if (! reader->db) {
+        rc = sqlite3_open_v2(conn->dbfile, &reader->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0);
+        if (rc != SQLITE_OK || db_apply_attr(reader->db, &conn->attr) != GEODB_RES_SOK) {
+            if (rc != SQLITE_OK) {
+                printf("Error: sqlite3_open_v2(%s): %s\n", conn->dbfile, reader->db? sqlite3_errmsg(reader->db) : "out of memory");
+            }
+
+            pthread_mutex_lock(&conn->poollock);
+            reader_close(reader);
+            pthread_mutex_unlock(&conn->poollock);
+            return 0;
+        }
+
+        if (conn->attr.pin_index) {
+            reader_pin_index(reader);
+        }
+    }
+
+    pthread_setspecific(conn->readerkey, reader);
+    return reader;
+}
+
+
+int geodb_conn_new(geodb_attr attr, geodb_conn *dbconn)
+{
+    geodb_conn conn;
+
+    pthread_once(&geodb_library_once, geodb_library_init);
+
+    conn = (geodb_conn) mem_alloc_zero(1, sizeof(struct geodb_conn_t));
+    if (attr) {
+        memcpy(&conn->attr, attr, sizeof(conn->attr));
+    }
+
+    if (pthread_mutex_init(&conn->poollock, 0)) {
+        printf("Error: pthread_mutex_init\n");
+        mem_free(conn);
+        return GEODB_RES_ERR;
+    }
+
+    if (pthread_key_create(&conn->readerkey, reader_on_thread_exit)) {
+        printf("Error: pthread_key_create\n");
+        pthread_mutex_destroy(&conn->poollock);
+        mem_free(conn);
+        return GEODB_RES_ERR;
+    }
+
+    *dbconn = conn;
+    return GEODB_RES_SOK;
+}
+
+
+void geodb_conn_free(geodb_conn conn)
+{
+    if (conn) {
+        if (geodb_conn_close(conn) != GEODB_RES_SOK) {
+            // other threads still read through conn
+            return;
+        }
+
+        pthread_key_delete(conn->readerkey);
+        pthread_mutex_destroy(&conn->poollock);
+
+        memset(conn->attr.key, 0, sizeof(conn->attr.key));
+        mem_free(conn);
+    }
+}
+
+
+int geodb_conn_open(geodb_conn conn, const char *main_dbfile, int openflags)
+{
+    int rc, flags;
+    char *errmsg = 0;
+
+    if (conn->db) {
+        printf("Error: geodb_conn already open: %s\n", conn->dbfile);
+        return GEODB_RES_ERR;
+    }
+
+    flags = SQLITE_OPEN_FULLMUTEX;
+    flags |= (openflags & GEODB_OPEN_READWRITE)? SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY;
+    if (openflags & GEODB_OPEN_CREATE) {
+        flags |= SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    }
+
+    rc = sqlite3_open_v2(main_dbfile, &conn->db, flags, 0);
+    if (rc != SQLITE_OK) {
+        printf("Error: sqlite3_open_v2(%s): %s\n", main_dbfile, conn->db? sqlite3_errmsg(conn->db) : "out of memory");
+        sqlite3_close_v2(conn->db);
+        conn->db = 0;
+        return GEODB_RES_ERR;
+    }
+
+    if (db_apply_attr(conn->db, &conn->attr) != GEODB_RES_SOK) {
+        sqlite3_close_v2(conn->db);
+        conn->db = 0;
+        return GEODB_RES_ERR;
+    }
+
+    if (flags & SQLITE_OPEN_READWRITE) {
+        // readers do not block writer and each other
+        if (sqlite3_exec(conn->db, "PRAGMA journal_mode=WAL", 0, 0, &errmsg) != SQLITE_OK) {
+            printf("Warn: PRAGMA journal_mode=WAL: %s\n", errmsg);
+            sqlite3_free(errmsg);
+        }
+    }
+
+    conn->dbfile = mem_strdup(main_dbfile);
+    conn->openflags = openflags;
+    return GEODB_RES_SOK;
+}
+
+
+int geodb_conn_close(geodb_conn conn)
+{
+    int i;
+
+    // read connections bound to other threads may be in the middle of a query
+    pthread_mutex_lock(&conn->poollock);
+    for (i = 0; i < conn->numreaders; i++) {
+        if (conn->readers[i].inuse && ! pthread_equal(conn->readers[i].owner, pthread_self())) {
+            pthread_mutex_unlock(&conn->poollock);
+            printf("Error: read connections in use\n");
+            return GEODB_RES_ERR;
+        }
+    }
+    for (i = 0; i < conn->numreaders; i++) {
+        reader_close(&conn->readers[i]);
+    }
+    conn->numreaders = 0;
+    pthread_mutex_unlock(&conn->poollock);
+
+    // reader of calling thread is closed
+    pthread_setspecific(conn->readerkey, 0);
+
+    if (conn->db) {
+        sqlite3_close_v2(conn->db);
+        conn->db = 0;
+    }
+
+    mem_free_s((void **) &conn->dbfile);
+    return GEODB_RES_SOK;
+}
+
+
+int geodb_conn_rekey(geodb_conn conn, const char *cipher, const char *key, int keylen)
+{
+    int i, ret = GEODB_RES_ERR;
+
+    if (! conn->db || ! (conn->openflags & (GEODB_OPEN_READWRITE | GEODB_OPEN_CREATE))) {
+        printf("Error: geodb_conn not open for write\n");
+        return GEODB_RES_ERR;
+    }
+
+    if (keylen < 0 || keylen > GEODB_KEYLEN_MAX || (cipher && strlen(cipher) > GEODB_NAMELEN_MAX)) {
+        printf("Error: invalid key or cipher\n");
+        return GEODB_RES_ERR;
+    }
+
+    // read connections still use the old key
+    pthread_mutex_lock(&conn->poollock);
+    for (i = 0; i < conn->numreaders; i++) {
+        if (conn->readers[i].inuse) {
+            pthread_mutex_unlock(&conn->poollock);
+            printf("Error: read connections in use\n");
+            return GEODB_RES_ERR;
+        }
+    }
+    for (i = 0; i < conn->numreaders; i++) {
+        reader_close(&conn->readers[i]);
+    }
+    conn->numreaders = 0;
+    pthread_mutex_unlock(&conn->poollock);
+
+    // sqlite3mc cannot rekey in WAL mode
+    if (db_execf(conn->db, "PRAGMA journal_mode=DELETE")) {
+        return GEODB_RES_ERR;
+    }
+
+    if (! cipher || ! cipher[0] || ! db_execf(conn->db, "PRAGMA cipher = '%q'", cipher)) {
+        if (sqlite3_rekey_v2(conn->db, "main", key, keylen) == SQLITE_OK) {
+            memset(conn->attr.cipher, 0, sizeof(conn->attr.cipher));
+            memset(conn->attr.key, 0, sizeof(conn->attr.key));
+            if (cipher) {
+                memcpy(conn->attr.cipher, cipher, strlen(cipher));
+            }
+            if (keylen > 0) {
+                memcpy(conn->attr.key, key, keylen);
+            }
+            conn->attr.keylen = keylen;
+            ret = GEODB_RES_SOK;
+        } else {
+            printf("Error: sqlite3_rekey_v2: %s\n", sqlite3_errmsg(conn->db));
+        }
+    }
+
+    db_execf(conn->db, "PRAGMA journal_mode=WAL");
+    return ret;
+}
+
+
+void geodb_conn_release_reader(geodb_conn conn)
+{
+    geodb_reader_t *reader = (geodb_reader_t *) pthread_getspecific(conn->readerkey);
+    if (reader) {
+        pthread_setspecific(conn->readerkey, 0);
+        reader_on_thread_exit(reader);
+    }
+}
+
+
+int geodb_conn_prepare(geodb_conn conn, const char *sql, int sqllen, geodb_stmt *outstmt)
+{
+    geodb_stmt stmt, cached = 0;
+    geodb_reader_t *reader = geodb_conn_get_reader(conn);
+
+    if (! reader) {
+        return GEODB_RES_ERR;
+    }
+
+    if (sqllen < 0) {
+        sqllen = (int) strlen(sql);
+    }
+
+    HASH_FIND(hh, reader->stmts, sql, sqllen, cached);
+    if (cached && ! cached->inuse) {
+        cached->inuse = 1;
+        *outstmt = cached;
+        return GEODB_RES_SOK;
+    }
+
+    // not cached, or the cached one is in use (nested query with the same sql)
+    stmt = (geodb_stmt) mem_alloc_zero(1, sizeof(struct geodb_stmt_t) + sqllen + 1);
+    memcpy(stmt->sql, sql, sqllen);
+    stmt->sqllen = sqllen;
+
+    if (sqlite3_prepare_v3(reader->db, stmt->sql, sqllen, SQLITE_PREPARE_PERSISTENT, &stmt->stmt, 0) != SQLITE_OK) {
+        printf("Error: sqlite3_prepare_v3(%.*s): %s\n", sqllen, sql, sqlite3_errmsg(reader->db));
+        mem_free(stmt);
+        return GEODB_RES_ERR;
+    }
+    stmt->inuse = 1;
+
+    if (! cached && reader->numstmts < GEODB_STMT_CACHE_MAX) {
+        stmt->reader = reader;
+        HASH_ADD_KEYPTR(hh, reader->stmts, stmt->sql, stmt->sqllen, stmt);
+        reader->numstmts++;
+    }
+
+    *outstmt = stmt;
+    return GEODB_RES_SOK;
+}
+
+
+void geodb_stmt_release(geodb_stmt stmt)
+{
+    sqlite3_reset(stmt->stmt);
+    sqlite3_clear_bindings(stmt->stmt);
+
+    if (stmt->reader) {
+        stmt->inuse = 0;
+    } else {
+        sqlite3_finalize(stmt->stmt);
+        mem_free(stmt);
+    }
+}
+
+
+void * geodb_stmt_handle(geodb_stmt stmt)
+{
+    return (void *) stmt->stmt;
+}
+
+
+int geodb_execute_sql(geodb_conn conn, const char *sql, int sqllen)
+{
+    int rc;
+    char *errmsg = 0;
+    char *sqlbuf = 0;
+
+    if (! conn->db) {
+        printf("Error: geodb_conn not open\n");
+        return GEODB_RES_ERR;
+    }
+
+    if (sqllen >= 0 && sql[sqllen] != '\0') {
+        sqlbuf = mem_strdup_len(sql, sqllen);
+        sql = sqlbuf;
+    }
+
+    rc = sqlite3_exec(conn->db, sql, 0, 0, &errmsg);
+    if (rc != SQLITE_OK) {
+        printf("Error: sqlite3_exec: %s\n", errmsg? errmsg : sqlite3_errmsg(conn->db));
+        sqlite3_free(errmsg);
+    }
+
+    mem_free(sqlbuf);
+    return (rc == SQLITE_OK)? GEODB_RES_SOK : GEODB_RES_ERR;
+}
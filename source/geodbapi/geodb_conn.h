@@ -0,0 +1,121 @@
+/**
+ * Copyright © 2024 MapAware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * @file geodb_conn.h
+ * @author 350137278@qq.com
+ * @brief geodb_conn: one writer connection and a pool of read connections
+ *
+ * @version 1.0.0
+ * @since 2024-11-04 09:20:16
+ * @date 2024-11-04 16:02:51
+ *
+ * @note
+ *   写连接只有一个 (SQLITE_OPEN_FULLMUTEX), 可以被任何线程使用.
+ *   读连接每个工作线程一个 (SQLITE_OPEN_NOMUTEX), 第一次使用时绑定到调用线程,
+ *   线程退出时归还到连接池. 每个读连接有自己的 prepared statement 缓存,
+ *   以 SQL 文本为键. 数据库使用 WAL 模式, 多个读连接可以并发查询.
+ *   每个连接打开时按 geodb_attr 设置密钥, cache_size 和 mmap_size. 未设置密钥时
+ *   不调用 sqlite3_key_v2, 页面读取没有解密开销.
+ */
+#ifndef GEODB_CONN_H__
+#define GEODB_CONN_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include "geodbapi_i.h"
+#include "geodb_attr.h"
+
+#include <common/uthash/uthash.h>
+
+#include <pthread.h>
+
+#if defined(_MSC_VER)
+  // link to pthread-w32 lib for MS Windows with MSVC
+  # pragma comment(lib, "pthreadVC2.lib")
+#endif
+
+
+#define GEODB_STMT_CACHE_MAX   256
+
+
+typedef struct geodb_reader_t  geodb_reader_t;
+
+
+typedef struct geodb_stmt_t
+{
+    UT_hash_handle hh;
+
+    // owner reader. NULL for statement not cached
+    geodb_reader_t *reader;
+
+    sqlite3_stmt *stmt;
+
+    int inuse;
+
+    int sqllen;
+    char sql[0];
+} * geodb_stmt;
+
+
+struct geodb_reader_t
+{
+    struct geodb_conn_t *conn;
+
+    sqlite3 *db;
+
+    // cached statements keyed by sql text
+    geodb_stmt stmts;
+    int numstmts;
+
+    // 1: bound to thread owner
+    int inuse;
+    pthread_t owner;
+};
+
+
+typedef struct geodb_conn_t
+{
+    char *dbfile;
+    int openflags;
+
+    // copy of geodb_attr given to geodb_conn_new
+    struct geodb_attr_t attr;
+
+    // writer connection (serialized)
+    sqlite3 *db;
+
+    // read connection pool
+    pthread_mutex_t poollock;
+    pthread_key_t readerkey;
+
+    int numreaders;
+    geodb_reader_t readers[GEODB_READERS_MAX];
+} * geodb_conn;
+
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* GEODB_CONN_H__ */
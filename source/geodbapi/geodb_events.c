@@ -0,0 +1,355 @@
+/**
+ * Copyright © 2024 MapAware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * @file geodb_events.c
+ * @author 350137278@qq.com
+ * @brief change events feed: dirty tiles of shapes changed by events
+ *
+ * @version 1.0.0
+ * @since 2024-11-06 10:05:37
+ * @date 2024-11-06 15:48:19
+ *
+ * @note
+ *   一个事件 (geodb_events.event_id) 在每个图层的事件表 geodb_e_$(layer_id) 中
+ *   记录被修改的 shapeid. 受影响的范围取事件表中的 MBR (删除或移动前的范围),
+ *   以及 shape 表中的当前 MBR. 两者都要重新渲染.
+ */
+#include "geodb_conn.h"
+#include "geodb_layer.h"
+
+
+// tiles per side at zoom z: 2^z
+#define GEODB_TILE_ZOOM_MAX    30
+
+// coalesce contained ranges only if not too many (O(n^2))
+#define GEODB_TILE_RANGES_CONTAIN_MAX   1024
+
+
+typedef struct
+{
+    double *envs;   // xmin, ymin, xmax, ymax for each
+    int numenvs;
+    int maxenvs;
+
+    geodb_tilerange *ranges;
+    int numranges;
+    int maxranges;
+} dirty_layer_ctx;
+
+
+static void dirty_add_env(dirty_layer_ctx *ctx, double xmin, double ymin, double xmax, double ymax)
+{
+    double *env;
+
+    if (ctx->numenvs == ctx->maxenvs) {
+        ctx->maxenvs = ctx->maxenvs? ctx->maxenvs * 2 : 256;
+        ctx->envs = (double *) mem_realloc(ctx->envs, sizeof(double) * 4 * ctx->maxenvs);
+    }
+
+    env = &ctx->envs[ctx->numenvs++ * 4];
+    env[0] = xmin;
+    env[1] = ymin;
+    env[2] = xmax;
+    env[3] = ymax;
+}
+
+
+static geodb_tilerange * dirty_new_range(dirty_layer_ctx *ctx)
+{
+    if (ctx->numranges == ctx->maxranges) {
+        ctx->maxranges = ctx->maxranges? ctx->maxranges * 2 : 256;
+        ctx->ranges = (geodb_tilerange *) mem_realloc(ctx->ranges, sizeof(geodb_tilerange) * ctx->maxranges);
+    }
+    return &ctx->ranges[ctx->numranges++];
+}
+
+
+static int cmp_range_column(const void *a, const void *b)
+{
+    const geodb_tilerange *r1 = (const geodb_tilerange *) a;
+    const geodb_tilerange *r2 = (const geodb_tilerange *) b;
+
+    if (r1->tx0 != r2->tx0) {
+        return (r1->tx0 < r2->tx0)? -1 : 1;
+    }
+    if (r1->tx1 != r2->tx1) {
+        return (r1->tx1 < r2->tx1)? -1 : 1;
+    }
+    return (r1->ty0 < r2->ty0)? -1 : (r1->ty0 > r2->ty0);
+}
+
+
+static int cmp_range_row(const void *a, const void *b)
+{
+    const geodb_tilerange *r1 = (const geodb_tilerange *) a;
+    const geodb_tilerange *r2 = (const geodb_tilerange *) b;
+
+    if (r1->ty0 != r2->ty0) {
+        return (r1->ty0 < r2->ty0)? -1 : 1;
+    }
+    if (r1->ty1 != r2->ty1) {
+        return (r1->ty1 < r2->ty1)? -1 : 1;
+    }
+    return (r1->tx0 < r2->tx0)? -1 : (r1->tx0 > r2->tx0);
+}
+
+
+/**
+ * 合并同一列 (tx0, tx1 相同) 或同一行 (ty0, ty1 相同) 上相交或相邻的瓦片范围.
+ *   合并后的范围不会包含任何非脏瓦片.
+ */
+static int coalesce_ranges_pass(geodb_tilerange *ranges, int numranges, int bycolumn)
+{
+    int i, m = 0;
+
+    qsort(ranges, numranges, sizeof(geodb_tilerange), bycolumn? cmp_range_column : cmp_range_row);
+
+    for (i = 0; i < numranges; i++) {
+        geodb_tilerange *last = m? &ranges[m - 1] : 0;
+
+        if (bycolumn && last && last->tx0 == ranges[i].tx0 && last->tx1 == ranges[i].tx1 && ranges[i].ty0 <= last->ty1 + 1) {
+            if (ranges[i].ty1 > last->ty1) {
+                last->ty1 = ranges[i].ty1;
+            }
+        } else if (! bycolumn && last && last->ty0 == ranges[i].ty0 && last->ty1 == ranges[i].ty1 && ranges[i].tx0 <= last->tx1 + 1) {
+            if (ranges[i].tx1 > last->tx1) {
+                last->tx1 = ranges[i].tx1;
+            }
+        } else {
+            ranges[m++] = ranges[i];
+        }
+    }
+
+    return m;
+}
+
+
+static int coalesce_ranges(geodb_tilerange *ranges, int numranges)
+{
+    int i, j, m, n;
+
+    do {
+        n = numranges;
+        numranges = coalesce_ranges_pass(ranges, numranges, 1);
+        numranges = coalesce_ranges_pass(ranges, numranges, 0);
+    } while (numranges < n);
+
+    if (numranges > GEODB_TILE_RANGES_CONTAIN_MAX) {
+        return numranges;
+    }
+
+    // remove ranges contained by others
+    for (m = 0, i = 0; i < numranges; i++) {
+        for (j = 0; j < numranges; j++) {
+            if (j != i && ranges[j].zoom >= 0 &&
+                ranges[j].tx0 <= ranges[i].tx0 && ranges[j].tx1 >= ranges[i].tx1 &&
+                ranges[j].ty0 <= ranges[i].ty0 && ranges[j].ty1 >= ranges[i].ty1) {
+                break;
+            }
+        }
+        if (j < numranges) {
+            // mark as removed
+            ranges[i].zoom = -1;
+        }
+    }
+    for (i = 0; i < numranges; i++) {
+        if (ranges[i].zoom >= 0) {
+            ranges[m++] = ranges[i];
+        }
+    }
+
+    return m;
+}
+
+
+static void dirty_layer_ranges(dirty_layer_ctx *ctx, const double tileBounds[4], int zoom_min, int zoom_max)
+{
+    int zoom, i, first;
+    const double *env;
+    geodb_tilerange *range;
+
+    ctx->numranges = 0;
+
+    for (zoom = zoom_min; zoom <= zoom_max; zoom++) {
+        first = ctx->numranges;
+
+        for (i = 0; i < ctx->numenvs; i++) {
+            env = &ctx->envs[i * 4];
+
+            if (env[2] < tileBounds[0] || env[0] > tileBounds[2] || env[3] < tileBounds[1] || env[1] > tileBounds[3]) {
+                // out of tile pyramid
+                continue;
+            }
+
+            range = dirty_new_range(ctx);
+            range->zoom = zoom;
+            geodb_grid_cells(tileBounds, zoom, env, &range->tx0, &range->ty0, &range->tx1, &range->ty1);
+        }
+
+        ctx->numranges = first + coalesce_ranges(&ctx->ranges[first], ctx->numranges - first);
+    }
+}
+
+
+static int dirty_layer_envs(geodb_conn conn, const char *event_table, const char *shape_table,
+    int64_t event_first, int64_t event_last, dirty_layer_ctx *ctx)
+{
+    int rc;
+    char sql[512];
+    geodb_stmt stmt;
+    sqlite3_stmt *pstmt;
+
+    // MBR before event (event table) and current MBR (shape table, NULL if deleted)
+    snprintf(sql, sizeof(sql),
+        "SELECT e.xmin, e.ymin, e.xmax, e.ymax, s.xmin, s.ymin, s.xmax, s.ymax"
+        " FROM %s e LEFT JOIN %s s ON s.shapeid = e.shapeid"
+        " WHERE e.event_id BETWEEN ?1 AND ?2",
+        event_table, shape_table);
+
+    if (geodb_conn_prepare(conn, sql, -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+    pstmt = stmt->stmt;
+
+    sqlite3_bind_int64(pstmt, 1, event_first);
+    sqlite3_bind_int64(pstmt, 2, event_last);
+
+    ctx->numenvs = 0;
+
+    while ((rc = sqlite3_step(pstmt)) == SQLITE_ROW) {
+        if (sqlite3_column_type(pstmt, 0) != SQLITE_NULL) {
+            dirty_add_env(ctx, sqlite3_column_double(pstmt, 0), sqlite3_column_double(pstmt, 1),
+                sqlite3_column_double(pstmt, 2), sqlite3_column_double(pstmt, 3));
+        }
+        if (sqlite3_column_type(pstmt, 4) != SQLITE_NULL) {
+            dirty_add_env(ctx, sqlite3_column_double(pstmt, 4), sqlite3_column_double(pstmt, 5),
+                sqlite3_column_double(pstmt, 6), sqlite3_column_double(pstmt, 7));
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(sqlite3_db_handle(pstmt)));
+        geodb_stmt_release(stmt);
+        return GEODB_RES_ERR;
+    }
+
+    geodb_stmt_release(stmt);
+    return GEODB_RES_SOK;
+}
+
+
+int geodb_events_last_id(geodb_conn conn, int64_t *eventid)
+{
+    int ret = GEODB_RES_ERR;
+    geodb_stmt stmt;
+
+    if (geodb_conn_prepare(conn, "SELECT IFNULL(MAX(event_id), 0) FROM geodb_events", -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    if (sqlite3_step(stmt->stmt) == SQLITE_ROW) {
+        *eventid = sqlite3_column_int64(stmt->stmt, 0);
+        ret = GEODB_RES_SOK;
+    }
+
+    geodb_stmt_release(stmt);
+    return ret;
+}
+
+
+int geodb_events_dirty_tiles(geodb_conn conn, int64_t event_first, int64_t event_last,
+    const double tileBounds[4], int zoom_min, int zoom_max,
+    int (*on_dirty_layer)(int64_t layerid, const double bounds[4], int numranges, const geodb_tilerange *ranges, void *userarg),
+    void *userarg)
+{
+    int rc, i, numlayers = 0;
+    geodb_stmt stmt;
+    sqlite3_stmt *pstmt;
+    dirty_layer_ctx ctx = {0};
+
+    if (zoom_min < 0 || zoom_max > GEODB_TILE_ZOOM_MAX || zoom_min > zoom_max) {
+        printf("Error: invalid zooms(%d-%d)\n", zoom_min, zoom_max);
+        return GEODB_RES_ERR;
+    }
+
+    if (geodb_conn_prepare(conn, "SELECT layer_id, shape_table, event_table, xmin, ymin, xmax, ymax FROM geodb_layers", -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+    pstmt = stmt->stmt;
+
+    while ((rc = sqlite3_step(pstmt)) == SQLITE_ROW) {
+        int64_t layerid = sqlite3_column_int64(pstmt, 0);
+        double bounds[4], layerBox[4];
+
+        if (dirty_layer_envs(conn, (const char *) sqlite3_column_text(pstmt, 2), (const char *) sqlite3_column_text(pstmt, 1),
+                event_first, event_last, &ctx) != GEODB_RES_SOK) {
+            numlayers = GEODB_RES_ERR;
+            break;
+        }
+
+        if (! ctx.numenvs) {
+            // layer not changed
+            continue;
+        }
+
+        bounds[0] = ctx.envs[0];
+        bounds[1] = ctx.envs[1];
+        bounds[2] = ctx.envs[2];
+        bounds[3] = ctx.envs[3];
+        for (i = 1; i < ctx.numenvs; i++) {
+            const double *env = &ctx.envs[i * 4];
+            bounds[0] = fmin(bounds[0], env[0]);
+            bounds[1] = fmin(bounds[1], env[1]);
+            bounds[2] = fmax(bounds[2], env[2]);
+            bounds[3] = fmax(bounds[3], env[3]);
+        }
+
+        if (! tileBounds) {
+            layerBox[0] = sqlite3_column_double(pstmt, 3);
+            layerBox[1] = sqlite3_column_double(pstmt, 4);
+            layerBox[2] = sqlite3_column_double(pstmt, 5);
+            layerBox[3] = sqlite3_column_double(pstmt, 6);
+        }
+
+        dirty_layer_ranges(&ctx, tileBounds? tileBounds : layerBox, zoom_min, zoom_max);
+
+        numlayers++;
+
+        if (on_dirty_layer && on_dirty_layer(layerid, bounds, ctx.numranges, ctx.ranges, userarg)) {
+            // stopped by caller
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+
+    if (numlayers != GEODB_RES_ERR && rc != SQLITE_DONE) {
+        printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(sqlite3_db_handle(pstmt)));
+        numlayers = GEODB_RES_ERR;
+    }
+
+    geodb_stmt_release(stmt);
+
+    mem_free(ctx.envs);
+    mem_free(ctx.ranges);
+    return numlayers;
+}
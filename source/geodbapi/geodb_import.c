@@ -0,0 +1,541 @@
+/**
+ * Copyright © 2024 MapAware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * @file geodb_import.c
+ * @author 350137278@qq.com
+ * @brief bulk import shapefile into geodb
+ *
+ * @version 1.0.0
+ * @since 2024-11-03 10:12:40
+ * @date 2024-11-03 18:36:05
+ *
+ * @note
+ *   批量导入的要点:
+ *   1) 导入期间: PRAGMA journal_mode=WAL; synchronous=OFF
+ *   2) 每 batchrows 个 shape 一个显式事务, 所有 INSERT 语句只 prepare 一次
+ *   3) 网格索引表 geodb_i_* 的二级索引在全部数据导入之后再创建
+ *   4) R*Tree 索引模式: 全部数据导入之后一次性装载 geodb_r_*, 然后创建同步触发器
+ */
+#include "geodbapi_i.h"
+#include "geodb_layer.h"
+
+#include <shapefile/shapefile_api.h>
+
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+
+
+#define GEODB_IMPORT_BATCHROWS   100000
+
+
+typedef struct
+{
+    sqlite3 *db;
+
+    int64_t layer_id;
+
+    char shape_table[GEODB_NAMELEN_MAX + 1];
+    char index_table[GEODB_NAMELEN_MAX + 1];
+    char event_table[GEODB_NAMELEN_MAX + 1];
+
+    geodb_index_mode index_mode;
+
+    int level_min;
+    int level_max;
+
+    // layer extent for grid index: xmin, ymin, xmax, ymax
+    double layerBox[4];
+
+    // prepared once, reused for all rows
+    sqlite3_stmt *shape_stmt;
+    sqlite3_stmt *index_stmts[GEODB_LEVEL_MAX + 1];
+
+    // reusable wkb buffer
+    void *wkbbuf;
+    int wkbsize;
+
+    int64_t index_rows;
+} geodb_import_ctx;
+
+
+static int import_exec(sqlite3 *db, const char *sql)
+{
+    char *errmsg = 0;
+    if (sqlite3_exec(db, sql, 0, 0, &errmsg) != SQLITE_OK) {
+        printf("Error: sqlite3_exec(%s): %s\n", sql, errmsg? errmsg : sqlite3_errmsg(db));
+        sqlite3_free(errmsg);
+        return GEODB_RES_ERR;
+    }
+    return GEODB_RES_SOK;
+}
+
+
+static int import_execf(sqlite3 *db, const char *sqlfmt, ...)
+{
+    int ret;
+    char *sql;
+    va_list args;
+
+    va_start(args, sqlfmt);
+    sql = sqlite3_vmprintf(sqlfmt, args);
+    va_end(args);
+
+    if (! sql) {
+        printf("Error: sqlite3_vmprintf: out of memory\n");
+        return GEODB_RES_ERR;
+    }
+
+    ret = import_exec(db, sql);
+    sqlite3_free(sql);
+    return ret;
+}
+
+
+static sqlite3_stmt * import_preparef(sqlite3 *db, const char *sqlfmt, ...)
+{
+    char *sql;
+    va_list args;
+    sqlite3_stmt *stmt = 0;
+
+    va_start(args, sqlfmt);
+    sql = sqlite3_vmprintf(sqlfmt, args);
+    va_end(args);
+
+    if (! sql) {
+        printf("Error: sqlite3_vmprintf: out of memory\n");
+        return 0;
+    }
+
+    // SQLITE_PREPARE_PERSISTENT: statement will be reused many times
+    if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0) != SQLITE_OK) {
+        printf("Error: sqlite3_prepare_v3(%s): %s\n", sql, sqlite3_errmsg(db));
+        stmt = 0;
+    }
+    sqlite3_free(sql);
+    return stmt;
+}
+
+
+static int import_step_reset(sqlite3 *db, sqlite3_stmt *stmt)
+{
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(db));
+        return GEODB_RES_ERR;
+    }
+    return GEODB_RES_SOK;
+}
+
+
+static void import_ctx_final(geodb_import_ctx *ctx)
+{
+    int level;
+
+    for (level = 0; level <= GEODB_LEVEL_MAX; level++) {
+        if (ctx->index_stmts[level]) {
+            sqlite3_finalize(ctx->index_stmts[level]);
+            ctx->index_stmts[level] = 0;
+        }
+    }
+
+    if (ctx->shape_stmt) {
+        sqlite3_finalize(ctx->shape_stmt);
+        ctx->shape_stmt = 0;
+    }
+
+    mem_free_s(&ctx->wkbbuf);
+}
+
+
+static int import_index_row(geodb_import_ctx *ctx, sqlite3_stmt *stmt, int ix, int iy, sqlite3_int64 shapeid)
+{
+    sqlite3_bind_int(stmt, 1, ix);
+    sqlite3_bind_int(stmt, 2, iy);
+    sqlite3_bind_int64(stmt, 3, shapeid);
+
+    ctx->index_rows++;
+    return import_step_reset(ctx->db, stmt);
+}
+
+
+static int import_index_shape(geodb_import_ctx *ctx, const SHPEnvelope *env, sqlite3_int64 shapeid)
+{
+    int level, ix, iy, ix0, iy0, ix1, iy1;
+    double envBox[4] = {env->XMin, env->YMin, env->XMax, env->YMax};
+
+    for (level = ctx->level_min; level <= ctx->level_max; level++) {
+        sqlite3_stmt *stmt = ctx->index_stmts[level];
+
+        geodb_grid_cells(ctx->layerBox, level, envBox, &ix0, &iy0, &ix1, &iy1);
+
+        if ((sqlite3_int64) (ix1 - ix0 + 1) * (iy1 - iy0 + 1) > GEODB_GRID_CELLS_MAX) {
+            if (import_index_row(ctx, stmt, GEODB_GRID_OVERSIZE, GEODB_GRID_OVERSIZE, shapeid) != GEODB_RES_SOK) {
+                return GEODB_RES_ERR;
+            }
+            continue;
+        }
+
+        for (iy = iy0; iy <= iy1; iy++) {
+            for (ix = ix0; ix <= ix1; ix++) {
+                if (import_index_row(ctx, stmt, ix, iy, shapeid) != GEODB_RES_SOK) {
+                    return GEODB_RES_ERR;
+                }
+            }
+        }
+    }
+
+    return GEODB_RES_SOK;
+}
+
+
+static int import_shape(geodb_import_ctx *ctx, const SHPObjectEx *shape, sqlite3_int64 shapeid, double timestamp)
+{
+    int cb;
+    sqlite3_stmt *stmt = ctx->shape_stmt;
+
+    sqlite3_bind_int64(stmt, 1, shapeid);
+    sqlite3_bind_double(stmt, 10, timestamp);
+
+    if (shape->nSHPType == SHPT_NULL || shape->nVertices == 0) {
+        // keep shapeid = record + 1 even for null shapes
+        sqlite3_bind_null(stmt, 2);
+        sqlite3_bind_null(stmt, 3);
+        sqlite3_bind_null(stmt, 4);
+        sqlite3_bind_null(stmt, 5);
+        sqlite3_bind_null(stmt, 6);
+        sqlite3_bind_double(stmt, 7, 0);
+        sqlite3_bind_double(stmt, 8, 0);
+        return import_step_reset(ctx->db, stmt);
+    }
+
+    cb = SHPObjectEx2WKB(shape, 0, 0, 0, 0, 0);
+    if (cb <= 0) {
+        printf("Error: SHPObjectEx2WKB failed on shape#%d\n", shape->nShapeId);
+        return GEODB_RES_ERR;
+    }
+    if (cb > ctx->wkbsize) {
+        ctx->wkbsize = memapi_align_bsize(cb, 4096);
+        ctx->wkbbuf = mem_realloc(ctx->wkbbuf, ctx->wkbsize);
+    }
+    cb = SHPObjectEx2WKB(shape, ctx->wkbbuf, 0, 0, 0, 0);
+
+    sqlite3_bind_double(stmt, 2, shape->dfXMin);
+    sqlite3_bind_double(stmt, 3, shape->dfYMin);
+    sqlite3_bind_double(stmt, 4, shape->dfXMax);
+    sqlite3_bind_double(stmt, 5, shape->dfYMax);
+    sqlite3_bind_blob(stmt, 6, ctx->wkbbuf, cb, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 7, fabs(SHPObjectExGetArea(shape)));
+    sqlite3_bind_double(stmt, 8, SHPObjectExGetLength(shape));
+
+    if (import_step_reset(ctx->db, stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    if (ctx->index_mode == geodb_index_rtree) {
+        // geodb_r_* is loaded after all shapes imported
+        return GEODB_RES_SOK;
+    }
+    return import_index_shape(ctx, &shape->_Bounds._Env, shapeid);
+}
+
+
+static int import_create_layer(geodb_import_ctx *ctx, const char *layername, int shapetype,
+    const double minBounds[4], const double maxBounds[4], int64_t numShapes, double timestamp)
+{
+    int level;
+    sqlite3 *db = ctx->db;
+
+    if (import_exec(db, GEODB_SQL_CREATE_EVENTS) ||
+        import_exec(db, GEODB_SQL_CREATE_LAYERS)) {
+        return GEODB_RES_ERR;
+    }
+
+    if (import_execf(db,
+            "INSERT INTO geodb_layers(layer_name, user_table, col_userid, shape_table, index_table, event_table,"
+            " shape_type, shape_encode, next_shapeid, level_min, level_max,"
+            " xmin, ymin, xmax, ymax, zmin, zmax, mmin, mmax, createtime, updatetime)"
+            " VALUES(%Q, %Q, 'shapeid', '-', '-', '-', %d, 'WKB', %lld, %d, %d,"
+            " %!.17g, %!.17g, %!.17g, %!.17g, %!.17g, %!.17g, %!.17g, %!.17g, %!.6f, %!.6f)",
+            layername, layername, shapetype, (sqlite3_int64) (numShapes + 1), ctx->level_min, ctx->level_max,
+            minBounds[0], minBounds[1], maxBounds[0], maxBounds[1],
+            minBounds[2], maxBounds[2], minBounds[3], maxBounds[3], timestamp, timestamp)) {
+        return GEODB_RES_ERR;
+    }
+    ctx->layer_id = sqlite3_last_insert_rowid(db);
+
+    snprintf(ctx->shape_table, sizeof(ctx->shape_table), GEODB_TABLE_SHAPE_FMT, (unsigned int) ctx->layer_id);
+    snprintf(ctx->index_table, sizeof(ctx->index_table),
+        (ctx->index_mode == geodb_index_rtree)? GEODB_TABLE_RTREE_FMT : GEODB_TABLE_INDEX_FMT, (unsigned int) ctx->layer_id);
+    snprintf(ctx->event_table, sizeof(ctx->event_table), GEODB_TABLE_EVENT_FMT, (unsigned int) ctx->layer_id);
+
+    if (import_execf(db, "UPDATE geodb_layers SET shape_table=%Q, index_table=%Q, event_table=%Q WHERE layer_id=%lld",
+            ctx->shape_table, ctx->index_table, ctx->event_table, (sqlite3_int64) ctx->layer_id)) {
+        return GEODB_RES_ERR;
+    }
+
+    if (import_execf(db, GEODB_SQL_CREATE_SHAPE_TABLE, ctx->shape_table) ||
+        import_execf(db, GEODB_SQL_CREATE_EVENT_TABLE, ctx->event_table)) {
+        return GEODB_RES_ERR;
+    }
+
+    if (ctx->index_mode == geodb_index_rtree) {
+        return import_execf(db, GEODB_SQL_CREATE_RTREE_TABLE, ctx->index_table);
+    }
+
+    // index tables without secondary index: created after load
+    for (level = ctx->level_min; level <= ctx->level_max; level++) {
+        if (import_execf(db, GEODB_SQL_CREATE_INDEX_TABLE, ctx->index_table, level)) {
+            return GEODB_RES_ERR;
+        }
+    }
+
+    return GEODB_RES_SOK;
+}
+
+
+static int import_prepare_stmts(geodb_import_ctx *ctx)
+{
+    int level;
+
+    ctx->shape_stmt = import_preparef(ctx->db,
+        "INSERT INTO %s(shapeid, xmin, ymin, xmax, ymax, shape, area, lens, flags, timestamp)"
+        " VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, NULL, ?10)", ctx->shape_table);
+    if (! ctx->shape_stmt) {
+        return GEODB_RES_ERR;
+    }
+
+    if (ctx->index_mode == geodb_index_rtree) {
+        return GEODB_RES_SOK;
+    }
+
+    for (level = ctx->level_min; level <= ctx->level_max; level++) {
+        ctx->index_stmts[level] = import_preparef(ctx->db,
+            "INSERT INTO %s_%d(ix, iy, shapeid) VALUES(?1, ?2, ?3)", ctx->index_table, level);
+        if (! ctx->index_stmts[level]) {
+            return GEODB_RES_ERR;
+        }
+    }
+
+    return GEODB_RES_SOK;
+}
+
+
+static int import_create_event_indexes(geodb_import_ctx *ctx)
+{
+    if (import_execf(ctx->db, GEODB_SQL_CREATE_EVENT_TABLE_UK, ctx->event_table, ctx->event_table) ||
+        import_execf(ctx->db, GEODB_SQL_CREATE_EVENT_TABLE_EK, ctx->event_table, ctx->event_table)) {
+        return GEODB_RES_ERR;
+    }
+    return GEODB_RES_SOK;
+}
+
+
+static int import_create_indexes(geodb_import_ctx *ctx)
+{
+    int level;
+
+    if (ctx->index_mode == geodb_index_rtree) {
+        // bulk load rtree, then keep it in sync with shape table by triggers
+        if (import_execf(ctx->db, GEODB_SQL_LOAD_RTREE_TABLE, ctx->index_table, ctx->shape_table)) {
+            return GEODB_RES_ERR;
+        }
+        ctx->index_rows = sqlite3_changes(ctx->db);
+
+        if (import_execf(ctx->db, GEODB_SQL_CREATE_RTREE_TRIGGER_INS, ctx->shape_table, ctx->shape_table, ctx->index_table) ||
+            import_execf(ctx->db, GEODB_SQL_CREATE_RTREE_TRIGGER_UPD, ctx->shape_table, ctx->shape_table, ctx->index_table, ctx->index_table) ||
+            import_execf(ctx->db, GEODB_SQL_CREATE_RTREE_TRIGGER_DEL, ctx->shape_table, ctx->shape_table, ctx->index_table)) {
+            return GEODB_RES_ERR;
+        }
+        return import_create_event_indexes(ctx);
+    }
+
+    for (level = ctx->level_min; level <= ctx->level_max; level++) {
+        if (import_execf(ctx->db, GEODB_SQL_CREATE_INDEX_TABLE_UK, ctx->index_table, level, ctx->index_table, level)) {
+            return GEODB_RES_ERR;
+        }
+    }
+
+    return import_create_event_indexes(ctx);
+}
+
+
+/**
+ * 导入失败: 删除已经创建的图层表和图层记录
+ */
+static void import_drop_layer(geodb_import_ctx *ctx)
+{
+    int level;
+
+    if (! ctx->layer_id) {
+        return;
+    }
+
+    sqlite3_exec(ctx->db, "ROLLBACK", 0, 0, 0);
+
+    if (ctx->index_mode == geodb_index_rtree) {
+        import_execf(ctx->db, "DROP TABLE IF EXISTS %s", ctx->index_table);
+    } else {
+        for (level = ctx->level_min; level <= ctx->level_max; level++) {
+            import_execf(ctx->db, "DROP TABLE IF EXISTS %s_%d", ctx->index_table, level);
+        }
+    }
+    import_execf(ctx->db, "DROP TABLE IF EXISTS %s", ctx->event_table);
+    import_execf(ctx->db, "DROP TABLE IF EXISTS %s", ctx->shape_table);
+    import_execf(ctx->db, "DELETE FROM geodb_layers WHERE layer_id=%lld", (sqlite3_int64) ctx->layer_id);
+}
+
+
+int geodb_import_shpfile(const char *geodbfile, const char *shpfile, const char *layername,
+    geodb_index_mode indexmode, int level_min, int level_max, int batchrows, int64_t *layerid)
+{
+    int ret = GEODB_RES_ERR;
+
+    SHPHandle hSHP = 0;
+    SHPObjectEx *shape = 0;
+
+    int nEntities = 0, nShapeType = 0, iShape, batchcount;
+    double minBounds[4], maxBounds[4], timestamp;
+
+    char namebuf[GEODB_NAMELEN_MAX + 1];
+
+    geodb_import_ctx ctx;
+    bzero(&ctx, sizeof(ctx));
+
+    if (level_min < GEODB_LEVEL_MIN || level_max > GEODB_LEVEL_MAX || level_min > level_max) {
+        printf("Error: invalid grid levels: %d-%d\n", level_min, level_max);
+        return GEODB_RES_ERR;
+    }
+    ctx.level_min = level_min;
+    ctx.level_max = level_max;
+    ctx.index_mode = indexmode;
+
+    if (batchrows <= 0) {
+        batchrows = GEODB_IMPORT_BATCHROWS;
+    }
+
+    if (! layername) {
+        // basename of shpfile without ".shp"
+        const char *name = strrchr(shpfile, '/');
+        name = name? name + 1 : shpfile;
+        snprintf(namebuf, sizeof(namebuf), "%.*s", (int) (strrchr(name, '.')? strrchr(name, '.') - name : strlen(name)), name);
+        layername = namebuf;
+    }
+
+    hSHP = SHPOpen(shpfile, "rb");
+    if (! hSHP) {
+        printf("Error: Cannot open shp file: %s\n", shpfile);
+        return GEODB_RES_ERR;
+    }
+    SHPGetInfo(hSHP, &nEntities, &nShapeType, minBounds, maxBounds);
+
+    ctx.layerBox[0] = minBounds[0];
+    ctx.layerBox[1] = minBounds[1];
+    ctx.layerBox[2] = maxBounds[0];
+    ctx.layerBox[3] = maxBounds[1];
+
+    if (! SHPCreateObjectEx(&shape)) {
+        printf("Error: out of memory\n");
+        SHPClose(hSHP);
+        return GEODB_RES_ERR;
+    }
+
+    // one connection owned by this thread during import
+    if (sqlite3_open_v2(geodbfile, &ctx.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, 0) != SQLITE_OK) {
+        printf("Error: sqlite3_open_v2(%s): %s\n", geodbfile, ctx.db? sqlite3_errmsg(ctx.db) : "out of memory");
+        goto exit_cleanup;
+    }
+
+    if (import_exec(ctx.db, "PRAGMA journal_mode=WAL") ||
+        import_exec(ctx.db, "PRAGMA synchronous=OFF") ||
+        import_exec(ctx.db, "PRAGMA temp_store=MEMORY") ||
+        import_exec(ctx.db, "PRAGMA cache_size=-262144")) {
+        goto exit_cleanup;
+    }
+
+    timestamp = (double) time(0);
+
+    if (import_exec(ctx.db, "BEGIN") ||
+        import_create_layer(&ctx, layername, nShapeType, minBounds, maxBounds, nEntities, timestamp) ||
+        import_prepare_stmts(&ctx)) {
+        goto exit_cleanup;
+    }
+
+    batchcount = 0;
+
+    for (iShape = 0; iShape < nEntities; iShape++) {
+        if (! SHPReadObjectEx(hSHP, iShape, shape)) {
+            printf("Error: SHPReadObjectEx() failed on shape#%d\n", iShape);
+            goto exit_cleanup;
+        }
+
+        if (import_shape(&ctx, shape, (sqlite3_int64) iShape + 1, timestamp) != GEODB_RES_SOK) {
+            goto exit_cleanup;
+        }
+
+        if (++batchcount == batchrows) {
+            if (import_exec(ctx.db, "COMMIT") || import_exec(ctx.db, "BEGIN")) {
+                goto exit_cleanup;
+            }
+            batchcount = 0;
+        }
+    }
+
+    if (import_exec(ctx.db, "COMMIT")) {
+        goto exit_cleanup;
+    }
+
+    // build secondary indexes once after all rows loaded
+    if (import_exec(ctx.db, "BEGIN") ||
+        import_create_indexes(&ctx) ||
+        import_exec(ctx.db, "COMMIT")) {
+        goto exit_cleanup;
+    }
+
+    printf("Info: imported %d shapes (%lld index rows) into layer: %s (layer_id=%lld)\n",
+        nEntities, (long long) ctx.index_rows, layername, (long long) ctx.layer_id);
+
+    if (layerid) {
+        *layerid = ctx.layer_id;
+    }
+    ret = GEODB_RES_SOK;
+
+exit_cleanup:
+    import_ctx_final(&ctx);
+
+    if (ctx.db) {
+        if (ret != GEODB_RES_SOK) {
+            import_drop_layer(&ctx);
+        }
+
+        // restore durability. journal_mode=WAL is persistent in database file
+        sqlite3_exec(ctx.db, "PRAGMA synchronous=NORMAL", 0, 0, 0);
+        sqlite3_exec(ctx.db, "PRAGMA wal_checkpoint(TRUNCATE)", 0, 0, 0);
+        sqlite3_close_v2(ctx.db);
+    }
+
+    SHPDestroyObjectEx(shape);
+    SHPClose(hSHP);
+    return ret;
+}
@@ -38,6 +38,10 @@ extern "C" {
 
 #include "geodbapi.h"
 
+#include <common/memapi.h>
+
+#include <math.h>
+
 
 /*********************************************************************
 sqlite>
@@ -104,33 +108,186 @@ CREATE TABLE IF NOT EXISTS geodb_i_ffffffff_0(
 CREATE INDEX geodb_i_ffffffff_0_uk ON geodb_i_ffffffff_0(ix, iy, shapeid);
 
 -- 创建图层事件表 SQL: geodb_e_$(layer_id)
+--   xmin, ymin, xmax, ymax: 事件发生前 shape 的 MBR (删除或移动 shape 时必须填写), 可以为 NULL
 CREATE TABLE IF NOT EXISTS geodb_e_ffffffff(
     shapeid         INTEGER NOT NULL,
-    event_id        INTEGER NOT NULL
+    event_id        INTEGER NOT NULL,
+    xmin            REAL,
+    ymin            REAL,
+    xmax            REAL,
+    ymax            REAL
 );
 CREATE INDEX geodb_e_ffffffff_uk ON geodb_e_ffffffff(shapeid, event_id);
+CREATE INDEX geodb_e_ffffffff_ek ON geodb_e_ffffffff(event_id);
+
+-- 可选: R*Tree 空间索引 SQL: geodb_r_$(layer_id), 此时 geodb_layers.index_table = 'geodb_r_$(layer_id)'
+CREATE VIRTUAL TABLE IF NOT EXISTS geodb_r_ffffffff USING rtree(
+    shapeid,
+    xmin, xmax,
+    ymin, ymax
+);
 
 *********************************************************************/
+
+/**
+ * 图层表名: $(layer_id) 为 8 位 16 进制数, 例如: geodb_s_0000001a
+ */
+#define GEODB_TABLE_SHAPE_FMT    "geodb_s_%08x"
+#define GEODB_TABLE_INDEX_FMT    "geodb_i_%08x"
+#define GEODB_TABLE_EVENT_FMT    "geodb_e_%08x"
+#define GEODB_TABLE_RTREE_FMT    "geodb_r_%08x"
+
+#define GEODB_TABLE_RTREE_PREFIX "geodb_r_"
+
+/**
+ * 网格索引层级: 第 level 级把图层范围等分为 (2^level x 2^level) 个网格.
+ *   一个 shape 在某一级覆盖的网格数超过 GEODB_GRID_CELLS_MAX 时,
+ *   只记录一行 (GEODB_GRID_OVERSIZE, GEODB_GRID_OVERSIZE), 查询时总是包含此行.
+ */
+#define GEODB_LEVEL_MIN          0
+#define GEODB_LEVEL_MAX          20
+
+#define GEODB_GRID_CELLS_MAX     16
+#define GEODB_GRID_OVERSIZE    (-1)
+
+// 查询时选择过滤框覆盖网格数不超过此值的最细层级
+#define GEODB_QUERY_CELLS_MAX    64
+
+
+#define GEODB_SQL_CREATE_EVENTS \
+    "CREATE TABLE IF NOT EXISTS geodb_events(" \
+    "event_id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "event_name VARCHAR(30) DEFAULT NULL," \
+    "timestamp REAL)"
+
+#define GEODB_SQL_CREATE_LAYERS \
+    "CREATE TABLE IF NOT EXISTS geodb_layers(" \
+    "layer_id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "layer_name VARCHAR(30) DEFAULT NULL," \
+    "table_space VARCHAR(30) DEFAULT NULL," \
+    "table_owner VARCHAR(30) DEFAULT NULL," \
+    "user_table VARCHAR(30) UNIQUE NOT NULL," \
+    "col_userid VARCHAR(30) NOT NULL," \
+    "col_shapeid VARCHAR(30) NOT NULL DEFAULT 'shapeid'," \
+    "col_updatetime VARCHAR(30) NOT NULL DEFAULT 'updatetime'," \
+    "shape_table VARCHAR(30) UNIQUE NOT NULL," \
+    "index_table VARCHAR(30) UNIQUE NOT NULL," \
+    "event_table VARCHAR(30) UNIQUE NOT NULL," \
+    "shape_type INT(2) NOT NULL," \
+    "shape_encode VARCHAR(9) NOT NULL DEFAULT 'WKB'," \
+    "next_shapeid INTEGER," \
+    "level_min INTEGER," \
+    "level_max INTEGER," \
+    "xmin REAL NOT NULL DEFAULT 0," \
+    "ymin REAL NOT NULL DEFAULT 0," \
+    "xmax REAL NOT NULL DEFAULT 0," \
+    "ymax REAL NOT NULL DEFAULT 0," \
+    "zmin REAL NOT NULL DEFAULT 0," \
+    "zmax REAL NOT NULL DEFAULT 0," \
+    "mmin REAL NOT NULL DEFAULT 0," \
+    "mmax REAL NOT NULL DEFAULT 0," \
+    "coordref VARCHAR(30)," \
+    "description VARCHAR(255)," \
+    "createtime REAL," \
+    "updatetime REAL)"
+
+// %s = shape_table
+#define GEODB_SQL_CREATE_SHAPE_TABLE \
+    "CREATE TABLE IF NOT EXISTS %s(" \
+    "shapeid INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "xmin REAL," \
+    "ymin REAL," \
+    "xmax REAL," \
+    "ymax REAL," \
+    "shape BLOB," \
+    "area REAL DEFAULT 0," \
+    "lens REAL DEFAULT 0," \
+    "flags VARCHAR(10)," \
+    "timestamp REAL)"
+
+// %s_%d = index_table, level
+#define GEODB_SQL_CREATE_INDEX_TABLE \
+    "CREATE TABLE IF NOT EXISTS %s_%d(" \
+    "ix INTEGER NOT NULL," \
+    "iy INTEGER NOT NULL," \
+    "shapeid INTEGER NOT NULL)"
+
+#define GEODB_SQL_CREATE_INDEX_TABLE_UK \
+    "CREATE INDEX IF NOT EXISTS %s_%d_uk ON %s_%d(ix, iy, shapeid)"
+
+// %s = event_table
+#define GEODB_SQL_CREATE_EVENT_TABLE \
+    "CREATE TABLE IF NOT EXISTS %s(" \
+    "shapeid INTEGER NOT NULL," \
+    "event_id INTEGER NOT NULL," \
+    "xmin REAL," \
+    "ymin REAL," \
+    "xmax REAL," \
+    "ymax REAL)"
+
+#define GEODB_SQL_CREATE_EVENT_TABLE_UK \
+    "CREATE INDEX IF NOT EXISTS %s_uk ON %s(shapeid, event_id)"
+
+#define GEODB_SQL_CREATE_EVENT_TABLE_EK \
+    "CREATE INDEX IF NOT EXISTS %s_ek ON %s(event_id)"
+
+// %s = rtree index_table
+#define GEODB_SQL_CREATE_RTREE_TABLE \
+    "CREATE VIRTUAL TABLE IF NOT EXISTS %s USING rtree(shapeid, xmin, xmax, ymin, ymax)"
+
+// %s, %s = rtree index_table, shape_table
+#define GEODB_SQL_LOAD_RTREE_TABLE \
+    "INSERT INTO %s(shapeid, xmin, xmax, ymin, ymax)" \
+    " SELECT shapeid, xmin, xmax, ymin, ymax FROM %s WHERE xmin IS NOT NULL"
+
+/**
+ * 保持 R*Tree 与图层空间表同步的触发器:
+ *   %s_ins, %s, %s = shape_table, shape_table, rtree index_table
+ */
+#define GEODB_SQL_CREATE_RTREE_TRIGGER_INS \
+    "CREATE TRIGGER IF NOT EXISTS %s_ins AFTER INSERT ON %s BEGIN" \
+    " INSERT INTO %s(shapeid, xmin, xmax, ymin, ymax)" \
+    " SELECT NEW.shapeid, NEW.xmin, NEW.xmax, NEW.ymin, NEW.ymax WHERE NEW.xmin IS NOT NULL;" \
+    " END"
+
+// %s, %s, %s, %s = shape_table, shape_table, rtree index_table, rtree index_table
+#define GEODB_SQL_CREATE_RTREE_TRIGGER_UPD \
+    "CREATE TRIGGER IF NOT EXISTS %s_upd AFTER UPDATE OF shapeid, xmin, ymin, xmax, ymax ON %s BEGIN" \
+    " DELETE FROM %s WHERE shapeid = OLD.shapeid;" \
+    " INSERT INTO %s(shapeid, xmin, xmax, ymin, ymax)" \
+    " SELECT NEW.shapeid, NEW.xmin, NEW.xmax, NEW.ymin, NEW.ymax WHERE NEW.xmin IS NOT NULL;" \
+    " END"
+
+// %s, %s, %s = shape_table, shape_table, rtree index_table
+#define GEODB_SQL_CREATE_RTREE_TRIGGER_DEL \
+    "CREATE TRIGGER IF NOT EXISTS %s_del AFTER DELETE ON %s BEGIN" \
+    " DELETE FROM %s WHERE shapeid = OLD.shapeid;" \
+    " END"
+
+
 typedef struct geodb_layer_t
 {
     int layer_id;
-    char layer_name[GEODB_NAME_MAXLEN + 1];
+    char layer_name[GEODB_NAMELEN_MAX + 1];
 
-    char table_space[GEODB_NAME_MAXLEN + 1];
-    char table_owner[GEODB_NAME_MAXLEN + 1];
+    char table_space[GEODB_NAMELEN_MAX + 1];
+    char table_owner[GEODB_NAMELEN_MAX + 1];
 
-    char user_table[GEODB_NAME_MAXLEN + 1];
-    char col_userid[GEODB_NAME_MAXLEN + 1];
-    char col_shapeid[GEODB_NAME_MAXLEN + 1];
-    char col_updatetime[GEODB_NAME_MAXLEN + 1];
+    char user_table[GEODB_NAMELEN_MAX + 1];
+    char col_userid[GEODB_NAMELEN_MAX + 1];
+    char col_shapeid[GEODB_NAMELEN_MAX + 1];
+    char col_updatetime[GEODB_NAMELEN_MAX + 1];
 
-    char shape_table[GEODB_NAME_MAXLEN + 1];
-    char index_table[GEODB_NAME_MAXLEN + 1];
-    char event_table[GEODB_NAME_MAXLEN + 1];
+    char shape_table[GEODB_NAMELEN_MAX + 1];
+    char index_table[GEODB_NAMELEN_MAX + 1];
+    char event_table[GEODB_NAMELEN_MAX + 1];
 
-    char shape_type[GEODB_NAME_MAXLEN + 1];
+    int shape_type;
     char shape_encode[10];
 
+    // geodb_index_grid or geodb_index_rtree (by index_table)
+    geodb_index_mode index_mode;
+
     int64_t next_shapeid;
 
     int level_min;
@@ -145,7 +302,7 @@ typedef struct geodb_layer_t
     double mmin;
     double mmax;
 
-    char coordref[GEODB_NAME_MAXLEN + 1];
+    char coordref[GEODB_NAMELEN_MAX + 1];
     char description[256];
 
     double create_time;
@@ -153,8 +310,50 @@ typedef struct geodb_layer_t
 } * geodb_layer;
 
 
+typedef struct shape_filter_t
+{
+    // filter box
+    double xmin;
+    double ymin;
+    double xmax;
+    double ymax;
+
+    // called for each shape whose MBR overlaps filter box. stop query if returns not 0
+    int (*on_shape)(int64_t shapeid, void *userarg);
+    void *userarg;
+} * shape_filter;
+
 
+/**
+ * 计算 env(xmin, ymin, xmax, ymax) 在第 level 级网格中覆盖的网格范围 [ix0, ix1] x [iy0, iy1].
+ *   网格划分的是图层范围 (layer xmin, ymin, xmax, ymax).
+ */
+STATIC_INLINE void geodb_grid_cells(const double layerBox[4], int level, const double env[4], int *ix0, int *iy0, int *ix1, int *iy1)
+{
+    int n = 1 << level;
+    double cw = (layerBox[2] - layerBox[0]) / n;
+    double ch = (layerBox[3] - layerBox[1]) / n;
 
+    if (cw > 0) {
+        *ix0 = (int) floor((env[0] - layerBox[0]) / cw);
+        *ix1 = (int) floor((env[2] - layerBox[0]) / cw);
+    } else {
+        *ix0 = *ix1 = 0;
+    }
+
+    if (ch > 0) {
+        *iy0 = (int) floor((env[1] - layerBox[1]) / ch);
+        *iy1 = (int) floor((env[3] - layerBox[1]) / ch);
+    } else {
+        *iy0 = *iy1 = 0;
+    }
+
+    // xmax, ymax fall into the last cell
+    *ix0 = (*ix0 < 0)? 0 : ((*ix0 >= n)? n - 1 : *ix0);
+    *ix1 = (*ix1 < 0)? 0 : ((*ix1 >= n)? n - 1 : *ix1);
+    *iy0 = (*iy0 < 0)? 0 : ((*iy0 >= n)? n - 1 : *iy0);
+    *iy1 = (*iy1 < 0)? 0 : ((*iy1 >= n)? n - 1 : *iy1);
+}
 
 
 #ifdef    __cplusplus
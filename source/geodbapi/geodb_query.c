@@ -0,0 +1,323 @@
+/**
+ * Copyright © 2024 MapAware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * @file geodb_query.c
+ * @author 350137278@qq.com
+ * @brief query layers and shapes by spatial index
+ *
+ * @version 1.0.0
+ * @since 2024-11-05 10:31:08
+ * @date 2024-11-05 17:45:22
+ *
+ * @note
+ *   图层的空间索引后端由 geodb_layers.index_table 决定:
+ *     geodb_i_$(layer_id)  -> 网格索引表 geodb_i_$(layer_id)_$(level)
+ *     geodb_r_$(layer_id)  -> sqlite R*Tree 虚表
+ *   两种后端返回相同的结果: MBR 与过滤框相交的 shapeid.
+ */
+#include "geodb_conn.h"
+#include "geodb_layer.h"
+
+
+#define GEODB_SQL_SELECT_LAYER \
+    "SELECT layer_id, layer_name, table_space, table_owner, user_table, col_userid, col_shapeid, col_updatetime," \
+    " shape_table, index_table, event_table, shape_type, shape_encode, next_shapeid, level_min, level_max," \
+    " xmin, ymin, xmax, ymax, zmin, zmax, mmin, mmax, coordref, description, createtime, updatetime" \
+    " FROM geodb_layers WHERE layer_id = ?1"
+
+
+static void column_text_copy(sqlite3_stmt *stmt, int col, char *buf, int bufsize)
+{
+    const char *text = (const char *) sqlite3_column_text(stmt, col);
+    snprintf(buf, bufsize, "%s", text? text : "");
+}
+
+
+int geodb_list_layers(geodb_conn conn, int64_t *layerids, int maxids)
+{
+    int rc, count = 0;
+    geodb_stmt stmt;
+
+    if (geodb_conn_prepare(conn, "SELECT layer_id FROM geodb_layers ORDER BY layer_id", -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    while ((rc = sqlite3_step(stmt->stmt)) == SQLITE_ROW) {
+        if (count < maxids) {
+            layerids[count] = sqlite3_column_int64(stmt->stmt, 0);
+        }
+        count++;
+    }
+
+    if (rc != SQLITE_DONE) {
+        printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(sqlite3_db_handle(stmt->stmt)));
+        count = GEODB_RES_ERR;
+    }
+
+    geodb_stmt_release(stmt);
+    return count;
+}
+
+
+int geodb_layer_open(geodb_conn conn, int64_t layerid, geodb_layer *outlayer)
+{
+    int rc;
+    geodb_stmt stmt;
+    sqlite3_stmt *pstmt;
+    geodb_layer layer;
+
+    if (geodb_conn_prepare(conn, GEODB_SQL_SELECT_LAYER, -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+    pstmt = stmt->stmt;
+
+    sqlite3_bind_int64(pstmt, 1, layerid);
+
+    rc = sqlite3_step(pstmt);
+    if (rc != SQLITE_ROW) {
+        if (rc == SQLITE_DONE) {
+            printf("Error: layer not found: layer_id=%lld\n", (long long) layerid);
+        } else {
+            printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(sqlite3_db_handle(pstmt)));
+        }
+        geodb_stmt_release(stmt);
+        return GEODB_RES_ERR;
+    }
+
+    layer = (geodb_layer) mem_alloc_zero(1, sizeof(struct geodb_layer_t));
+
+    layer->layer_id = sqlite3_column_int(pstmt, 0);
+    column_text_copy(pstmt, 1, layer->layer_name, sizeof(layer->layer_name));
+    column_text_copy(pstmt, 2, layer->table_space, sizeof(layer->table_space));
+    column_text_copy(pstmt, 3, layer->table_owner, sizeof(layer->table_owner));
+    column_text_copy(pstmt, 4, layer->user_table, sizeof(layer->user_table));
+    column_text_copy(pstmt, 5, layer->col_userid, sizeof(layer->col_userid));
+    column_text_copy(pstmt, 6, layer->col_shapeid, sizeof(layer->col_shapeid));
+    column_text_copy(pstmt, 7, layer->col_updatetime, sizeof(layer->col_updatetime));
+    column_text_copy(pstmt, 8, layer->shape_table, sizeof(layer->shape_table));
+    column_text_copy(pstmt, 9, layer->index_table, sizeof(layer->index_table));
+    column_text_copy(pstmt, 10, layer->event_table, sizeof(layer->event_table));
+    layer->shape_type = sqlite3_column_int(pstmt, 11);
+    column_text_copy(pstmt, 12, layer->shape_encode, sizeof(layer->shape_encode));
+    layer->next_shapeid = sqlite3_column_int64(pstmt, 13);
+    layer->level_min = sqlite3_column_int(pstmt, 14);
+    layer->level_max = sqlite3_column_int(pstmt, 15);
+    layer->xmin = sqlite3_column_double(pstmt, 16);
+    layer->ymin = sqlite3_column_double(pstmt, 17);
+    layer->xmax = sqlite3_column_double(pstmt, 18);
+    layer->ymax = sqlite3_column_double(pstmt, 19);
+    layer->zmin = sqlite3_column_double(pstmt, 20);
+    layer->zmax = sqlite3_column_double(pstmt, 21);
+    layer->mmin = sqlite3_column_double(pstmt, 22);
+    layer->mmax = sqlite3_column_double(pstmt, 23);
+    column_text_copy(pstmt, 24, layer->coordref, sizeof(layer->coordref));
+    column_text_copy(pstmt, 25, layer->description, sizeof(layer->description));
+    layer->create_time = sqlite3_column_double(pstmt, 26);
+    layer->update_time = sqlite3_column_double(pstmt, 27);
+
+    geodb_stmt_release(stmt);
+
+    if (! strncmp(layer->index_table, GEODB_TABLE_RTREE_PREFIX, sizeof(GEODB_TABLE_RTREE_PREFIX) - 1)) {
+        layer->index_mode = geodb_index_rtree;
+    } else {
+        layer->index_mode = geodb_index_grid;
+    }
+
+    if (layer->level_min < GEODB_LEVEL_MIN || layer->level_max > GEODB_LEVEL_MAX || layer->level_min > layer->level_max) {
+        printf("Error: invalid levels(%d-%d) of layer: layer_id=%lld\n", layer->level_min, layer->level_max, (long long) layerid);
+        mem_free(layer);
+        return GEODB_RES_ERR;
+    }
+
+    *outlayer = layer;
+    return GEODB_RES_SOK;
+}
+
+
+void geodb_layer_free(geodb_layer layer)
+{
+    mem_free(layer);
+}
+
+
+geodb_index_mode geodb_layer_index_mode(geodb_layer layer)
+{
+    return layer->index_mode;
+}
+
+
+void geodb_layer_get_bounds(geodb_layer layer, double bounds[4])
+{
+    bounds[0] = layer->xmin;
+    bounds[1] = layer->ymin;
+    bounds[2] = layer->xmax;
+    bounds[3] = layer->ymax;
+}
+
+
+int geodb_layer_index_size(geodb_conn conn, geodb_layer layer, int64_t *bytes)
+{
+    int ret = GEODB_RES_ERR;
+    geodb_stmt stmt;
+
+    // grid: geodb_i_X_$(level) and geodb_i_X_$(level)_uk; rtree: geodb_r_X_node, _parent, _rowid
+    if (geodb_conn_prepare(conn, "SELECT SUM(pgsize) FROM dbstat WHERE substr(name, 1, ?2) = ?1", -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    sqlite3_bind_text(stmt->stmt, 1, layer->index_table, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt->stmt, 2, (int) strlen(layer->index_table));
+
+    if (sqlite3_step(stmt->stmt) == SQLITE_ROW) {
+        *bytes = sqlite3_column_int64(stmt->stmt, 0);
+        ret = GEODB_RES_SOK;
+    }
+
+    geodb_stmt_release(stmt);
+    return ret;
+}
+
+
+int shape_filter_new(double xmin, double ymin, double xmax, double ymax,
+    int (*on_shape)(int64_t shapeid, void *userarg), void *userarg, shape_filter *outfilter)
+{
+    shape_filter filter = (shape_filter) mem_alloc_zero(1, sizeof(struct shape_filter_t));
+
+    filter->xmin = xmin;
+    filter->ymin = ymin;
+    filter->xmax = xmax;
+    filter->ymax = ymax;
+    filter->on_shape = on_shape;
+    filter->userarg = userarg;
+
+    *outfilter = filter;
+    return GEODB_RES_SOK;
+}
+
+
+void shape_filter_free(shape_filter filter)
+{
+    mem_free(filter);
+}
+
+
+static int query_shapes_step(geodb_stmt stmt, shape_filter filter)
+{
+    int rc, count = 0;
+
+    while ((rc = sqlite3_step(stmt->stmt)) == SQLITE_ROW) {
+        count++;
+        if (filter->on_shape && filter->on_shape(sqlite3_column_int64(stmt->stmt, 0), filter->userarg)) {
+            // stopped by caller
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        printf("Error: sqlite3_step: %s\n", sqlite3_errmsg(sqlite3_db_handle(stmt->stmt)));
+        count = GEODB_RES_ERR;
+    }
+
+    geodb_stmt_release(stmt);
+    return count;
+}
+
+
+static int query_shapes_rtree(geodb_conn conn, geodb_layer layer, shape_filter filter)
+{
+    char sql[512];
+    geodb_stmt stmt;
+
+    // rtree holds 32-bit float MBR (rounded outward): check with exact MBR in shape table
+    snprintf(sql, sizeof(sql),
+        "SELECT s.shapeid FROM %s r, %s s"
+        " WHERE r.xmax >= ?1 AND r.xmin <= ?3 AND r.ymax >= ?2 AND r.ymin <= ?4"
+        " AND s.shapeid = r.shapeid"
+        " AND s.xmax >= ?1 AND s.xmin <= ?3 AND s.ymax >= ?2 AND s.ymin <= ?4",
+        layer->index_table, layer->shape_table);
+
+    if (geodb_conn_prepare(conn, sql, -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    sqlite3_bind_double(stmt->stmt, 1, filter->xmin);
+    sqlite3_bind_double(stmt->stmt, 2, filter->ymin);
+    sqlite3_bind_double(stmt->stmt, 3, filter->xmax);
+    sqlite3_bind_double(stmt->stmt, 4, filter->ymax);
+
+    return query_shapes_step(stmt, filter);
+}
+
+
+static int query_shapes_grid(geodb_conn conn, geodb_layer layer, shape_filter filter)
+{
+    char sql[768];
+    geodb_stmt stmt;
+    int level, ix0, iy0, ix1, iy1;
+
+    double layerBox[4] = {layer->xmin, layer->ymin, layer->xmax, layer->ymax};
+    double filterBox[4] = {filter->xmin, filter->ymin, filter->xmax, filter->ymax};
+
+    // the finest level at which filter box covers no more than GEODB_QUERY_CELLS_MAX cells
+    for (level = layer->level_max; level > layer->level_min; level--) {
+        geodb_grid_cells(layerBox, level, filterBox, &ix0, &iy0, &ix1, &iy1);
+        if ((sqlite3_int64) (ix1 - ix0 + 1) * (iy1 - iy0 + 1) <= GEODB_QUERY_CELLS_MAX) {
+            break;
+        }
+    }
+    geodb_grid_cells(layerBox, level, filterBox, &ix0, &iy0, &ix1, &iy1);
+
+    // one index seek per column: ix = xs.ix AND iy BETWEEN iy0 AND iy1
+    snprintf(sql, sizeof(sql),
+        "WITH RECURSIVE xs(ix) AS (SELECT ?5 UNION ALL SELECT ix + 1 FROM xs WHERE ix < ?6)"
+        " SELECT s.shapeid FROM %s s WHERE s.shapeid IN ("
+        "SELECT i.shapeid FROM xs, %s_%d i WHERE i.ix = xs.ix AND i.iy BETWEEN ?7 AND ?8"
+        " UNION ALL SELECT shapeid FROM %s_%d WHERE ix = %d AND iy = %d)"
+        " AND s.xmax >= ?1 AND s.xmin <= ?3 AND s.ymax >= ?2 AND s.ymin <= ?4",
+        layer->shape_table, layer->index_table, level, layer->index_table, level, GEODB_GRID_OVERSIZE, GEODB_GRID_OVERSIZE);
+
+    if (geodb_conn_prepare(conn, sql, -1, &stmt) != GEODB_RES_SOK) {
+        return GEODB_RES_ERR;
+    }
+
+    sqlite3_bind_double(stmt->stmt, 1, filter->xmin);
+    sqlite3_bind_double(stmt->stmt, 2, filter->ymin);
+    sqlite3_bind_double(stmt->stmt, 3, filter->xmax);
+    sqlite3_bind_double(stmt->stmt, 4, filter->ymax);
+    sqlite3_bind_int(stmt->stmt, 5, ix0);
+    sqlite3_bind_int(stmt->stmt, 6, ix1);
+    sqlite3_bind_int(stmt->stmt, 7, iy0);
+    sqlite3_bind_int(stmt->stmt, 8, iy1);
+
+    return query_shapes_step(stmt, filter);
+}
+
+
+int geodb_query_shapes(geodb_conn conn, geodb_layer layer, shape_filter filter)
+{
+    if (layer->index_mode == geodb_index_rtree) {
+        return query_shapes_rtree(conn, layer, filter);
+    }
+    return query_shapes_grid(conn, layer, filter);
+}
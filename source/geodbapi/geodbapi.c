@@ -27,46 +27,38 @@
  *
  * @version 1.0.2
  * @create     2013-04-24
- * @date 2024-11-02 02:09:40
+ * @date 2024-11-04 16:10:05
  */
-#include "geodbapi_i.h"
-
-
-static int on_next_row(void* userarg, int column_size, char* column_value[], char* column_name[])
-{
-    int i;
-
-    for (i = 0; i < column_size; i++) {
-        printf("%s = %s\n", column_name[i], (char*)column_value[i]);
-    }
-    printf("----\n");
-    return 0;
-}
+#include "geodb_conn.h"
 
 
 int geodb_context_open(const char* dbfile)
 {
-    int ret, flags;
-    char * err;
+    int ret;
+    geodb_conn conn = 0;
+    geodb_stmt stmt = 0;
+    sqlite3_stmt *pstmt;
 
-    ret = sqlite3_config(SQLITE_CONFIG_MULTITHREAD);
-
-    ret = sqlite3_initialize();
-
-    flags = SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_FULLMUTEX | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_SHAREDCACHE;
-
-    sqlite3 *geodb = 0;
-    ret = sqlite3_open_v2(dbfile, &geodb, flags, 0);
+    ret = geodb_conn_new(0, &conn);
+    if (ret != GEODB_RES_SOK) {
+        return ret;
+    }
 
-    ret = sqlite3_key_v2(geodb, 0, "pass", 4);
+    ret = geodb_conn_open(conn, dbfile, GEODB_OPEN_READWRITE | GEODB_OPEN_CREATE);
+    if (ret == GEODB_RES_SOK) {
+        ret = geodb_conn_prepare(conn, "SELECT layer_id, layer_name, shape_table FROM geodb_layers", -1, &stmt);
+        if (ret == GEODB_RES_SOK) {
+            pstmt = (sqlite3_stmt *) geodb_stmt_handle(stmt);
 
-    err = 0;
-    ret = sqlite3_exec(geodb, "select * from abc", on_next_row, 0 /* userdata */, &err);
-    if (err) {
-        sqlite3_free(err);
+            while (sqlite3_step(pstmt) == SQLITE_ROW) {
+                printf("layer_id = %lld, layer_name = %s, shape_table = %s\n",
+                    (long long) sqlite3_column_int64(pstmt, 0), sqlite3_column_text(pstmt, 1), sqlite3_column_text(pstmt, 2));
+            }
+            geodb_stmt_release(stmt);
+        }
+        geodb_conn_release_reader(conn);
     }
 
-
-    ret = sqlite3_close_v2(geodb);
+    geodb_conn_free(conn);
     return ret;
-}
\ No newline at end of file
+}
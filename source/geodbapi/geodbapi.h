@@ -53,6 +53,17 @@ extern "C" {
 
 #define GEODB_NAMELEN_MAX    30
 
+#define GEODB_RES_SOK      0
+#define GEODB_RES_ERR    (-1)
+
+// openflags for geodb_conn_open()
+#define GEODB_OPEN_READONLY    0x00
+#define GEODB_OPEN_READWRITE   0x01
+#define GEODB_OPEN_CREATE      0x02
+
+// max read connections (worker threads) per geodb_conn
+#define GEODB_READERS_MAX      64
+
 
 
 typedef struct geodb_attr_t     * geodb_attr;
@@ -65,10 +76,33 @@ typedef struct shape_filter_t   * shape_filter;
 
 
 typedef enum {
-    conn_attr = 0
+    conn_attr = 0,
+    conn_attr_cipher,       // bytes: cipher name (sqlite3mc)
+    conn_attr_key,          // bytes: passphrase. empty for unencrypted database (fast path)
+    conn_attr_cache_size,   // integer: page cache KB per connection
+    conn_attr_mmap_size,    // integer: mmap bytes (unencrypted database only)
+    conn_attr_pin_index     // integer: 1 to preload spatial index pages on each read connection
 } geodb_attr_name;
 
 
+// spatial index backend of layer (geodb_layers.index_table)
+typedef enum {
+    geodb_index_grid = 0,   // geodb_i_$(layer_id)_$(level)
+    geodb_index_rtree = 1   // geodb_r_$(layer_id): sqlite R*Tree virtual table
+} geodb_index_mode;
+
+
+// dirty tiles [tx0, tx1] x [ty0, ty1] at zoom. ty counts from ymin of tile bounds
+typedef struct geodb_tilerange_t
+{
+    int zoom;
+    int tx0;
+    int ty0;
+    int tx1;
+    int ty1;
+} geodb_tilerange;
+
+
 
 
 
@@ -90,6 +124,20 @@ GEODBAPI int geodb_attr_get_bytes(geodb_attr attr, geodb_attr_name name, char *o
 GEODBAPI int geodb_layer_new(geodb_attr attr, geodb_layer *layer);
 GEODBAPI void geodb_layer_free(geodb_layer layer);
 
+// layer_id of all layers in geodb. returns number of layers (may > maxids), or GEODB_RES_ERR
+GEODBAPI int geodb_list_layers(geodb_conn dbconn, int64_t *layerids, int maxids);
+
+// read layer from geodb_layers by layer_id
+GEODBAPI int geodb_layer_open(geodb_conn dbconn, int64_t layerid, geodb_layer *layer);
+
+GEODBAPI geodb_index_mode geodb_layer_index_mode(geodb_layer layer);
+
+// bounds: xmin, ymin, xmax, ymax
+GEODBAPI void geodb_layer_get_bounds(geodb_layer layer, double bounds[4]);
+
+// bytes of spatial index of layer (needs dbstat)
+GEODBAPI int geodb_layer_index_size(geodb_conn dbconn, geodb_layer layer, int64_t *bytes);
+
 
 // geodb_coldef API
 GEODBAPI int geodb_coldef_new(geodb_attr attr, geodb_coldef *coldef);
@@ -100,20 +148,58 @@ GEODBAPI void geodb_coldef_free(geodb_coldef coldef);
 GEODBAPI int geodb_stmt_new(geodb_attr attr, geodb_stmt *stmt);
 GEODBAPI int geodb_stmt_free(geodb_stmt stmt);
 
+// reset statement and give it back to the cache of its reader
+GEODBAPI void geodb_stmt_release(geodb_stmt stmt);
+
+// returns sqlite3_stmt *
+GEODBAPI void * geodb_stmt_handle(geodb_stmt stmt);
+
 
 // geodb_conn API
 GEODBAPI int geodb_conn_new(geodb_attr attr, geodb_conn *dbconn);
+
+// dbconn is not freed if geodb_conn_close fails
 GEODBAPI void geodb_conn_free(geodb_conn dbconn);
 
 GEODBAPI int geodb_conn_open(geodb_conn dbconn, const char *main_dbfile, int openflags);
+
+/**
+ * geodb_conn_close
+ *   close database and all read connections. fails (GEODB_RES_ERR) if any
+ *   read connection is still bound to another thread: such threads must call
+ *   geodb_conn_release_reader() or exit first.
+ */
 GEODBAPI int geodb_conn_close(geodb_conn dbconn);
 
+/**
+ * geodb_conn_rekey
+ *   encrypt (or decrypt if keylen = 0) database opened with GEODB_OPEN_READWRITE.
+ *   all read connections of dbconn are closed, and use the new key from now on.
+ */
+GEODBAPI int geodb_conn_rekey(geodb_conn dbconn, const char *cipher, const char *key, int keylen);
+
 GEODBAPI int geodb_attach_db(geodb_conn dbconn, const char *dbfile, const char *dbname);
 GEODBAPI int geodb_detach_db(geodb_conn dbconn, const char *dbname);
 
 GEODBAPI int geodb_execute_stmt(geodb_conn dbconn, geodb_stmt stmt);
 GEODBAPI int geodb_execute_sql(geodb_conn dbconn, const char *sql, int sqllen);
 
+/**
+ * geodb_conn_prepare
+ *   get a prepared statement from the read connection of calling thread.
+ *   the read connection is bound to calling thread at first call, and
+ *   statements are cached in it by sql text. must be released by
+ *   geodb_stmt_release() in the same thread.
+ */
+GEODBAPI int geodb_conn_prepare(geodb_conn dbconn, const char *sql, int sqllen, geodb_stmt *stmt);
+
+/**
+ * geodb_conn_release_reader
+ *   give back the read connection of calling thread to pool.
+ *   (called automatically at thread exit)
+ */
+GEODBAPI void geodb_conn_release_reader(geodb_conn dbconn);
+
 GEODBAPI int geodb_query_layers(geodb_conn dbconn, const char *dbname, const char *whereSQL, int *layerid);
 
 
@@ -123,8 +209,60 @@ GEODBAPI void geodb_shape_free(geodb_shape shape);
 
 
 // shape_filter API
+GEODBAPI int shape_filter_new(double xmin, double ymin, double xmax, double ymax,
+    int (*on_shape)(int64_t shapeid, void *userarg), void *userarg, shape_filter *filter);
+GEODBAPI void shape_filter_free(shape_filter filter);
+
+/**
+ * geodb_query_shapes
+ *   find shapes whose MBR overlaps filter box, by the index backend the layer declares.
+ * Returns:
+ *   number of shapes passed to filter->on_shape, or GEODB_RES_ERR(-1)
+ */
 GEODBAPI int geodb_query_shapes(geodb_conn dbconn, geodb_layer layer, shape_filter filter);
 
+// geodb_events API
+
+// largest event_id in geodb_events, 0 if no event
+GEODBAPI int geodb_events_last_id(geodb_conn dbconn, int64_t *eventid);
+
+/**
+ * geodb_events_dirty_tiles
+ *   collect shapes of all layers changed by events in [event_first, event_last] (geodb_e_$(layer_id)),
+ *   and coalesce their MBRs into dirty tile ranges for each zoom in [zoom_min, zoom_max].
+ *   at zoom z the tile bounds are divided into 2^z x 2^z tiles.
+ *
+ *   tileBounds: xmin, ymin, xmax, ymax of tile pyramid. NULL for bounds of each layer
+ *   on_dirty_layer: called once per changed layer. bounds is the union of affected MBRs,
+ *     ranges may overlap each other but cover only dirty tiles. stop if returns not 0
+ *
+ * Returns:
+ *   number of changed layers, or GEODB_RES_ERR(-1)
+ */
+GEODBAPI int geodb_events_dirty_tiles(geodb_conn dbconn, int64_t event_first, int64_t event_last,
+    const double tileBounds[4], int zoom_min, int zoom_max,
+    int (*on_dirty_layer)(int64_t layerid, const double bounds[4], int numranges, const geodb_tilerange *ranges, void *userarg),
+    void *userarg);
+
+// geodb_import API
+
+/**
+ * geodb_import_shpfile
+ *   import all shapes of shpfile into geodbfile as a new layer:
+ *     geodb_layers, geodb_s_$(layer_id), geodb_i_$(layer_id)_$(level), geodb_e_$(layer_id)
+ *
+ *   layername: NULL for basename of shpfile
+ *   indexmode: geodb_index_grid or geodb_index_rtree
+ *   level_min, level_max: grid index levels [GEODB_LEVEL_MIN, GEODB_LEVEL_MAX]
+ *   batchrows: shapes per transaction (<= 0 for default)
+ *   layerid: returns layer_id of new layer if success
+ *
+ * Returns:
+ *   GEODB_RES_SOK(0) or GEODB_RES_ERR(-1)
+ */
+GEODBAPI int geodb_import_shpfile(const char *geodbfile, const char *shpfile, const char *layername,
+    geodb_index_mode indexmode, int level_min, int level_max, int batchrows, int64_t *layerid);
+
 /////////////////////////////////////////////////////////////
 
 GEODBAPI int geodb_context_open(const char *dbfile);
@@ -26,10 +26,10 @@
  *
  * @author mapaware@hotmail.com
  * @copyright © 2024-2030 mapaware.top All Rights Reserved.
- * @version 0.0.5
+ * @version 0.0.6
  *
  * @since 2024-09-29 10:20:21
- * @date 2024-10-29 01:40:06
+ * @date 2024-11-09 17:36:05
  *
  * @note
  *
@@ -42,6 +42,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "maprender.h"
+
 // SDL
 #if defined(_MSC_VER)
   // link to SDL2.lib and SDL2.dll required
@@ -56,6 +58,24 @@
 #endif
 
 
+#define MAPAWARE_WINDOW_WIDTH    1280
+#define MAPAWARE_WINDOW_HEIGHT    800
+
+// 事件等待超时, 约 60 fps
+#define MAPAWARE_WAIT_EVENT_MS     16
+
+// 每多少帧输出一次帧时间统计
+#define MAPAWARE_STATS_FRAMES     120
+
+#define MAPAWARE_ZOOM_STEP        1.25
+
+// 滚轮停止多少毫秒后认为缩放结束, 提交精画请求
+#define MAPAWARE_ZOOM_SETTLE_MS   150
+
+// 数据坐标精度 (ViewportInitAll)
+#define MAPAWARE_DATA_PRECISION   1e-6
+
+
 FILE *log_file = NULL;
 
 // 自定义日志回调函数，将日志输出到指定文件
@@ -79,26 +99,149 @@ void SdlLogCallback(void* userdata, int category, SDL_LogPriority priority, cons
 }
 
 
+/**
+ * 帧时间统计: 主线程每帧耗时和渲染线程每帧耗时
+ */
+typedef struct
+{
+    Uint64 freq;
+
+    int frames;
+    double frameMsSum;
+    double frameMsMax;
+
+    int rendered;
+    double renderMsSum;
+    double renderMsMax;
+    double latencyMsSum;
+    int latencies;
+
+    int tiles;
+    int newTiles;
+    int coarse;
+    int timedout;
+} FrameStats;
+
+
+static void FrameStatsLog(FrameStats *stats)
+{
+    SDL_Log("frame: %d presented avg %.2f ms max %.2f ms; render: %d frames avg %.1f ms max %.1f ms, latency avg %.1f ms; tiles: %d (%d rendered); coarse: %d (%d timed out)",
+        stats->frames, stats->frameMsSum / stats->frames, stats->frameMsMax,
+        stats->rendered,
+        stats->rendered? stats->renderMsSum / stats->rendered : 0.0,
+        stats->renderMsMax,
+        stats->latencies? stats->latencyMsSum / stats->latencies : 0.0,
+        stats->tiles, stats->newTiles, stats->coarse, stats->timedout);
+
+    stats->frames = 0;
+    stats->frameMsSum = 0;
+    stats->frameMsMax = 0;
+    stats->rendered = 0;
+    stats->renderMsSum = 0;
+    stats->renderMsMax = 0;
+    stats->latencyMsSum = 0;
+    stats->latencies = 0;
+    stats->tiles = 0;
+    stats->newTiles = 0;
+    stats->coarse = 0;
+    stats->timedout = 0;
+}
+
+
+static Uint32 frameReadyEvent = (Uint32) -1;
+
+// 渲染线程回调: 唤醒主线程事件循环
+static void OnFrameReady(void *userarg)
+{
+    SDL_Event ev;
+    SDL_zero(ev);
+    ev.type = frameReadyEvent;
+    SDL_PushEvent(&ev);
+}
+
+
+/**
+ * 已完成帧按其渲染时的视口画在当前视口中 (平移或缩放), 直到新帧到达
+ */
+static void FrameDestRect(const Viewport2D *frameVp, const Viewport2D *curVp, SDL_FRect *dst)
+{
+    CGBox2D dataBox, viewBox;
+
+    ViewToDataBox(frameVp, frameVp->viewBox, &dataBox);
+    DataToViewBox(curVp, dataBox, &viewBox);
+
+    dst->x = (float) viewBox.Xmin;
+    dst->y = (float) viewBox.Ymin;
+    dst->w = (float) (viewBox.Xmax - viewBox.Xmin);
+    dst->h = (float) (viewBox.Ymax - viewBox.Ymin);
+}
+
+
+static int UploadFrame(SDL_Renderer *ren, SDL_Texture **tex, int *texW, int *texH, const MapRenderFrame *frame)
+{
+    int y;
+    void *pixels;
+    int pitch;
+
+    if (! *tex || *texW != frame->width || *texH != frame->height) {
+        if (*tex) {
+            SDL_DestroyTexture(*tex);
+        }
+
+        // cairo ARGB32 is native-endian 32-bit ARGB
+        *tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, frame->width, frame->height);
+        if (! *tex) {
+            SDL_Log("SDL_CreateTexture error: %s", SDL_GetError());
+            return -1;
+        }
+        *texW = frame->width;
+        *texH = frame->height;
+    }
+
+    if (SDL_LockTexture(*tex, NULL, &pixels, &pitch) != 0) {
+        SDL_Log("SDL_LockTexture error: %s", SDL_GetError());
+        return -1;
+    }
+
+    for (y = 0; y < frame->height; y++) {
+        memcpy((char *) pixels + (size_t) y * pitch, frame->pixels + (size_t) y * frame->stride, (size_t) frame->width * 4);
+    }
+
+    SDL_UnlockTexture(*tex);
+    return 0;
+}
+
+
 /**
  * MapAware 程序主入口
  *    sdl2.dll 必须放在本程序目录下
+ *
+ *   $ mapaware [/path/to/maplayers.cfg] [MAPID]
+ *
+ *   鼠标左键拖动平移, 滚轮缩放 (缩放中先显示粗帧), Home 全图, Esc 退出
  */
 #undef main
 
 int main(int argc, char * argv[])
 {
-    // 背景图片: earth.bmp 放在本程序的同目录下
+    // 图层配置: 默认 maplayers.cfg 放在本程序的同目录下
     char path[256];
-    snprintf(path, 255, "%s", argv[0]);
-    if (strrchr(path, '/')) {
-        *strrchr(path, '/') = '\0';
-        strcat(path, "/earth.bmp");
-    } else if (strrchr(path, '\\')) {
-        *strrchr(path, '\\') = '\0';
-        strcat(path, "\\earth.bmp");
+    const char *mapid = (argc > 2)? argv[2] : "default";
+
+    if (argc > 1) {
+        snprintf(path, sizeof(path), "%s", argv[1]);
     } else {
-        // bad path
-        return -1;
+        snprintf(path, 255, "%s", argv[0]);
+        if (strrchr(path, '/')) {
+            *strrchr(path, '/') = '\0';
+            strcat(path, "/maplayers.cfg");
+        } else if (strrchr(path, '\\')) {
+            *strrchr(path, '\\') = '\0';
+            strcat(path, "\\maplayers.cfg");
+        } else {
+            // bad path
+            return -1;
+        }
     }
     path[255] = '\0';
 
@@ -108,29 +251,44 @@ int main(int argc, char * argv[])
 
     // 设置自定义的日志回调函数
     SDL_LogSetOutputFunction(SdlLogCallback, NULL);
-    SDL_Log("BMP FILE: %s", path);
+    SDL_Log("MAPLAYERS FILE: %s [map:%s]", path, mapid);
+
+    frameReadyEvent = SDL_RegisterEvents(1);
+    if (frameReadyEvent == (Uint32) -1) {
+        SDL_Log("SDL_RegisterEvents error: %s", SDL_GetError());
+        SDL_Quit();
+        return 1;
+    }
+
+    MapRenderer renderer;
+    if (MapRendererStart(&renderer, path, mapid, OnFrameReady, NULL) != 0) {
+        SDL_Log("MapRendererStart failed: %s", path);
+        SDL_Quit();
+        return 1;
+    }
 
     SDL_Window * win = NULL;
 
-    SDL_Log("SDL_CreateWindow flags=SDL_WINDOW_OPENGL | SDL_WINDOW_FULLSCREEN_DESKTOP");
-    win = SDL_CreateWindow("sdlWindow",
+    SDL_Log("SDL_CreateWindow flags=SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI");
+    win = SDL_CreateWindow("MapAware",
                 SDL_WINDOWPOS_CENTERED,  // 居中
                 SDL_WINDOWPOS_CENTERED,
-                640, 480,
-                SDL_WINDOW_OPENGL | SDL_WINDOW_FULLSCREEN_DESKTOP);  //  SDL_WINDOW_RESIZABLE
+                MAPAWARE_WINDOW_WIDTH, MAPAWARE_WINDOW_HEIGHT,
+                SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
 
     if (! win) {
         SDL_Log("SDL_CreateWindow error: %s", SDL_GetError());
 
         // 第一次失败，则用不同的参数二次调用创建窗口
-        SDL_Log("SDL_CreateWindow flags=SDL_WINDOW_FULLSCREEN_DESKTOP");
-        win = SDL_CreateWindow("sdlWindow",
+        SDL_Log("SDL_CreateWindow flags=SDL_WINDOW_RESIZABLE");
+        win = SDL_CreateWindow("MapAware",
                 SDL_WINDOWPOS_CENTERED,  // 居中
                 SDL_WINDOWPOS_CENTERED,
-                640, 480,
-                SDL_WINDOW_FULLSCREEN_DESKTOP);  //  SDL_WINDOW_RESIZABLE
+                MAPAWARE_WINDOW_WIDTH, MAPAWARE_WINDOW_HEIGHT,
+                SDL_WINDOW_RESIZABLE);
         if (! win) {
             SDL_Log("SDL_CreateWindow error: %s", SDL_GetError());
+            MapRendererStop(&renderer);
             SDL_Quit();
             return 1;
         }
@@ -152,6 +310,7 @@ int main(int argc, char * argv[])
         if (! ren) {
             SDL_Log("SDL_CreateRenderer error: %s\n", SDL_GetError());
             SDL_DestroyWindow(win);
+            MapRendererStop(&renderer);
             SDL_Quit();
             return 1;
         }
@@ -159,53 +318,198 @@ int main(int argc, char * argv[])
         SDL_Log("SDL_CreateRenderer ok\n");
     }
 
-    // 加载图片做窗口背景
-    SDL_Surface *bmp = SDL_LoadBMP(path);
-    if (bmp == NULL) {
-        SDL_DestroyRenderer(ren);
-        SDL_DestroyWindow(win);
-        SDL_Log("SDL_LoadBMP error: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
-    }
+    // 视口按渲染器输出像素计算 (HiDPI 下大于窗口尺寸)
+    int winW, winH, outW, outH;
+    SDL_GetWindowSize(win, &winW, &winH);
+    SDL_GetRendererOutputSize(ren, &outW, &outH);
+
+    Viewport2D viewport;
+    CGBox2D viewBox = {.Xmin = 0, .Ymin = 0, .Xmax = outW, .Ymax = outH};
+    CGSize2D viewDPI = {dpi_low_display, dpi_low_display};
+    ViewportInitAll(&viewport, renderer.dataBox, viewBox, viewDPI, MAPAWARE_DATA_PRECISION);
+
+    // 当前显示的帧
+    SDL_Texture *tex = NULL;
+    int texW = 0, texH = 0;
+    Viewport2D frameViewport;
+    int hasFrame = 0;
+
+    // 最近一次请求
+    uint64_t reqSeq = MapRendererRequest(&renderer, &viewport, outW, outH, 0);
+    Uint64 reqCounter = SDL_GetPerformanceCounter();
+    uint64_t latencySeq = 0;
+
+    FrameStats stats;
+    SDL_zero(stats);
+    stats.freq = SDL_GetPerformanceFrequency();
+
+    int quit = 0, dragging = 0, viewChanged = 0, redraw = 1;
+
+    // 缩放手势: css_bitflag_zoomin or css_bitflag_zoomout, 0 if none
+    int zoomFlags = 0;
+    Uint32 zoomTicks = 0;
+
+    while (! quit) {
+        SDL_Event ev;
+
+        if (SDL_WaitEventTimeout(&ev, MAPAWARE_WAIT_EVENT_MS)) {
+            do {
+                float pixelRatio = winW > 0? (float) outW / winW : 1.0f;
+
+                if (ev.type == frameReadyEvent) {
+                    redraw = 1;
+                    continue;
+                }
+
+                switch (ev.type) {
+                case SDL_QUIT:
+                    quit = 1;
+                    break;
+
+                case SDL_WINDOWEVENT:
+                    if (ev.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        SDL_GetWindowSize(win, &winW, &winH);
+                        SDL_GetRendererOutputSize(ren, &outW, &outH);
+                        ViewportResizeView(&viewport, 0, 0, outW, outH);
+                        viewChanged = 1;
+                    }
+                    redraw = 1;
+                    break;
+
+                case SDL_MOUSEBUTTONDOWN:
+                    if (ev.button.button == SDL_BUTTON_LEFT) {
+                        dragging = 1;
+                    }
+                    break;
+
+                case SDL_MOUSEBUTTONUP:
+                    if (ev.button.button == SDL_BUTTON_LEFT) {
+                        dragging = 0;
+                    }
+                    break;
+
+                case SDL_MOUSEMOTION:
+                    if (dragging) {
+                        ViewportPanView(&viewport, ev.motion.xrel * pixelRatio, ev.motion.yrel * pixelRatio);
+                        viewChanged = 1;
+                    }
+                    break;
+
+                case SDL_MOUSEWHEEL:
+                    if (ev.wheel.y) {
+                        int mx, my;
+                        SDL_GetMouseState(&mx, &my);
+                        CGPoint2D at = {mx * pixelRatio, my * pixelRatio};
+                        ViewportZoomAt(&viewport, at, ev.wheel.y > 0? MAPAWARE_ZOOM_STEP : 1.0 / MAPAWARE_ZOOM_STEP);
+                        zoomFlags = ev.wheel.y > 0? css_bitflag_zoomin : css_bitflag_zoomout;
+                        zoomTicks = SDL_GetTicks();
+                        viewChanged = 1;
+                    }
+                    break;
+
+                case SDL_KEYDOWN:
+                    if (ev.key.keysym.sym == SDLK_ESCAPE) {
+                        quit = 1;
+                    } else if (ev.key.keysym.sym == SDLK_HOME) {
+                        ViewportZoomAll(&viewport, 1.0);
+                        viewChanged = 1;
+                    }
+                    break;
+                }
+            } while (SDL_PollEvent(&ev));
+        }
 
-    // To use a hardware accelerated texture for rendering we can create one from
-    // the surface we loaded
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(ren, bmp);
+        Uint64 t0 = SDL_GetPerformanceCounter();
 
-    // We no longer need the surface
-    SDL_FreeSurface(bmp);
-    if (tex == NULL){
-        SDL_DestroyRenderer(ren);
-        SDL_DestroyWindow(win);
-        SDL_Log("SDL_CreateTextureFromSurface error: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
-    }
+        if (zoomFlags && ! viewChanged && SDL_GetTicks() - zoomTicks >= MAPAWARE_ZOOM_SETTLE_MS) {
+            // 缩放停止: 精画
+            zoomFlags = 0;
+            viewChanged = 1;
+        }
+
+        if (viewChanged) {
+            // 只提交最新视口, 渲染线程丢弃未开始的旧请求. 缩放中只要粗帧
+            reqSeq = MapRendererRequest(&renderer, &viewport, outW, outH, zoomFlags);
+            reqCounter = t0;
+            viewChanged = 0;
+            redraw = 1;
+        }
+
+        MapRenderFrame *frame = MapRendererTakeFrame(&renderer);
+        if (frame) {
+            if (UploadFrame(ren, &tex, &texW, &texH, frame) == 0) {
+                frameViewport = frame->viewport;
+                hasFrame = 1;
+
+                stats.rendered++;
+                stats.renderMsSum += frame->renderMs;
+                if (frame->renderMs > stats.renderMsMax) {
+                    stats.renderMsMax = frame->renderMs;
+                }
+                stats.tiles += frame->numTiles;
+                stats.newTiles += frame->newTiles;
+                if (frame->drawFlags) {
+                    stats.coarse++;
+                    if (frame->drawStatus == draw_job_timedout) {
+                        stats.timedout++;
+                    }
+                }
+
+                // first frame of latest request (cached tiles come before rendered ones)
+                if (frame->seq == reqSeq && latencySeq != reqSeq) {
+                    stats.latencyMsSum += (double) (t0 - reqCounter) * 1000.0 / stats.freq;
+                    stats.latencies++;
+                    latencySeq = reqSeq;
+                }
+            }
+            MapRenderFrameFree(frame);
+            redraw = 1;
+        }
 
-    // A sleepy rendering loop, wait for 5 seconds and render and present the screen each time
-    for (int i = 0; i < 100; ++i) {
-        //First clear the renderer
+        if (! redraw) {
+            continue;
+        }
+        redraw = 0;
+
+        SDL_SetRenderDrawColor(ren, 255, 255, 255, 255);
         SDL_RenderClear(ren);
 
-        //Draw the texture
-        SDL_RenderCopy(ren, tex, NULL, NULL);
+        if (hasFrame) {
+            SDL_FRect dst;
+            FrameDestRect(&frameViewport, &viewport, &dst);
+            SDL_RenderCopyF(ren, tex, NULL, &dst);
+        }
 
-        //Update the screen
         SDL_RenderPresent(ren);
 
-        // Take a quick break after all that hard work
-        SDL_Delay(50);
+        double frameMs = (double) (SDL_GetPerformanceCounter() - t0) * 1000.0 / stats.freq;
+        stats.frames++;
+        stats.frameMsSum += frameMs;
+        if (frameMs > stats.frameMsMax) {
+            stats.frameMsMax = frameMs;
+        }
+        if (stats.frames == MAPAWARE_STATS_FRAMES) {
+            FrameStatsLog(&stats);
+        }
+    }
+
+    if (stats.frames) {
+        FrameStatsLog(&stats);
     }
 
     //Clean up our objects and quit
-    SDL_DestroyTexture(tex);
+    MapRendererStop(&renderer);
+    shapeFileCacheTrim();
+
+    if (tex) {
+        SDL_DestroyTexture(tex);
+    }
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(win);
 
-    SDL_Log("sdlWindow app exit with 0");
+    SDL_Log("MapAware app exit with 0");
 
     SDL_Quit();
 
     return 0;
-}
\ No newline at end of file
+}
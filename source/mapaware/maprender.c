@@ -0,0 +1,1027 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file maprender.c
+ * @brief render map layers on a background thread.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.2
+ *
+ * @since 2024-11-08 09:30:12
+ * @date 2024-11-09 17:36:05
+ *
+ * @note
+ */
+#include "maprender.h"
+
+#include <common/timeut.h>
+
+#include <errno.h>
+
+
+// 视口内或预取的一个瓦片
+typedef struct
+{
+    int tx;
+    int ty;
+
+    // distance to center of view in tiles
+    double dist;
+
+    // referenced surface of tile, NULL if not rendered
+    cairo_surface_t *surface;
+} MapTileSlot;
+
+
+static int MapTileSlotCmp(const void *a, const void *b)
+{
+    double d = ((const MapTileSlot *) a)->dist - ((const MapTileSlot *) b)->dist;
+    return d < 0? -1 : (d > 0? 1 : 0);
+}
+
+
+static void MapRenderLayerDraw(MapRenderLayer *layer, cairoDrawCtx *CDC, drawJob *job)
+{
+    // default style for layer without stylefile, not style of previous layer
+    cairoDrawCtxSetStyle(CDC, layer->styleKeys, layer->data->styleclass);
+
+    if (layer->projEntry) {
+        shapeProjEntryDrawJob(layer->projEntry, CDC, job);
+    } else {
+        shapeFileInfoDrawJob(&layer->shpEntry->shpInfo, CDC, job);
+    }
+}
+
+
+// a newer request arrived (or quit): stop rendering tiles for seq
+static int MapRendererIsStale(MapRenderer *renderer, uint64_t seq)
+{
+    int stale;
+    pthread_mutex_lock(&renderer->lock);
+    stale = renderer->quit || renderer->reqSeq != seq;
+    pthread_mutex_unlock(&renderer->lock);
+    return stale;
+}
+
+
+static cairo_surface_t * MapRendererDrawTile(MapRenderer *renderer, const MapTileGrid *grid, const Viewport2D *viewport, int tx, int ty)
+{
+    int i;
+    cairoDrawCtx CDC;
+    cairo_surface_t *surface;
+
+    // transparent
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, MAPTILE_SIZE, MAPTILE_SIZE);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        printf("Error: cairo_image_surface_create(%d, %d)\n", MAPTILE_SIZE, MAPTILE_SIZE);
+        cairo_surface_destroy(surface);
+        return 0;
+    }
+
+    bzero(&CDC, sizeof(CDC));
+    cssDrawStyleInit(&CDC.drawStyles);
+    CDC.surface = surface;
+    CDC.cr = cairo_create(surface);
+    MapTileGridTileViewport(grid, viewport, tx, ty, &CDC.viewport);
+
+    for (i = 0; i < renderer->numLayers; i++) {
+        MapRenderLayerDraw(&renderer->layers[i], &CDC, 0);
+    }
+
+    cairo_destroy(CDC.cr);
+    cairo_surface_flush(surface);
+
+    return surface;
+}
+
+
+// draw tile and put it into cache. returns referenced surface or NULL
+static cairo_surface_t * MapRendererCacheTile(MapRenderer *renderer, const MapTileGrid *grid, const Viewport2D *viewport, const MapTileKey *key)
+{
+    cairo_surface_t *surface = MapRendererDrawTile(renderer, grid, viewport, key->tx, key->ty);
+    if (surface) {
+        MapTileCachePut(&renderer->tileCache, key, surface);
+    }
+    return surface;
+}
+
+
+static void MapTileKeySet(MapTileKey *key, uint64_t layerset, int zoom, int tx, int ty)
+{
+    bzero(key, sizeof(MapTileKey));
+    key->layerset = layerset;
+    key->zoom = zoom;
+    key->tx = tx;
+    key->ty = ty;
+}
+
+
+/**
+ * 把已有的瓦片按当前视口拼成一帧. 瓦片边缘取整到像素, 相邻瓦片之间没有缝隙
+ */
+static MapRenderFrame * MapRenderFrameCompose(MapRenderer *renderer, const Viewport2D *viewport, int width, int height,
+    const MapTileGrid *grid, const MapTileSlot *slots, int numSlots)
+{
+    int i;
+    cairo_t *cr;
+    MapRenderFrame *frame;
+
+    frame = (MapRenderFrame *) mem_alloc_zero(1, sizeof(MapRenderFrame));
+
+    frame->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (cairo_surface_status(frame->surface) != CAIRO_STATUS_SUCCESS) {
+        printf("Error: cairo_image_surface_create(%d, %d)\n", width, height);
+        MapRenderFrameFree(frame);
+        return 0;
+    }
+
+    cr = cairo_create(frame->surface);
+
+    // background
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+
+    for (i = 0; i < numSlots; i++) {
+        CGBox2D box, view;
+        double x0, y0, x1, y1;
+
+        if (! slots[i].surface) {
+            continue;
+        }
+
+        MapTileGridTileBox(grid, slots[i].tx, slots[i].ty, &box);
+        DataToViewBox(viewport, box, &view);
+
+        x0 = floor(view.Xmin + 0.5);
+        y0 = floor(view.Ymin + 0.5);
+        x1 = floor(view.Xmax + 0.5);
+        y1 = floor(view.Ymax + 0.5);
+        if (x1 <= x0 || y1 <= y0) {
+            continue;
+        }
+
+        cairo_save(cr);
+        cairo_translate(cr, x0, y0);
+        cairo_scale(cr, (x1 - x0) / MAPTILE_SIZE, (y1 - y0) / MAPTILE_SIZE);
+        cairo_set_source_surface(cr, slots[i].surface, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+
+        frame->numTiles++;
+    }
+
+    cairo_destroy(cr);
+    cairo_surface_flush(frame->surface);
+
+    frame->pixels = cairo_image_surface_get_data(frame->surface);
+    frame->width = width;
+    frame->height = height;
+    frame->stride = cairo_image_surface_get_stride(frame->surface);
+    frame->viewport = *viewport;
+
+    for (i = 0; i < renderer->numLayers; i++) {
+        frame->numShapes += renderer->layers[i].shpEntry->shpInfo.nEntities;
+    }
+
+    return frame;
+}
+
+
+/**
+ * 缩放中的粗帧: 半分辨率, 不用瓦片. 被新请求取消时返回 NULL
+ */
+static MapRenderFrame * MapRenderFrameDrawCoarse(MapRenderer *renderer, const Viewport2D *viewport, int width, int height, int drawFlags, uint64_t seq)
+{
+    int i;
+    cairoDrawCtx CDC;
+    drawJob job;
+    MapRenderFrame *frame;
+
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+
+    frame = (MapRenderFrame *) mem_alloc_zero(1, sizeof(MapRenderFrame));
+
+    frame->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, cw, ch);
+    if (cairo_surface_status(frame->surface) != CAIRO_STATUS_SUCCESS) {
+        printf("Error: cairo_image_surface_create(%d, %d)\n", cw, ch);
+        MapRenderFrameFree(frame);
+        return 0;
+    }
+
+    bzero(&CDC, sizeof(CDC));
+    cssDrawStyleInit(&CDC.drawStyles);
+    CDC.surface = frame->surface;
+    CDC.cr = cairo_create(frame->surface);
+    CDC.drawFlags = drawFlags;
+
+    // same view center, half of pixels per data unit
+    CDC.viewport = *viewport;
+    CDC.viewport.viewBox.Xmin = 0;
+    CDC.viewport.viewBox.Ymin = 0;
+    CDC.viewport.viewBox.Xmax = cw;
+    CDC.viewport.viewBox.Ymax = ch;
+    CDC.viewport.viewCP.X = viewport->viewCP.X * 0.5;
+    CDC.viewport.viewCP.Y = viewport->viewCP.Y * 0.5;
+    CDC.viewport.XScale = viewport->XScale * 0.5;
+
+    // background
+    cairo_set_source_rgb(CDC.cr, 1, 1, 1);
+    cairo_paint(CDC.cr);
+
+    drawJobInit(&job, MAPRENDER_COARSE_TIMEOUT_MS, 0);
+
+    pthread_mutex_lock(&renderer->lock);
+    if (renderer->quit || renderer->reqSeq != seq) {
+        drawJobCancel(&job);
+    }
+    renderer->coarseJob = &job;
+    pthread_mutex_unlock(&renderer->lock);
+
+    for (i = 0; i < renderer->numLayers; i++) {
+        MapRenderLayerDraw(&renderer->layers[i], &CDC, &job);
+        frame->numShapes += renderer->layers[i].shpEntry->shpInfo.nEntities;
+    }
+
+    pthread_mutex_lock(&renderer->lock);
+    renderer->coarseJob = 0;
+    pthread_mutex_unlock(&renderer->lock);
+
+    cairo_destroy(CDC.cr);
+
+    if (job.status == draw_job_cancelled) {
+        MapRenderFrameFree(frame);
+        return 0;
+    }
+
+    cairo_surface_flush(frame->surface);
+
+    frame->pixels = cairo_image_surface_get_data(frame->surface);
+    frame->width = cw;
+    frame->height = ch;
+    frame->stride = cairo_image_surface_get_stride(frame->surface);
+    frame->viewport = CDC.viewport;
+    frame->drawFlags = drawFlags;
+    frame->numDrawn = job.numDrawn;
+    frame->drawStatus = job.status;
+
+    return frame;
+}
+
+
+static void MapRendererPublish(MapRenderer *renderer, MapRenderFrame *frame, uint64_t seq, const struct timespec *t0, int newTiles)
+{
+    struct timespec t1;
+
+    getnowtimeofday(&t1);
+    frame->renderMs = (double) difftime_msec(t0, &t1);
+    frame->seq = seq;
+    frame->newTiles = newTiles;
+
+    pthread_mutex_lock(&renderer->lock);
+    if (renderer->ready) {
+        // main thread has not taken the previous one
+        MapRenderFrameFree(renderer->ready);
+    }
+    renderer->ready = frame;
+    pthread_mutex_unlock(&renderer->lock);
+
+    if (renderer->onFrameReady) {
+        renderer->onFrameReady(renderer->userarg);
+    }
+}
+
+
+/**
+ * 渲染一个请求:
+ *   1) 视口内已缓存的瓦片立即拼成一帧送出
+ *   2) 由近及远画出缺少的瓦片, 再送出完整的帧
+ *   3) 预取视口外一圈瓦片
+ * 2) 和 3) 每画完一个瓦片检查新请求, 有则放弃 (已画的瓦片留在缓存中)
+ * 缩放中 (drawFlags) 瓦片不全时只画粗帧, 不预取
+ */
+static void MapRendererRender(MapRenderer *renderer, const Viewport2D *viewport, int width, int height, int drawFlags, uint64_t seq)
+{
+    int i, tx, ty, tx0, ty0, tx1, ty1;
+    int numSlots = 0, numCached = 0, newTiles = 0;
+    double cx, cy;
+    struct timespec t0;
+    CGBox2D viewData;
+    MapTileGrid grid;
+    MapTileSlot *slots;
+    MapRenderFrame *frame;
+
+    // 请求内的临时块 (瓦片槽, 图层的图形 id 等) 在线程的 arena 上
+    mem_arena_t *arena = mem_arena_default();
+    mem_arena_mark_t mark;
+
+    getnowtimeofday(&t0);
+
+    MapTileGridInit(&grid, renderer->dataBox, viewport->XScale);
+
+    ViewToDataBox(viewport, viewport->viewBox, &viewData);
+
+    if (! MapTileGridRange(&grid, &viewData, &tx0, &ty0, &tx1, &ty1)) {
+        // nothing of data in view
+        frame = MapRenderFrameCompose(renderer, viewport, width, height, &grid, 0, 0);
+        if (frame) {
+            MapRendererPublish(renderer, frame, seq, &t0, 0);
+        }
+        return;
+    }
+
+    cx = ((viewData.Xmin + viewData.Xmax) * 0.5 - grid.originX) / grid.tileData;
+    cy = (grid.originY - (viewData.Ymin + viewData.Ymax) * 0.5) / grid.tileData;
+
+    mem_arena_mark(arena, &mark);
+    slots = (MapTileSlot *) mem_arena_alloc_zero(arena, (tx1 - tx0 + 1) * (ty1 - ty0 + 1), sizeof(MapTileSlot));
+
+    for (ty = ty0; ty <= ty1; ty++) {
+        for (tx = tx0; tx <= tx1; tx++) {
+            MapTileSlot *slot = &slots[numSlots++];
+            MapTileKey key;
+
+            MapTileKeySet(&key, renderer->layerset, grid.zoom, tx, ty);
+
+            slot->tx = tx;
+            slot->ty = ty;
+            slot->dist = hypot(tx + 0.5 - cx, ty + 0.5 - cy);
+            slot->surface = MapTileCacheGet(&renderer->tileCache, &key);
+            if (slot->surface) {
+                numCached++;
+            }
+        }
+    }
+
+    if (drawFlags && numCached < numSlots) {
+        frame = MapRenderFrameDrawCoarse(renderer, viewport, width, height, drawFlags, seq);
+        if (frame) {
+            MapRendererPublish(renderer, frame, seq, &t0, 0);
+        }
+        goto done;
+    }
+
+    if (numCached == numSlots) {
+        // all visible tiles cached
+        frame = MapRenderFrameCompose(renderer, viewport, width, height, &grid, slots, numSlots);
+        if (frame) {
+            MapRendererPublish(renderer, frame, seq, &t0, 0);
+        }
+    } else {
+        if (numCached) {
+            frame = MapRenderFrameCompose(renderer, viewport, width, height, &grid, slots, numSlots);
+            if (frame) {
+                MapRendererPublish(renderer, frame, seq, &t0, 0);
+            }
+        }
+
+        qsort(slots, numSlots, sizeof(MapTileSlot), MapTileSlotCmp);
+
+        for (i = 0; i < numSlots; i++) {
+            MapTileKey key;
+
+            if (slots[i].surface) {
+                continue;
+            }
+            if (MapRendererIsStale(renderer, seq)) {
+                goto done;
+            }
+
+            MapTileKeySet(&key, renderer->layerset, grid.zoom, slots[i].tx, slots[i].ty);
+            slots[i].surface = MapRendererCacheTile(renderer, &grid, viewport, &key);
+            newTiles++;
+        }
+
+        frame = MapRenderFrameCompose(renderer, viewport, width, height, &grid, slots, numSlots);
+        if (frame) {
+            MapRendererPublish(renderer, frame, seq, &t0, newTiles);
+        }
+    }
+
+    if (drawFlags) {
+        // still zooming
+        goto done;
+    }
+
+    // prefetch ring of neighbouring tiles
+    for (ty = ty0 - 1; ty <= ty1 + 1; ty++) {
+        for (tx = tx0 - 1; tx <= tx1 + 1; tx++) {
+            MapTileKey key;
+            cairo_surface_t *surface;
+
+            if (ty >= ty0 && ty <= ty1 && tx >= tx0 && tx <= tx1) {
+                continue;
+            }
+            if (tx < 0 || ty < 0 || tx >= grid.numTX || ty >= grid.numTY) {
+                continue;
+            }
+
+            MapTileKeySet(&key, renderer->layerset, grid.zoom, tx, ty);
+
+            if (MapTileCacheHas(&renderer->tileCache, &key)) {
+                continue;
+            }
+            if (MapRendererIsStale(renderer, seq)) {
+                goto done;
+            }
+
+            surface = MapRendererCacheTile(renderer, &grid, viewport, &key);
+            if (surface) {
+                cairo_surface_destroy(surface);
+            }
+        }
+    }
+
+done:
+    for (i = 0; i < numSlots; i++) {
+        if (slots[i].surface) {
+            cairo_surface_destroy(slots[i].surface);
+        }
+    }
+    mem_arena_rewind(arena, &mark);
+}
+
+
+// FNV-1a of layer files
+static uint64_t MapLayersetHash(uint64_t hash, const char *shpfile)
+{
+    while (*shpfile) {
+        hash ^= (unsigned char) *shpfile++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+static uint64_t MapRendererLayerset(const MapRenderLayer *layers, int numLayers)
+{
+    int i;
+    uint64_t layerset = 0xcbf29ce484222325ULL;
+
+    for (i = 0; i < numLayers; i++) {
+        layerset = MapLayersetHash(layerset, CBSTR(layers[i].data->shpfile));
+    }
+    return layerset;
+}
+
+
+static int MapCstrEqual(cstrbuf a, cstrbuf b)
+{
+    if (! a || ! b) {
+        return a == b;
+    }
+    return a->len == b->len && ! memcmp(a->str, b->str, a->len);
+}
+
+
+static void MapRenderLayerBox(const MapRenderLayer *layer, CGBox2D *box)
+{
+    const shapeFileInfo *shpInfo = &layer->shpEntry->shpInfo;
+
+    if (layer->projEntry) {
+        *box = layer->projEntry->dataBox;
+        return;
+    }
+
+    box->Xmin = shpInfo->minBounds[0];
+    box->Ymin = shpInfo->minBounds[1];
+    box->Xmax = shpInfo->maxBounds[0];
+    box->Ymax = shpInfo->maxBounds[1];
+}
+
+
+// union of boxes: count is number of boxes in box
+static void MapBoxExtend(CGBox2D *box, int *count, const MapRenderLayer *layer)
+{
+    CGBox2D add;
+    MapRenderLayerBox(layer, &add);
+
+    if (! (*count)++) {
+        *box = add;
+    } else {
+        box->Xmin = fmin(box->Xmin, add.Xmin);
+        box->Ymin = fmin(box->Ymin, add.Ymin);
+        box->Xmax = fmax(box->Xmax, add.Xmax);
+        box->Ymax = fmax(box->Ymax, add.Ymax);
+    }
+}
+
+
+static int MapRenderLayerOpen(MapRenderLayer *layer, const struct MapLayerData *data, cstrbuf mapProj4def)
+{
+    bzero(layer, sizeof(MapRenderLayer));
+    layer->data = data;
+
+    if (! data->shpfile || ! (layer->shpEntry = shapeFileCacheAcquire(CBSTR(data->shpfile)))) {
+        printf("Warn: skip layer: %s\n", CBSTR(data->layerid));
+        return -1;
+    }
+    layer->projEntry = shapeProjCacheAcquire(layer->shpEntry, CBSTR(data->proj4def), CBSTR(mapProj4def));
+
+    if (data->stylefile) {
+        layer->styleKeys = cssStyleReloadFile(CBSTR(data->stylefile));
+        if (! layer->styleKeys) {
+            printf("Warn: bad stylefile of layer %s: %s\n", CBSTR(data->layerid), CBSTR(data->stylefile));
+        }
+    }
+    layer->styleDigest = cssStyleClassDigest(layer->styleKeys, data->styleclass);
+
+    return 0;
+}
+
+
+static void MapRendererWatchFiles(MapRenderer *renderer)
+{
+    int i;
+
+    MapWatchAdd(&renderer->watch, renderer->layersfile);
+
+    for (i = 0; i < renderer->numLayers; i++) {
+        const struct MapLayerData *data = renderer->layers[i].data;
+
+        MapWatchAdd(&renderer->watch, CBSTR(data->shpfile));
+        if (data->stylefile) {
+            MapWatchAdd(&renderer->watch, CBSTR(data->stylefile));
+        }
+    }
+}
+
+
+// a new layer compared with the current ones
+typedef struct
+{
+    // index of current layer with same layerid, -1 if added
+    int oldIndex;
+
+    // 1: shape file not shared with current layer (added or changed)
+    int newShp;
+
+    // 1: must be redrawn
+    int dirty;
+} MapRenderLayerDiff;
+
+
+/**
+ * 重新加载变化了的文件, 与当前图层比较后替换, 只删除受影响的瓦片.
+ * 返回 0 表示画出的内容没有变化
+ */
+static int MapRendererReload(MapRenderer *renderer)
+{
+    int i, j, k;
+    struct timespec t0, t1;
+    MapWatch *watch = &renderer->watch;
+    struct MapLayersCfg newCfg, *cfg = &renderer->layersCfg;
+    int cfgChanged = MapWatchIsChanged(watch, renderer->layersfile);
+
+    int numData, numLayers = 0, numOld = renderer->numLayers;
+    int added = 0, reopened = 0, restyled = 0, moved = 0, removed = 0;
+    int numDirty = 0, numBoxes = 0, full = 0, numTiles = 0;
+    CGBox2D dirtyBox, dataBox;
+
+    MapRenderLayer *layers;
+    MapRenderLayerDiff *diffs;
+    int *newIndex, *order;
+
+    getnowtimeofday(&t0);
+
+    if (cfgChanged) {
+        MapLayersCfgInit(&newCfg);
+        if (load_maplayers_file(renderer->layersfile, renderer->mapid, &newCfg) <= 0) {
+            printf("Warn: reload %s: no layers of [map:%s], keep current layers\n", renderer->layersfile, CBSTR(renderer->mapid));
+            MapLayersCfgUninit(&newCfg);
+            MapWatchClearChanged(watch);
+            return 0;
+        }
+        cfg = &newCfg;
+    }
+
+    numData = MapLayersCfgGetLayers(cfg);
+
+    layers = (MapRenderLayer *) mem_alloc_zero(numData, sizeof(MapRenderLayer));
+    diffs = (MapRenderLayerDiff *) mem_alloc_zero(numData, sizeof(MapRenderLayerDiff));
+
+    // for current layers: index of new layer, -1 if removed
+    newIndex = (int *) mem_alloc_zero(numOld, sizeof(int));
+    order = (int *) mem_alloc_zero(numOld, sizeof(int));
+    for (j = 0; j < numOld; j++) {
+        newIndex[j] = -1;
+    }
+
+    for (i = 0; i < numData; i++) {
+        const struct MapLayerData *data = (struct MapLayerData *) utarray_eltptr(cfg->layers_array, i);
+        MapRenderLayer *layer = &layers[numLayers];
+        MapRenderLayerDiff *diff = &diffs[numLayers];
+        MapRenderLayer *old = 0;
+
+        for (j = 0; j < numOld; j++) {
+            if (newIndex[j] == -1 && MapCstrEqual(renderer->layers[j].data->layerid, data->layerid)) {
+                old = &renderer->layers[j];
+                break;
+            }
+        }
+
+        layer->data = data;
+        if (! data->shpfile) {
+            printf("Warn: skip layer: %s\n", CBSTR(data->layerid));
+            continue;
+        }
+
+        // 未变的 shp 文件从缓存得到同一个句柄和 MBRTree
+        layer->shpEntry = shapeFileCacheAcquire(CBSTR(data->shpfile));
+        if (! layer->shpEntry) {
+            printf("Warn: skip layer: %s\n", CBSTR(data->layerid));
+            continue;
+        }
+        // 坐标系不变时从缓存得到同一个投影条目
+        layer->projEntry = shapeProjCacheAcquire(layer->shpEntry, CBSTR(data->proj4def), CBSTR(cfg->proj4def));
+
+        if (! old || old->shpEntry != layer->shpEntry || old->projEntry != layer->projEntry) {
+            diff->newShp = 1;
+            diff->dirty = 1;
+            if (old) {
+                reopened++;
+            }
+        }
+
+        if (old && MapCstrEqual(old->data->stylefile, data->stylefile) && ! (data->stylefile && MapWatchIsChanged(watch, CBSTR(data->stylefile)))) {
+            layer->styleKeys = old->styleKeys;
+        } else if (data->stylefile) {
+            layer->styleKeys = cssStyleReloadFile(CBSTR(data->stylefile));
+            if (! layer->styleKeys) {
+                if (old && MapCstrEqual(old->data->stylefile, data->stylefile)) {
+                    // 正在编辑的样式文件有错, 保留原样式
+                    printf("Warn: bad stylefile of layer %s: %s, keep current style\n", CBSTR(data->layerid), CBSTR(data->stylefile));
+                    layer->styleKeys = old->styleKeys;
+                } else {
+                    printf("Warn: bad stylefile of layer %s: %s\n", CBSTR(data->layerid), CBSTR(data->stylefile));
+                }
+            }
+        }
+        layer->styleDigest = cssStyleClassDigest(layer->styleKeys, data->styleclass);
+
+        if (old) {
+            if (layer->styleDigest != old->styleDigest) {
+                diff->dirty = 1;
+                restyled++;
+            }
+            diff->oldIndex = (int) (old - renderer->layers);
+            newIndex[diff->oldIndex] = numLayers;
+        } else {
+            diff->oldIndex = -1;
+            diff->dirty = 1;
+            added++;
+        }
+
+        numLayers++;
+    }
+
+    if (! numLayers) {
+        // nothing opened or taken from current layers
+        printf("Warn: reload %s: no shape file opened, keep current layers\n", renderer->layersfile);
+        if (cfgChanged) {
+            MapLayersCfgUninit(&newCfg);
+        }
+        MapWatchClearChanged(watch);
+        goto done;
+    }
+
+    // 保留下来的图层之间的先后次序变了也要重画: order 为按原次序排列的新序号
+    for (k = 0, j = 0; j < numOld; j++) {
+        if (newIndex[j] != -1) {
+            order[k++] = newIndex[j];
+        }
+    }
+    for (k = 0, i = 0; i < numLayers; i++) {
+        if (diffs[i].oldIndex != -1 && order[k++] != i && ! diffs[i].dirty) {
+            diffs[i].dirty = 1;
+            moved++;
+        }
+    }
+
+    // 变化了的图层的新旧范围
+    for (i = 0; i < numLayers; i++) {
+        if (diffs[i].dirty) {
+            MapBoxExtend(&dirtyBox, &numDirty, &layers[i]);
+            if (diffs[i].oldIndex != -1 && diffs[i].newShp) {
+                MapBoxExtend(&dirtyBox, &numDirty, &renderer->layers[diffs[i].oldIndex]);
+            }
+        }
+        MapBoxExtend(&dataBox, &numBoxes, &layers[i]);
+    }
+    for (j = 0; j < numOld; j++) {
+        if (newIndex[j] == -1) {
+            MapBoxExtend(&dirtyBox, &numDirty, &renderer->layers[j]);
+            removed++;
+        }
+    }
+
+    // 瓦片网格随数据范围而变
+    full = memcmp(&dataBox, &renderer->dataBox, sizeof(CGBox2D)) ||
+        (cfgChanged && ! MapCstrEqual(newCfg.proj4def, renderer->layersCfg.proj4def));
+
+    // replace layers
+    for (j = 0; j < numOld; j++) {
+        MapRenderLayer *old = &renderer->layers[j];
+        i = newIndex[j];
+
+        shapeProjCacheRelease(old->projEntry);
+        shapeFileCacheRelease(old->shpEntry);
+        if (old->styleKeys && (i == -1 || layers[i].styleKeys != old->styleKeys)) {
+            CssKeyArrayFree(old->styleKeys);
+        }
+    }
+    mem_free(renderer->layers);
+
+    // 删除了的图层不再占用文件
+    shapeProjCacheTrim();
+    shapeFileCacheTrim();
+
+    renderer->layers = layers;
+    renderer->numLayers = numLayers;
+    layers = 0;
+
+    if (cfgChanged) {
+        MapLayersCfgUninit(&renderer->layersCfg);
+        renderer->layersCfg = newCfg;
+    }
+
+    if (full) {
+        numTiles = MapTileCacheRemoveLayerset(&renderer->tileCache, renderer->layerset);
+        renderer->layerset = MapRendererLayerset(renderer->layers, renderer->numLayers);
+        renderer->dataBox = dataBox;
+    } else if (numDirty) {
+        numTiles = MapTileCacheRemoveBox(&renderer->tileCache, renderer->layerset, renderer->dataBox, &dirtyBox, MAPRENDER_DIRTY_PAD_PX);
+    }
+
+    // 新的文件也要监视
+    MapRendererWatchFiles(renderer);
+    MapWatchClearChanged(watch);
+
+    getnowtimeofday(&t1);
+    printf("reload: %d layers, %d added, %d reopened, %d restyled, %d moved, %d removed. %s%d tiles dropped. %.1f ms\n",
+        renderer->numLayers, added, reopened, restyled, moved, removed, full? "all " : "", numTiles, (double) difftime_msec(&t0, &t1));
+
+done:
+    mem_free(layers);
+    mem_free(diffs);
+    mem_free(newIndex);
+    mem_free(order);
+
+    return numDirty || full;
+}
+
+
+static void * MapRendererThread(void *arg)
+{
+    struct timespec t0, lastWatch;
+    MapRenderer *renderer = (MapRenderer *) arg;
+
+    getnowtimeofday(&lastWatch);
+
+    for (;;) {
+        Viewport2D viewport;
+        int width = 0, height = 0, drawFlags = 0, render = 0;
+        uint64_t seq = 0;
+
+        pthread_mutex_lock(&renderer->lock);
+        while (! renderer->quit && renderer->reqSeq == renderer->doneSeq) {
+            // wake up to check files
+            struct timespec abstime;
+            getnowtimeofday(&abstime);
+            abstime.tv_sec += MAPRENDER_WATCH_MS / 1000;
+            abstime.tv_nsec += (MAPRENDER_WATCH_MS % 1000) * 1000000L;
+            if (abstime.tv_nsec >= 1000000000L) {
+                abstime.tv_sec++;
+                abstime.tv_nsec -= 1000000000L;
+            }
+            if (pthread_cond_timedwait(&renderer->cond, &renderer->lock, &abstime) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (renderer->quit) {
+            pthread_mutex_unlock(&renderer->lock);
+            break;
+        }
+        if (renderer->reqSeq != renderer->doneSeq) {
+            viewport = renderer->reqViewport;
+            width = renderer->reqWidth;
+            height = renderer->reqHeight;
+            drawFlags = renderer->reqFlags;
+            seq = renderer->reqSeq;
+            renderer->doneSeq = seq;
+            render = 1;
+        }
+        pthread_mutex_unlock(&renderer->lock);
+
+        // 请求之间检查文件变化
+        getnowtimeofday(&t0);
+        if (difftime_msec(&lastWatch, &t0) >= MAPRENDER_WATCH_MS) {
+            lastWatch = t0;
+
+            if (MapWatchPoll(&renderer->watch) > 0 && MapRendererReload(renderer) && ! render) {
+                // redraw latest request with reloaded layers
+                pthread_mutex_lock(&renderer->lock);
+                viewport = renderer->reqViewport;
+                width = renderer->reqWidth;
+                height = renderer->reqHeight;
+                drawFlags = renderer->reqFlags;
+                seq = renderer->reqSeq;
+                render = (seq > 0);
+                pthread_mutex_unlock(&renderer->lock);
+            }
+        }
+
+        if (render) {
+            MapRendererRender(renderer, &viewport, width, height, drawFlags, seq);
+        }
+    }
+
+    mem_arena_default_final();
+    return 0;
+}
+
+
+static void MapRendererCleanup(MapRenderer *renderer)
+{
+    int i;
+    for (i = 0; i < renderer->numLayers; i++) {
+        shapeProjCacheRelease(renderer->layers[i].projEntry);
+        shapeFileCacheRelease(renderer->layers[i].shpEntry);
+        if (renderer->layers[i].styleKeys) {
+            CssKeyArrayFree(renderer->layers[i].styleKeys);
+        }
+    }
+    mem_free_s((void **) &renderer->layers);
+    renderer->numLayers = 0;
+
+    MapLayersCfgUninit(&renderer->layersCfg);
+    cstrbufFree(&renderer->mapid);
+    MapWatchFinal(&renderer->watch);
+}
+
+
+int MapRendererStart(MapRenderer *renderer, const char *layersfile, const char *mapid,
+    void (*onFrameReady)(void *userarg), void *userarg)
+{
+    int i, numLayers, numBoxes = 0;
+    struct timespec t0, t1;
+
+    bzero(renderer, sizeof(MapRenderer));
+    MapLayersCfgInit(&renderer->layersCfg);
+    MapTileCacheInit(&renderer->tileCache, MAPTILE_CACHE_BYTES);
+    MapWatchInit(&renderer->watch);
+
+    snprintf(renderer->layersfile, sizeof(renderer->layersfile), "%s", layersfile);
+    renderer->mapid = cstrbufNew(0, mapid, (ub4) strlen(mapid));
+
+    numLayers = load_maplayers_file(layersfile, renderer->mapid, &renderer->layersCfg);
+    if (numLayers <= 0) {
+        printf("Error: no layers of [map:%s] in: %s\n", mapid, layersfile);
+        MapRendererCleanup(renderer);
+        return -1;
+    }
+
+    renderer->layers = (MapRenderLayer *) mem_alloc_zero(numLayers, sizeof(MapRenderLayer));
+
+    // 瓦片只画相交的图形: 缓存中新打开的文件读入外接矩形并建立 MBRTree
+    getnowtimeofday(&t0);
+    for (i = 0; i < numLayers; i++) {
+        const struct MapLayerData *data = (struct MapLayerData *) utarray_eltptr(renderer->layersCfg.layers_array, i);
+        if (MapRenderLayerOpen(&renderer->layers[renderer->numLayers], data, renderer->layersCfg.proj4def) == 0) {
+            MapBoxExtend(&renderer->dataBox, &numBoxes, &renderer->layers[renderer->numLayers]);
+            renderer->numLayers++;
+        }
+    }
+    getnowtimeofday(&t1);
+    printf("open %d layers: %.1f ms\n", renderer->numLayers, (double) difftime_msec(&t0, &t1));
+
+    if (! renderer->numLayers) {
+        printf("Error: no shape file opened: %s\n", layersfile);
+        MapRendererCleanup(renderer);
+        return -1;
+    }
+
+    renderer->layerset = MapRendererLayerset(renderer->layers, renderer->numLayers);
+    MapRendererWatchFiles(renderer);
+
+    renderer->onFrameReady = onFrameReady;
+    renderer->userarg = userarg;
+
+    pthread_mutex_init(&renderer->lock, 0);
+    pthread_cond_init(&renderer->cond, 0);
+
+    if (pthread_create(&renderer->thread, 0, MapRendererThread, renderer)) {
+        printf("Error: pthread_create\n");
+        pthread_cond_destroy(&renderer->cond);
+        pthread_mutex_destroy(&renderer->lock);
+        MapRendererCleanup(renderer);
+        return -1;
+    }
+    renderer->started = 1;
+
+    return 0;
+}
+
+
+void MapRendererStop(MapRenderer *renderer)
+{
+    if (! renderer->started) {
+        return;
+    }
+
+    pthread_mutex_lock(&renderer->lock);
+    renderer->quit = 1;
+    if (renderer->coarseJob) {
+        drawJobCancel(renderer->coarseJob);
+    }
+    pthread_cond_signal(&renderer->cond);
+    pthread_mutex_unlock(&renderer->lock);
+
+    pthread_join(renderer->thread, 0);
+    renderer->started = 0;
+
+    MapRenderFrameFree(renderer->ready);
+    renderer->ready = 0;
+
+    printf("tile cache: %d tiles, %.1f MB, hits %llu, misses %llu, evicts %llu\n",
+        renderer->tileCache.numTiles, renderer->tileCache.bytes / 1048576.0,
+        (unsigned long long) renderer->tileCache.hits,
+        (unsigned long long) renderer->tileCache.misses,
+        (unsigned long long) renderer->tileCache.evicts);
+    MapTileCacheClear(&renderer->tileCache);
+
+    pthread_cond_destroy(&renderer->cond);
+    pthread_mutex_destroy(&renderer->lock);
+
+    MapRendererCleanup(renderer);
+}
+
+
+uint64_t MapRendererRequest(MapRenderer *renderer, const Viewport2D *viewport, int width, int height, int drawFlags)
+{
+    uint64_t seq;
+
+    pthread_mutex_lock(&renderer->lock);
+    if (width > 0 && height > 0) {
+        renderer->reqViewport = *viewport;
+        renderer->reqWidth = width;
+        renderer->reqHeight = height;
+        renderer->reqFlags = drawFlags;
+        renderer->reqSeq++;
+
+        // drawing for the old viewport is wasted
+        if (renderer->coarseJob) {
+            drawJobCancel(renderer->coarseJob);
+        }
+        pthread_cond_signal(&renderer->cond);
+    }
+    seq = renderer->reqSeq;
+    pthread_mutex_unlock(&renderer->lock);
+
+    return seq;
+}
+
+
+MapRenderFrame * MapRendererTakeFrame(MapRenderer *renderer)
+{
+    MapRenderFrame *frame;
+
+    pthread_mutex_lock(&renderer->lock);
+    frame = renderer->ready;
+    renderer->ready = 0;
+    pthread_mutex_unlock(&renderer->lock);
+
+    return frame;
+}
+
+
+void MapRenderFrameFree(MapRenderFrame *frame)
+{
+    if (frame) {
+        if (frame->surface) {
+            cairo_surface_destroy(frame->surface);
+        }
+        mem_free(frame);
+    }
+}
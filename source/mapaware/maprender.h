@@ -0,0 +1,203 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file maprender.h
+ * @brief render map layers on a background thread.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.3
+ *
+ * @since 2024-11-08 09:30:12
+ * @date 2024-11-12 16:48:32
+ *
+ * @note
+ *   主线程提交视口 (MapRendererRequest), 渲染线程用 shapetool 的 cairo 绘制
+ *   路径把图层画到 ARGB32 瓦片上, 再把视口内的瓦片拼成帧. 只保留最新的请求和
+ *   最新完成的帧, 中间的请求被丢弃.
+ *   瓦片缓存在 MapTileCache 中: 平移时已缓存的瓦片先拼成一帧立即送出, 然后只画
+ *   新露出的瓦片, 最后预取视口外一圈瓦片. 每画完一个瓦片检查是否有新请求.
+ *   缩放手势进行中 (css_bitflag_zoomin/zoomout) 的请求只画一个粗帧: 半分辨率,
+ *   简化几何, 不画边线, 不进缓存. 视口一变粗帧立即取消. 粗帧超过
+ *   MAPRENDER_COARSE_TIMEOUT_MS 时停止, 已画的部分照样送出. 手势停止后主线程再提交
+ *   不带标志的请求, 按瓦片精画.
+ *   热加载: 渲染线程每 MAPRENDER_WATCH_MS 检查图层配置文件, 样式文件和 shp 文件.
+ *   只重新解析变化了的文件, 按 layerid 与当前图层比较: 未变的图层沿用已打开的
+ *   shp 文件和 MBRTree; shp 文件变了才重新打开; 样式只比较图层所用样式类的摘要.
+ *   缓存中只删除与变化图层相交的瓦片. 数据范围或 proj4def 变化时删除全部瓦片.
+ *   投影: 图层的 proj4def (shp 的坐标系) 与地图的不同时, 从 shapeProjCache
+ *   画变换后的图形, 变换结果按 (shp 文件, 坐标系) 缓存, 平移时不再计算.
+ */
+#ifndef MAP_RENDER_H__
+#define MAP_RENDER_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include <shapetool/drawshape.h>
+#include <shapetool/shapecache.h>
+#include <shapetool/shapeproj.h>
+#include <shapetool/drawlayers.h>
+
+#include "maptilecache.h"
+#include "mapwatch.h"
+
+#include <pthread.h>
+
+#if defined(_MSC_VER)
+  // link to pthread-w32 lib for MS Windows with MSVC
+  # pragma comment(lib, "pthreadVC2.lib")
+#endif
+
+
+// 粗帧的绘制时限
+#define MAPRENDER_COARSE_TIMEOUT_MS    100
+
+// 检查文件变化的间隔
+#define MAPRENDER_WATCH_MS             500
+
+// 图层变化时失效瓦片的外扩像素 (边线宽度)
+#define MAPRENDER_DIRTY_PAD_PX           4
+
+
+typedef struct
+{
+    // cairo image (CAIRO_FORMAT_ARGB32)
+    cairo_surface_t *surface;
+
+    unsigned char *pixels;
+    int width;
+    int height;
+    int stride;
+
+    // viewport the frame rendered with
+    Viewport2D viewport;
+
+    // sequence of request
+    uint64_t seq;
+
+    // milliseconds of drawing
+    double renderMs;
+
+    // total shapes of layers
+    int numShapes;
+
+    // tiles composited and tiles rendered (not cached) for this frame
+    int numTiles;
+    int newTiles;
+
+    // drawFlags of request: not 0 for coarse frame (half resolution)
+    int drawFlags;
+
+    // coarse frame: shapes drawn, draw_job_timedout if not all drawn
+    int numDrawn;
+    drawJobStatus drawStatus;
+} MapRenderFrame;
+
+
+typedef struct
+{
+    // config of layer in MapRenderer.layersCfg
+    const struct MapLayerData *data;
+
+    // shared in shapeFileCache
+    shapeFileEntry *shpEntry;
+
+    // shpEntry reprojected into proj4def of map, NULL if same crs
+    shapeProjEntry *projEntry;
+
+    // compiled stylefile, NULL if none
+    CssKeyArray styleKeys;
+
+    // digest of styleclass in styleKeys
+    uint64_t styleDigest;
+} MapRenderLayer;
+
+
+typedef struct
+{
+    char layersfile[256];
+    cstrbuf mapid;
+
+    struct MapLayersCfg layersCfg;
+
+    // opened layers in drawing order
+    MapRenderLayer *layers;
+    int numLayers;
+
+    // union bounds of all layers
+    CGBox2D dataBox;
+
+    // hash of layer files for MapTileKey, renewed when all tiles are dropped
+    uint64_t layerset;
+
+    // accessed only by render thread
+    MapTileCache tileCache;
+    MapWatch watch;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int quit;
+
+    // latest request
+    Viewport2D reqViewport;
+    int reqWidth;
+    int reqHeight;
+    int reqFlags;
+    uint64_t reqSeq;
+    uint64_t doneSeq;
+
+    // coarse drawing in progress, cancelled by new request
+    drawJob *coarseJob;
+
+    // latest completed frame, taken by MapRendererTakeFrame
+    MapRenderFrame *ready;
+
+    // called on render thread when a frame is ready
+    void (*onFrameReady)(void *userarg);
+    void *userarg;
+} MapRenderer;
+
+
+int MapRendererStart(MapRenderer *renderer, const char *layersfile, const char *mapid,
+    void (*onFrameReady)(void *userarg), void *userarg);
+
+void MapRendererStop(MapRenderer *renderer);
+
+// submit viewport to render. replaces the pending one. returns sequence of request
+//   drawFlags: css_bitflag_zoomin or css_bitflag_zoomout while zooming for a coarse frame, 0 for full quality
+uint64_t MapRendererRequest(MapRenderer *renderer, const Viewport2D *viewport, int width, int height, int drawFlags);
+
+// returns latest completed frame or NULL. caller owns the frame
+MapRenderFrame * MapRendererTakeFrame(MapRenderer *renderer);
+
+void MapRenderFrameFree(MapRenderFrame *frame);
+
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* MAP_RENDER_H__ */
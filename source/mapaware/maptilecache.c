@@ -0,0 +1,260 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file maptilecache.c
+ * @brief LRU cache of rendered map tiles.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-09 10:12:40
+ * @date 2024-11-09 17:36:05
+ *
+ * @note
+ */
+#include "maptilecache.h"
+
+
+static void MapTileFree(MapTileCache *cache, MapTile *tile)
+{
+    HASH_DELETE(hh, cache->tiles, tile);
+    cache->numTiles--;
+    cache->bytes -= tile->bytes;
+
+    cairo_surface_destroy(tile->surface);
+    mem_free(tile);
+}
+
+
+void MapTileCacheInit(MapTileCache *cache, size_t budget)
+{
+    bzero(cache, sizeof(MapTileCache));
+    cache->budget = budget;
+}
+
+
+void MapTileCacheClear(MapTileCache *cache)
+{
+    MapTile *tile, *tmp;
+
+    HASH_ITER(hh, cache->tiles, tile, tmp) {
+        MapTileFree(cache, tile);
+    }
+}
+
+
+cairo_surface_t * MapTileCacheGet(MapTileCache *cache, const MapTileKey *key)
+{
+    MapTile *tile = 0;
+
+    HASH_FIND(hh, cache->tiles, key, sizeof(MapTileKey), tile);
+    if (! tile) {
+        cache->misses++;
+        return 0;
+    }
+    cache->hits++;
+
+    // move to tail as the most recently used
+    HASH_DELETE(hh, cache->tiles, tile);
+    HASH_ADD(hh, cache->tiles, key, sizeof(MapTileKey), tile);
+
+    return cairo_surface_reference(tile->surface);
+}
+
+
+int MapTileCacheHas(MapTileCache *cache, const MapTileKey *key)
+{
+    MapTile *tile = 0;
+    HASH_FIND(hh, cache->tiles, key, sizeof(MapTileKey), tile);
+    return tile? 1 : 0;
+}
+
+
+void MapTileCachePut(MapTileCache *cache, const MapTileKey *key, cairo_surface_t *surface)
+{
+    MapTile *tile = 0;
+
+    HASH_FIND(hh, cache->tiles, key, sizeof(MapTileKey), tile);
+    if (tile) {
+        MapTileFree(cache, tile);
+    }
+
+    tile = (MapTile *) mem_alloc_zero(1, sizeof(MapTile));
+    tile->key = *key;
+    tile->surface = cairo_surface_reference(surface);
+    tile->bytes = (size_t) cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+
+    HASH_ADD(hh, cache->tiles, key, sizeof(MapTileKey), tile);
+    cache->numTiles++;
+    cache->bytes += tile->bytes;
+
+    // evict from head (least recently used), but keep the new one
+    while (cache->bytes > cache->budget && cache->tiles != tile) {
+        MapTileFree(cache, cache->tiles);
+        cache->evicts++;
+    }
+}
+
+
+int MapTileCacheRemoveLayerset(MapTileCache *cache, uint64_t layerset)
+{
+    int removed = 0;
+    MapTile *tile, *tmp;
+
+    HASH_ITER(hh, cache->tiles, tile, tmp) {
+        if (tile->key.layerset == layerset) {
+            MapTileFree(cache, tile);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+
+int MapTileCacheRemoveBox(MapTileCache *cache, uint64_t layerset, CGBox2D dataBox, const CGBox2D *box, double padPixels)
+{
+    int removed = 0;
+    MapTile *tile, *tmp;
+    MapTileGrid grid;
+
+    grid.zoom = INT_MIN;
+
+    HASH_ITER(hh, cache->tiles, tile, tmp) {
+        CGBox2D tileBox;
+        double pad;
+
+        if (tile->key.layerset != layerset) {
+            continue;
+        }
+        if (tile->key.zoom != grid.zoom) {
+            MapTileGridInitZoom(&grid, dataBox, tile->key.zoom);
+        }
+
+        // strokes reach outside of geometry
+        pad = padPixels / grid.scale;
+
+        MapTileGridTileBox(&grid, tile->key.tx, tile->key.ty, &tileBox);
+        if (tileBox.Xmax + pad < box->Xmin || tileBox.Xmin - pad > box->Xmax ||
+            tileBox.Ymax + pad < box->Ymin || tileBox.Ymin - pad > box->Ymax) {
+            continue;
+        }
+
+        MapTileFree(cache, tile);
+        removed++;
+    }
+    return removed;
+}
+
+
+static double MapTileGridBaseScale(CGBox2D dataBox)
+{
+    double dx = CGBoxGetDX(dataBox);
+    double dy = CGBoxGetDY(dataBox);
+    double dmax = (dx > dy? dx : dy);
+
+    // zoom 0: whole data extent in one tile
+    return MAPTILE_SIZE / (dmax > 0? dmax : 1.0);
+}
+
+
+void MapTileGridInit(MapTileGrid *grid, CGBox2D dataBox, double XScale)
+{
+    double baseScale = MapTileGridBaseScale(dataBox);
+
+    MapTileGridInitZoom(grid, dataBox, (int) floor(log2(XScale / baseScale) * MAPTILE_ZOOM_STEPS + 0.5));
+}
+
+
+void MapTileGridInitZoom(MapTileGrid *grid, CGBox2D dataBox, int zoom)
+{
+    double dx = CGBoxGetDX(dataBox);
+    double dy = CGBoxGetDY(dataBox);
+
+    grid->zoom = zoom;
+    grid->scale = MapTileGridBaseScale(dataBox) * pow(2.0, (double) grid->zoom / MAPTILE_ZOOM_STEPS);
+    grid->tileData = MAPTILE_SIZE / grid->scale;
+
+    grid->originX = dataBox.Xmin;
+    grid->originY = dataBox.Ymax;
+
+    grid->numTX = (int) ceil(dx / grid->tileData);
+    grid->numTY = (int) ceil(dy / grid->tileData);
+    if (grid->numTX < 1) {
+        grid->numTX = 1;
+    }
+    if (grid->numTY < 1) {
+        grid->numTY = 1;
+    }
+}
+
+
+int MapTileGridRange(const MapTileGrid *grid, const CGBox2D *box, int *tx0, int *ty0, int *tx1, int *ty1)
+{
+    double x0 = floor((box->Xmin - grid->originX) / grid->tileData);
+    double x1 = floor((box->Xmax - grid->originX) / grid->tileData);
+    double y0 = floor((grid->originY - box->Ymax) / grid->tileData);
+    double y1 = floor((grid->originY - box->Ymin) / grid->tileData);
+
+    if (x1 < 0 || y1 < 0 || x0 >= grid->numTX || y0 >= grid->numTY) {
+        return 0;
+    }
+
+    *tx0 = x0 < 0? 0 : (int) x0;
+    *ty0 = y0 < 0? 0 : (int) y0;
+    *tx1 = x1 >= grid->numTX? grid->numTX - 1 : (int) x1;
+    *ty1 = y1 >= grid->numTY? grid->numTY - 1 : (int) y1;
+    return 1;
+}
+
+
+void MapTileGridTileBox(const MapTileGrid *grid, int tx, int ty, CGBox2D *box)
+{
+    box->Xmin = grid->originX + tx * grid->tileData;
+    box->Xmax = box->Xmin + grid->tileData;
+    box->Ymax = grid->originY - ty * grid->tileData;
+    box->Ymin = box->Ymax - grid->tileData;
+}
+
+
+void MapTileGridTileViewport(const MapTileGrid *grid, const Viewport2D *vp, int tx, int ty, Viewport2D *tileVp)
+{
+    CGBox2D box;
+    MapTileGridTileBox(grid, tx, ty, &box);
+
+    *tileVp = *vp;
+
+    tileVp->viewBox.Xmin = 0;
+    tileVp->viewBox.Ymin = 0;
+    tileVp->viewBox.Xmax = MAPTILE_SIZE;
+    tileVp->viewBox.Ymax = MAPTILE_SIZE;
+    tileVp->viewCP.X = MAPTILE_SIZE * 0.5;
+    tileVp->viewCP.Y = MAPTILE_SIZE * 0.5;
+    tileVp->dpiRatio = 1.0;
+
+    tileVp->dataCP.X = (box.Xmin + box.Xmax) * 0.5;
+    tileVp->dataCP.Y = (box.Ymin + box.Ymax) * 0.5;
+
+    // exact scale of zoom level, not clamped by MinScale/MaxScale
+    tileVp->XScale = grid->scale;
+}
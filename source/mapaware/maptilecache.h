@@ -0,0 +1,164 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file maptilecache.h
+ * @brief LRU cache of rendered map tiles.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-09 10:12:40
+ * @date 2024-11-09 17:36:05
+ *
+ * @note
+ *   瓦片是 MAPTILE_SIZE x MAPTILE_SIZE 的 ARGB32 图像. 键为 (图层集合, 缩放级别, tx, ty).
+ *   缩放级别由 Viewport2D.XScale 量化得到: 级别 0 时整个数据范围正好放入一个瓦片,
+ *   每升 MAPTILE_ZOOM_STEPS 级比例尺加倍. tx 从数据范围 Xmin 向右, ty 从 Ymax 向下.
+ *   缓存只被渲染线程访问, 不加锁. 按最近使用排序 (uthash 插入顺序), 超出内存预算时
+ *   淘汰最久未用的瓦片.
+ */
+#ifndef MAP_TILE_CACHE_H__
+#define MAP_TILE_CACHE_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include <common/viewport.h>
+#include <common/memapi.h>
+#include <common/uthash/uthash.h>
+
+#include <cairo/cairo.h>
+
+
+#define MAPTILE_SIZE             256
+
+// 每倍比例尺的缩放级别数
+#define MAPTILE_ZOOM_STEPS         4
+
+// 默认内存预算: 1024 个瓦片
+#define MAPTILE_CACHE_BYTES      (256 * 1024 * 1024)
+
+
+typedef struct
+{
+    // hash of layers drawn on tile
+    uint64_t layerset;
+
+    int zoom;
+    int tx;
+    int ty;
+} MapTileKey;
+
+
+typedef struct
+{
+    UT_hash_handle hh;
+
+    MapTileKey key;
+
+    cairo_surface_t *surface;
+    size_t bytes;
+} MapTile;
+
+
+typedef struct
+{
+    // head is the least recently used
+    MapTile *tiles;
+    int numTiles;
+
+    size_t bytes;
+    size_t budget;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evicts;
+} MapTileCache;
+
+
+/**
+ * 瓦片网格: 某一缩放级别下瓦片和数据坐标的换算
+ */
+typedef struct
+{
+    int zoom;
+
+    // pixels per data unit of tiles at zoom
+    double scale;
+
+    // data size of one tile
+    double tileData;
+
+    // Xmin, Ymax of data extent
+    double originX;
+    double originY;
+
+    // tiles covering data extent: [0, numTX) x [0, numTY)
+    int numTX;
+    int numTY;
+} MapTileGrid;
+
+
+void MapTileCacheInit(MapTileCache *cache, size_t budget);
+
+void MapTileCacheClear(MapTileCache *cache);
+
+// returns referenced surface of tile (caller must cairo_surface_destroy) or NULL.
+// hit tile becomes the most recently used
+cairo_surface_t * MapTileCacheGet(MapTileCache *cache, const MapTileKey *key);
+
+// test tile is cached without touching it
+int MapTileCacheHas(MapTileCache *cache, const MapTileKey *key);
+
+// cache takes a reference of surface. evicts least recently used tiles over budget
+void MapTileCachePut(MapTileCache *cache, const MapTileKey *key, cairo_surface_t *surface);
+
+// drop all tiles drawn with layerset
+int MapTileCacheRemoveLayerset(MapTileCache *cache, uint64_t layerset);
+
+// drop tiles of layerset (grid of dataBox) within padPixels of data box. returns number of tiles removed
+int MapTileCacheRemoveBox(MapTileCache *cache, uint64_t layerset, CGBox2D dataBox, const CGBox2D *box, double padPixels);
+
+
+// grid of zoom level nearest to XScale for dataBox
+void MapTileGridInit(MapTileGrid *grid, CGBox2D dataBox, double XScale);
+
+// grid of given zoom level for dataBox
+void MapTileGridInitZoom(MapTileGrid *grid, CGBox2D dataBox, int zoom);
+
+// tiles [tx0, tx1] x [ty0, ty1] overlap data box, clipped to data extent. returns 0 if none
+int MapTileGridRange(const MapTileGrid *grid, const CGBox2D *box, int *tx0, int *ty0, int *tx1, int *ty1);
+
+// data box of tile
+void MapTileGridTileBox(const MapTileGrid *grid, int tx, int ty, CGBox2D *box);
+
+// viewport to draw tile into a MAPTILE_SIZE x MAPTILE_SIZE image
+void MapTileGridTileViewport(const MapTileGrid *grid, const Viewport2D *vp, int tx, int ty, Viewport2D *tileVp);
+
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* MAP_TILE_CACHE_H__ */
@@ -0,0 +1,205 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file mapwatch.c
+ * @brief watch files of map layers for changes.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-12 09:20:15
+ * @date 2024-11-12 16:48:32
+ *
+ * @note
+ */
+#include "mapwatch.h"
+
+#include <sys/stat.h>
+
+#ifdef __LINUX__
+# include <sys/inotify.h>
+# include <unistd.h>
+# include <fcntl.h>
+#endif
+
+
+static void MapWatchStat(const char *path, int64_t *mtime, int64_t *size)
+{
+#if defined(_MSC_VER)
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) {
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+#endif
+        *mtime = -1;
+        *size = -1;
+        return;
+    }
+
+#ifdef __LINUX__
+    *mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    *mtime = (int64_t) st.st_mtime;
+#endif
+    *size = (int64_t) st.st_size;
+}
+
+
+void MapWatchInit(MapWatch *watch)
+{
+    bzero(watch, sizeof(MapWatch));
+    watch->fd = -1;
+
+#ifdef __LINUX__
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd == -1) {
+        printf("Warn: inotify_init1 failed: %s. poll files with stat\n", strerror(errno));
+    }
+#endif
+}
+
+
+void MapWatchFinal(MapWatch *watch)
+{
+#ifdef __LINUX__
+    if (watch->fd != -1) {
+        close(watch->fd);
+    }
+#endif
+    mem_free_s((void **) &watch->files);
+    bzero(watch, sizeof(MapWatch));
+    watch->fd = -1;
+}
+
+
+int MapWatchAdd(MapWatch *watch, const char *path)
+{
+    MapWatchFile *file;
+
+    for (int i = 0; i < watch->numFiles; i++) {
+        if (! strcmp(watch->files[i].path, path)) {
+            return i;
+        }
+    }
+
+    if (watch->numFiles == watch->capacity) {
+        watch->capacity = watch->capacity? watch->capacity * 2 : 16;
+        watch->files = (MapWatchFile *) mem_realloc(watch->files, sizeof(MapWatchFile) * watch->capacity);
+    }
+
+    file = &watch->files[watch->numFiles];
+    bzero(file, sizeof(MapWatchFile));
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    MapWatchStat(file->path, &file->mtime, &file->size);
+
+#ifdef __LINUX__
+    if (watch->fd != -1) {
+        // watch directory: saving by rename replaces the file inode
+        char dir[256];
+        char *slash;
+
+        snprintf(dir, sizeof(dir), "%s", path);
+        slash = strrchr(dir, '/');
+        if (! slash) {
+            snprintf(dir, sizeof(dir), ".");
+        } else if (slash == dir) {
+            dir[1] = 0;
+        } else {
+            *slash = 0;
+        }
+
+        if (inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB) == -1) {
+            printf("Warn: inotify_add_watch(%s) failed: %s\n", dir, strerror(errno));
+        }
+    }
+#endif
+
+    return watch->numFiles++;
+}
+
+
+MapWatchFile * MapWatchFind(MapWatch *watch, const char *path)
+{
+    for (int i = 0; i < watch->numFiles; i++) {
+        if (! strcmp(watch->files[i].path, path)) {
+            return &watch->files[i];
+        }
+    }
+    return 0;
+}
+
+
+int MapWatchIsChanged(MapWatch *watch, const char *path)
+{
+    MapWatchFile *file = MapWatchFind(watch, path);
+    return file? file->changed : 0;
+}
+
+
+void MapWatchClearChanged(MapWatch *watch)
+{
+    for (int i = 0; i < watch->numFiles; i++) {
+        watch->files[i].changed = 0;
+    }
+}
+
+
+int MapWatchPoll(MapWatch *watch)
+{
+    int changes = 0;
+
+#ifdef __LINUX__
+    if (watch->fd != -1) {
+        char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        int numEvents = 0;
+        ssize_t len;
+
+        // drain events. any event in watched directories leads to checking stat
+        while ((len = read(watch->fd, events, sizeof(events))) > 0) {
+            numEvents++;
+        }
+        if (! numEvents) {
+            return 0;
+        }
+    }
+#endif
+
+    for (int i = 0; i < watch->numFiles; i++) {
+        MapWatchFile *file = &watch->files[i];
+        int64_t mtime, size;
+
+        MapWatchStat(file->path, &mtime, &size);
+        if (mtime != file->mtime || size != file->size) {
+            file->mtime = mtime;
+            file->size = size;
+            if (! file->changed) {
+                file->changed = 1;
+                changes++;
+            }
+        }
+    }
+
+    return changes;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file mapwatch.h
+ * @brief watch files of map layers for changes.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-12 09:20:15
+ * @date 2024-11-12 16:48:32
+ *
+ * @note
+ *   Linux 上用 inotify 监视文件所在的目录 (编辑器常以改名方式保存), 没有事件时
+ *   MapWatchPoll 不访问文件系统. 其他平台或 inotify 不可用时每次比较 stat 的
+ *   修改时间和大小. 调用方自己控制轮询间隔.
+ */
+#ifndef MAP_WATCH_H__
+#define MAP_WATCH_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include <common/memapi.h>
+
+
+typedef struct
+{
+    char path[256];
+
+    // modified time (nanoseconds on Linux) and size, -1 if not exists
+    int64_t mtime;
+    int64_t size;
+
+    // set by MapWatchPoll, cleared by caller
+    int changed;
+} MapWatchFile;
+
+
+typedef struct
+{
+    MapWatchFile *files;
+    int numFiles;
+    int capacity;
+
+    // inotify fd, -1 for stat polling
+    int fd;
+} MapWatch;
+
+
+void MapWatchInit(MapWatch *watch);
+
+void MapWatchFinal(MapWatch *watch);
+
+// watch path (ignored if already watched). returns index of file
+int MapWatchAdd(MapWatch *watch, const char *path);
+
+// returns file watched by path or NULL
+MapWatchFile * MapWatchFind(MapWatch *watch, const char *path);
+
+// test file changed (since last MapWatchClearChanged)
+int MapWatchIsChanged(MapWatch *watch, const char *path);
+
+void MapWatchClearChanged(MapWatch *watch);
+
+// check files for changes. returns number of files newly changed
+int MapWatchPoll(MapWatch *watch);
+
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* MAP_WATCH_H__ */
@@ -435,14 +435,44 @@ int DBFAddField (DBFHandle psDBF, const char * pszFieldName, DBFFieldType eType,
 }
 
 
+/**
+ * Copy field iField of record pabyRec as string into szStringField
+ */
+static void DBFCopyField (DBFHandle psDBF, const unsigned char *pabyRec, int iField, char *szStringField)
+{
+    strncpy(szStringField, ((const char *) pabyRec) + psDBF->panFieldOffset[iField],
+        psDBF->panFieldSize[iField]);
+    szStringField[ psDBF->panFieldSize[iField] ] = '\0';
+
+#ifdef TRIM_DBF_WHITESPACE
+    /* Should we trim white space off the string attribute value? */
+    {
+        char *pchSrc, *pchDst;
+
+        pchDst = pchSrc = szStringField;
+        while (*pchSrc == ' ') {
+            pchSrc++;
+        }
+
+        while (*pchSrc != '\0') {
+            *(pchDst++) = * (pchSrc++);
+        }
+
+        *pchDst = '\0';
+        while (pchDst != szStringField && * (--pchDst) == ' ') {
+            *pchDst = '\0';
+        }
+    }
+#endif
+}
+
+
 /**
  * Read one of the attribute fields of a record
  */
 static void *DBFReadAttribute (DBFHandle psDBF, int hEntity, int iField, char chReqType)
 {
     int           nRecordOffset;
-    unsigned char *pabyRec;
-    void          *pReturnField = 0;
 
     if (hEntity < 0 || hEntity >= psDBF->nRecords) {
         return (0);
@@ -469,40 +499,88 @@ static void *DBFReadAttribute (DBFHandle psDBF, int hEntity, int iField, char ch
         psDBF->nCurrentRecord = hEntity;
     }
 
-    pabyRec = (unsigned char *) psDBF->pszCurrentRecord;
-
-    strncpy(psDBF->szStringField, ((const char *) pabyRec) + psDBF->panFieldOffset[iField],
-        psDBF->panFieldSize[iField]);
-    psDBF->szStringField[ psDBF->panFieldSize[iField] ] = '\0';
-
-    pReturnField = psDBF->szStringField;
+    DBFCopyField(psDBF, (const unsigned char *) psDBF->pszCurrentRecord, iField, psDBF->szStringField);
 
     if (chReqType == 'N') {
         psDBF->dDoubleField = atof (psDBF->szStringField);
-        pReturnField = &psDBF->dDoubleField;
+        return &psDBF->dDoubleField;
     }
-#ifdef TRIM_DBF_WHITESPACE
-    /* Should we trim white space off the string attribute value? */
-    else {
-        char *pchSrc, *pchDst;
 
-        pchDst = pchSrc = psDBF->szStringField;
-        while (*pchSrc == ' ') {
-            pchSrc++;
-        }
+    return psDBF->szStringField;
+}
 
-        while (*pchSrc != '\0') {
-            *(pchDst++) = * (pchSrc++);
+
+/**
+ * Reentrant DBFReadAttribute: record and field buffers are in ctx.
+ *   psDBF must not have unflushed changes (opened with "rb").
+ */
+static void *DBFReadAttributeR (DBFHandle psDBF, DBFReadContext *ctx, int hEntity, int iField, char chReqType)
+{
+    if (hEntity < 0 || hEntity >= psDBF->nRecords) {
+        return (0);
+    }
+
+    if (iField < 0 || iField >= psDBF->nFields) {
+        return (0);
+    }
+
+    if (ctx->hDBF != psDBF || ctx->nRecord != hEntity) {
+        if (psDBF->nRecordLength > ctx->nBufSize) {
+            ctx->nBufSize = psDBF->nRecordLength;
+            ctx->pszRecord = (char *) SfRealloc(ctx->pszRecord, ctx->nBufSize);
         }
 
-        *pchDst = '\0';
-        while (pchDst != psDBF->szStringField && * (--pchDst) == ' ') {
-            *pchDst = '\0';
+        ctx->nRecord = -1;
+        if (! SfPread(psDBF->fp, ctx->pszRecord, psDBF->nRecordLength, (long) psDBF->nRecordLength * hEntity + psDBF->nHeaderLength)) {
+            return 0;
         }
+
+        ctx->hDBF = psDBF;
+        ctx->nRecord = hEntity;
+    }
+
+    DBFCopyField(psDBF, (const unsigned char *) ctx->pszRecord, iField, ctx->szStringField);
+
+    if (chReqType == 'N') {
+        ctx->dDoubleField = atof (ctx->szStringField);
+        return &ctx->dDoubleField;
     }
-#endif
 
-    return (pReturnField);
+    return ctx->szStringField;
+}
+
+
+void DBFReadContextInit (DBFReadContext *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->nRecord = -1;
+}
+
+
+void DBFReadContextFinal (DBFReadContext *ctx)
+{
+    free(ctx->pszRecord);
+    DBFReadContextInit(ctx);
+}
+
+
+int DBFReadIntegerAttributeR (DBFHandle psDBF, DBFReadContext *ctx, int iRecord, int iField)
+{
+    double *pdValue = (double*) DBFReadAttributeR (psDBF, ctx, iRecord, iField, 'N');
+    return pdValue? (int) *pdValue : 0;
+}
+
+
+double DBFReadDoubleAttributeR (DBFHandle psDBF, DBFReadContext *ctx, int iRecord, int iField)
+{
+    double *pdValue = (double*) DBFReadAttributeR (psDBF, ctx, iRecord, iField, 'N');
+    return pdValue? *pdValue : 0.0;
+}
+
+
+const char * DBFReadStringAttributeR (DBFHandle psDBF, DBFReadContext *ctx, int iRecord, int iField)
+{
+    return (const char *) DBFReadAttributeR (psDBF, ctx, iRecord, iField, 'C');
 }
 
 
@@ -47,6 +47,9 @@ const char * shapefile_lib_version(const char **_libname)
 }
 
 
+static int SHPWriteIndexEntries(SHPHandle psSHP);
+
+
 /**
  * Write out a header for the .shp and .shx files as well as the
  *   contents of the index (.shx) file
@@ -57,7 +60,11 @@ void SHPWriteHeader (SHPHandle psSHP)
     int      i;
     int      i32;
     double   dValue;
-    int      *panSHX;
+
+    /* Buffered records first */
+    if (! SHPFlushAppend(psSHP)) {
+        return;
+    }
 
     /* Prepare header block for .shp file */
     for (i = 0; i < 100; i++) {
@@ -150,30 +157,8 @@ void SHPWriteHeader (SHPHandle psSHP)
         return;
     }
 
-    /* Write out the .shx contents */
-    panSHX = (int *) malloc(sizeof(int) * 2 * psSHP->nRecords);
-
-    if (_host_big_endian) {
-        for (i = 0; i < psSHP->nRecords; i++) {
-            panSHX[i*2  ] = psSHP->panRecOffset[i]/2;
-            panSHX[i*2+1] = psSHP->panRecSize[i]/2;
-        }
-    } else {
-        for (i = 0; i < psSHP->nRecords; i++) {
-            panSHX[i*2  ] = psSHP->panRecOffset[i]/2;
-            panSHX[i*2+1] = psSHP->panRecSize[i]/2;
-
-            /* !_host_big_endian */
-            BO_swap_dword(panSHX+i*2);
-            BO_swap_dword(panSHX+i*2+1);
-        }
-    }
-
-    if ((int)fwrite(panSHX, sizeof(int)*2, psSHP->nRecords, psSHP->fpSHX) != psSHP->nRecords) {
-        perror("Failure writing .shx contents.\n");
-    }
-
-    free(panSHX);
+    /* Write out the .shx contents not written yet */
+    SHPWriteIndexEntries(psSHP);
 
     /* Flush to disk */
     fflush(psSHP->fpSHP);
@@ -374,6 +359,7 @@ SHPHandle SHPOpen (const char * pszLayer, const char * pszAccess)
 
     /* Read the .shx file to get the offsets to each record in the .shp file */
     psSHP->nMaxRecords = psSHP->nRecords;
+    psSHP->nSHXWritten = psSHP->nRecords;
     psSHP->panRecOffset = (int *) malloc(sizeof(int) * MAX_V2(1, psSHP->nMaxRecords));
     psSHP->panRecSize = (int *) malloc(sizeof(int) * MAX_V2(1, psSHP->nMaxRecords));
     pabyBuf = (ub1 *) malloc(8 * MAX_V2(1, psSHP->nRecords));
@@ -388,25 +374,17 @@ SHPHandle SHPOpen (const char * pszLayer, const char * pszAccess)
         return (0);
     }
 
-    if (_host_big_endian) {
-        for (i = 0; i < psSHP->nRecords; i++) {
-            memcpy(&nOffset, pabyBuf + i * 8, 4);
-            memcpy(&nLength, pabyBuf + i * 8 + 4, 4);
-
-            psSHP->panRecOffset[i] = nOffset*2;
-            psSHP->panRecSize[i] = nLength*2;
-        }
-    } else {
-        for (i = 0; i < psSHP->nRecords; i++) {
-            memcpy(&nOffset, pabyBuf + i * 8, 4);
-            BO_swap_dword(&nOffset);
+    /* .shx entries are big endian */
+    if (!_host_big_endian) {
+        SHPKernelSwap32(pabyBuf, pabyBuf, psSHP->nRecords * 2);
+    }
 
-            memcpy(&nLength, pabyBuf + i * 8 + 4, 4);
-            BO_swap_dword(&nLength);
+    for (i = 0; i < psSHP->nRecords; i++) {
+        memcpy(&nOffset, pabyBuf + i * 8, 4);
+        memcpy(&nLength, pabyBuf + i * 8 + 4, 4);
 
-            psSHP->panRecOffset[i] = nOffset*2;
-            psSHP->panRecSize[i] = nLength*2;
-        }
+        psSHP->panRecOffset[i] = nOffset*2;
+        psSHP->panRecSize[i] = nLength*2;
     }
 
     free(pabyBuf);
@@ -427,6 +405,7 @@ void SHPClose(SHPHandle psSHP)
     }
 
     /* Free all resources, and close files */
+    free(psSHP->pabyAppend);
     free(psSHP->panRecOffset);
     free(psSHP->panRecSize);
     fclose(psSHP->fpSHX);
@@ -472,6 +451,25 @@ void SHPGetInfo(SHPHandle psSHP,
 }
 
 
+/**
+ * SHPGetRecordTable()
+ *   offsets and sizes (bytes, without record header) of records in shp file.
+ *   the tables are owned by hSHP and valid until SHPClose.
+ * Returns:
+ *   number of records
+ */
+int SHPGetRecordTable(SHPHandle hSHP, const int **panRecOffset, const int **panRecSize)
+{
+    if (panRecOffset) {
+        *panRecOffset = hSHP->panRecOffset;
+    }
+    if (panRecSize) {
+        *panRecSize = hSHP->panRecSize;
+    }
+    return hSHP->nRecords;
+}
+
+
 /**
  * SHPGetType()
  */
@@ -610,7 +608,7 @@ SHPHandle SHPCreate(const char * pszLayer, int nShapeType)
  * Compute a bounds rectangle for a shape, and set it into the
  *  indicated location in the record
  */
-static void _SHPSetBounds(ub1 * pabyRec, SHPObject * psShape)
+static void _SHPSetBounds(ub1 * pabyRec, const SHPObject * psShape)
 {
     ByteCopy(&(psShape->dfXMin), pabyRec +  0, 8);
     ByteCopy(&(psShape->dfYMin), pabyRec +  8, 8);
@@ -828,6 +826,19 @@ SHPObjectEx * SHPCreateObjectEx (SHPObjectEx ** ppsObject)
 }
 
 
+/**
+ * Create a nil shape object taking itself and its buffers from arena.
+ *   they are taken back by rewinding arena, SHPDestroyObjectEx() does
+ *   nothing on it.
+ */
+SHPObjectEx * SHPCreateObjectExArena (SHPObjectEx ** ppsObject, struct _mem_arena_t *arena)
+{
+    *ppsObject = (SHPObjectEx *) mem_arena_alloc_zero(arena, 1, sizeof(SHPObjectEx));
+    (*ppsObject)->pArena = arena;
+    return (*ppsObject);
+}
+
+
 /**
  * Create a simple (common) shape object
  * Destroy with SHPDestroyObject()
@@ -844,37 +855,23 @@ SHPObject * SHPCreateSimpleObject (
 
 
 /**
- * Write out the vertices of a new structure
- *  Note that it is only possible to write vertices at the end of the file
+ * Max bytes of record for psObject (with record header)
  */
-int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
+static int SHPRecordSizeBound(const SHPObject * psObject)
 {
-    ub1   *pabyRec;
-    int    i32;
-    int    nRecordOffset, i, nRecordSize = 0;
-
-    psSHP->bUpdated = SHAPEFILE_TRUE;
-
-    /* Ensure that shape object matches the type of the file it is being written to */
-    SHAPEFILE_ASSERT(psObject->nSHPType == psSHP->nShapeType || psObject->nSHPType == SHPT_NULL);
-
-    /* Either blow an assertion, or if they are disabled,
-   *  set the shapeid to -1 for appends */
-    SHAPEFILE_ASSERT(nShapeId == -1 || (nShapeId >= 0 && nShapeId < psSHP->nRecords));
-
-    if (nShapeId != -1 && nShapeId >= psSHP->nRecords) {
-        nShapeId = -1;
-    }
+    return psObject->nVertices * 4 * sizeof(double) + psObject->nParts * 8 + 128;
+}
 
-    /* Add the new entity to the in memory index */
-    if (nShapeId == -1 && psSHP->nRecords+1 > psSHP->nMaxRecords) {
-        psSHP->nMaxRecords =(int) (psSHP->nMaxRecords * 1.3 + 100);
-        psSHP->panRecOffset = (int *) SfRealloc(psSHP->panRecOffset,sizeof(int) * psSHP->nMaxRecords);
-        psSHP->panRecSize = (int *) SfRealloc(psSHP->panRecSize,sizeof(int) * psSHP->nMaxRecords);
-    }
 
-    /* Initialize record */
-    pabyRec = (ub1 *) malloc(psObject->nVertices * 4 * sizeof(double) + psObject->nParts * 8 + 128);
+/**
+ * Encode psObject into pabyRec (with record header) for record nShapeId.
+ * Returns:
+ *   size of record in bytes, -1 if unknown shape type
+ */
+static int SHPEncodeObject(int nShapeId, const SHPObject * psObject, ub1 *pabyRec)
+{
+    int    i32;
+    int    nRecordSize = 0;
 
     /* Extract vertices for a Polygon or Arc */
     if (psObject->nSHPType == SHPT_POLYGON ||
@@ -903,73 +900,42 @@ int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
         /* Write part start positions */
         ByteCopy(psObject->panPartStart, pabyRec + 44 + 8, 4 * psObject->nParts);
         if (_host_big_endian) {
-            for (i = 0; i < psObject->nParts; i++) {
-                BO_swap_dword(pabyRec + 44 + 8 + 4*i);
-                nRecordSize += 4;
-            }
-        } else {
-            nRecordSize += (4 * psObject->nParts);
+            SHPKernelSwap32(pabyRec + nRecordSize, pabyRec + nRecordSize, psObject->nParts);
         }
+        nRecordSize += (4 * psObject->nParts);
 
         /* Write multipatch part types if needed */
         if (psObject->nSHPType == SHPT_MULTIPATCH) {
             memcpy(pabyRec + nRecordSize, psObject->panPartType, 4*psObject->nParts);
 
             if (_host_big_endian) {
-                for (i = 0; i < psObject->nParts; i++) {
-                    BO_swap_dword(pabyRec + nRecordSize);
-                    nRecordSize += 4;
-                }
-            } else {
-                nRecordSize += (4 * psObject->nParts);
+                SHPKernelSwap32(pabyRec + nRecordSize, pabyRec + nRecordSize, psObject->nParts);
             }
+            nRecordSize += (4 * psObject->nParts);
         }
 
         /* Write the (x,y) vertex values */
+        for (i = 0; i < psObject->nVertices; i++) {
+            ByteCopy(psObject->padfX + i, pabyRec + nRecordSize + i * 16, 8);
+            ByteCopy(psObject->padfY + i, pabyRec + nRecordSize + i * 16 + 8, 8);
+        }
         if (_host_big_endian) {
-            for (i = 0; i < psObject->nVertices; i++) {
-                ByteCopy(psObject->padfX + i, pabyRec + nRecordSize, 8);
-                ByteCopy(psObject->padfY + i, pabyRec + nRecordSize + 8, 8);
-                BO_swap_qword(pabyRec + nRecordSize);
-                BO_swap_qword(pabyRec + nRecordSize + 8);
-                nRecordSize += 2 * 8;
-            }
-        } else {
-            for (i = 0; i < psObject->nVertices; i++) {
-                ByteCopy(psObject->padfX + i, pabyRec + nRecordSize, 8);
-                ByteCopy(psObject->padfY + i, pabyRec + nRecordSize + 8, 8);
-                nRecordSize += 2 * 8;
-            }
+            SHPKernelSwap64(pabyRec + nRecordSize, pabyRec + nRecordSize, 2 * psObject->nVertices);
         }
+        nRecordSize += 16 * psObject->nVertices;
 
-        /* Write the Z coordinates (if any) */
+        /* Write the Z coordinates (if any): range and values */
         if (psObject->nSHPType == SHPT_POLYGONZ ||
             psObject->nSHPType == SHPT_ARCZ ||
             psObject->nSHPType == SHPT_MULTIPATCH) {
             ByteCopy(&(psObject->dfZMin), pabyRec + nRecordSize, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-            }
-            nRecordSize += 8;
-
-            ByteCopy(&(psObject->dfZMax), pabyRec + nRecordSize, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-            }
-            nRecordSize += 8;
+            ByteCopy(&(psObject->dfZMax), pabyRec + nRecordSize + 8, 8);
+            ByteCopy(psObject->padfZ, pabyRec + nRecordSize + 16, 8 * psObject->nVertices);
 
             if (_host_big_endian) {
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfZ + i, pabyRec + nRecordSize, 8);
-                    BO_swap_qword(pabyRec + nRecordSize);
-                    nRecordSize += 8;
-                }
-            } else {
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfZ + i, pabyRec + nRecordSize, 8);
-                    nRecordSize += 8;
-                }
+                SHPKernelSwap64(pabyRec + nRecordSize, pabyRec + nRecordSize, 2 + psObject->nVertices);
             }
+            nRecordSize += 16 + 8 * psObject->nVertices;
         }
 
         /* Write the M values, if any */
@@ -979,29 +945,13 @@ int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
 #endif
             || psObject->nSHPType == SHPT_POLYGONZ || psObject->nSHPType == SHPT_ARCZ) {
             ByteCopy(&(psObject->dfMMin), pabyRec + nRecordSize, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-            }
-            nRecordSize += 8;
-
-            ByteCopy(&(psObject->dfMMax), pabyRec + nRecordSize, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-            }
-            nRecordSize += 8;
+            ByteCopy(&(psObject->dfMMax), pabyRec + nRecordSize + 8, 8);
+            ByteCopy(psObject->padfM, pabyRec + nRecordSize + 16, 8 * psObject->nVertices);
 
             if (_host_big_endian) {
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfM + i, pabyRec + nRecordSize, 8);
-                    BO_swap_qword(pabyRec + nRecordSize);
-                    nRecordSize += 8;
-                }
-            } else {
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfM + i, pabyRec + nRecordSize, 8);
-                    nRecordSize += 8;
-                }
+                SHPKernelSwap64(pabyRec + nRecordSize, pabyRec + nRecordSize, 2 + psObject->nVertices);
             }
+            nRecordSize += 16 + 8 * psObject->nVertices;
         }
     } else if (psObject->nSHPType == SHPT_MULTIPOINT ||
         psObject->nSHPType == SHPT_MULTIPOINTZ ||
@@ -1018,79 +968,36 @@ int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
         }
         ByteCopy(&nPoints, pabyRec + 44, 4);
 
+        for (i = 0; i < psObject->nVertices; i++) {
+            ByteCopy(psObject->padfX + i, pabyRec + 48 + i*16, 8);
+            ByteCopy(psObject->padfY + i, pabyRec + 48 + i*16 + 8, 8);
+        }
         if (_host_big_endian) {
-            for (i = 0; i < psObject->nVertices; i++) {
-                ByteCopy(psObject->padfX + i, pabyRec + 48 + i*16, 8);
-                ByteCopy(psObject->padfY + i, pabyRec + 48 + i*16 + 8, 8);
-                BO_swap_qword(pabyRec + 48 + i*16);
-                BO_swap_qword(pabyRec + 48 + i*16 + 8);
-            }
-        } else {
-            for (i = 0; i < psObject->nVertices; i++) {
-                ByteCopy(psObject->padfX + i, pabyRec + 48 + i*16, 8);
-                ByteCopy(psObject->padfY + i, pabyRec + 48 + i*16 + 8, 8);
-            }
+            SHPKernelSwap64(pabyRec + 48, pabyRec + 48, 2 * psObject->nVertices);
         }
 
         nRecordSize = 48 + 16 * psObject->nVertices;
 
         if (psObject->nSHPType == SHPT_MULTIPOINTZ) {
-
             ByteCopy(&(psObject->dfZMin), pabyRec + nRecordSize, 8);
+            ByteCopy(&(psObject->dfZMax), pabyRec + nRecordSize + 8, 8);
+            ByteCopy(psObject->padfZ, pabyRec + nRecordSize + 16, 8 * psObject->nVertices);
 
             if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-                nRecordSize += 8;
-                ByteCopy(&(psObject->dfZMax), pabyRec + nRecordSize, 8);
-                BO_swap_qword(pabyRec + nRecordSize);
-                nRecordSize += 8;
-
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfZ + i, pabyRec + nRecordSize, 8);
-                    BO_swap_qword(pabyRec + nRecordSize);
-                    nRecordSize += 8;
-                }
-            } else {
-                nRecordSize += 8;
-                ByteCopy(&(psObject->dfZMax), pabyRec + nRecordSize, 8);
-                nRecordSize += 8;
-
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfZ + i, pabyRec + nRecordSize, 8);
-                    nRecordSize += 8;
-                }
+                SHPKernelSwap64(pabyRec + nRecordSize, pabyRec + nRecordSize, 2 + psObject->nVertices);
             }
+            nRecordSize += 16 + 8 * psObject->nVertices;
         }
 
         if (psObject->nSHPType == SHPT_MULTIPOINTZ || psObject->nSHPType == SHPT_MULTIPOINTM) {
             ByteCopy(&(psObject->dfMMin), pabyRec + nRecordSize, 8);
+            ByteCopy(&(psObject->dfMMax), pabyRec + nRecordSize + 8, 8);
+            ByteCopy(psObject->padfM, pabyRec + nRecordSize + 16, 8 * psObject->nVertices);
 
             if (_host_big_endian) {
-                BO_swap_qword(pabyRec + nRecordSize);
-                nRecordSize += 8;
-
-                ByteCopy(&(psObject->dfMMax), pabyRec + nRecordSize, 8);
-
-                BO_swap_qword(pabyRec + nRecordSize);
-                nRecordSize += 8;
-
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfM + i, pabyRec + nRecordSize, 8);
-                    BO_swap_qword(pabyRec + nRecordSize);
-                    nRecordSize += 8;
-                }
-            } else {
-                nRecordSize += 8;
-
-                ByteCopy(&(psObject->dfMMax), pabyRec + nRecordSize, 8);
-
-                nRecordSize += 8;
-
-                for (i = 0; i < psObject->nVertices; i++) {
-                    ByteCopy(psObject->padfM + i, pabyRec + nRecordSize, 8);
-                    nRecordSize += 8;
-                }
+                SHPKernelSwap64(pabyRec + nRecordSize, pabyRec + nRecordSize, 2 + psObject->nVertices);
             }
+            nRecordSize += 16 + 8 * psObject->nVertices;
         }
     } else if (psObject->nSHPType == SHPT_POINT ||
         psObject->nSHPType == SHPT_POINTZ ||
@@ -1127,21 +1034,7 @@ int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
     } else {
         /* unknown type */
         SHAPEFILE_ASSERT(SHAPEFILE_FALSE);
-    }
-
-    /* Establish where we are going to put this record. If we are
-   *  rewriting and existing record, and it will fit, then put it
-   *  back where the original came from.  Otherwise write at the end
-   */
-    if (nShapeId == -1 || psSHP->panRecSize[nShapeId] < nRecordSize-8) {
-        if (nShapeId == -1) {
-            nShapeId = psSHP->nRecords++;
-        }
-        psSHP->panRecOffset[nShapeId] = nRecordOffset = psSHP->nFileSize;
-        psSHP->panRecSize[nShapeId] = nRecordSize-8;
-        psSHP->nFileSize += nRecordSize;
-    } else {
-        nRecordOffset = psSHP->panRecOffset[nShapeId];
+        return -1;
     }
 
     /* Set the shape type, record number, and record size */
@@ -1163,169 +1056,393 @@ int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
     }
     ByteCopy(&i32, pabyRec + 8, 4);
 
-    /* Write out record */
-    if (fseek(psSHP->fpSHP, nRecordOffset, 0) != 0 || fwrite(pabyRec, nRecordSize, 1, psSHP->fpSHP) < 1) {
-        free(pabyRec);
-        return -1;
-    }
+    return nRecordSize;
+}
 
-    free(pabyRec);
 
-    /* Expand file wide bounds based on this shape */
-    if (psSHP->adBoundsMin[0] == 0.0 && psSHP->adBoundsMax[0] == 0.0 &&
-        psSHP->adBoundsMin[1] == 0.0 && psSHP->adBoundsMax[1] == 0.0) {
-        if (psObject->nSHPType == SHPT_NULL || psObject->nVertices == 0) {
-            psSHP->adBoundsMin[0] = psSHP->adBoundsMax[0] = 0.0;
-            psSHP->adBoundsMin[1] = psSHP->adBoundsMax[1] = 0.0;
-            psSHP->adBoundsMin[2] = psSHP->adBoundsMax[2] = 0.0;
-            psSHP->adBoundsMin[3] = psSHP->adBoundsMax[3] = 0.0;
-        } else {
-            psSHP->adBoundsMin[0] = psSHP->adBoundsMax[0] = psObject->padfX[0];
-            psSHP->adBoundsMin[1] = psSHP->adBoundsMax[1] = psObject->padfY[0];
-            psSHP->adBoundsMin[2] = psSHP->adBoundsMax[2] = psObject->padfZ[0];
-            psSHP->adBoundsMin[3] = psSHP->adBoundsMax[3] = psObject->padfM[0];
-        }
+/**
+ * Expand file wide bounds based on extents of shape
+ */
+static void SHPMergeBounds(SHPHandle psSHP, const SHPObject * psObject)
+{
+    if (psObject->nSHPType == SHPT_NULL || psObject->nVertices == 0) {
+        return;
     }
 
-    for (i = 0; i < psObject->nVertices; i++) {
-        psSHP->adBoundsMin[0] = MIN_V2(psSHP->adBoundsMin[0],psObject->padfX[i]);
-        psSHP->adBoundsMin[1] = MIN_V2(psSHP->adBoundsMin[1],psObject->padfY[i]);
-        psSHP->adBoundsMin[2] = MIN_V2(psSHP->adBoundsMin[2],psObject->padfZ[i]);
-        psSHP->adBoundsMin[3] = MIN_V2(psSHP->adBoundsMin[3],psObject->padfM[i]);
-        psSHP->adBoundsMax[0] = MAX_V2(psSHP->adBoundsMax[0],psObject->padfX[i]);
-        psSHP->adBoundsMax[1] = MAX_V2(psSHP->adBoundsMax[1],psObject->padfY[i]);
-        psSHP->adBoundsMax[2] = MAX_V2(psSHP->adBoundsMax[2],psObject->padfZ[i]);
-        psSHP->adBoundsMax[3] = MAX_V2(psSHP->adBoundsMax[3],psObject->padfM[i]);
+    if (psSHP->adBoundsMin[0] == 0.0 && psSHP->adBoundsMax[0] == 0.0 &&
+        psSHP->adBoundsMin[1] == 0.0 && psSHP->adBoundsMax[1] == 0.0) {
+        psSHP->adBoundsMin[0] = psObject->dfXMin;
+        psSHP->adBoundsMin[1] = psObject->dfYMin;
+        psSHP->adBoundsMin[2] = psObject->dfZMin;
+        psSHP->adBoundsMin[3] = psObject->dfMMin;
+        psSHP->adBoundsMax[0] = psObject->dfXMax;
+        psSHP->adBoundsMax[1] = psObject->dfYMax;
+        psSHP->adBoundsMax[2] = psObject->dfZMax;
+        psSHP->adBoundsMax[3] = psObject->dfMMax;
+    } else {
+        psSHP->adBoundsMin[0] = MIN_V2(psSHP->adBoundsMin[0], psObject->dfXMin);
+        psSHP->adBoundsMin[1] = MIN_V2(psSHP->adBoundsMin[1], psObject->dfYMin);
+        psSHP->adBoundsMin[2] = MIN_V2(psSHP->adBoundsMin[2], psObject->dfZMin);
+        psSHP->adBoundsMin[3] = MIN_V2(psSHP->adBoundsMin[3], psObject->dfMMin);
+        psSHP->adBoundsMax[0] = MAX_V2(psSHP->adBoundsMax[0], psObject->dfXMax);
+        psSHP->adBoundsMax[1] = MAX_V2(psSHP->adBoundsMax[1], psObject->dfYMax);
+        psSHP->adBoundsMax[2] = MAX_V2(psSHP->adBoundsMax[2], psObject->dfZMax);
+        psSHP->adBoundsMax[3] = MAX_V2(psSHP->adBoundsMax[3], psObject->dfMMax);
     }
-
-    return(nShapeId );
 }
 
 
 /**
- * Read the vertices, parts, and other non-attribute information for one shape
+ * Grow the in memory index for one more record.
+ * Returns:
+ *   SHAPEFILE_FALSE if out of memory
  */
-SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
+static int SHPGrowRecords(SHPHandle psSHP)
 {
-    SHPObject           *psShape;
+    int nMaxRecords, *panRecOffset, *panRecSize;
 
-    /* Validate the record/entity number */
-    if (hEntity < 0 || hEntity >= psSHP->nRecords) {
-        return (0);
+    if (psSHP->nRecords < psSHP->nMaxRecords) {
+        return SHAPEFILE_TRUE;
     }
 
-    /* Ensure our record buffer is large enough */
-    if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
-        psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
-        psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
+    nMaxRecords = psSHP->nMaxRecords < 1024? 1024 : psSHP->nMaxRecords + psSHP->nMaxRecords / 2;
+
+    panRecOffset = (int *) realloc(psSHP->panRecOffset, sizeof(int) * nMaxRecords);
+    if (! panRecOffset) {
+        return SHAPEFILE_FALSE;
     }
+    psSHP->panRecOffset = panRecOffset;
 
-    /* Read the record */
-    if (fseek(psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0) != 0 ||
-        fread(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP) != 1) {
-        return 0;
+    panRecSize = (int *) realloc(psSHP->panRecSize, sizeof(int) * nMaxRecords);
+    if (! panRecSize) {
+        return SHAPEFILE_FALSE;
     }
+    psSHP->panRecSize = panRecSize;
 
-    /* Allocate and minimally initialize the object */
-    psShape = (SHPObject *) calloc(1,sizeof(SHPObject));
-    if (!psShape) {
-        return 0;
+    psSHP->nMaxRecords = nMaxRecords;
+    return SHAPEFILE_TRUE;
+}
+
+
+/**
+ * Write .shx entries of records [nSHXWritten, nRecords)
+ */
+static int SHPWriteIndexEntries(SHPHandle psSHP)
+{
+    int  anSHX[2 * 1024];
+    int  i, n;
+
+    if (psSHP->nSHXWritten >= psSHP->nRecords) {
+        return SHAPEFILE_TRUE;
     }
 
-    psShape->nShapeId = hEntity;
-    memcpy(&psShape->nSHPType, psSHP->pabyRec + 8, 4);
-    if (_host_big_endian) {
-        BO_swap_dword(&(psShape->nSHPType));
+    if (fseek(psSHP->fpSHX, 100 + 8 * (long) psSHP->nSHXWritten, 0) != 0) {
+        return SHAPEFILE_FALSE;
     }
 
-    /* Extract vertices for a Polygon or Arc */
-    if (SHPTypeHasParts(psShape->nSHPType)) {
-        int nPoints, nParts, i, nOffset;
+    while (psSHP->nSHXWritten < psSHP->nRecords) {
+        n = MIN_V2(psSHP->nRecords - psSHP->nSHXWritten, 1024);
 
-        /* Extract part/point count, and build vertex and part arrays to proper size */
-        memcpy(&nPoints, psSHP->pabyRec + 40 + 8, 4);
-        memcpy(&nParts, psSHP->pabyRec + 36 + 8, 4);
-        if (_host_big_endian) {
-            BO_swap_dword(&nPoints);
-            BO_swap_dword(&nParts);
-        }
-        if (nPoints==0) {
-            free(psShape);
-            return 0;
+        for (i = 0; i < n; i++) {
+            anSHX[i*2  ] = psSHP->panRecOffset[psSHP->nSHXWritten + i]/2;
+            anSHX[i*2+1] = psSHP->panRecSize[psSHP->nSHXWritten + i]/2;
         }
 
-        /* Get the X/Y bounds */
-        memcpy(&(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8);
-        memcpy(&(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8);
-        memcpy(&(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8);
-        memcpy(&(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8);
+        if (!_host_big_endian) {
+            SHPKernelSwap32(anSHX, anSHX, n * 2);
+        }
 
-        if (_host_big_endian) {
-            BO_swap_qword(&(psShape->dfXMin));
-            BO_swap_qword(&(psShape->dfYMin));
-            BO_swap_qword(&(psShape->dfXMax));
-            BO_swap_qword(&(psShape->dfYMax));
+        if ((int) fwrite(anSHX, sizeof(int)*2, n, psSHP->fpSHX) != n) {
+            perror("Failure writing .shx contents.\n");
+            return SHAPEFILE_FALSE;
         }
+        psSHP->nSHXWritten += n;
+    }
 
-        psShape->nVertices = nPoints;
-        psShape->padfX = (double *) calloc(nPoints, sizeof(double));
-        psShape->padfY = (double *) calloc(nPoints, sizeof(double));
-        psShape->padfZ = (double *) calloc(nPoints, sizeof(double));
-        psShape->padfM = (double *) calloc(nPoints, sizeof(double));
+    return SHAPEFILE_TRUE;
+}
 
-        psShape->nParts = nParts;
-        psShape->panPartStart = (int *) calloc(nParts+1, sizeof(int));
-        psShape->panPartType = (int *) calloc(nParts, sizeof(int));
 
-        for (i = 0; i < nParts; i++) {
-            psShape->panPartType[i] = SHPP_RING;
-        }
+int SHPBeginAppend(SHPHandle psSHP, int nBufSize)
+{
+    if (psSHP->pabyAppend) {
+        return SHAPEFILE_TRUE;
+    }
 
-        /* Copy out the part array from the record */
-        memcpy(psShape->panPartStart, psSHP->pabyRec + 44 + 8, 4 * nParts);
+    if (nBufSize <= 0) {
+        nBufSize = SHP_APPEND_BUFSIZE;
+    }
 
-        if (_host_big_endian) {
-            for (i = 0; i < nParts; i++) {
-                BO_swap_dword(psShape->panPartStart+i);
-            }
-        }
+    psSHP->pabyAppend = (unsigned char *) malloc(nBufSize);
+    if (! psSHP->pabyAppend) {
+        return SHAPEFILE_FALSE;
+    }
 
-        nOffset = 44 + 8 + 4*nParts;
+    psSHP->nAppendBufSize = nBufSize;
+    psSHP->nAppendUsed = 0;
+    return SHAPEFILE_TRUE;
+}
 
-        psShape->panPartStart[psShape->nParts] = psShape->nVertices;
 
-        /* If this is a multipatch, we will also have parts types */
-        if (psShape->nSHPType == SHPT_MULTIPATCH) {
-            memcpy(psShape->panPartType, psSHP->pabyRec + nOffset, 4*nParts);
+int SHPFlushAppend(SHPHandle psSHP)
+{
+    if (psSHP->nAppendUsed > 0) {
+        if (fseek(psSHP->fpSHP, psSHP->nAppendOffset, 0) != 0 ||
+            fwrite(psSHP->pabyAppend, psSHP->nAppendUsed, 1, psSHP->fpSHP) != 1) {
+            return SHAPEFILE_FALSE;
+        }
+        psSHP->nAppendUsed = 0;
 
-            if (_host_big_endian) {
-                for (i = 0; i < nParts; i++) {
-                    BO_swap_dword(psShape->panPartType+i);
-                }
-            }
-            nOffset += 4*nParts;
+        if (! SHPWriteIndexEntries(psSHP)) {
+            return SHAPEFILE_FALSE;
         }
 
-        /* Copy out the vertices from the record */
-        if (_host_big_endian) {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(psShape->padfX + i, psSHP->pabyRec + nOffset + i * 16, 8);
-                memcpy(psShape->padfY + i, psSHP->pabyRec + nOffset + i * 16 + 8, 8);
+        /* appended records are visible to pread */
+        fflush(psSHP->fpSHP);
+        fflush(psSHP->fpSHX);
+    }
 
-                BO_swap_qword(psShape->padfX + i);
-                BO_swap_qword(psShape->padfY + i);
-            }
-        } else {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(psShape->padfX + i, psSHP->pabyRec + nOffset + i * 16, 8);
-                memcpy(psShape->padfY + i, psSHP->pabyRec + nOffset + i * 16 + 8, 8);
-            }
-        }
+    return SHAPEFILE_TRUE;
+}
 
-        nOffset += 16*nPoints;
 
-        /* If we have a Z coordinate, collect that now */
-        if (psShape->nSHPType == SHPT_POLYGONZ || psShape->nSHPType == SHPT_ARCZ || psShape->nSHPType == SHPT_MULTIPATCH) {
+int SHPEndAppend(SHPHandle psSHP)
+{
+    int ret = SHPFlushAppend(psSHP);
+
+    free(psSHP->pabyAppend);
+    psSHP->pabyAppend = 0;
+    psSHP->nAppendBufSize = 0;
+    return ret;
+}
+
+
+/**
+ * Write out the vertices of a new structure
+ *  Note that it is only possible to write vertices at the end of the file
+ */
+int SHPWriteObject(SHPHandle psSHP, int nShapeId, SHPObject * psObject)
+{
+    ub1   *pabyRec;
+    int    nRecordOffset, nRecordSize, nBound;
+
+    psSHP->bUpdated = SHAPEFILE_TRUE;
+
+    /* Ensure that shape object matches the type of the file it is being written to */
+    SHAPEFILE_ASSERT(psObject->nSHPType == psSHP->nShapeType || psObject->nSHPType == SHPT_NULL);
+
+    /* Either blow an assertion, or if they are disabled,
+   *  set the shapeid to -1 for appends */
+    SHAPEFILE_ASSERT(nShapeId == -1 || (nShapeId >= 0 && nShapeId < psSHP->nRecords));
+
+    if (nShapeId != -1 && nShapeId >= psSHP->nRecords) {
+        nShapeId = -1;
+    }
+
+    /* Add the new entity to the in memory index */
+    if (nShapeId == -1 && ! SHPGrowRecords(psSHP)) {
+        return -1;
+    }
+
+    nBound = SHPRecordSizeBound(psObject);
+
+    if (nShapeId == -1 && psSHP->pabyAppend && nBound <= psSHP->nAppendBufSize) {
+        /* Buffered append: encode into the append buffer */
+        if (psSHP->nAppendUsed + nBound > psSHP->nAppendBufSize && ! SHPFlushAppend(psSHP)) {
+            return -1;
+        }
+        if (psSHP->nAppendUsed == 0) {
+            psSHP->nAppendOffset = psSHP->nFileSize;
+        }
+
+        nShapeId = psSHP->nRecords;
+        nRecordSize = SHPEncodeObject(nShapeId, psObject, psSHP->pabyAppend + psSHP->nAppendUsed);
+        if (nRecordSize < 0 || psSHP->nFileSize > INT_MAX - nRecordSize) {
+            return -1;
+        }
+
+        psSHP->nRecords++;
+        psSHP->panRecOffset[nShapeId] = psSHP->nFileSize;
+        psSHP->panRecSize[nShapeId] = nRecordSize-8;
+        psSHP->nFileSize += nRecordSize;
+        psSHP->nAppendUsed += nRecordSize;
+
+        SHPMergeBounds(psSHP, psObject);
+        return nShapeId;
+    }
+
+    /* Buffered records go before this one */
+    if (! SHPFlushAppend(psSHP)) {
+        return -1;
+    }
+
+    /* Initialize record: record buffer of handle reused */
+    if (nBound > psSHP->nBufSize) {
+        pabyRec = (ub1 *) realloc(psSHP->pabyRec, nBound);
+        if (! pabyRec) {
+            return -1;
+        }
+        psSHP->pabyRec = pabyRec;
+        psSHP->nBufSize = nBound;
+    }
+    pabyRec = psSHP->pabyRec;
+
+    nRecordSize = SHPEncodeObject(nShapeId == -1? psSHP->nRecords : nShapeId, psObject, pabyRec);
+    if (nRecordSize < 0) {
+        return -1;
+    }
+
+    /* Establish where we are going to put this record. If we are
+   *  rewriting and existing record, and it will fit, then put it
+   *  back where the original came from.  Otherwise write at the end
+   */
+    if (nShapeId == -1 || psSHP->panRecSize[nShapeId] < nRecordSize-8) {
+        if (psSHP->nFileSize > INT_MAX - nRecordSize) {
+            return -1;
+        }
+        if (nShapeId == -1) {
+            nShapeId = psSHP->nRecords++;
+        } else {
+            /* .shx entry of moved record rewritten */
+            psSHP->nSHXWritten = MIN_V2(psSHP->nSHXWritten, nShapeId);
+        }
+        psSHP->panRecOffset[nShapeId] = nRecordOffset = psSHP->nFileSize;
+        psSHP->panRecSize[nShapeId] = nRecordSize-8;
+        psSHP->nFileSize += nRecordSize;
+    } else {
+        nRecordOffset = psSHP->panRecOffset[nShapeId];
+    }
+
+    /* Write out record */
+    if (fseek(psSHP->fpSHP, nRecordOffset, 0) != 0 || fwrite(pabyRec, nRecordSize, 1, psSHP->fpSHP) < 1) {
+        return -1;
+    }
+
+    SHPMergeBounds(psSHP, psObject);
+
+    return(nShapeId);
+}
+
+
+/**
+ * Read the vertices, parts, and other non-attribute information for one shape
+ */
+SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
+{
+    SHPObject           *psShape;
+
+    /* Validate the record/entity number */
+    if (hEntity < 0 || hEntity >= psSHP->nRecords) {
+        return (0);
+    }
+
+    /* Records buffered by SHPBeginAppend not in file yet */
+    if (psSHP->nAppendUsed > 0) {
+        SHPFlushAppend(psSHP);
+    }
+
+    /* Ensure our record buffer is large enough */
+    if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
+        psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
+        psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
+    }
+
+    /* Read the record */
+    if (fseek(psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0) != 0 ||
+        fread(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP) != 1) {
+        return 0;
+    }
+
+    /* Allocate and minimally initialize the object */
+    psShape = (SHPObject *) calloc(1,sizeof(SHPObject));
+    if (!psShape) {
+        return 0;
+    }
+
+    psShape->nShapeId = hEntity;
+    memcpy(&psShape->nSHPType, psSHP->pabyRec + 8, 4);
+    if (_host_big_endian) {
+        BO_swap_dword(&(psShape->nSHPType));
+    }
+
+    /* Extract vertices for a Polygon or Arc */
+    if (SHPTypeHasParts(psShape->nSHPType)) {
+        int nPoints, nParts, i, nOffset;
+
+        /* Extract part/point count, and build vertex and part arrays to proper size */
+        memcpy(&nPoints, psSHP->pabyRec + 40 + 8, 4);
+        memcpy(&nParts, psSHP->pabyRec + 36 + 8, 4);
+        if (_host_big_endian) {
+            BO_swap_dword(&nPoints);
+            BO_swap_dword(&nParts);
+        }
+        if (nPoints==0) {
+            free(psShape);
+            return 0;
+        }
+
+        /* Get the X/Y bounds */
+        memcpy(&(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8);
+        memcpy(&(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8);
+        memcpy(&(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8);
+        memcpy(&(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8);
+
+        if (_host_big_endian) {
+            BO_swap_qword(&(psShape->dfXMin));
+            BO_swap_qword(&(psShape->dfYMin));
+            BO_swap_qword(&(psShape->dfXMax));
+            BO_swap_qword(&(psShape->dfYMax));
+        }
+
+        psShape->nVertices = nPoints;
+        psShape->padfX = (double *) calloc(nPoints, sizeof(double));
+        psShape->padfY = (double *) calloc(nPoints, sizeof(double));
+        psShape->padfZ = (double *) calloc(nPoints, sizeof(double));
+        psShape->padfM = (double *) calloc(nPoints, sizeof(double));
+
+        psShape->nParts = nParts;
+        psShape->panPartStart = (int *) calloc(nParts+1, sizeof(int));
+        psShape->panPartType = (int *) calloc(nParts, sizeof(int));
+
+        for (i = 0; i < nParts; i++) {
+            psShape->panPartType[i] = SHPP_RING;
+        }
+
+        /* Copy out the part array from the record */
+        memcpy(psShape->panPartStart, psSHP->pabyRec + 44 + 8, 4 * nParts);
+
+        if (_host_big_endian) {
+            SHPKernelSwap32(psShape->panPartStart, psShape->panPartStart, nParts);
+        }
+
+        nOffset = 44 + 8 + 4*nParts;
+
+        psShape->panPartStart[psShape->nParts] = psShape->nVertices;
+
+        /* If this is a multipatch, we will also have parts types */
+        if (psShape->nSHPType == SHPT_MULTIPATCH) {
+            memcpy(psShape->panPartType, psSHP->pabyRec + nOffset, 4*nParts);
+
+            if (_host_big_endian) {
+                SHPKernelSwap32(psShape->panPartType, psShape->panPartType, nParts);
+            }
+            nOffset += 4*nParts;
+        }
+
+        /* Copy out the vertices from the record */
+        for (i = 0; i < nPoints; i++) {
+            memcpy(psShape->padfX + i, psSHP->pabyRec + nOffset + i * 16, 8);
+            memcpy(psShape->padfY + i, psSHP->pabyRec + nOffset + i * 16 + 8, 8);
+        }
+        if (_host_big_endian) {
+            SHPKernelSwap64(psShape->padfX, psShape->padfX, nPoints);
+            SHPKernelSwap64(psShape->padfY, psShape->padfY, nPoints);
+        }
+
+        nOffset += 16*nPoints;
+
+        /* If we have a Z coordinate, collect that now */
+        if (psShape->nSHPType == SHPT_POLYGONZ || psShape->nSHPType == SHPT_ARCZ || psShape->nSHPType == SHPT_MULTIPATCH) {
             memcpy(&(psShape->dfZMin), psSHP->pabyRec + nOffset, 8);
             memcpy(&(psShape->dfZMax), psSHP->pabyRec + nOffset + 8, 8);
 
@@ -1333,10 +1450,7 @@ SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
                 BO_swap_qword(&(psShape->dfZMin));
                 BO_swap_qword(&(psShape->dfZMax));
 
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                    BO_swap_qword(psShape->padfZ + i);
-                }
+                SHPKernelSwap64(psShape->padfZ, psSHP->pabyRec + nOffset + 16, nPoints);
             } else {
                 for (i = 0; i < nPoints; i++) {
                     memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
@@ -1357,10 +1471,7 @@ SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
                 BO_swap_qword(&(psShape->dfMMin));
                 BO_swap_qword(&(psShape->dfMMax));
 
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                    BO_swap_qword(psShape->padfM + i);
-                }
+                SHPKernelSwap64(psShape->padfM, psSHP->pabyRec + nOffset + 16, nPoints);
             } else {
                 for (i = 0; i < nPoints; i++) {
                     memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
@@ -1388,19 +1499,13 @@ SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
         psShape->padfZ = (double *) calloc(nPoints,sizeof(double));
         psShape->padfM = (double *) calloc(nPoints,sizeof(double));
 
+        for (i = 0; i < nPoints; i++) {
+            memcpy(psShape->padfX+i, psSHP->pabyRec + 48 + 16 * i, 8);
+            memcpy(psShape->padfY+i, psSHP->pabyRec + 48 + 16 * i + 8, 8);
+        }
         if (_host_big_endian) {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(psShape->padfX+i, psSHP->pabyRec + 48 + 16 * i, 8);
-                memcpy(psShape->padfY+i, psSHP->pabyRec + 48 + 16 * i + 8, 8);
-
-                BO_swap_qword(psShape->padfX + i);
-                BO_swap_qword(psShape->padfY + i);
-            }
-        } else {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(psShape->padfX+i, psSHP->pabyRec + 48 + 16 * i, 8);
-                memcpy(psShape->padfY+i, psSHP->pabyRec + 48 + 16 * i + 8, 8);
-            }
+            SHPKernelSwap64(psShape->padfX, psShape->padfX, nPoints);
+            SHPKernelSwap64(psShape->padfY, psShape->padfY, nPoints);
         }
 
         nOffset = 48 + 16*nPoints;
@@ -1427,10 +1532,7 @@ SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
                 BO_swap_qword(&(psShape->dfZMin));
                 BO_swap_qword(&(psShape->dfZMax));
 
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                    BO_swap_qword(psShape->padfZ + i);
-                }
+                SHPKernelSwap64(psShape->padfZ, psSHP->pabyRec + nOffset + 16, nPoints);
             } else {
                 for (i = 0; i < nPoints; i++) {
                     memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
@@ -1453,10 +1555,7 @@ SHPObject * SHPReadObject(SHPHandle psSHP, int hEntity)
                 BO_swap_qword(&(psShape->dfMMin));
                 BO_swap_qword(&(psShape->dfMMax));
 
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                    BO_swap_qword(psShape->padfM + i);
-                }
+                SHPKernelSwap64(psShape->padfM, psSHP->pabyRec + nOffset + 16, nPoints);
             } else {
                 for (i = 0; i < nPoints; i++) {
                     memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
@@ -1527,6 +1626,11 @@ int SHPReadObjectBounds(SHPHandle psSHP, int hEntity, SHPBounds *Bounds, double
 {
     int nSHPType;
 
+    /* Records buffered by SHPBeginAppend not in file yet */
+    if (psSHP->nAppendUsed > 0) {
+        SHPFlushAppend(psSHP);
+    }
+
     if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
         psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
         psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
@@ -1705,21 +1809,14 @@ int SHPReadObjectBounds(SHPHandle psSHP, int hEntity, SHPBounds *Bounds, double
 }
 
 
-SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelope *env, double *pointEpsilon)
+/**
+ * envelope of shape record in pabyRec (with record header)
+ */
+static int SHPParseObjectEnvelope(const ub1 *pabyRec, SHPEnvelope *env, double *pointEpsilon)
 {
     int nSHPType;
 
-    if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
-        psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
-        psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
-    }
-
-    if (fseek(psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0) != 0 ||
-        fread(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP) != 1) {
-        return (SHPT_NULL);
-    }
-
-    memcpy(&nSHPType, psSHP->pabyRec + 8, 4);
+    memcpy(&nSHPType, pabyRec + 8, 4);
     if (_host_big_endian) {
         BO_swap_dword(&(nSHPType));
     }
@@ -1733,8 +1830,8 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
         nSHPType == SHPT_MULTIPATCH) {
         int nPoints, nParts;
 
-        memcpy(&nPoints, psSHP->pabyRec + 40 + 8, 4);
-        memcpy(&nParts, psSHP->pabyRec + 36 + 8, 4);
+        memcpy(&nPoints, pabyRec + 40 + 8, 4);
+        memcpy(&nParts, pabyRec + 36 + 8, 4);
 
         if (_host_big_endian) {
             BO_swap_dword(&nPoints);
@@ -1745,10 +1842,10 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
             return (SHPT_NULL);
         }
 
-        memcpy(&(env->XMin), psSHP->pabyRec + 8 +  4, 8);
-        memcpy(&(env->YMin), psSHP->pabyRec + 8 + 12, 8);
-        memcpy(&(env->XMax), psSHP->pabyRec + 8 + 20, 8);
-        memcpy(&(env->YMax), psSHP->pabyRec + 8 + 28, 8);
+        memcpy(&(env->XMin), pabyRec + 8 +  4, 8);
+        memcpy(&(env->YMin), pabyRec + 8 + 12, 8);
+        memcpy(&(env->XMax), pabyRec + 8 + 20, 8);
+        memcpy(&(env->YMax), pabyRec + 8 + 28, 8);
 
         if (_host_big_endian) {
             BO_swap_qword(&(env->XMin));
@@ -1760,7 +1857,7 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
         nSHPType == SHPT_MULTIPOINTM ||
         nSHPType == SHPT_MULTIPOINTZ) {
         int nPoints;
-        memcpy(&nPoints, psSHP->pabyRec + 44, 4);
+        memcpy(&nPoints, pabyRec + 44, 4);
 
         if (_host_big_endian) {
             BO_swap_dword(&nPoints);
@@ -1770,10 +1867,10 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
             return (SHPT_NULL);
         }
 
-        memcpy(&(env->XMin), psSHP->pabyRec + 8 +  4, 8);
-        memcpy(&(env->YMin), psSHP->pabyRec + 8 + 12, 8);
-        memcpy(&(env->XMax), psSHP->pabyRec + 8 + 20, 8);
-        memcpy(&(env->YMax), psSHP->pabyRec + 8 + 28, 8);
+        memcpy(&(env->XMin), pabyRec + 8 +  4, 8);
+        memcpy(&(env->YMin), pabyRec + 8 + 12, 8);
+        memcpy(&(env->XMax), pabyRec + 8 + 20, 8);
+        memcpy(&(env->YMax), pabyRec + 8 + 28, 8);
 
         if (_host_big_endian) {
             BO_swap_qword(&(env->XMin));
@@ -1784,8 +1881,8 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
     } else if (nSHPType == SHPT_POINT ||
         nSHPType == SHPT_POINTM ||
         nSHPType == SHPT_POINTZ) {
-        memcpy(&env->XMin, psSHP->pabyRec + 12, 8);
-        memcpy(&env->YMin, psSHP->pabyRec + 20, 8);
+        memcpy(&env->XMin, pabyRec + 12, 8);
+        memcpy(&env->YMin, pabyRec + 20, 8);
 
         if (_host_big_endian) {
             BO_swap_qword(&env->XMin);
@@ -1808,49 +1905,120 @@ SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelop
 }
 
 
-/**
- * Read the vertices, parts, and other non-attribute information for one shape
- *   cheungmine 2008-12
- */
-int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
+SHAPEFILE_API int SHPReadObjectEnvelope(SHPHandle psSHP, int hEntity, SHPEnvelope *env, double *pointEpsilon)
 {
-    /* Validate the record/entity number */
-    if (hEntity < 0 || hEntity >= psSHP->nRecords) {
-        return(SHAPEFILE_FALSE);
+    /* Records buffered by SHPBeginAppend not in file yet */
+    if (psSHP->nAppendUsed > 0) {
+        SHPFlushAppend(psSHP);
     }
 
-    /* Ensure our record buffer is large enough */
     if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
         psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
         psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
     }
 
-    /* Read the record */
     if (fseek(psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0) != 0 ||
         fread(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP) != 1) {
-        return(SHAPEFILE_FALSE);
-    }
-
-    /* Allocate and minimally initialize the object */
-    psShape->nShapeId = hEntity;
-    memcpy(&psShape->nSHPType, psSHP->pabyRec + 8, 4);
-    if (_host_big_endian) {
-        BO_swap_dword(&(psShape->nSHPType));
+        return (SHPT_NULL);
     }
 
-    /* Extract vertices for a Polygon or Arc */
-    if (psShape->nSHPType == SHPT_POLYGON ||
-        psShape->nSHPType == SHPT_ARC ||
-        psShape->nSHPType == SHPT_POLYGONZ ||
-        psShape->nSHPType == SHPT_POLYGONM ||
-        psShape->nSHPType == SHPT_ARCZ ||
-        psShape->nSHPType == SHPT_ARCM ||
-        psShape->nSHPType == SHPT_MULTIPATCH) {
-        int nPoints, nParts, i, nOffset;
+    return SHPParseObjectEnvelope(psSHP->pabyRec, env, pointEpsilon);
+}
 
-        /* Extract part/point count, and build vertex and part arrays to proper size */
-        memcpy(&nPoints, psSHP->pabyRec + 40 + 8, 4);
-        memcpy(&nParts, psSHP->pabyRec + 36 + 8, 4);
+
+/**
+ * grow pPoints of psShape to nPoints at least. padfZ and padfM are only
+ *   allocated by SHPObjectExZM for records having them, and then grown
+ *   along with pPoints.
+ */
+static void SHPObjectExReserve(SHPObjectEx *psShape, int nPoints)
+{
+    if (psShape->nPointsSize < nPoints) {
+        int nOldSize = psShape->nPointsSize;
+        psShape->nPointsSize = (nPoints/MEM_BLKSIZE+1)*MEM_BLKSIZE;
+        psShape->pPoints = (SHPPointType *) SfArenaRealloc(psShape->pArena, psShape->pPoints,
+            nOldSize*sizeof(SHPPointType), psShape->nPointsSize*sizeof(SHPPointType));
+        if (psShape->padfZ) {
+            psShape->padfZ = (double *) SfArenaRealloc(psShape->pArena, psShape->padfZ,
+                nOldSize*sizeof(double), psShape->nPointsSize*sizeof(double));
+        }
+        if (psShape->padfM) {
+            psShape->padfM = (double *) SfArenaRealloc(psShape->pArena, psShape->padfM,
+                nOldSize*sizeof(double), psShape->nPointsSize*sizeof(double));
+        }
+    }
+}
+
+
+/* ppadf: &psShape->padfZ or &psShape->padfM, allocated with nPointsSize */
+static double * SHPObjectExZM(SHPObjectEx *psShape, double **ppadf)
+{
+    if (! *ppadf) {
+        *ppadf = (double *) SfArenaRealloc(psShape->pArena, 0, 0, psShape->nPointsSize*sizeof(double));
+    }
+    return *ppadf;
+}
+
+
+/**
+ * copy nPoints values of Z or M (with range) at pabyRec into psShape.
+ *   pabyRec NULL: not provided, range and values (M of M types) are 0
+ */
+static void SHPObjectExCopyZM(SHPObjectEx *psShape, double **ppadf, double *pdfMin, double *pdfMax, const ub1 *pabyRec, int nPoints)
+{
+    double *padf, adfRange[2];
+
+    if (! pabyRec) {
+        *pdfMin = *pdfMax = 0;
+        if (ppadf) {
+            memset(SHPObjectExZM(psShape, ppadf), 0, sizeof(double) * nPoints);
+        }
+        return;
+    }
+
+    memcpy(adfRange, pabyRec, 16);
+
+    padf = SHPObjectExZM(psShape, ppadf);
+    memcpy(padf, pabyRec + 16, sizeof(double) * nPoints);
+
+    if (_host_big_endian) {
+        SHPKernelSwap64(adfRange, adfRange, 2);
+        SHPKernelSwap64(padf, padf, nPoints);
+    }
+
+    *pdfMin = adfRange[0];
+    *pdfMax = adfRange[1];
+}
+
+
+/**
+ * Parse shape record in pabyRec (nRecBytes with record header) into psShape
+ *   padfZ and padfM are only allocated for records having Z or M values
+ *   (M values of M types are 0 if not provided), they are left as they
+ *   are otherwise.
+ */
+int SHPParseObjectEx(const ub1 *pabyRec, int nRecBytes, int hEntity, SHPObjectEx *psShape)
+{
+    /* Allocate and minimally initialize the object */
+    psShape->nShapeId = hEntity;
+    memcpy(&psShape->nSHPType, pabyRec + 8, 4);
+    if (_host_big_endian) {
+        BO_swap_dword(&(psShape->nSHPType));
+    }
+
+    /* Extract vertices for a Polygon or Arc */
+    if (psShape->nSHPType == SHPT_POLYGON ||
+        psShape->nSHPType == SHPT_ARC ||
+        psShape->nSHPType == SHPT_POLYGONZ ||
+        psShape->nSHPType == SHPT_POLYGONM ||
+        psShape->nSHPType == SHPT_ARCZ ||
+        psShape->nSHPType == SHPT_ARCM ||
+        psShape->nSHPType == SHPT_MULTIPATCH) {
+        int nPoints, nParts, i, nOffset;
+
+        /* Extract part/point count, and build vertex and part arrays to proper size */
+        memcpy(&nPoints, pabyRec + 40 + 8, 4);
+        memcpy(&nParts, pabyRec + 36 + 8, 4);
 
         if (_host_big_endian) {
             BO_swap_dword(&nPoints);
@@ -1862,10 +2030,10 @@ int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
         }
 
         /* Get the X/Y bounds */
-        memcpy(&(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8);
-        memcpy(&(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8);
-        memcpy(&(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8);
-        memcpy(&(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8);
+        memcpy(&(psShape->dfXMin), pabyRec + 8 +  4, 8);
+        memcpy(&(psShape->dfYMin), pabyRec + 8 + 12, 8);
+        memcpy(&(psShape->dfXMax), pabyRec + 8 + 20, 8);
+        memcpy(&(psShape->dfYMax), pabyRec + 8 + 28, 8);
 
         if (_host_big_endian) {
             BO_swap_qword(&(psShape->dfXMin));
@@ -1876,19 +2044,17 @@ int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
 
         psShape->nVertices = nPoints;
 
-        if (psShape->nPointsSize < nPoints) {
-            psShape->nPointsSize = (nPoints/MEM_BLKSIZE+1)*MEM_BLKSIZE;
-            psShape->pPoints = (SHPPointType *) realloc(psShape->pPoints, psShape->nPointsSize*sizeof(SHPPointType));
-            psShape->padfZ = (double *) realloc(psShape->padfZ, psShape->nPointsSize*sizeof(double));
-            psShape->padfM = (double *) realloc(psShape->padfM, psShape->nPointsSize*sizeof(double));
-        }
+        SHPObjectExReserve(psShape, nPoints);
 
         psShape->nParts = nParts;
 
         if (psShape->nPartsSize <= nParts) {
+            int nOldSize = psShape->nPartsSize;
             psShape->nPartsSize = ((nParts+16)/16)*16;
-            psShape->panPartStart = (int *) realloc(psShape->panPartStart, psShape->nPartsSize*sizeof(int));
-            psShape->panPartType = (int *) realloc(psShape->panPartType, psShape->nPartsSize*sizeof(int));
+            psShape->panPartStart = (int *) SfArenaRealloc(psShape->pArena, psShape->panPartStart,
+                nOldSize*sizeof(int), psShape->nPartsSize*sizeof(int));
+            psShape->panPartType = (int *) SfArenaRealloc(psShape->pArena, psShape->panPartType,
+                nOldSize*sizeof(int), psShape->nPartsSize*sizeof(int));
         }
 
         for (i = 0; i < nParts; i++) {
@@ -1896,11 +2062,9 @@ int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
         }
 
         /* Copy out the part array from the record */
-        memcpy(psShape->panPartStart, psSHP->pabyRec + 44 + 8, 4 * nParts);
+        memcpy(psShape->panPartStart, pabyRec + 44 + 8, 4 * nParts);
         if (_host_big_endian) {
-            for (i = 0; i < nParts; i++) {
-                BO_swap_dword(psShape->panPartStart+i);
-            }
+            SHPKernelSwap32(psShape->panPartStart, psShape->panPartStart, nParts);
         }
         nOffset = 44 + 8 + 4*nParts;
 
@@ -1908,232 +2072,686 @@ int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
 
         /* If this is a multipatch, we will also have parts types */
         if (psShape->nSHPType == SHPT_MULTIPATCH) {
-            memcpy(psShape->panPartType, psSHP->pabyRec + nOffset, 4*nParts);
+            memcpy(psShape->panPartType, pabyRec + nOffset, 4*nParts);
             if (_host_big_endian) {
-                for (i = 0; i < nParts; i++) {
-                    BO_swap_dword(psShape->panPartType+i);
-                }
+                SHPKernelSwap32(psShape->panPartType, psShape->panPartType, nParts);
             }
             nOffset += 4*nParts;
         }
 
         /* Copy out the vertices from the record */
-        for (i = 0; i < nPoints; i++) {
-            memcpy(&psShape->pPoints[i].x, psSHP->pabyRec + nOffset + i * 16, 8);
-            memcpy(&psShape->pPoints[i].y, psSHP->pabyRec + nOffset + i * 16 + 8, 8);
-        }
+        memcpy(psShape->pPoints, pabyRec + nOffset, 16 * nPoints);
 
         if (_host_big_endian) {
-            for (i = 0; i < nPoints; i++) {
-                BO_swap_qword(&psShape->pPoints[i].x);
-                BO_swap_qword(&psShape->pPoints[i].y);
-            }
+            SHPKernelSwap64(psShape->pPoints, psShape->pPoints, 2 * nPoints);
         }
 
         nOffset += 16*nPoints;
 
         /* If we have a Z coordinate, collect that now */
         if (psShape->nSHPType == SHPT_POLYGONZ || psShape->nSHPType == SHPT_ARCZ || psShape->nSHPType == SHPT_MULTIPATCH) {
-            memcpy(&(psShape->dfZMin), psSHP->pabyRec + nOffset, 8);
-            memcpy(&(psShape->dfZMax), psSHP->pabyRec + nOffset + 8, 8);
+            SHPObjectExCopyZM(psShape, &psShape->padfZ, &psShape->dfZMin, &psShape->dfZMax, pabyRec + nOffset, nPoints);
+            nOffset += 16 + 8*nPoints;
+        } else {
+            SHPObjectExCopyZM(psShape, 0, &psShape->dfZMin, &psShape->dfZMax, 0, nPoints);
+        }
+
+        /* If we have a M measure value, then read it now.  We assume
+         *  that the measure can be present for any shape if the size is
+         *  big enough, but really it will only occur for the Z shapes
+         *  (options), and the M shapes.
+         */
+        if (nRecBytes >= nOffset + 16 + 8*nPoints) {
+            SHPObjectExCopyZM(psShape, &psShape->padfM, &psShape->dfMMin, &psShape->dfMMax, pabyRec + nOffset, nPoints);
+        } else {
+            SHPObjectExCopyZM(psShape, (psShape->nSHPType == SHPT_POLYGONM || psShape->nSHPType == SHPT_ARCM)? &psShape->padfM : 0,
+                &psShape->dfMMin, &psShape->dfMMax, 0, nPoints);
+        }
+    } else if (psShape->nSHPType == SHPT_MULTIPOINT ||
+        psShape->nSHPType == SHPT_MULTIPOINTM ||
+        psShape->nSHPType == SHPT_MULTIPOINTZ) {
+        /* Extract vertices for a MultiPoint */
+        int nPoints, nOffset;
+
+        memcpy(&nPoints, pabyRec + 44, 4);
+        if (_host_big_endian) {
+            BO_swap_dword(&nPoints);
+        }
+        if (! nPoints) {
+            return SHAPEFILE_FALSE;
+        }
+
+        psShape->nVertices = nPoints;
+
+        SHPObjectExReserve(psShape, nPoints);
+
+        memcpy(psShape->pPoints, pabyRec + 48, 16 * nPoints);
+        if (_host_big_endian) {
+            SHPKernelSwap64(psShape->pPoints, psShape->pPoints, 2 * nPoints);
+        }
+
+        nOffset = 48 + 16*nPoints;
+
+        /* Get the X/Y bounds */
+        memcpy(&(psShape->dfXMin), pabyRec + 8 +  4, 8);
+        memcpy(&(psShape->dfYMin), pabyRec + 8 + 12, 8);
+        memcpy(&(psShape->dfXMax), pabyRec + 8 + 20, 8);
+        memcpy(&(psShape->dfYMax), pabyRec + 8 + 28, 8);
+
+        if (_host_big_endian) {
+            BO_swap_qword(&(psShape->dfXMin));
+            BO_swap_qword(&(psShape->dfYMin));
+            BO_swap_qword(&(psShape->dfXMax));
+            BO_swap_qword(&(psShape->dfYMax));
+        }
+
+        /* If we have a Z coordinate, collect that now */
+        if (psShape->nSHPType == SHPT_MULTIPOINTZ) {
+            SHPObjectExCopyZM(psShape, &psShape->padfZ, &psShape->dfZMin, &psShape->dfZMax, pabyRec + nOffset, nPoints);
+            nOffset += 16 + 8*nPoints;
+        } else {
+            SHPObjectExCopyZM(psShape, 0, &psShape->dfZMin, &psShape->dfZMax, 0, nPoints);
+        }
+
+        /* If we have a M measure value, then read it now.  We assume
+         *  that the measure can be present for any shape if the size is
+         *  big enough, but really it will only occur for the Z shapes
+         * (options), and the M shapes
+         */
+        if (nRecBytes >= nOffset + 16 + 8*nPoints) {
+            SHPObjectExCopyZM(psShape, &psShape->padfM, &psShape->dfMMin, &psShape->dfMMax, pabyRec + nOffset, nPoints);
+        } else {
+            SHPObjectExCopyZM(psShape, (psShape->nSHPType == SHPT_MULTIPOINTM)? &psShape->padfM : 0,
+                &psShape->dfMMin, &psShape->dfMMax, 0, nPoints);
+        }
+    } else if (psShape->nSHPType == SHPT_POINT ||
+        psShape->nSHPType == SHPT_POINTM ||
+        psShape->nSHPType == SHPT_POINTZ) {
+        /* Extract vertices for a point */
+        int nOffset;
+        psShape->nVertices = 1;
+        SHPObjectExReserve(psShape, 1);
+        memcpy(&psShape->pPoints[0].x, pabyRec + 12, 8);
+        memcpy(&psShape->pPoints[0].y, pabyRec + 20, 8);
+
+        if (_host_big_endian) {
+            BO_swap_qword(&psShape->pPoints[0].x);
+            BO_swap_qword(&psShape->pPoints[0].y);
+        }
+
+        nOffset = 20 + 8;
+
+        /* Since no extents are supplied in the record, apply them from the single vertex */
+        psShape->dfXMin = psShape->dfXMax = psShape->pPoints[0].x;
+        psShape->dfYMin = psShape->dfYMax = psShape->pPoints[0].y;
+        psShape->dfZMin = psShape->dfZMax = 0;
+        psShape->dfMMin = psShape->dfMMax = 0;
+
+        /* If we have a Z coordinate, collect that now */
+        if (psShape->nSHPType == SHPT_POINTZ) {
+            double *padfZ = SHPObjectExZM(psShape, &psShape->padfZ);
+            memcpy(padfZ, pabyRec + nOffset, 8);
+            if (_host_big_endian) {
+                SHPKernelSwap64(padfZ, padfZ, 1);
+            }
+            psShape->dfZMin = psShape->dfZMax = padfZ[0];
+            nOffset += 8;
+        }
+
+        /* If we have a M measure value, then read it now.  We assume
+         *  that the measure can be present for any shape if the size is
+         *  big enough, but really it will only occur for the Z shapes
+         *  (options), and the M shapes
+         */
+        if (nRecBytes >= nOffset + 8) {
+            double *padfM = SHPObjectExZM(psShape, &psShape->padfM);
+            memcpy(padfM, pabyRec + nOffset, 8);
+            if (_host_big_endian) {
+                SHPKernelSwap64(padfM, padfM, 1);
+            }
+            psShape->dfMMin = psShape->dfMMax = padfM[0];
+        } else if (psShape->nSHPType == SHPT_POINTM) {
+            SHPObjectExZM(psShape, &psShape->padfM)[0] = 0;
+        }
+    } else {
+        return (SHAPEFILE_FALSE);
+    }
+
+    return (SHAPEFILE_TRUE);
+}
+
+
+/**
+ * Read the vertices, parts, and other non-attribute information for one shape
+ *   cheungmine 2008-12
+ */
+int SHPReadObjectEx(SHPHandle psSHP, int hEntity, SHPObjectEx *psShape)
+{
+    /* Validate the record/entity number */
+    if (hEntity < 0 || hEntity >= psSHP->nRecords) {
+        return(SHAPEFILE_FALSE);
+    }
+
+    /* Records buffered by SHPBeginAppend not in file yet */
+    if (psSHP->nAppendUsed > 0) {
+        SHPFlushAppend(psSHP);
+    }
+
+    /* Ensure our record buffer is large enough */
+    if (psSHP->panRecSize[hEntity]+8 > psSHP->nBufSize) {
+        psSHP->nBufSize = psSHP->panRecSize[hEntity]+8;
+        psSHP->pabyRec = (ub1 *) SfRealloc(psSHP->pabyRec,psSHP->nBufSize);
+    }
+
+    /* Read the record */
+    if (fseek(psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0) != 0 ||
+        fread(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, 1, psSHP->fpSHP) != 1) {
+        return(SHAPEFILE_FALSE);
+    }
+
+    return SHPParseObjectEx(psSHP->pabyRec, psSHP->panRecSize[hEntity]+8, hEntity, psShape);
+}
+
+
+/**
+ * SHPReadContext: reentrant reads on a shared handle
+ */
+void SHPReadContextInit(SHPReadContext *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->nEntity = -1;
+}
+
+
+void SHPReadContextFinal(SHPReadContext *ctx)
+{
+    if (! ctx->pArena) {
+        free(ctx->pabyRec);
+    }
+    SHPReadContextInit(ctx);
+}
+
+
+/**
+ * read record hEntity into ctx->pabyRec if not there yet.
+ *   only panRecOffset/panRecSize of psSHP are used: they are not changed
+ *   by reading, so threads can share a handle opened with "rb".
+ */
+static int SHPReadRecordR(SHPHandle psSHP, SHPReadContext *ctx, int hEntity)
+{
+    int nRecBytes;
+
+    if (hEntity < 0 || hEntity >= psSHP->nRecords) {
+        return SHAPEFILE_FALSE;
+    }
+
+    if (ctx->hSHP == psSHP && ctx->nEntity == hEntity) {
+        return SHAPEFILE_TRUE;
+    }
+
+    nRecBytes = psSHP->panRecSize[hEntity]+8;
+    if (nRecBytes > ctx->nBufSize) {
+        ctx->pabyRec = (ub1 *) SfArenaRealloc(ctx->pArena, ctx->pabyRec, ctx->nBufSize, nRecBytes);
+        ctx->nBufSize = nRecBytes;
+    }
+
+    ctx->nEntity = -1;
+    if (! SfPread(psSHP->fpSHP, ctx->pabyRec, nRecBytes, psSHP->panRecOffset[hEntity])) {
+        return SHAPEFILE_FALSE;
+    }
+
+    ctx->hSHP = psSHP;
+    ctx->nEntity = hEntity;
+    return SHAPEFILE_TRUE;
+}
+
+
+int SHPReadObjectEnvelopeR(SHPHandle psSHP, SHPReadContext *ctx, int hEntity, SHPEnvelope *env, double *pointEpsilon)
+{
+    if (! SHPReadRecordR(psSHP, ctx, hEntity)) {
+        return SHPT_NULL;
+    }
+    return SHPParseObjectEnvelope(ctx->pabyRec, env, pointEpsilon);
+}
+
+
+/* record header, type, bbox, nParts and nPoints: all needed for envelope */
+#define SHP_ENVELOPE_PREFIX  52
+
+int SHPReadObjectEnvelopes(SHPHandle psSHP, SHPEnvelope *envs, double *pointEpsilon)
+{
+    int i, j, nValid = 0;
+    ub1 *pabyBuf;
+    ub1 abyRec[SHP_ENVELOPE_PREFIX];
+
+    pabyBuf = (ub1 *) SfRealloc(0, SHP_FETCH_MAXREAD + SHP_ENVELOPE_PREFIX);
+
+    for (i = 0; i < psSHP->nRecords; i = j) {
+        long nStart = psSHP->panRecOffset[i];
+        long nEnd = nStart + MIN_V2(psSHP->panRecSize[i] + 8, SHP_ENVELOPE_PREFIX);
+
+        /* small records in file order are read by one pread, only the
+         * leading bytes of a record are read otherwise */
+        for (j = i + 1; j < psSHP->nRecords; j++) {
+            long nRecStart = psSHP->panRecOffset[j];
+            long nRecEnd = nRecStart + MIN_V2(psSHP->panRecSize[j] + 8, SHP_ENVELOPE_PREFIX);
+
+            if (nRecStart < nEnd || nRecStart - nEnd > SHP_FETCH_MAXGAP || nRecEnd - nStart > SHP_FETCH_MAXREAD) {
+                break;
+            }
+            nEnd = nRecEnd;
+        }
+
+        if (! SfPread(psSHP->fpSHP, pabyBuf, (int) (nEnd - nStart), nStart)) {
+            for (; i < j; i++) {
+                envs[i].XMin = 1;
+                envs[i].XMax = -1;
+            }
+            continue;
+        }
+
+        for (; i < j; i++) {
+            const ub1 *pabyRec = pabyBuf + (psSHP->panRecOffset[i] - nStart);
+            int nRecBytes = psSHP->panRecSize[i] + 8;
+
+            if (nRecBytes < SHP_ENVELOPE_PREFIX) {
+                /* point or null record: parse a zero padded copy */
+                memset(abyRec, 0, sizeof(abyRec));
+                memcpy(abyRec, pabyRec, MAX_V2(nRecBytes, 0));
+                pabyRec = abyRec;
+            }
+
+            /* null shape: XMin > XMax */
+            if (nRecBytes < 12 || SHPParseObjectEnvelope(pabyRec, &envs[i], pointEpsilon) == SHPT_NULL) {
+                envs[i].XMin = 1;
+                envs[i].XMax = -1;
+            } else {
+                nValid++;
+            }
+        }
+    }
+
+    free(pabyBuf);
+    return nValid;
+}
+
+
+int SHPReadObjectExR(SHPHandle psSHP, SHPReadContext *ctx, int hEntity, SHPObjectEx *psShape)
+{
+    if (! SHPReadRecordR(psSHP, ctx, hEntity)) {
+        return SHAPEFILE_FALSE;
+    }
+    return SHPParseObjectEx(ctx->pabyRec, psSHP->panRecSize[hEntity]+8, hEntity, psShape);
+}
+
+
+/* int of record at pabyRec in host order */
+static int SHPGeomViewInt(const ub1 *pabyRec)
+{
+    int v;
+    memcpy(&v, pabyRec, 4);
+    if (_host_big_endian) {
+        BO_swap_dword(&v);
+    }
+    return v;
+}
+
+
+/**
+ * Z or M values at *pnOffset of record (with range if nRange is 16, none
+ *   for points). returns NULL if record ends before them.
+ */
+static const double * SHPGeomViewZM(ub1 *pabyRec, int nRecBytes, int *pnOffset, int nRange, int nPoints, double *pdfMin, double *pdfMax)
+{
+    ub1 *padf = pabyRec + *pnOffset + nRange;
+
+    if (*pnOffset + nRange + 8*nPoints > nRecBytes) {
+        return NULL;
+    }
+
+    if (_host_big_endian) {
+        SHPKernelSwap64(padf, padf, nPoints);
+    }
+
+    if (nRange) {
+        double adfRange[2];
+        memcpy(adfRange, pabyRec + *pnOffset, 16);
+        if (_host_big_endian) {
+            SHPKernelSwap64(adfRange, adfRange, 2);
+        }
+        *pdfMin = adfRange[0];
+        *pdfMax = adfRange[1];
+    } else {
+        memcpy(pdfMin, padf, 8);
+        *pdfMax = *pdfMin;
+    }
+
+    *pnOffset += nRange + 8*nPoints;
+    return (const double *) padf;
+}
+
+
+int SHPParseGeomView(void *pvRec, int nRecBytes, int hEntity, SHPGeomView *view)
+{
+    ub1 *pabyRec = (ub1 *) pvRec;
+    int nSHPType, nParts = 0, nPoints, nOffset, nRange = 16, bHasZ;
+
+    /* the smallest not null record is a point */
+    if (nRecBytes < 28) {
+        return SHAPEFILE_FALSE;
+    }
+
+    nSHPType = SHPGeomViewInt(pabyRec + 8);
+
+    switch (nSHPType) {
+    case SHPT_POINT:
+    case SHPT_POINTZ:
+    case SHPT_POINTM:
+        nPoints = 1;
+        nOffset = 12;
+        nRange = 0;
+        break;
+
+    case SHPT_MULTIPOINT:
+    case SHPT_MULTIPOINTZ:
+    case SHPT_MULTIPOINTM:
+        if (nRecBytes < 48) {
+            return SHAPEFILE_FALSE;
+        }
+        nPoints = SHPGeomViewInt(pabyRec + 44);
+        nOffset = 48;
+        break;
+
+    case SHPT_ARC:
+    case SHPT_ARCZ:
+    case SHPT_ARCM:
+    case SHPT_POLYGON:
+    case SHPT_POLYGONZ:
+    case SHPT_POLYGONM:
+    case SHPT_MULTIPATCH:
+        if (nRecBytes < 52) {
+            return SHAPEFILE_FALSE;
+        }
+        nParts = SHPGeomViewInt(pabyRec + 44);
+        nPoints = SHPGeomViewInt(pabyRec + 48);
+        nOffset = 52;
+        break;
+
+    default:
+        return SHAPEFILE_FALSE;
+    }
+
+    /* parts (and types of multipatch) and points must be in record */
+    if (nPoints <= 0 || nParts < 0 ||
+        nOffset + (int64_t) nParts * (nSHPType == SHPT_MULTIPATCH? 8 : 4) + (int64_t) nPoints * 16 > nRecBytes) {
+        return SHAPEFILE_FALSE;
+    }
+
+    view->nSHPType = nSHPType;
+    view->nShapeId = hEntity;
+    view->nParts = nParts;
+    view->nVertices = nPoints;
+    view->panPartStart = NULL;
+    view->panPartType = NULL;
+    view->padfZ = NULL;
+
+    if (nParts) {
+        int iPart, nStart, nPrevStart = 0;
+
+        view->panPartStart = (const int *) (pabyRec + nOffset);
+        if (_host_big_endian) {
+            SHPKernelSwap32(pabyRec + nOffset, pabyRec + nOffset, nParts);
+        }
+
+        /* readers index padfXY by part starts: first is 0, others ascending within points */
+        for (iPart = 0; iPart < nParts; iPart++) {
+            memcpy(&nStart, pabyRec + nOffset + 4*iPart, 4);
+            if ((iPart == 0 && nStart != 0) || nStart < nPrevStart || nStart >= nPoints) {
+                return SHAPEFILE_FALSE;
+            }
+            nPrevStart = nStart;
+        }
+        nOffset += 4*nParts;
+
+        if (nSHPType == SHPT_MULTIPATCH) {
+            view->panPartType = (const int *) (pabyRec + nOffset);
+            if (_host_big_endian) {
+                SHPKernelSwap32(pabyRec + nOffset, pabyRec + nOffset, nParts);
+            }
+            nOffset += 4*nParts;
+        }
+    }
+
+    view->padfXY = (const double *) (pabyRec + nOffset);
+    if (_host_big_endian) {
+        SHPKernelSwap64(pabyRec + nOffset, pabyRec + nOffset, 2*nPoints);
+    }
+    nOffset += 16*nPoints;
+
+    if (nRange) {
+        memcpy(&view->dfXMin, pabyRec + 12, 32);
+        if (_host_big_endian) {
+            SHPKernelSwap64(&view->dfXMin, &view->dfXMin, 4);
+        }
+    } else {
+        /* no extents are supplied for points */
+        memcpy(&view->dfXMin, view->padfXY, 16);
+        view->dfXMax = view->dfXMin;
+        view->dfYMax = view->dfYMin;
+    }
+
+    SHPHasZM(nSHPType, &bHasZ, 0);
+    if (bHasZ) {
+        view->padfZ = SHPGeomViewZM(pabyRec, nRecBytes, &nOffset, nRange, nPoints, &view->dfZMin, &view->dfZMax);
+        if (! view->padfZ) {
+            return SHAPEFILE_FALSE;
+        }
+    }
+
+    /* M values are optional, as in SHPParseObjectEx */
+    view->padfM = SHPGeomViewZM(pabyRec, nRecBytes, &nOffset, nRange, nPoints, &view->dfMMin, &view->dfMMax);
+
+    return SHAPEFILE_TRUE;
+}
+
+
+int SHPReadGeomViewR(SHPHandle psSHP, SHPReadContext *ctx, int hEntity, SHPGeomView *view)
+{
+    if (! SHPReadRecordR(psSHP, ctx, hEntity)) {
+        return SHAPEFILE_FALSE;
+    }
+    if (_host_big_endian) {
+        /* record is swapped in place by view: read it again next time */
+        ctx->nEntity = -1;
+    }
+    return SHPParseGeomView(ctx->pabyRec, psSHP->panRecSize[hEntity]+8, hEntity, view);
+}
+
+
+typedef struct
+{
+    int nOffset;
+    int nShapeId;
+} SHPFetchRecord;
+
+
+static int SHPFetchRecordCmp(const void *a, const void *b)
+{
+    const SHPFetchRecord *ra = (const SHPFetchRecord *) a;
+    const SHPFetchRecord *rb = (const SHPFetchRecord *) b;
+    return (ra->nOffset > rb->nOffset) - (ra->nOffset < rb->nOffset);
+}
+
+
+/* onFetchRecord of SHPFetchRecords returns: */
+#define SHP_FETCH_SKIP      0   /* record not passed (null shape) */
+#define SHP_FETCH_NEXT      1   /* record passed, fetch next */
+#define SHP_FETCH_STOP      2   /* record passed, stop */
+
+/**
+ * read records of panShapeIds in order of file offset and pass each one
+ *   in ctx->pabyRec to onFetchRecord.
+ */
+static int SHPFetchRecords(SHPHandle psSHP, SHPReadContext *ctx, const int *panShapeIds, int nShapes,
+    int (*onFetchRecord)(ub1 *pabyRec, int nRecBytes, int hEntity, void *fetchParam), void *fetchParam)
+{
+    int i, j, k, nRecs = 0, nFetched = 0;
+    long nAdvised = 0;
+    SHPFetchRecord *pRecs;
+
+    if (nShapes <= 0) {
+        return 0;
+    }
+
+    pRecs = (SHPFetchRecord *) SfArenaRealloc(ctx->pArena, 0, 0, sizeof(SHPFetchRecord) * nShapes);
+    for (i = 0; i < nShapes; i++) {
+        int hEntity = panShapeIds[i];
+        if (hEntity >= 0 && hEntity < psSHP->nRecords) {
+            pRecs[nRecs].nOffset = psSHP->panRecOffset[hEntity];
+            pRecs[nRecs].nShapeId = hEntity;
+            nRecs++;
+        }
+    }
+    qsort(pRecs, nRecs, sizeof(SHPFetchRecord), SHPFetchRecordCmp);
 
-            if (_host_big_endian) {
-                BO_swap_qword(&(psShape->dfZMin));
-                BO_swap_qword(&(psShape->dfZMax));
-            }
+    /* record in ctx is overwritten */
+    ctx->nEntity = -1;
 
-            for (i = 0; i < nPoints; i++) {
-                memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-            }
+    for (i = 0; i < nRecs; i = j) {
+        long nStart = pRecs[i].nOffset;
+        long nEnd = nStart + psSHP->panRecSize[pRecs[i].nShapeId] + 8;
 
-            if (_host_big_endian) {
-                for (i = 0; i < nPoints; i++) {
-                    BO_swap_qword(psShape->padfZ + i);
-                }
-            }
+        /* coalesce following records into one read [nStart, nEnd) */
+        for (j = i + 1; j < nRecs; j++) {
+            long nRecEnd = (long) pRecs[j].nOffset + psSHP->panRecSize[pRecs[j].nShapeId] + 8;
 
-            nOffset += 16 + 8*nPoints;
+            if (pRecs[j].nOffset - nEnd > SHP_FETCH_MAXGAP || MAX_V2(nEnd, nRecEnd) - nStart > SHP_FETCH_MAXREAD) {
+                break;
+            }
+            nEnd = MAX_V2(nEnd, nRecEnd);
         }
 
-        /* If we have a M measure value, then read it now.  We assume
-         *  that the measure can be present for any shape if the size is
-         *  big enough, but really it will only occur for the Z shapes
-         *  (options), and the M shapes.
-         */
-        if (psSHP->panRecSize[hEntity]+8 >= nOffset + 16 + 8*nPoints) {
-            memcpy(&(psShape->dfMMin), psSHP->pabyRec + nOffset, 8);
-            memcpy(&(psShape->dfMMax), psSHP->pabyRec + nOffset + 8, 8);
+        /* hint ranges ahead of this read, nearby records as one range */
+        if (nAdvised < nEnd) {
+            long nFrom = -1, nTo = 0;
 
-            if (_host_big_endian) {
-                BO_swap_qword(&(psShape->dfMMin));
-                BO_swap_qword(&(psShape->dfMMax));
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
+            for (k = i; k < nRecs && pRecs[k].nOffset < nEnd + SHP_FETCH_READAHEAD; k++) {
+                long nRecEnd = (long) pRecs[k].nOffset + psSHP->panRecSize[pRecs[k].nShapeId] + 8;
+                if (nRecEnd <= nAdvised) {
+                    continue;
                 }
-                for (i = 0; i < nPoints; i++) {
-                    BO_swap_qword(psShape->padfM + i);
+                if (nFrom != -1 && pRecs[k].nOffset - nTo > SHP_FETCH_MAXGAP) {
+                    SfWillNeed(psSHP->fpSHP, nFrom, nTo - nFrom);
+                    nFrom = -1;
                 }
-            } else {
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
+                if (nFrom == -1) {
+                    nFrom = MAX_V2(nAdvised, (long) pRecs[k].nOffset);
                 }
+                nTo = MAX_V2(nTo, nRecEnd);
+            }
+            if (nFrom != -1) {
+                SfWillNeed(psSHP->fpSHP, nFrom, nTo - nFrom);
+                nAdvised = nTo;
             }
         }
-    } else if (psShape->nSHPType == SHPT_MULTIPOINT ||
-        psShape->nSHPType == SHPT_MULTIPOINTM ||
-        psShape->nSHPType == SHPT_MULTIPOINTZ) {
-        /* Extract vertices for a MultiPoint */
-        int nPoints, i, nOffset;
 
-        memcpy(&nPoints, psSHP->pabyRec + 44, 4);
-        if (_host_big_endian) {
-            BO_swap_dword(&nPoints);
-        }
-        if (! nPoints) {
-            return SHAPEFILE_FALSE;
+        if (nEnd - nStart > ctx->nBufSize) {
+            ctx->pabyRec = (ub1 *) SfArenaRealloc(ctx->pArena, ctx->pabyRec, ctx->nBufSize, (int) (nEnd - nStart));
+            ctx->nBufSize = (int) (nEnd - nStart);
         }
 
-        psShape->nVertices = nPoints;
-
-        if (psShape->nPointsSize < nPoints) {
-            psShape->nPointsSize = (nPoints/MEM_BLKSIZE+1)*MEM_BLKSIZE;
-            psShape->pPoints = (SHPPointType *) realloc(psShape->pPoints, psShape->nPointsSize*sizeof(SHPPointType));
-            psShape->padfZ = (double *) realloc(psShape->padfZ, psShape->nPointsSize*sizeof(double));
-            psShape->padfM = (double *) realloc(psShape->padfM, psShape->nPointsSize*sizeof(double));
+        if (! SfPread(psSHP->fpSHP, ctx->pabyRec, (int) (nEnd - nStart), nStart)) {
+            continue;
         }
 
-        if (_host_big_endian) {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(&psShape->pPoints[i].x, psSHP->pabyRec + 48 + 16 * i, 8);
-                memcpy(&psShape->pPoints[i].y, psSHP->pabyRec + 48 + 16 * i + 8, 8);
+        for (k = i; k < j; k++) {
+            int hEntity = pRecs[k].nShapeId;
 
-                BO_swap_qword(&psShape->pPoints[i].x);
-                BO_swap_qword(&psShape->pPoints[i].y);
+            if (k > i && pRecs[k].nShapeId == pRecs[k-1].nShapeId) {
+                /* duplicated id */
+                continue;
             }
-        } else {
-            for (i = 0; i < nPoints; i++) {
-                memcpy(&psShape->pPoints[i].x, psSHP->pabyRec + 48 + 16 * i, 8);
-                memcpy(&psShape->pPoints[i].y, psSHP->pabyRec + 48 + 16 * i + 8, 8);
+
+            switch (onFetchRecord(ctx->pabyRec + (pRecs[k].nOffset - nStart), psSHP->panRecSize[hEntity]+8, hEntity, fetchParam)) {
+            case SHP_FETCH_NEXT:
+                nFetched++;
+                break;
+            case SHP_FETCH_STOP:
+                if (! ctx->pArena) {
+                    free(pRecs);
+                }
+                return nFetched + 1;
             }
         }
+    }
 
-        nOffset = 48 + 16*nPoints;
+    if (! ctx->pArena) {
+        free(pRecs);
+    }
+    return nFetched;
+}
 
-        /* Get the X/Y bounds */
-        memcpy(&(psShape->dfXMin), psSHP->pabyRec + 8 +  4, 8);
-        memcpy(&(psShape->dfYMin), psSHP->pabyRec + 8 + 12, 8);
-        memcpy(&(psShape->dfXMax), psSHP->pabyRec + 8 + 20, 8);
-        memcpy(&(psShape->dfYMax), psSHP->pabyRec + 8 + 28, 8);
 
-        if (_host_big_endian) {
-            BO_swap_qword(&(psShape->dfXMin));
-            BO_swap_qword(&(psShape->dfYMin));
-            BO_swap_qword(&(psShape->dfXMax));
-            BO_swap_qword(&(psShape->dfYMax));
-        }
+typedef struct
+{
+    SHPObjectEx *psShape;
+    int (*onFetchShape)(SHPObjectEx *psShape, void *userParam);
+    void *userParam;
+} SHPFetchShapeParam;
 
-        /* If we have a Z coordinate, collect that now */
-        if (psShape->nSHPType == SHPT_MULTIPOINTZ) {
-            memcpy(&(psShape->dfZMin), psSHP->pabyRec + nOffset, 8);
-            memcpy(&(psShape->dfZMax), psSHP->pabyRec + nOffset + 8, 8);
 
-            if (_host_big_endian) {
-                BO_swap_qword(&(psShape->dfZMin));
-                BO_swap_qword(&(psShape->dfZMax));
-            }
+static int SHPFetchShapeRecord(ub1 *pabyRec, int nRecBytes, int hEntity, void *fetchParam)
+{
+    SHPFetchShapeParam *param = (SHPFetchShapeParam *) fetchParam;
 
-            if (_host_big_endian) {
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                    BO_swap_qword(psShape->padfZ + i);
-                }
-            } else {
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfZ + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                }
-            }
-            nOffset += 16 + 8*nPoints;
-        }
+    if (! SHPParseObjectEx(pabyRec, nRecBytes, hEntity, param->psShape)) {
+        return SHP_FETCH_SKIP;
+    }
+    return param->onFetchShape(param->psShape, param->userParam)? SHP_FETCH_NEXT : SHP_FETCH_STOP;
+}
 
-        /* If we have a M measure value, then read it now.  We assume
-         *  that the measure can be present for any shape if the size is
-         *  big enough, but really it will only occur for the Z shapes
-         * (options), and the M shapes
-         */
-        if (psSHP->panRecSize[hEntity]+8 >= nOffset + 16 + 8*nPoints) {
-            memcpy(&(psShape->dfMMin), psSHP->pabyRec + nOffset, 8);
-            memcpy(&(psShape->dfMMax), psSHP->pabyRec + nOffset + 8, 8);
 
-            if (_host_big_endian) {
-                BO_swap_qword(&(psShape->dfMMin));
-                BO_swap_qword(&(psShape->dfMMax));
+int SHPFetchShapes(SHPHandle psSHP, SHPReadContext *ctx, const int *panShapeIds, int nShapes, SHPObjectEx *psShape,
+    int (*onFetchShape)(SHPObjectEx *psShape, void *userParam), void *userParam)
+{
+    SHPFetchShapeParam param;
 
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                }
+    param.psShape = psShape;
+    param.onFetchShape = onFetchShape;
+    param.userParam = userParam;
 
-                for (i = 0; i < nPoints; i++) {
-                    BO_swap_qword(psShape->padfM + i);
-                }
-            } else {
-                for (i = 0; i < nPoints; i++) {
-                    memcpy(psShape->padfM + i, psSHP->pabyRec + nOffset + 16 + i*8, 8);
-                }
-            }
-        }
-    } else if (psShape->nSHPType == SHPT_POINT ||
-        psShape->nSHPType == SHPT_POINTM ||
-        psShape->nSHPType == SHPT_POINTZ) {
-        /* Extract vertices for a point */
-        int nOffset;
-        psShape->nVertices = 1;
-        if (psShape->nPointsSize < 1) {
-            psShape->nPointsSize = 8;
-            psShape->pPoints = (SHPPointType *) realloc(psShape->pPoints, psShape->nPointsSize*sizeof(SHPPointType));
-            psShape->padfZ = (double *) realloc(psShape->padfZ, psShape->nPointsSize*sizeof(double));
-            psShape->padfM = (double *) realloc(psShape->padfM, psShape->nPointsSize*sizeof(double));
-        }
-        memcpy(&psShape->pPoints[0].x, psSHP->pabyRec + 12, 8);
-        memcpy(&psShape->pPoints[0].y, psSHP->pabyRec + 20, 8);
+    return SHPFetchRecords(psSHP, ctx, panShapeIds, nShapes, SHPFetchShapeRecord, &param);
+}
 
-        if (_host_big_endian) {
-            BO_swap_qword(&psShape->pPoints[0].x);
-            BO_swap_qword(&psShape->pPoints[0].y);
-        }
 
-        nOffset = 20 + 8;
+typedef struct
+{
+    int (*onFetchView)(const SHPGeomView *view, void *userParam);
+    void *userParam;
+} SHPFetchViewParam;
 
-        /* If we have a Z coordinate, collect that now */
-        if (psShape->nSHPType == SHPT_POINTZ) {
-            memcpy(psShape->padfZ, psSHP->pabyRec + nOffset, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(psShape->padfZ);
-            }
-            nOffset += 8;
-        }
 
-        /* If we have a M measure value, then read it now.  We assume
-         *  that the measure can be present for any shape if the size is
-         *  big enough, but really it will only occur for the Z shapes
-         *  (options), and the M shapes
-         */
-        if (psSHP->panRecSize[hEntity]+8 >= nOffset + 8) {
-            memcpy(psShape->padfM, psSHP->pabyRec + nOffset, 8);
-            if (_host_big_endian) {
-                BO_swap_qword(psShape->padfM);
-            }
-        }
+static int SHPFetchViewRecord(ub1 *pabyRec, int nRecBytes, int hEntity, void *fetchParam)
+{
+    SHPFetchViewParam *param = (SHPFetchViewParam *) fetchParam;
+    SHPGeomView view;
 
-        /* Since no extents are supplied in the record, apply them from the single vertex */
-        psShape->dfXMin = psShape->dfXMax = psShape->pPoints[0].x;
-        psShape->dfYMin = psShape->dfYMax = psShape->pPoints[0].y;
-        psShape->dfZMin = psShape->dfZMax = psShape->padfZ[0];
-        psShape->dfMMin = psShape->dfMMax = psShape->padfM[0];
-    } else {
-        return (SHAPEFILE_FALSE);
+    if (! SHPParseGeomView(pabyRec, nRecBytes, hEntity, &view)) {
+        return SHP_FETCH_SKIP;
     }
+    return param->onFetchView(&view, param->userParam)? SHP_FETCH_NEXT : SHP_FETCH_STOP;
+}
 
-    return (SHAPEFILE_TRUE);
+
+int SHPFetchGeomViews(SHPHandle psSHP, SHPReadContext *ctx, const int *panShapeIds, int nShapes,
+    int (*onFetchView)(const SHPGeomView *view, void *userParam), void *userParam)
+{
+    SHPFetchViewParam param;
+
+    param.onFetchView = onFetchView;
+    param.userParam = userParam;
+
+    return SHPFetchRecords(psSHP, ctx, panShapeIds, nShapes, SHPFetchViewRecord, &param);
 }
 
 
@@ -2243,7 +2861,7 @@ void SHPDestroyObject(SHPObject * psShape)
  */
 void  SHPDestroyObjectEx(SHPObjectEx * psShape)
 {
-    if (psShape) {
+    if (psShape && ! psShape->pArena) {
         free(psShape->pPoints);
         free(psShape->padfZ);
         free(psShape->padfM);
@@ -2256,11 +2874,12 @@ void  SHPDestroyObjectEx(SHPObjectEx * psShape)
 
 /**
  * Reset the winding of polygon objects to adhere to the specification
+ *
+ *   Rings contained by an even number of rings are outer rings, others
+ *   are holes (see SHPNestRings). Rings are not reordered.
  */
 int SHPRewindObject(SHPObject *psObject)
 {
-    int  iOpRing, bAltered = 0;
-
     /* Do nothing if this is not a polygon object */
     if (psObject->nSHPType != SHPT_POLYGON &&
         psObject->nSHPType != SHPT_POLYGONZ &&
@@ -2272,111 +2891,13 @@ int SHPRewindObject(SHPObject *psObject)
         return 0;
     }
 
-    /* Process each of the rings */
-    for (iOpRing = 0; iOpRing < psObject->nParts; iOpRing++) {
-        int      bInner, iVert, nVertCount, nVertStart, iCheckRing;
-        double   dfSum, dfTestX, dfTestY;
-
-        /* Determine if this ring is an inner ring or an outer ring
-     *  relative to all the other rings.  For now we assume the
-     *  first ring is outer and all others are inner, but eventually
-     *  we need to fix this to handle multiple island polygons and
-     *  unordered sets of rings
-     */
-        dfTestX = psObject->padfX[psObject->panPartStart[iOpRing]];
-        dfTestY = psObject->padfY[psObject->panPartStart[iOpRing]];
-
-        bInner = SHAPEFILE_FALSE;
-        for (iCheckRing = 0; iCheckRing < psObject->nParts; iCheckRing++) {
-            int iEdge;
-
-            if (iCheckRing == iOpRing) {
-                continue;
-            }
-
-            nVertStart = psObject->panPartStart[iCheckRing];
-
-            nVertCount = psObject->panPartStart[iCheckRing+1] - psObject->panPartStart[iCheckRing];
-
-            for (iEdge = 0; iEdge < nVertCount; iEdge++) {
-                int iNext;
-
-                if (iEdge < nVertCount-1) {
-                    iNext = iEdge+1;
-                } else {
-                    iNext = 0;
-                }
-
-                if ((psObject->padfY[iEdge+nVertStart] < dfTestY && psObject->padfY[iNext+nVertStart] >= dfTestY) ||
-                    (psObject->padfY[iNext+nVertStart] < dfTestY && psObject->padfY[iEdge+nVertStart] >= dfTestY)) {
-                    if (psObject->padfX[iEdge+nVertStart] +
-                        (dfTestY - psObject->padfY[iEdge+nVertStart]) / (psObject->padfY[iNext+nVertStart] -
-                        psObject->padfY[iEdge+nVertStart]) *
-                        (psObject->padfX[iNext+nVertStart] - psObject->padfX[iEdge+nVertStart]) < dfTestX) {
-                        bInner = !bInner;
-                    }
-                }
-            }
-        }
-
-        /* Determine the current order of this ring so we will know if it has to be reversed */
-        nVertStart = psObject->panPartStart[iOpRing];
-
-        nVertCount = psObject->panPartStart[iOpRing+1] - psObject->panPartStart[iOpRing];
-
-        dfSum = 0.0;
-        for (iVert = nVertStart; iVert < nVertStart+nVertCount-1; iVert++) {
-            dfSum += psObject->padfX[iVert] * psObject->padfY[iVert+1] - psObject->padfY[iVert] * psObject->padfX[iVert+1];
-        }
-
-        dfSum += psObject->padfX[iVert] * psObject->padfY[nVertStart] - psObject->padfY[iVert] * psObject->padfX[nVertStart];
-
-        /* Reverse if necessary */
-        if ((dfSum < 0.0 && bInner) || (dfSum > 0.0 && !bInner)) {
-            int   i;
-            bAltered++;
-
-            for (i = 0; i < nVertCount/2; i++) {
-                double dfSaved;
-
-                /* Swap X */
-                dfSaved = psObject->padfX[nVertStart+i];
-                psObject->padfX[nVertStart+i] =
-                psObject->padfX[nVertStart+nVertCount-i-1];
-                psObject->padfX[nVertStart+nVertCount-i-1] = dfSaved;
-
-                /* Swap Y */
-                dfSaved = psObject->padfY[nVertStart+i];
-                psObject->padfY[nVertStart+i] =
-                psObject->padfY[nVertStart+nVertCount-i-1];
-                psObject->padfY[nVertStart+nVertCount-i-1] = dfSaved;
-
-                /* Swap Z */
-                if (psObject->padfZ) {
-                    dfSaved = psObject->padfZ[nVertStart+i];
-                    psObject->padfZ[nVertStart+i] =
-                    psObject->padfZ[nVertStart+nVertCount-i-1];
-                    psObject->padfZ[nVertStart+nVertCount-i-1] = dfSaved;
-                }
-
-                /* Swap M */
-                if (psObject->padfM) {
-                    dfSaved = psObject->padfM[nVertStart+i];
-                    psObject->padfM[nVertStart+i] =
-                    psObject->padfM[nVertStart+nVertCount-i-1];
-                    psObject->padfM[nVertStart+nVertCount-i-1] = dfSaved;
-                }
-            }
-        }
-    }
-    return bAltered;
+    return SHPRewindRings(psObject->nParts, psObject->panPartStart, psObject->padfX, psObject->padfY, 1,
+        psObject->padfZ, psObject->padfM, 0, 0);
 }
 
 
 int SHPRewindObjectEx (SHPObjectEx *psObject)
 {
- int  iOpRing, bAltered = 0;
-
     /* Do nothing if this is not a polygon object */
     if (psObject->nSHPType != SHPT_POLYGON &&
         psObject->nSHPType != SHPT_POLYGONZ &&
@@ -2388,151 +2909,26 @@ int SHPRewindObjectEx (SHPObjectEx *psObject)
         return 0;
     }
 
-    /* Process each of the rings */
-    for (iOpRing = 0; iOpRing < psObject->nParts; iOpRing++) {
-        int      bInner, iVert, nVertCount, nVertStart, iCheckRing;
-        double   dfSum, dfTestX, dfTestY;
-
-        /* Determine if this ring is an inner ring or an outer ring
-     *  relative to all the other rings.  For now we assume the
-     *  first ring is outer and all others are inner, but eventually
-     *  we need to fix this to handle multiple island polygons and
-     *  unordered sets of rings
-     */
-        dfTestX = psObject->pPoints[psObject->panPartStart[iOpRing]].x;
-        dfTestY = psObject->pPoints[psObject->panPartStart[iOpRing]].y;
-
-        bInner = SHAPEFILE_FALSE;
-        for (iCheckRing = 0; iCheckRing < psObject->nParts; iCheckRing++) {
-            int iEdge;
-
-            if (iCheckRing == iOpRing) {
-                continue;
-            }
-
-            nVertStart = psObject->panPartStart[iCheckRing];
-
-            nVertCount = psObject->panPartStart[iCheckRing+1] - psObject->panPartStart[iCheckRing];
-
-            for (iEdge = 0; iEdge < nVertCount; iEdge++) {
-                int iNext;
-
-                if (iEdge < nVertCount-1) {
-                    iNext = iEdge+1;
-                } else {
-                    iNext = 0;
-                }
-
-                if ((psObject->pPoints[iEdge+nVertStart].y < dfTestY && psObject->pPoints[iNext+nVertStart].y >= dfTestY) ||
-                    (psObject->pPoints[iNext+nVertStart].y < dfTestY && psObject->pPoints[iEdge+nVertStart].y >= dfTestY)) {
-                    if (psObject->pPoints[iEdge+nVertStart].x + (dfTestY - psObject->pPoints[iEdge+nVertStart].y) /
-                        (psObject->pPoints[iNext+nVertStart].y - psObject->pPoints[iEdge+nVertStart].y) *
-                        (psObject->pPoints[iNext+nVertStart].x - psObject->pPoints[iEdge+nVertStart].x) < dfTestX) {
-                        bInner = !bInner;
-                    }
-                }
-            }
-        }
-
-        /* Determine the current order of this ring so we will know if it has to be reversed */
-        nVertStart = psObject->panPartStart[iOpRing];
-
-        nVertCount = psObject->panPartStart[iOpRing+1] - psObject->panPartStart[iOpRing];
-
-        dfSum = 0.0;
-        for (iVert = nVertStart; iVert < nVertStart+nVertCount-1; iVert++) {
-            dfSum += psObject->pPoints[iVert].x * psObject->pPoints[iVert+1].y - psObject->pPoints[iVert].y * psObject->pPoints[iVert+1].x;
-        }
-
-        dfSum += psObject->pPoints[iVert].x * psObject->pPoints[nVertStart].y - psObject->pPoints[iVert].y * psObject->pPoints[nVertStart].x;
-
-        /* Reverse if necessary */
-        if ((dfSum < 0.0 && bInner) || (dfSum > 0.0 && !bInner)) {
-            int   i;
-            bAltered++;
-
-            for (i = 0; i < nVertCount/2; i++) {
-                double dfSaved;
-
-                /* Swap X */
-                dfSaved = psObject->pPoints[nVertStart+i].x;
-                psObject->pPoints[nVertStart+i].x = psObject->pPoints[nVertStart+nVertCount-i-1].x;
-                psObject->pPoints[nVertStart+nVertCount-i-1].x = dfSaved;
-
-                /* Swap Y */
-                dfSaved = psObject->pPoints[nVertStart+i].y;
-                psObject->pPoints[nVertStart+i].y = psObject->pPoints[nVertStart+nVertCount-i-1].y;
-                psObject->pPoints[nVertStart+nVertCount-i-1].y = dfSaved;
-
-                /* Swap Z */
-                if (psObject->padfZ) {
-                    dfSaved = psObject->padfZ[nVertStart+i];
-                    psObject->padfZ[nVertStart+i] = psObject->padfZ[nVertStart+nVertCount-i-1];
-                    psObject->padfZ[nVertStart+nVertCount-i-1] = dfSaved;
-                }
-
-                /* Swap M */
-                if (psObject->padfM) {
-                    dfSaved = psObject->padfM[nVertStart+i];
-                    psObject->padfM[nVertStart+i] = psObject->padfM[nVertStart+nVertCount-i-1];
-                    psObject->padfM[nVertStart+nVertCount-i-1] = dfSaved;
-                }
-            }
-        }
-    }
-    return bAltered;
+    return SHPRewindRings(psObject->nParts, psObject->panPartStart, &psObject->pPoints[0].x, &psObject->pPoints[0].y, 2,
+        psObject->padfZ, psObject->padfM, 0, 0);
 }
 
 
 double SHPLengthOfXYs (double *padfX, double *padfY, int start, int end)
 {
-    int i;
-    double dx, dy;
-    double sum = 0;
-    int np = end - start - 1;
-
-    for (i = 0; i < np; i++) {
-        dx = padfX[start + i + 1] - padfX[start + i];
-        dy = padfY[start + i + 1] - padfY[start + i];
-
-        sum += sqrt(dx*dx + dy*dy);
-    }
-
-    return sum;
+    return SHPKernelLengthOfXYs(padfX + start, padfY + start, end - start);
 }
 
 
 double SHPLengthOfPoints (SHPPointType *pPoints, int start, int end)
 {
-    int i;
-
-    double dx, dy;
-    double sum = 0;
-    SHPPointType *pt = pPoints + start;
-    int np = end - start - 1;
-
-    for (i = 0; i < np; i++) {
-        dx = pt[i+1].x - pt[i].x;
-        dy = pt[i+1].y - pt[i].y;
-
-        sum += sqrt(dx*dx + dy*dy);
-    }
-
-    return sum;
+    return SHPKernelLengthOfPoints(pPoints + start, end - start);
 }
 
 
 double SHPAreaOfXYs (double *padfX, double *padfY, int start, int end, int *CCW)
 {
-    int i;
-    double sum = 0;
-    double *pX = padfX + start;
-    double *pY = padfY + start;
-    int np = end - start - 1;
-
-    for (i = 1; i < np; i++) {
-        sum += (pX[i] - pX[0]) * (pY[i+1] - pY[i-1]);
-    }
+    double sum = SHPKernelAreaOfXYs(padfX + start, padfY + start, end - start);
 
     if (CCW) {
         *CCW = SGNOF(sum);
@@ -2544,14 +2940,7 @@ double SHPAreaOfXYs (double *padfX, double *padfY, int start, int end, int *CCW)
 
 double SHPAreaOfPoints (SHPPointType *pPoints, int start, int end, int *CCW)
 {
-    int i;
-    double sum = 0;
-    SHPPointType *pt = pPoints + start;
-    int np = end - start - 1;
-
-    for (i = 1; i < np; i++) {
-        sum += (pt[i].x - pt[0].x) * (pt[i+1].y - pt[i-1].y);
-    }
+    double sum = SHPKernelAreaOfPoints(pPoints + start, end - start);
 
     if (CCW) {
         *CCW = SGNOF(sum);
@@ -3076,6 +3465,39 @@ int SHPObjectEx2WKT (const SHPObjectEx *psObject, char *wktBuffer, double offset
 }
 
 
+void * SHPObjectEx2WKBArena (const SHPObjectEx *psObject, struct _mem_arena_t *arena, double offsetX, double offsetY, double offsetZ, double offsetM, int *pcbWkb)
+{
+    void *wkbBuffer;
+    int cb = SHPObjectEx2WKB(psObject, 0, offsetX, offsetY, offsetZ, offsetM);
+
+    *pcbWkb = 0;
+    if (cb <= 0) {
+        return 0;
+    }
+
+    wkbBuffer = mem_arena_alloc(arena, cb);
+    *pcbWkb = SHPObjectEx2WKB(psObject, wkbBuffer, offsetX, offsetY, offsetZ, offsetM);
+    return wkbBuffer;
+}
+
+
+char * SHPObjectEx2WKTArena (const SHPObjectEx *psObject, struct _mem_arena_t *arena, double offsetX, double offsetY, double offsetZ, double offsetM, int nDecimalsXY, int nDecimalsZ, int nDecimalsM, int *pcchWkt)
+{
+    char *wktBuffer;
+    int cch = SHPObjectEx2WKT(psObject, 0, offsetX, offsetY, offsetZ, offsetM, nDecimalsXY, nDecimalsZ, nDecimalsM);
+
+    *pcchWkt = 0;
+    if (cch <= 0) {
+        return 0;
+    }
+
+    wktBuffer = (char *) mem_arena_alloc_align(arena, cch + 1, sizeof(char));
+    *pcchWkt = SHPObjectEx2WKT(psObject, wktBuffer, offsetX, offsetY, offsetZ, offsetM, nDecimalsXY, nDecimalsZ, nDecimalsM);
+    wktBuffer[*pcchWkt] = 0;
+    return wktBuffer;
+}
+
+
 /*************************************************************************
  *                             SHAPES MBR Tree API
  ************************************************************************/
@@ -3106,5 +3528,5 @@ int SHPMBRTreeAddShape(SHPMBRTree rtree, const SHPEnvelope *shapeEnv, void *shap
 
 int SHPMBRTreeSearch(SHPMBRTree rtree, const SHPEnvelope *searchEnv, int(* onSearchShape)(void * shapeData,  void *userParam), void *userParam)
 {
-    return RTreeSearchMbr(rtree->rtRoot, (const RTREE_MBR *)searchEnv, onSearchShape, &userParam);
+    return RTreeSearchMbr(rtree->rtRoot, (const RTREE_MBR *)searchEnv, onSearchShape, userParam);
 }
\ No newline at end of file
@@ -67,6 +67,8 @@ SHAPEFILE_API void SHPGetInfo (SHPHandle hSHP, int *pnEntities, int *pnShapeType
 
 SHAPEFILE_API int SHPGetType (SHPHandle hSHP, int *bHasZ, int *bHasM);
 
+SHAPEFILE_API int SHPGetRecordTable (SHPHandle hSHP, const int **panRecOffset, const int **panRecSize);
+
 SHAPEFILE_API SHPObject* SHPReadObject (SHPHandle hSHP, int iShape);
 
 SHAPEFILE_API int SHPReadObjectEx (SHPHandle psSHP, int iShape, SHPObjectEx *psShape);
@@ -75,12 +77,81 @@ SHAPEFILE_API int SHPReadObjectBounds (SHPHandle hSHP, int iShape, SHPBounds *Bo
 
 SHAPEFILE_API int SHPReadObjectEnvelope (SHPHandle hSHP, int iShape, SHPEnvelope *rect, double *pointEpsilon);
 
+SHAPEFILE_API void SHPReadContextInit (SHPReadContext *ctx);
+
+SHAPEFILE_API void SHPReadContextFinal (SHPReadContext *ctx);
+
+/* reentrant: same as SHPReadObjectEx but reads into caller-owned ctx */
+SHAPEFILE_API int SHPReadObjectExR (SHPHandle hSHP, SHPReadContext *ctx, int iShape, SHPObjectEx *psShape);
+
+SHAPEFILE_API int SHPReadObjectEnvelopeR (SHPHandle hSHP, SHPReadContext *ctx, int iShape, SHPEnvelope *rect, double *pointEpsilon);
+
+/**
+ * SHPReadObjectEnvelopes
+ *   read envelopes of all shapes into envs[nRecords] by reading only the
+ *   leading bytes (header and bbox) of records. null shapes: XMin > XMax.
+ * Returns:
+ *   number of not null shapes
+ */
+SHAPEFILE_API int SHPReadObjectEnvelopes (SHPHandle hSHP, SHPEnvelope *envs, double *pointEpsilon);
+
+/**
+ * SHPFetchShapes
+ *   read shapes of panShapeIds in order of file offset (id order for files
+ *   written sequentially): nearby records are read by one pread, ranges
+ *   ahead are hinted with posix_fadvise. each shape is decoded into psShape
+ *   and passed to onFetchShape, which returns 0 to stop.
+ * Returns:
+ *   number of shapes passed to onFetchShape
+ */
+SHAPEFILE_API int SHPFetchShapes (SHPHandle hSHP, SHPReadContext *ctx, const int *panShapeIds, int nShapes, SHPObjectEx *psShape,
+    int (*onFetchShape)(SHPObjectEx *psShape, void *userParam), void *userParam);
+
+/**
+ * SHPParseGeomView
+ *   describe shape record in pabyRec (nRecBytes with record header, see
+ *   SHPGetRecordTable) by view without copying. big-endian hosts: arrays
+ *   of record are swapped in place, so pabyRec must be writable and the
+ *   record parsed only once.
+ * Returns:
+ *   SHAPEFILE_FALSE for null, empty or truncated records, or part starts
+ *   not ascending from 0 within points
+ */
+SHAPEFILE_API int SHPParseGeomView (void *pabyRec, int nRecBytes, int iShape, SHPGeomView *view);
+
+/* reentrant: view of record iShape read into ctx, valid until next read with ctx */
+SHAPEFILE_API int SHPReadGeomViewR (SHPHandle hSHP, SHPReadContext *ctx, int iShape, SHPGeomView *view);
+
+/* same as SHPFetchShapes but passes views of records in ctx */
+SHAPEFILE_API int SHPFetchGeomViews (SHPHandle hSHP, SHPReadContext *ctx, const int *panShapeIds, int nShapes,
+    int (*onFetchView)(const SHPGeomView *view, void *userParam), void *userParam);
+
 SHAPEFILE_API int SHPWriteObject (SHPHandle hSHP, int iShape, SHPObject *psObject);
 
+/**
+ * SHPBeginAppend
+ *   buffered append mode: records written by SHPWriteObject(hSHP, -1, ...)
+ *   are encoded into a buffer of nBufSize bytes (0 for SHP_APPEND_BUFSIZE)
+ *   and written with their .shx entries when it is full. records larger
+ *   than buffer and rewrites of records are written directly as before.
+ *   SHPFlushAppend writes buffered records, SHPEndAppend also frees buffer.
+ *   SHPWriteHeader and SHPClose flush buffer.
+ * Returns:
+ *   SHAPEFILE_FALSE if failed
+ */
+SHAPEFILE_API int SHPBeginAppend (SHPHandle hSHP, int nBufSize);
+
+SHAPEFILE_API int SHPFlushAppend (SHPHandle hSHP);
+
+SHAPEFILE_API int SHPEndAppend (SHPHandle hSHP);
+
 SHAPEFILE_API void SHPDestroyObject (SHPObject * psObject);
 
 SHAPEFILE_API SHPObjectEx* SHPCreateObjectEx (SHPObjectEx ** ppsObject);
 
+/* object and its buffers from arena: taken back by rewinding arena, not by SHPDestroyObjectEx */
+SHAPEFILE_API SHPObjectEx* SHPCreateObjectExArena (SHPObjectEx ** ppsObject, struct _mem_arena_t *arena);
+
 SHAPEFILE_API void SHPDestroyObjectEx (SHPObjectEx *psObject);
 
 SHAPEFILE_API void SHPComputeExtents (SHPObject *psObject);
@@ -100,6 +171,27 @@ SHAPEFILE_API int SHPRewindObject (SHPObject *psObject);
 
 SHAPEFILE_API int SHPRewindObjectEx (SHPObjectEx *psObjectEx);
 
+/**
+ * SHPObjectExNestRings
+ *   find parent of every ring of polygon: the smallest ring containing it.
+ *   panParent[i] = -1 and panDepth[i] = 0 for top level outer rings.
+ *   rings of even depth are outer rings, odd depth are holes.
+ * Returns:
+ *   number of rings, -1 if not polygon
+ */
+SHAPEFILE_API int SHPObjectExNestRings (const SHPObjectEx *psObject, int *panParent, int *panDepth);
+
+/**
+ * SHPObjectFixRings, SHPObjectExFixRings
+ *   make outer rings clockwise and holes counter clockwise by nesting of
+ *   rings, and put each outer ring followed by its holes (OGC order).
+ * Returns:
+ *   number of rings reversed or moved, 0 if valid, -1 if not polygon
+ */
+SHAPEFILE_API int SHPObjectFixRings (SHPObject *psObject);
+
+SHAPEFILE_API int SHPObjectExFixRings (SHPObjectEx *psObject);
+
 SHAPEFILE_API void SHPClose (SHPHandle hSHP);
 
 SHAPEFILE_API void SHPWriteHeader (SHPHandle hSHP);
@@ -118,6 +210,21 @@ SHAPEFILE_API double SHPAreaOfPoints (SHPPointType *pPoints, int start, int end,
 
 SHAPEFILE_API double SHPObjectExGetLength (const SHPObjectEx *psObject);
 
+/**
+ * SHPGetSIMDLevel
+ *   SHP_SIMD_AVX2, SHP_SIMD_SSE2 or SHP_SIMD_NONE: the best supported
+ *   by CPU unless changed by SHPSetSIMDLevel.
+ */
+SHAPEFILE_API int SHPGetSIMDLevel (void);
+
+/**
+ * SHPSetSIMDLevel
+ *   use kernels of given level (for benchmarks), -1 for the best.
+ * Returns:
+ *   level used, which is not above the best supported.
+ */
+SHAPEFILE_API int SHPSetSIMDLevel (int level);
+
 /**
  * SHPObjectExGetArea
  *   get area of polygon object
@@ -180,6 +287,31 @@ SHAPEFILE_API int SHPObjectEx2WKT (const SHPObjectEx *psObject, char *wktBuffer,
     double offsetX, double offsetY, double offsetZ, double offsetM,
     int nDecimalsXY, int nDecimalsZ, int nDecimalsM);
 
+/**
+ * SHPObjectEx2WKBArena, SHPObjectEx2WKTArena
+ *   same as SHPObjectEx2WKB and SHPObjectEx2WKT but write into buffer taken
+ *   from arena. WKT is terminated by 0 which is not counted.
+ * Returns:
+ *   buffer and its bytes in *pcbWkb (*pcchWkt), NULL for null shape
+ */
+SHAPEFILE_API void* SHPObjectEx2WKBArena (const SHPObjectEx *psObject, struct _mem_arena_t *arena,
+    double offsetX, double offsetY, double offsetZ, double offsetM, int *pcbWkb);
+
+SHAPEFILE_API char* SHPObjectEx2WKTArena (const SHPObjectEx *psObject, struct _mem_arena_t *arena,
+    double offsetX, double offsetY, double offsetZ, double offsetM,
+    int nDecimalsXY, int nDecimalsZ, int nDecimalsM, int *pcchWkt);
+
+/**
+ * SHPExportShapes
+ *   convert all shapes into WKB or WKT (see SHPExportOptions) and pass them
+ *   in record order to onExportShape, pData = NULL and cbData = 0 for null
+ *   shape. WKT is not terminated by 0. onExportShape returns 0 to stop.
+ * Returns:
+ *   number of shapes passed to onExportShape, -1 if read failed
+ */
+SHAPEFILE_API int SHPExportShapes (SHPHandle hSHP, const SHPExportOptions *options,
+    int (*onExportShape)(int nShapeId, const void *pData, int cbData, void *userParam), void *userParam);
+
 
 /*************************************************************************
  *                             SHPTree Index API
@@ -187,6 +319,15 @@ SHAPEFILE_API int SHPObjectEx2WKT (const SHPObjectEx *psObject, char *wktBuffer,
 
 SHAPEFILE_API SHPTreeHandle SHPCreateTree (SHPHandle hSHP, int nDimension, int nMaxDepth, double *padfBoundsMin, double *padfBoundsMax);
 
+/**
+ * SHPCreateTreeFromBounds
+ *   build 2D tree of nShapes envelopes (XMin > XMax for null shape) without
+ *   reading shapes. top levels are split first and subtrees under them are
+ *   built by nThreads threads, each subtree has its own node arena.
+ *   shapes are placed in the same nodes as SHPTreeAddShapeId does.
+ */
+SHAPEFILE_API SHPTreeHandle SHPCreateTreeFromBounds (int nShapes, const SHPEnvelope *pEnvelopes, int nMaxDepth, double *padfBoundsMin, double *padfBoundsMax, int nThreads);
+
 SHAPEFILE_API void  SHPDestroyTree (SHPTreeHandle hTree);
 
 SHAPEFILE_API int SHPTreeAddShapeId (SHPTreeHandle hTree, SHPObject *psObject);
@@ -238,6 +379,17 @@ SHAPEFILE_API const char* DBFReadStringAttribute (DBFHandle hDBF, int iShape, in
 
 SHAPEFILE_API int DBFReadCopyStringAttribute (DBFHandle hDBF, int iShape, int iField, char *buffer);
 
+SHAPEFILE_API void DBFReadContextInit (DBFReadContext *ctx);
+
+SHAPEFILE_API void DBFReadContextFinal (DBFReadContext *ctx);
+
+/* reentrant: same as DBFRead*Attribute but reads into caller-owned ctx */
+SHAPEFILE_API int DBFReadIntegerAttributeR (DBFHandle hDBF, DBFReadContext *ctx, int iShape, int iField);
+
+SHAPEFILE_API double DBFReadDoubleAttributeR (DBFHandle hDBF, DBFReadContext *ctx, int iShape, int iField);
+
+SHAPEFILE_API const char* DBFReadStringAttributeR (DBFHandle hDBF, DBFReadContext *ctx, int iShape, int iField);
+
 SHAPEFILE_API const char* DBFReadLogicalAttribute (DBFHandle hDBF, int iShape, int iField);
 
 SHAPEFILE_API int DBFIsAttributeNULL (DBFHandle hDBF, int iShape, int iField );
@@ -97,6 +97,40 @@ typedef int SHAPEFILE_RESULT;
 #define SHAPEFILE_SUCCESS     0
 #define SHAPEFILE_ERROR     (-1)
 
+/* SHPGetSIMDLevel: kernels used by SHPAreaOf*, SHPLengthOf* */
+#define SHP_SIMD_NONE   0
+#define SHP_SIMD_SSE2   1
+#define SHP_SIMD_AVX2   2
+
+/* SHPFetchShapes: records closer than MAXGAP bytes are read together,
+ *   one read is at most MAXREAD bytes (unless one record is larger),
+ *   ranges of READAHEAD bytes ahead are hinted to the kernel. */
+#ifndef SHP_FETCH_MAXGAP
+# define SHP_FETCH_MAXGAP       16384
+#endif
+
+#ifndef SHP_FETCH_MAXREAD
+# define SHP_FETCH_MAXREAD      1048576
+#endif
+
+#ifndef SHP_FETCH_READAHEAD
+# define SHP_FETCH_READAHEAD    4194304
+#endif
+
+/* SHPExportShapes: records read at once by a batch, at most */
+#ifndef SHP_EXPORT_BATCHBYTES
+# define SHP_EXPORT_BATCHBYTES  262144
+#endif
+
+#ifndef SHP_EXPORT_BATCHRECS
+# define SHP_EXPORT_BATCHRECS   1024
+#endif
+
+/* SHPBeginAppend: default size of buffer for appended records */
+#ifndef SHP_APPEND_BUFSIZE
+# define SHP_APPEND_BUFSIZE     4194304
+#endif
+
 /*
  * WKB_ByteOrder: 1 byte
  */
@@ -363,6 +397,9 @@ typedef struct shape_tree_root * SHPTreeHandle;
 
 typedef struct _SHPInfoRTree   * SHPMBRTree;
 
+/* bump allocator (common/memapi.h) for buffers of objects and contexts */
+struct _mem_arena_t;
+
 
 #define SHAPEFILE_RECORDS_MAX   256000000
 
@@ -567,6 +604,9 @@ typedef struct _SHPObjectEx
     double      *padfZ;
     double      *padfM;
 
+    /* buffers taken from arena if not NULL (SHPCreateObjectExArena) */
+    struct _mem_arena_t *pArena;
+
     union{
         struct{
             double      dfXMin;
@@ -583,6 +623,110 @@ typedef struct _SHPObjectEx
     };
 } SHPObjectEx, *SHPObjectExHandle;
 
+
+/* -------------------------------------------------------------------- */
+/*      SHPGeomView - one shape record described in place: the arrays   */
+/*      point into the record buffer (SHPReadContext, file mapping) and */
+/*      are valid while it lives and holds the record. Nothing is       */
+/*      copied on little-endian hosts. Arrays are only 4-byte aligned.  */
+/* -------------------------------------------------------------------- */
+typedef struct _SHPGeomView
+{
+    int         nSHPType;
+    int         nShapeId;
+
+    int         nParts;         /* 0 for points and multipoints */
+    const int   *panPartStart;  /* no ending entry: part i ends at panPartStart[i+1] or nVertices */
+    const int   *panPartType;   /* SHPT_MULTIPATCH only, NULL for SHPP_RING */
+
+    int         nVertices;
+    const double *padfXY;       /* interleaved x0, y0, x1, y1, ... */
+    const double *padfZ;        /* NULL if not provided */
+    const double *padfM;        /* NULL if not provided */
+
+    union{
+        struct{
+            double      dfXMin;
+            double      dfYMin;
+            double      dfXMax;
+            double      dfYMax;
+
+            double      dfZMin;
+            double      dfZMax;
+            double      dfMMin;
+            double      dfMMax;
+        };
+        SHPBounds       _Bounds;
+    };
+} SHPGeomView;
+
+
+/* -------------------------------------------------------------------- */
+/*      SHPReadContext, DBFReadContext - caller-owned buffers for       */
+/*      reentrant reads (SHPReadObjectExR, DBFRead*AttributeR). Reads   */
+/*      use pread at record offsets and leave the FILE position and     */
+/*      buffers of the handle alone, so threads with their own context  */
+/*      can share one handle opened with "rb".                          */
+/* -------------------------------------------------------------------- */
+typedef struct _SHPReadContext
+{
+    unsigned char *pabyRec;
+    int         nBufSize;
+
+    /* buffers taken from arena if not NULL: set after SHPReadContextInit,
+       valid until arena is rewound to a mark before it */
+    struct _mem_arena_t *pArena;
+
+    /* record in pabyRec: reading it again takes no I/O. -1 if none */
+    SHPHandle   hSHP;
+    int         nEntity;
+} SHPReadContext;
+
+
+/* -------------------------------------------------------------------- */
+/*      SHPExportOptions - SHPExportShapes converts every shape into    */
+/*      WKB or WKT. nThreads > 1: one thread reads records, nThreads    */
+/*      threads convert them, output is passed in record order and is   */
+/*      the same as serial conversion (nThreads <= 1).                  */
+/* -------------------------------------------------------------------- */
+#define SHP_EXPORT_WKB      1
+#define SHP_EXPORT_WKT      2
+
+typedef struct _SHPExportOptions
+{
+    int         nFormat;    /* SHP_EXPORT_WKB or SHP_EXPORT_WKT */
+    int         nThreads;
+
+    double      offsetX;
+    double      offsetY;
+    double      offsetZ;
+    double      offsetM;
+
+    /* WKT only */
+    int         nDecimalsXY;
+    int         nDecimalsZ;
+    int         nDecimalsM;
+
+    /* optional reprojection: called by converting threads on the whole */
+    /* pPoints array (x,y pairs) of every shape before it is converted.  */
+    void        (*pfnTransformXY)(double *padfXY, int nPoints, void *pUserData);
+    void        *pTransformData;
+} SHPExportOptions;
+
+
+typedef struct _DBFReadContext
+{
+    char        *pszRecord;
+    int         nBufSize;
+
+    /* record in pszRecord, -1 if none */
+    DBFHandle   hDBF;
+    int         nRecord;
+
+    double      dDoubleField;
+    char        szStringField[257];    /* max is 256 chars */
+} DBFReadContext;
+
 #if defined(__cplusplus)
 }
 #endif
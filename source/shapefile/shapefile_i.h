@@ -59,10 +59,24 @@ static const char LIBVERSION[] = "0.0.1";
 #include <common/rtree.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <math.h>
 
+#if defined(_WIN32)
+# include <io.h>
+# include <windows.h>
+#else
+# include <unistd.h>
+# include <fcntl.h>
+#endif
+
 #include "shapefile_api.h"
+
+/* shpkernel.c: byte swap n dwords or qwords from src to dst (can be same, unaligned) */
+extern void SHPKernelSwap32 (void *dst, const void *src, int n);
+extern void SHPKernelSwap64 (void *dst, const void *src, int n);
+
 #include "shp2wkb.h"
 #include "shp2wkt.h"
 
@@ -113,6 +127,15 @@ typedef struct  _SHPInfo
     unsigned char *pabyRec;
     int         nBufSize;
 
+    /* .shx entries of [0, nSHXWritten) are on disk */
+    int         nSHXWritten;
+
+    /* buffered append: nAppendUsed bytes of records at nAppendOffset */
+    unsigned char *pabyAppend;
+    int         nAppendBufSize;
+    int         nAppendUsed;
+    int         nAppendOffset;
+
     /* RTree */
     SHPInfoRTree MBRTree;
 } SHPInfo;
@@ -201,6 +224,78 @@ static void * SfRealloc (void * pMem, int nNewSize)
 }
 
 
+/**
+ * SfRealloc from arena if it is not NULL. nOldSize: bytes of pMem in arena
+ */
+static void * SfArenaRealloc (struct _mem_arena_t *arena, void * pMem, int nOldSize, int nNewSize)
+{
+    if (arena) {
+        return mem_arena_realloc(arena, pMem, nOldSize, nNewSize);
+    }
+    return SfRealloc(pMem, nNewSize);
+}
+
+
+/**
+ * SfWillNeed
+ *   hint that bytes at nOffset of fp will be read soon.
+ */
+static void SfWillNeed (FILE *fp, long nOffset, long nSize)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(fp), (off_t) nOffset, (off_t) nSize, POSIX_FADV_WILLNEED);
+#else
+    (void) fp;
+    (void) nOffset;
+    (void) nSize;
+#endif
+}
+
+
+/**
+ * SfPread
+ *   read nSize bytes at nOffset of fp. position of fp is kept on POSIX (pread),
+ *   but moved on Windows (ReadFile with OVERLAPPED): saving and restoring it
+ *   would race between reader threads. so callers of stdio on the same fp
+ *   must fseek before fread/fwrite, as all of them in shapefile do.
+ * Returns:
+ *   1 if all bytes read, 0 if failed
+ */
+static int SfPread (FILE *fp, void *pBuf, int nSize, long nOffset)
+{
+#if defined(_WIN32)
+    OVERLAPPED ov;
+    DWORD nRead = 0;
+    HANDLE hFile = (HANDLE) _get_osfhandle(_fileno(fp));
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) nOffset;
+
+    if (! ReadFile(hFile, pBuf, (DWORD) nSize, &nRead, &ov)) {
+        return 0;
+    }
+    return (nRead == (DWORD) nSize);
+#else
+    int fd = fileno(fp);
+    char *p = (char *) pBuf;
+
+    while (nSize > 0) {
+        ssize_t n = pread(fd, p, (size_t) nSize, (off_t) nOffset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        p += n;
+        nSize -= (int) n;
+        nOffset += (long) n;
+    }
+    return 1;
+#endif
+}
+
+
 static int SHPTypeHasParts(int nSHPType)
 {
     return (nSHPType == SHPT_POLYGON ||
@@ -213,6 +308,26 @@ static int SHPTypeHasParts(int nSHPType)
 }
 
 
+/* shpkernel.c: twice signed area of closed ring, length of line (n points) */
+extern double SHPKernelAreaOfPoints (const SHPPointType *pPoints, int n);
+extern double SHPKernelAreaOfXYs (const double *padfX, const double *padfY, int n);
+extern double SHPKernelLengthOfPoints (const SHPPointType *pPoints, int n);
+extern double SHPKernelLengthOfXYs (const double *padfX, const double *padfY, int n);
+
+/* shpnest.c: rings of vertices (x, y) at pdX[i*nStride], pdY[i*nStride].
+ *   panDepth: number of rings containing the ring, padfArea: twice signed area */
+extern int SHPNestRings (int nParts, const int *panPartStart, const double *pdX, const double *pdY, int nStride,
+    int *panParent, int *panDepth, double *padfArea);
+
+/* reverse rings by depth: outer (even) clockwise, holes counter clockwise.
+ *   panParent and panDepth (output) can be NULL */
+extern int SHPRewindRings (int nParts, const int *panPartStart, double *pdX, double *pdY, int nStride, double *padfZ, double *padfM,
+    int *panParent, int *panDepth);
+
+/* parse shape record in pabyRec (nRecBytes with record header) into psShape */
+extern int SHPParseObjectEx (const ub1 *pabyRec, int nRecBytes, int hEntity, SHPObjectEx *psShape);
+
+
 static void StringToUpper (char *str, int len)
 {
     char *p = str;
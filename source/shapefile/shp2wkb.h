@@ -77,6 +77,55 @@ static ub1 wkb_bo_xdr = WKB_BYTEORDER_XDR;
 
 #define WKBHeaderSize    (sizeof(ub1) + sizeof(ub4))
 
+
+/**
+ * coordinates (x, y[, t]) of n vertices with offsets in XDR: written in host
+ * order then swapped all together. pT: z or m values, 0 for none.
+ * returns bytes written.
+ */
+static int WKBPutXYs (ub1 *pb, const double *pX, const double *pY, const double *pT, int n,
+    double offX, double offY, double offT)
+{
+    int i, dims = pT? 3 : 2;
+    double v[3];
+
+    for (i = 0; i < n; i++) {
+        v[0] = pX[i] + offX;
+        v[1] = pY[i] + offY;
+        if (pT) {
+            v[2] = pT[i] + offT;
+        }
+        memcpy(pb + (size_t) i * dims * 8, v, dims * 8);
+    }
+
+    if (_host_little_endian) {
+        SHPKernelSwap64(pb, pb, n * dims);
+    }
+    return n * dims * 8;
+}
+
+
+static int WKBPutPoints (ub1 *pb, const SHPPointType *pPoints, const double *pT, int n,
+    double offX, double offY, double offT)
+{
+    int i, dims = pT? 3 : 2;
+    double v[3];
+
+    for (i = 0; i < n; i++) {
+        v[0] = pPoints[i].x + offX;
+        v[1] = pPoints[i].y + offY;
+        if (pT) {
+            v[2] = pT[i] + offT;
+        }
+        memcpy(pb + (size_t) i * dims * 8, v, dims * 8);
+    }
+
+    if (_host_little_endian) {
+        SHPKernelSwap64(pb, pb, n * dims);
+    }
+    return n * dims * 8;
+}
+
 /*************************** Well-known Binary (WKB) *************************/
 
 #define WKBPointSize(num)     (num)*(WKBHeaderSize + 2*sizeof(double))
@@ -119,12 +168,9 @@ static int Point2WKB (const SHPObject *pObj, void *pv, double offX, double offY)
 static int Arc2WKB (const SHPObject *pObj, void *pv, double offX, double offY)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -136,13 +182,7 @@ static int Arc2WKB (const SHPObject *pObj, void *pv, double offX, double offY)
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->padfX[iPoint] + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfY[iPoint] + offY);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX, pObj->padfY, 0, pObj->nVertices, offX, offY, 0);
     } else {
         cb = WKBLineStringSize(pObj->nVertices);
     }
@@ -179,13 +219,7 @@ static int Polygon2WKB (const SHPObject *pObj, void *pv, double offX, double off
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->padfX[p] + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfY[p] + offY);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX + p, pObj->padfY + p, 0, p1 - p, offX, offY, 0);
         }
     } else {
         int iPart = 0;
@@ -277,12 +311,9 @@ static int PointZ2WKB (const SHPObject *pObj, void *pv, double offX, double offY
 static int ArcZ2WKB (const SHPObject *pObj, void *pv, double offX, double offY, double offZ)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -294,16 +325,7 @@ static int ArcZ2WKB (const SHPObject *pObj, void *pv, double offX, double offY,
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->padfX[iPoint] + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfY[iPoint] + offY);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfZ[iPoint] + offZ);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX, pObj->padfY, pObj->padfZ, pObj->nVertices, offX, offY, offZ);
     } else {
         cb = WKBLineStringZSize(pObj->nVertices);
     }
@@ -340,16 +362,7 @@ static int PolygonZ2WKB (const SHPObject *pObj, void *pv, double offX, double of
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->padfX[p] + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfY[p] + offY);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfZ[p] + offZ);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX + p, pObj->padfY + p, pObj->padfZ + p, p1 - p, offX, offY, offZ);
         }
     } else {
         int iPart = 0;
@@ -449,12 +462,9 @@ static int PointM2WKB (const SHPObject *pObj, void *pv, double offX, double offY
 static int ArcM2WKB (const SHPObject *pObj, void *pv, double offX, double offY, double offM)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -466,16 +476,7 @@ static int ArcM2WKB (const SHPObject *pObj, void *pv, double offX, double offY,
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->padfX[iPoint] + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfY[iPoint] + offY);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfM[iPoint] + offM);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX, pObj->padfY, pObj->padfM, pObj->nVertices, offX, offY, offM);
     } else {
         cb = WKBLineStringMSize(pObj->nVertices);
     }
@@ -512,16 +513,7 @@ static int PolygonM2WKB (const SHPObject *pObj, void *pv, double offX, double of
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->padfX[p] + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfY[p] + offY);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfM[p] + offM);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutXYs((ub1 *) pv + cb, pObj->padfX + p, pObj->padfY + p, pObj->padfM + p, p1 - p, offX, offY, offM);
         }
     } else {
         int iPart = 0;
@@ -618,12 +610,9 @@ static int exPoint2WKB (const SHPObjectEx *pObj, void *pv, double offX, double o
 static int exArc2WKB (const SHPObjectEx *pObj, void *pv, double offX, double offY)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -635,13 +624,7 @@ static int exArc2WKB (const SHPObjectEx *pObj, void *pv, double offX, double off
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].x + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].y + offY);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints, 0, pObj->nVertices, offX, offY, 0);
     } else {
         cb = WKBLineStringSize(pObj->nVertices);
     }
@@ -678,13 +661,7 @@ static int exPolygon2WKB (const SHPObjectEx *pObj, void *pv, double offX, double
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->pPoints[p].x + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->pPoints[p].y + offY);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints + p, 0, p1 - p, offX, offY, 0);
         }
     } else {
         int iPart = 0;
@@ -780,12 +757,9 @@ static int exPointZ2WKB (const SHPObjectEx *pObj, void *pv, double offX, double
 static int exArcZ2WKB (const SHPObjectEx *pObj, void *pv, double offX, double offY, double offZ)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -797,16 +771,7 @@ static int exArcZ2WKB (const SHPObjectEx *pObj, void *pv, double offX, double of
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].x + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].y + offY);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfZ[iPoint] + offZ);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints, pObj->padfZ, pObj->nVertices, offX, offY, offZ);
     } else {
         cb = WKBLineStringZSize(pObj->nVertices);
     }
@@ -843,16 +808,7 @@ static int exPolygonZ2WKB (const SHPObjectEx *pObj, void *pv, double offX, doubl
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->pPoints[p].x + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->pPoints[p].y + offY);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfZ[p] + offZ);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints + p, pObj->padfZ + p, p1 - p, offX, offY, offZ);
         }
     } else {
         int iPart = 0;
@@ -952,12 +908,9 @@ static int exPointM2WKB (const SHPObjectEx *pObj, void *pv, double offX, double
 static int exArcM2WKB (const SHPObjectEx *pObj, void *pv, double offX, double offY, double offM)
 {
     ub4 v4;
-    double   v8;
     int cb = 0;
 
     if (pv) {
-        int iPoint = 0;
-
         /* byte order flag */
         ValBufCopy(pv, cb, wkb_bo_xdr);
 
@@ -969,16 +922,7 @@ static int exArcM2WKB (const SHPObjectEx *pObj, void *pv, double offX, double of
         v4 = BO_i32_htobe(pObj->nVertices);
         ValBufCopy(pv, cb, v4);
 
-        for (; iPoint < pObj->nVertices; iPoint++) {
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].x + offX);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->pPoints[iPoint].y + offY);
-            ValBufCopy(pv, cb, v8);
-
-            v8 = BO_f64_htobe(pObj->padfM[iPoint] + offM);
-            ValBufCopy(pv, cb, v8);
-        }
+        cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints, pObj->padfM, pObj->nVertices, offX, offY, offM);
     } else {
         cb = WKBLineStringMSize(pObj->nVertices);
     }
@@ -1015,16 +959,7 @@ static int exPolygonM2WKB (const SHPObjectEx *pObj, void *pv, double offX, doubl
             v4 = BO_i32_htobe(p1 - p);
             ValBufCopy(pv, cb, v4);
 
-            for (; p < p1; p++) {
-                v8 = BO_f64_htobe(pObj->pPoints[p].x + offX);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->pPoints[p].y + offY);
-                ValBufCopy(pv, cb, v8);
-
-                v8 = BO_f64_htobe(pObj->padfM[p] + offM);
-                ValBufCopy(pv, cb, v8);
-            }
+            cb += WKBPutPoints((ub1 *) pv + cb, pObj->pPoints + p, pObj->padfM + p, p1 - p, offX, offY, offM);
         }
     } else {
         int iPart = 0;
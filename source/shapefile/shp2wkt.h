@@ -83,8 +83,7 @@ static int Point2WKT (const SHPObject *pObj, char *pbBuf, double offX, double of
             dig, *pObj->padfX + offX,
             dig, *pObj->padfY + offY);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT (%.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT (%.*lf %.*lf)",
             dig, *pObj->padfX + offX,
             dig, *pObj->padfY + offY);
     }
@@ -135,41 +134,39 @@ static int Arc2WKT (const SHPObject *pObj, char *pbBuf, double offX, double offY
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING (");
+            cb += snprintf(0, 0, "MULTILINESTRING (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING ");
+            cb += snprintf(0, 0, "LINESTRING ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY);
                 }
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -212,35 +209,33 @@ static int Polygon2WKT (const SHPObject *pObj, char *pbBuf, double offX, double
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON (");
+        cb += snprintf(0, 0, "POLYGON (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY);
                 }
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -269,23 +264,21 @@ static int MultiPoint2WKT (const SHPObject *pObj, char *pbBuf, double offX, doub
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT (");
+        cb += snprintf(0, 0, "MULTIPOINT (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf),",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf)",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -302,8 +295,7 @@ static int PointZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, double o
             dig, *pObj->padfY + offY,
             digZ, *pObj->padfZ + offZ);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT Z (%.*lf %.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT Z (%.*lf %.*lf %.*lf)",
             dig, *pObj->padfX + offX,
             dig, *pObj->padfY + offY,
             digZ, *pObj->padfZ + offZ);
@@ -357,28 +349,26 @@ static int ArcZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, double off
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING Z (");
+            cb += snprintf(0, 0, "MULTILINESTRING Z (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING Z ");
+            cb += snprintf(0, 0, "LINESTRING Z ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digZ, pObj->padfZ[at] + offZ);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digZ, pObj->padfZ[at] + offZ);
@@ -386,14 +376,14 @@ static int ArcZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, double off
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -438,23 +428,21 @@ static int PolygonZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, double
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON Z (");
+        cb += snprintf(0, 0, "POLYGON Z (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digZ, pObj->padfZ[at] + offZ);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digZ, pObj->padfZ[at] + offZ);
@@ -462,13 +450,13 @@ static int PolygonZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, double
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -499,25 +487,23 @@ static int MultiPointZ2WKT (const SHPObject *pObj, char *pbBuf, double offX, dou
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT Z (");
+        cb += snprintf(0, 0, "MULTIPOINT Z (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf),",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY,
                     digZ, pObj->padfZ[i] + offZ);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf)",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY,
                     digZ, pObj->padfZ[i] + offZ);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -534,8 +520,7 @@ static int PointM2WKT (const SHPObject *pObj, char *pbBuf, double offX, double o
             dig, *pObj->padfY + offY,
             digM, *pObj->padfM + offM);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT M (%.*lf %.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT M (%.*lf %.*lf %.*lf)",
             dig, *pObj->padfX + offX,
             dig, *pObj->padfY + offY,
             digM, *pObj->padfM + offM);
@@ -589,28 +574,26 @@ static int ArcM2WKT (const SHPObject *pObj, char *pbBuf, double offX, double off
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING M (");
+            cb += snprintf(0, 0, "MULTILINESTRING M (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING M ");
+            cb += snprintf(0, 0, "LINESTRING M ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digM, pObj->padfM[at] + offM);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digM, pObj->padfM[at] + offM);
@@ -618,14 +601,14 @@ static int ArcM2WKT (const SHPObject *pObj, char *pbBuf, double offX, double off
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -670,23 +653,21 @@ static int PolygonM2WKT (const SHPObject *pObj, char *pbBuf, double offX, double
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON M (");
+        cb += snprintf(0, 0, "POLYGON M (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digM, pObj->padfM[at] + offM);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->padfX[at] + offX,
                         dig, pObj->padfY[at] + offY,
                         digM, pObj->padfM[at] + offM);
@@ -694,13 +675,13 @@ static int PolygonM2WKT (const SHPObject *pObj, char *pbBuf, double offX, double
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -731,25 +712,23 @@ static int MultiPointM2WKT (const SHPObject *pObj, char *pbBuf, double offX, dou
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT M (");
+        cb += snprintf(0, 0, "MULTIPOINT M (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf),",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY,
                     digM, pObj->padfM[i] + offM);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf)",
                     dig, pObj->padfX[i] + offX,
                     dig, pObj->padfY[i] + offY,
                     digM, pObj->padfM[i] + offM);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -765,8 +744,7 @@ static int exPoint2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, doubl
             dig, pObj->pPoints->x + offX,
             dig, pObj->pPoints->y + offY);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT (%.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT (%.*lf %.*lf)",
             dig, pObj->pPoints->x + offX,
             dig, pObj->pPoints->y + offY);
     }
@@ -785,8 +763,7 @@ static int exPointZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, doub
             dig, pObj->pPoints->y + offY,
             digZ, *pObj->padfZ + offZ);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT Z (%.*lf %.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT Z (%.*lf %.*lf %.*lf)",
             dig, pObj->pPoints->x + offX,
             dig, pObj->pPoints->y + offY,
             digZ, *pObj->padfZ + offZ);
@@ -806,8 +783,7 @@ static int exPointM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, doub
             dig, pObj->pPoints->y + offY,
             digM, *pObj->padfM + offM);
     } else {
-        static char tmpbuf[128];
-        cb = sprintf(tmpbuf, "POINT M (%.*lf %.*lf %.*lf)",
+        cb = snprintf(0, 0, "POINT M (%.*lf %.*lf %.*lf)",
             dig, pObj->pPoints->x + offX,
             dig, pObj->pPoints->y + offY,
             digM, *pObj->padfM + offM);
@@ -839,23 +815,21 @@ static int exMultiPoint2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX,
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT (");
+        cb += snprintf(0, 0, "MULTIPOINT (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf),",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf)",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -886,25 +860,23 @@ static int exMultiPointZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX,
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT Z (");
+        cb += snprintf(0, 0, "MULTIPOINT Z (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf),",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY,
                     digZ, pObj->padfZ[i] + offZ);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf)",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY,
                     digZ, pObj->padfZ[i] + offZ);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -935,25 +907,23 @@ static int exMultiPointM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX,
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "MULTIPOINT M (");
+        cb += snprintf(0, 0, "MULTIPOINT M (");
 
         for (; i < pObj->nVertices; i++) {
             if (i < pObj->nVertices -1) {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf),",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf),",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY,
                     digM, pObj->padfM[i] + offM);
             } else {
-                cb += sprintf(tmpbuf + cb, "(%.*lf %.*lf %.*lf)",
+                cb += snprintf(0, 0, "(%.*lf %.*lf %.*lf)",
                     dig, pObj->pPoints[i].x + offX,
                     dig, pObj->pPoints[i].y + offY,
                     digM, pObj->padfM[i] + offM);
             }
         }
 
-        cb += sprintf(tmpbuf + cb, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -1002,41 +972,39 @@ static int exArc2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, double
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING (");
+            cb += snprintf(0, 0, "MULTILINESTRING (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING ");
+            cb += snprintf(0, 0, "LINESTRING ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY);
                 }
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -1088,28 +1056,26 @@ static int exArcZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, double
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING Z (");
+            cb += snprintf(0, 0, "MULTILINESTRING Z (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING Z ");
+            cb += snprintf(0, 0, "LINESTRING Z ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digZ, pObj->padfZ[at] + offZ);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digZ, pObj->padfZ[at] + offZ);
@@ -1117,14 +1083,14 @@ static int exArcZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, double
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -1176,28 +1142,26 @@ static int exArcM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, double
             cb += sprintf(pbBuf, ")");
         }
     } else {
-        static char tmpbuf[128];
-
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, "MULTILINESTRING M (");
+            cb += snprintf(0, 0, "MULTILINESTRING M (");
         } else {
-            cb += sprintf(tmpbuf, "LINESTRING M ");
+            cb += snprintf(0, 0, "LINESTRING M ");
         }
 
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digM, pObj->padfM[at] + offM);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digM, pObj->padfM[at] + offM);
@@ -1205,14 +1169,14 @@ static int exArcM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, double
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
         if (pObj->nParts > 1) {
-            cb += sprintf(tmpbuf, ")");
+            cb += snprintf(0, 0, ")");
         }
     }
 
@@ -1255,35 +1219,33 @@ static int exPolygon2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, dou
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON (");
+        cb += snprintf(0, 0, "POLYGON (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY);
                 }
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -1327,23 +1289,21 @@ static int exPolygonZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, do
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON Z (");
+        cb += snprintf(0, 0, "POLYGON Z (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digZ, pObj->padfZ[at] + offZ);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digZ, pObj->padfZ[at] + offZ);
@@ -1351,13 +1311,13 @@ static int exPolygonZ2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, do
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
@@ -1401,23 +1361,21 @@ static int exPolygonM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, do
 
         cb += sprintf(pbBuf + cb, ")");
     } else {
-        static char tmpbuf[128];
-
-        cb += sprintf(tmpbuf, "POLYGON M (");
+        cb += snprintf(0, 0, "POLYGON M (");
         for (; iPart < pObj->nParts; iPart++) {
             start = pObj->panPartStart[iPart];
             end = pObj->panPartStart[iPart+1];
 
-            cb += sprintf(tmpbuf, "(");
+            cb += snprintf(0, 0, "(");
 
             for (at = start; at < end; at++) {
                 if (at < end -1) {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf,",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf,",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digM, pObj->padfM[at] + offM);
                 } else {
-                    cb += sprintf(tmpbuf, "%.*lf %.*lf %.*lf",
+                    cb += snprintf(0, 0, "%.*lf %.*lf %.*lf",
                         dig, pObj->pPoints[at].x + offX,
                         dig, pObj->pPoints[at].y + offY,
                         digM, pObj->padfM[at] + offM);
@@ -1425,13 +1383,13 @@ static int exPolygonM2WKT (const SHPObjectEx *pObj, char *pbBuf, double offX, do
             }
 
             if (iPart < pObj->nParts -1) {
-                cb += sprintf(tmpbuf, "),");
+                cb += snprintf(0, 0, "),");
             } else {
-                cb += sprintf(tmpbuf, ")");
+                cb += snprintf(0, 0, ")");
             }
         }
 
-        cb += sprintf(tmpbuf, ")");
+        cb += snprintf(0, 0, ")");
     }
 
     return cb;
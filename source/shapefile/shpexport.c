@@ -0,0 +1,383 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shpexport.c
+ * @brief Convert shapes of a shapefile into WKB or WKT by threads.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-20 10:12:36
+ * @date 2024-11-20 10:12:36
+ *
+ * @note
+ *   nThreads > 1 的流水线:
+ *     读线程   - 按文件顺序把连续的记录成批读入空闲槽 (一次 pread)
+ *     转换线程 - 各自用自己的 SHPObjectEx 解析并转换一批记录
+ *     调用线程 - 按批次顺序把结果交给回调
+ *   nSlots 个槽组成环, 每个槽只有一个原子变量 nTicket = nSeq*4 + state,
+ *   各阶段只等待属于自己的 (批次, 状态), 不用锁.
+ */
+#include "shapefile_i.h"
+
+#include <pthread.h>
+#include <common/uatomic.h>
+
+#if defined(_MSC_VER)
+  // link to pthread-w32 lib for MS Windows with MSVC
+  # pragma comment(lib, "pthreadVC2.lib")
+#endif
+
+
+/* state of slot in low 2 bits of nTicket */
+#define SHP_EXPORT_SLOT_FREE    0   /* can be read into by batch nSeq */
+#define SHP_EXPORT_SLOT_READY   1   /* records of batch nSeq read */
+#define SHP_EXPORT_SLOT_DONE    2   /* records of batch nSeq converted */
+
+#define SHP_EXPORT_TICKET(nSeq, state)  ((nSeq)*4 + (state))
+
+
+typedef struct
+{
+    uatomic_int nTicket;
+
+    /* records [iFirst, iFirst+nCount) read from nOffset */
+    int         iFirst;
+    int         nCount;
+    long        nOffset;
+
+    ub1        *pabyRec;
+    int         nRecBufSize;
+
+    /* output of record iFirst+k: [panOutOffset[k], panOutOffset[k+1]) */
+    ub1        *pabyOut;
+    int         nOutBufSize;
+    int         panOutOffset[SHP_EXPORT_BATCHRECS + 1];
+} SHPExportSlot;
+
+
+typedef struct
+{
+    SHPHandle   hSHP;
+    const SHPExportOptions *options;
+
+    SHPExportSlot *pSlots;
+    int         nSlots;
+
+    /* number of batches, INT_MAX until all records are read */
+    uatomic_int nBatches;
+
+    /* next batch taken by a converting thread */
+    uatomic_int nNextSeq;
+
+    uatomic_int bAbort;
+    uatomic_int bReadError;
+} SHPExporter;
+
+
+static void SHPExportYield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+
+/**
+ * append WKB or WKT of psShape at *ppabyOut + nOutUsed.
+ *   points of psShape are reprojected in place if pfnTransformXY given.
+ *   returns bytes appended, 0 for null shape.
+ */
+static int SHPExportConvert(const SHPExportOptions *options, SHPObjectEx *psShape, ub1 **ppabyOut, int *pnOutBufSize, int nOutUsed)
+{
+    int cb;
+
+    if (psShape->nSHPType == SHPT_NULL) {
+        return 0;
+    }
+
+    if (options->pfnTransformXY && psShape->nVertices > 0) {
+        options->pfnTransformXY((double *) psShape->pPoints, psShape->nVertices, options->pTransformData);
+    }
+
+    if (options->nFormat == SHP_EXPORT_WKT) {
+        cb = SHPObjectEx2WKT(psShape, 0, options->offsetX, options->offsetY, options->offsetZ, options->offsetM,
+            options->nDecimalsXY, options->nDecimalsZ, options->nDecimalsM);
+    } else {
+        cb = SHPObjectEx2WKB(psShape, 0, options->offsetX, options->offsetY, options->offsetZ, options->offsetM);
+    }
+    if (cb <= 0) {
+        return 0;
+    }
+
+    /* WKT is terminated by 0 which is not counted */
+    if (nOutUsed + cb + 1 > *pnOutBufSize) {
+        *pnOutBufSize = MAX_V2(nOutUsed + cb + 1, *pnOutBufSize + *pnOutBufSize / 2);
+        *ppabyOut = (ub1 *) SfRealloc(*ppabyOut, *pnOutBufSize);
+    }
+
+    if (options->nFormat == SHP_EXPORT_WKT) {
+        return SHPObjectEx2WKT(psShape, (char *) (*ppabyOut + nOutUsed), options->offsetX, options->offsetY, options->offsetZ, options->offsetM,
+            options->nDecimalsXY, options->nDecimalsZ, options->nDecimalsM);
+    }
+    return SHPObjectEx2WKB(psShape, *ppabyOut + nOutUsed, options->offsetX, options->offsetY, options->offsetZ, options->offsetM);
+}
+
+
+/**
+ * wait until nTicket of slot equals to nTicket.
+ *   returns SHAPEFILE_FALSE if aborted or batch nSeq is beyond the end.
+ */
+static int SHPExportWait(SHPExporter *exporter, SHPExportSlot *slot, int nSeq, int nTicket)
+{
+    int nSpins = 0;
+
+    while (uatomic_int_get(&slot->nTicket) != nTicket) {
+        if (uatomic_int_get(&exporter->bAbort) || nSeq >= uatomic_int_get(&exporter->nBatches)) {
+            return SHAPEFILE_FALSE;
+        }
+        if (++nSpins > 64) {
+            SHPExportYield();
+        }
+    }
+    return SHAPEFILE_TRUE;
+}
+
+
+static void * SHPExportReadThread(void *arg)
+{
+    SHPExporter *exporter = (SHPExporter *) arg;
+    SHPHandle psSHP = exporter->hSHP;
+    int i, j, nSeq = 0;
+
+    for (i = 0; i < psSHP->nRecords; i = j, nSeq++) {
+        SHPExportSlot *slot = &exporter->pSlots[nSeq % exporter->nSlots];
+        long nStart = psSHP->panRecOffset[i];
+        long nEnd = nStart + psSHP->panRecSize[i] + 8;
+
+        /* following records in file order make up the batch */
+        for (j = i + 1; j < psSHP->nRecords && j - i < SHP_EXPORT_BATCHRECS; j++) {
+            long nRecStart = psSHP->panRecOffset[j];
+            long nRecEnd = nRecStart + psSHP->panRecSize[j] + 8;
+
+            if (nRecStart < nEnd || nRecStart - nEnd > SHP_FETCH_MAXGAP || nRecEnd - nStart > SHP_EXPORT_BATCHBYTES) {
+                break;
+            }
+            nEnd = nRecEnd;
+        }
+
+        if (! SHPExportWait(exporter, slot, nSeq, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_FREE))) {
+            return 0;
+        }
+
+        if (nEnd - nStart > slot->nRecBufSize) {
+            slot->nRecBufSize = (int) (nEnd - nStart);
+            slot->pabyRec = (ub1 *) SfRealloc(slot->pabyRec, slot->nRecBufSize);
+        }
+
+        if (! SfPread(psSHP->fpSHP, slot->pabyRec, (int) (nEnd - nStart), nStart)) {
+            uatomic_int_set(&exporter->bReadError, 1);
+            uatomic_int_set(&exporter->bAbort, 1);
+            return 0;
+        }
+
+        slot->iFirst = i;
+        slot->nCount = j - i;
+        slot->nOffset = nStart;
+
+        uatomic_int_comp_exch(&slot->nTicket, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_FREE), SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_READY));
+    }
+
+    uatomic_int_set(&exporter->nBatches, nSeq);
+    return 0;
+}
+
+
+static void * SHPExportConvertThread(void *arg)
+{
+    SHPExporter *exporter = (SHPExporter *) arg;
+    SHPHandle psSHP = exporter->hSHP;
+    SHPObjectEx *psShape;
+
+    SHPCreateObjectEx(&psShape);
+
+    for (;;) {
+        int k, nSeq = uatomic_int_add(&exporter->nNextSeq) - 1;
+        SHPExportSlot *slot = &exporter->pSlots[nSeq % exporter->nSlots];
+
+        if (! SHPExportWait(exporter, slot, nSeq, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_READY))) {
+            break;
+        }
+
+        slot->panOutOffset[0] = 0;
+        for (k = 0; k < slot->nCount; k++) {
+            int hEntity = slot->iFirst + k;
+            int cb = 0;
+
+            if (SHPParseObjectEx(slot->pabyRec + (psSHP->panRecOffset[hEntity] - slot->nOffset), psSHP->panRecSize[hEntity]+8, hEntity, psShape)) {
+                cb = SHPExportConvert(exporter->options, psShape, &slot->pabyOut, &slot->nOutBufSize, slot->panOutOffset[k]);
+            }
+            slot->panOutOffset[k+1] = slot->panOutOffset[k] + cb;
+        }
+
+        uatomic_int_comp_exch(&slot->nTicket, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_READY), SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_DONE));
+    }
+
+    SHPDestroyObjectEx(psShape);
+    return 0;
+}
+
+
+static int SHPExportShapesSerial(SHPHandle psSHP, const SHPExportOptions *options,
+    int (*onExportShape)(int nShapeId, const void *pData, int cbData, void *userParam), void *userParam)
+{
+    int hEntity, nExported = 0, nOutBufSize = 0;
+    ub1 *pabyOut = 0;
+    SHPObjectEx *psShape;
+    SHPReadContext ctx;
+
+    SHPCreateObjectEx(&psShape);
+    SHPReadContextInit(&ctx);
+
+    for (hEntity = 0; hEntity < psSHP->nRecords; hEntity++) {
+        int cb = 0;
+
+        if (SHPReadObjectExR(psSHP, &ctx, hEntity, psShape)) {
+            cb = SHPExportConvert(options, psShape, &pabyOut, &nOutBufSize, 0);
+        }
+
+        nExported++;
+        if (! onExportShape(hEntity, cb? pabyOut : 0, cb, userParam)) {
+            break;
+        }
+    }
+
+    SHPReadContextFinal(&ctx);
+    SHPDestroyObjectEx(psShape);
+    free(pabyOut);
+    return nExported;
+}
+
+
+int SHPExportShapes(SHPHandle psSHP, const SHPExportOptions *options,
+    int (*onExportShape)(int nShapeId, const void *pData, int cbData, void *userParam), void *userParam)
+{
+    int i, nSeq, nThreads, nStarted = 0, nExported = 0;
+    pthread_t reader, *workers;
+    SHPExporter exporter;
+
+    if (psSHP->nAppendUsed > 0) {
+        SHPFlushAppend(psSHP);
+    }
+
+    nThreads = MIN_V2(options->nThreads, psSHP->nRecords / SHP_EXPORT_BATCHRECS + 1);
+    if (nThreads <= 1) {
+        return SHPExportShapesSerial(psSHP, options, onExportShape, userParam);
+    }
+
+    memset(&exporter, 0, sizeof(exporter));
+    exporter.hSHP = psSHP;
+    exporter.options = options;
+    exporter.nBatches = INT_MAX;
+
+    /* every stage has a slot to work on while the others are busy */
+    exporter.nSlots = nThreads * 2 + 2;
+    exporter.pSlots = (SHPExportSlot *) calloc(exporter.nSlots, sizeof(SHPExportSlot));
+    if (! exporter.pSlots) {
+        printf("Error: SHPExportShapes - out of memory\n");
+        return -1;
+    }
+    for (i = 0; i < exporter.nSlots; i++) {
+        exporter.pSlots[i].nTicket = SHP_EXPORT_TICKET(i, SHP_EXPORT_SLOT_FREE);
+    }
+
+    workers = (pthread_t *) calloc(nThreads, sizeof(pthread_t));
+    if (! workers || pthread_create(&reader, 0, SHPExportReadThread, &exporter) != 0) {
+        free(workers);
+        free(exporter.pSlots);
+        return SHPExportShapesSerial(psSHP, options, onExportShape, userParam);
+    }
+    for (; nStarted < nThreads; nStarted++) {
+        if (pthread_create(&workers[nStarted], 0, SHPExportConvertThread, &exporter) != 0) {
+            break;
+        }
+    }
+
+    if (nStarted == 0) {
+        uatomic_int_set(&exporter.bAbort, 1);
+        pthread_join(reader, 0);
+        for (i = 0; i < exporter.nSlots; i++) {
+            free(exporter.pSlots[i].pabyRec);
+        }
+        free(exporter.pSlots);
+        free(workers);
+        return SHPExportShapesSerial(psSHP, options, onExportShape, userParam);
+    }
+
+    /* pass results in order of batches */
+    for (nSeq = 0; ; nSeq++) {
+        SHPExportSlot *slot = &exporter.pSlots[nSeq % exporter.nSlots];
+
+        if (! SHPExportWait(&exporter, slot, nSeq, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_DONE))) {
+            break;
+        }
+
+        for (i = 0; i < slot->nCount; i++) {
+            int cb = slot->panOutOffset[i+1] - slot->panOutOffset[i];
+
+            nExported++;
+            if (! onExportShape(slot->iFirst + i, cb? slot->pabyOut + slot->panOutOffset[i] : 0, cb, userParam)) {
+                uatomic_int_set(&exporter.bAbort, 1);
+                break;
+            }
+        }
+
+        if (i < slot->nCount) {
+            /* stopped by onExportShape */
+            break;
+        }
+
+        uatomic_int_comp_exch(&slot->nTicket, SHP_EXPORT_TICKET(nSeq, SHP_EXPORT_SLOT_DONE), SHP_EXPORT_TICKET(nSeq + exporter.nSlots, SHP_EXPORT_SLOT_FREE));
+    }
+
+    pthread_join(reader, 0);
+    for (i = 0; i < nStarted; i++) {
+        pthread_join(workers[i], 0);
+    }
+
+    for (i = 0; i < exporter.nSlots; i++) {
+        free(exporter.pSlots[i].pabyRec);
+        free(exporter.pSlots[i].pabyOut);
+    }
+    free(exporter.pSlots);
+    free(workers);
+
+    if (exporter.bReadError) {
+        printf("Error: SHPExportShapes - read records failed\n");
+        return -1;
+    }
+    return nExported;
+}
@@ -0,0 +1,569 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shpkernel.c
+ * @brief SIMD kernels for area and length of rings and lines, and bulk byte swap.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-22 09:36:15
+ * @date 2024-11-26 10:41:05
+ *
+ * @note
+ *   x86-64: SSE2 总是可用, AVX2 运行时检测 CPU 后才使用.
+ *   其它平台只有标量版本.
+ *   SIMD 版本的求和次序与标量不同, 结果可能差几个 ulp.
+ *   字节交换 (SHP 大端字段, XDR WKB): 整个数组一次交换, 源与目标可以相同,
+ *   地址不必对齐.
+ */
+#include "shapefile_i.h"
+
+#include <common/uatomic.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define SHP_KERNEL_X86
+
+# include <immintrin.h>
+
+# if defined(_MSC_VER)
+#   include <intrin.h>
+#   define SHP_TARGET_AVX2
+# else
+#   define SHP_TARGET_AVX2  __attribute__((target("avx2")))
+# endif
+#endif
+
+
+/* -------------------------------------------------------------------- */
+/*      scalar kernels (also tails of SIMD kernels)                     */
+/*                                                                      */
+/*      area: sum of (x[i]-x[0]) * (y[i+1]-y[i-1]) for i in [i0, i1),   */
+/*      which is twice the signed area of closed ring when i0 = 1 and   */
+/*      i1 = n-1. length: sum of |p[i+1]-p[i]| for i in [i0, i1).       */
+/* -------------------------------------------------------------------- */
+static double AreaOfPointsScalar(const SHPPointType *pt, int i0, int i1)
+{
+    int i;
+    double sum = 0;
+
+    for (i = i0; i < i1; i++) {
+        sum += (pt[i].x - pt[0].x) * (pt[i+1].y - pt[i-1].y);
+    }
+    return sum;
+}
+
+
+static double AreaOfXYsScalar(const double *pX, const double *pY, int i0, int i1)
+{
+    int i;
+    double sum = 0;
+
+    for (i = i0; i < i1; i++) {
+        sum += (pX[i] - pX[0]) * (pY[i+1] - pY[i-1]);
+    }
+    return sum;
+}
+
+
+static double LengthOfPointsScalar(const SHPPointType *pt, int i0, int i1)
+{
+    int i;
+    double dx, dy, sum = 0;
+
+    for (i = i0; i < i1; i++) {
+        dx = pt[i+1].x - pt[i].x;
+        dy = pt[i+1].y - pt[i].y;
+        sum += sqrt(dx*dx + dy*dy);
+    }
+    return sum;
+}
+
+
+static double LengthOfXYsScalar(const double *pX, const double *pY, int i0, int i1)
+{
+    int i;
+    double dx, dy, sum = 0;
+
+    for (i = i0; i < i1; i++) {
+        dx = pX[i+1] - pX[i];
+        dy = pY[i+1] - pY[i];
+        sum += sqrt(dx*dx + dy*dy);
+    }
+    return sum;
+}
+
+
+static void Swap32Scalar(ub1 *dst, const ub1 *src, int i0, int n)
+{
+    int i;
+    uint32_t v;
+
+    for (i = i0; i < n; i++) {
+        memcpy(&v, src + 4*i, 4);
+        BO_swap_dword(&v);
+        memcpy(dst + 4*i, &v, 4);
+    }
+}
+
+
+static void Swap64Scalar(ub1 *dst, const ub1 *src, int i0, int n)
+{
+    int i;
+    uint64_t v;
+
+    for (i = i0; i < n; i++) {
+        memcpy(&v, src + 8*i, 8);
+        BO_swap_qword(&v);
+        memcpy(dst + 8*i, &v, 8);
+    }
+}
+
+
+#ifdef SHP_KERNEL_X86
+
+/* -------------------------------------------------------------------- */
+/*      SSE2                                                            */
+/* -------------------------------------------------------------------- */
+static double HorizontalSum2(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+
+static double AreaOfPointsSSE2(const SHPPointType *pt, int i0, int i1)
+{
+    int i = i0;
+    const double *p = (const double *) pt;
+    __m128d p0 = _mm_loadu_pd(p);
+    __m128d acc = _mm_setzero_pd();
+
+    /* points i and i+1: [x-x0] * [y(i+1)-y(i-1)] */
+    for (; i + 2 <= i1; i += 2) {
+        __m128d e0 = _mm_sub_pd(_mm_loadu_pd(p + 2*i), p0);
+        __m128d e1 = _mm_sub_pd(_mm_loadu_pd(p + 2*i + 2), p0);
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(p + 2*i + 2), _mm_loadu_pd(p + 2*i - 2));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(p + 2*i + 4), _mm_loadu_pd(p + 2*i));
+
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_unpacklo_pd(e0, e1), _mm_unpackhi_pd(d0, d1)));
+    }
+
+    return HorizontalSum2(acc) + AreaOfPointsScalar(pt, i, i1);
+}
+
+
+static double AreaOfXYsSSE2(const double *pX, const double *pY, int i0, int i1)
+{
+    int i = i0;
+    __m128d x0 = _mm_set1_pd(pX[0]);
+    __m128d acc = _mm_setzero_pd();
+
+    for (; i + 2 <= i1; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(pX + i), x0);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(pY + i + 1), _mm_loadu_pd(pY + i - 1));
+        acc = _mm_add_pd(acc, _mm_mul_pd(dx, dy));
+    }
+
+    return HorizontalSum2(acc) + AreaOfXYsScalar(pX, pY, i, i1);
+}
+
+
+static double LengthOfPointsSSE2(const SHPPointType *pt, int i0, int i1)
+{
+    int i = i0;
+    const double *p = (const double *) pt;
+    __m128d acc = _mm_setzero_pd();
+
+    /* segments i and i+1 */
+    for (; i + 2 <= i1; i += 2) {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(p + 2*i + 2), _mm_loadu_pd(p + 2*i));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(p + 2*i + 4), _mm_loadu_pd(p + 2*i + 2));
+        __m128d dx = _mm_unpacklo_pd(d0, d1);
+        __m128d dy = _mm_unpackhi_pd(d0, d1);
+
+        acc = _mm_add_pd(acc, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+    }
+
+    return HorizontalSum2(acc) + LengthOfPointsScalar(pt, i, i1);
+}
+
+
+static double LengthOfXYsSSE2(const double *pX, const double *pY, int i0, int i1)
+{
+    int i = i0;
+    __m128d acc = _mm_setzero_pd();
+
+    for (; i + 2 <= i1; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(pX + i + 1), _mm_loadu_pd(pX + i));
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(pY + i + 1), _mm_loadu_pd(pY + i));
+
+        acc = _mm_add_pd(acc, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+    }
+
+    return HorizontalSum2(acc) + LengthOfXYsScalar(pX, pY, i, i1);
+}
+
+
+/* swap bytes of 16-bit words, then reverse words of each dword/qword */
+static void Swap32SSE2(ub1 *dst, const ub1 *src, int n)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 4*i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i *) (dst + 4*i), v);
+    }
+
+    Swap32Scalar(dst, src, i, n);
+}
+
+
+static void Swap64SSE2(ub1 *dst, const ub1 *src, int n)
+{
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 8*i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i *) (dst + 8*i), v);
+    }
+
+    Swap64Scalar(dst, src, i, n);
+}
+
+
+/* -------------------------------------------------------------------- */
+/*      AVX2                                                            */
+/* -------------------------------------------------------------------- */
+SHP_TARGET_AVX2
+static double HorizontalSum4(__m256d v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+
+SHP_TARGET_AVX2
+static double AreaOfPointsAVX2(const SHPPointType *pt, int i0, int i1)
+{
+    int i = i0;
+    const double *p = (const double *) pt;
+    __m256d p0 = _mm256_broadcast_pd((const __m128d *) p);
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+
+    /* points i..i+3: [x-x0, y-y0] * swap([x, y](i+1) - [x, y](i-1)),
+     * only even lanes are wanted */
+    for (; i + 4 <= i1; i += 4) {
+        __m256d e0 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i), p0);
+        __m256d e1 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i + 4), p0);
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i + 2), _mm256_loadu_pd(p + 2*i - 2));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i + 6), _mm256_loadu_pd(p + 2*i + 2));
+
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(e0, _mm256_permute_pd(d0, 0x5)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(e1, _mm256_permute_pd(d1, 0x5)));
+    }
+
+    acc0 = _mm256_blend_pd(_mm256_add_pd(acc0, acc1), _mm256_setzero_pd(), 0xA);
+    return HorizontalSum4(acc0) + AreaOfPointsScalar(pt, i, i1);
+}
+
+
+SHP_TARGET_AVX2
+static double AreaOfXYsAVX2(const double *pX, const double *pY, int i0, int i1)
+{
+    int i = i0;
+    __m256d x0 = _mm256_set1_pd(pX[0]);
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+
+    for (; i + 8 <= i1; i += 8) {
+        __m256d dx0 = _mm256_sub_pd(_mm256_loadu_pd(pX + i), x0);
+        __m256d dx1 = _mm256_sub_pd(_mm256_loadu_pd(pX + i + 4), x0);
+        __m256d dy0 = _mm256_sub_pd(_mm256_loadu_pd(pY + i + 1), _mm256_loadu_pd(pY + i - 1));
+        __m256d dy1 = _mm256_sub_pd(_mm256_loadu_pd(pY + i + 5), _mm256_loadu_pd(pY + i + 3));
+
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(dx0, dy0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(dx1, dy1));
+    }
+
+    return HorizontalSum4(_mm256_add_pd(acc0, acc1)) + AreaOfXYsScalar(pX, pY, i, i1);
+}
+
+
+SHP_TARGET_AVX2
+static double LengthOfPointsAVX2(const SHPPointType *pt, int i0, int i1)
+{
+    int i = i0;
+    const double *p = (const double *) pt;
+    __m256d acc = _mm256_setzero_pd();
+
+    /* segments i..i+3: hadd gives [s(i), s(i+2), s(i+1), s(i+3)] */
+    for (; i + 4 <= i1; i += 4) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i + 2), _mm256_loadu_pd(p + 2*i));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(p + 2*i + 6), _mm256_loadu_pd(p + 2*i + 4));
+        __m256d s = _mm256_hadd_pd(_mm256_mul_pd(d0, d0), _mm256_mul_pd(d1, d1));
+
+        acc = _mm256_add_pd(acc, _mm256_sqrt_pd(s));
+    }
+
+    return HorizontalSum4(acc) + LengthOfPointsScalar(pt, i, i1);
+}
+
+
+SHP_TARGET_AVX2
+static double LengthOfXYsAVX2(const double *pX, const double *pY, int i0, int i1)
+{
+    int i = i0;
+    __m256d acc = _mm256_setzero_pd();
+
+    for (; i + 4 <= i1; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(pX + i + 1), _mm256_loadu_pd(pX + i));
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(pY + i + 1), _mm256_loadu_pd(pY + i));
+
+        acc = _mm256_add_pd(acc, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+    }
+
+    return HorizontalSum4(acc) + LengthOfXYsScalar(pX, pY, i, i1);
+}
+
+
+SHP_TARGET_AVX2
+static void Swap32AVX2(ub1 *dst, const ub1 *src, int n)
+{
+    int i = 0;
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + 4*i));
+        _mm256_storeu_si256((__m256i *) (dst + 4*i), _mm256_shuffle_epi8(v, mask));
+    }
+
+    Swap32Scalar(dst, src, i, n);
+}
+
+
+SHP_TARGET_AVX2
+static void Swap64AVX2(ub1 *dst, const ub1 *src, int n)
+{
+    int i = 0;
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + 8*i));
+        _mm256_storeu_si256((__m256i *) (dst + 8*i), _mm256_shuffle_epi8(v, mask));
+    }
+
+    Swap64Scalar(dst, src, i, n);
+}
+
+
+static int SHPDetectSIMDLevel(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        int avx, osxsave;
+
+        __cpuid(info, 1);
+        avx = (info[2] >> 28) & 1;
+        osxsave = (info[2] >> 27) & 1;
+
+        /* OS saves YMM registers */
+        if (avx && osxsave && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if ((info[1] >> 5) & 1) {
+                return SHP_SIMD_AVX2;
+            }
+        }
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SHP_SIMD_AVX2;
+    }
+#endif
+    return SHP_SIMD_SSE2;
+}
+
+#else
+
+static int SHPDetectSIMDLevel(void)
+{
+    return SHP_SIMD_NONE;
+}
+
+#endif /* SHP_KERNEL_X86 */
+
+
+/* -1: not detected yet */
+static uatomic_int simdLevelMax = -1;
+static uatomic_int simdLevel = -1;
+
+
+int SHPGetSIMDLevel(void)
+{
+    int level = uatomic_int_get(&simdLevel);
+    if (level == -1) {
+        level = SHPDetectSIMDLevel();
+        uatomic_int_comp_exch(&simdLevelMax, -1, level);
+        uatomic_int_comp_exch(&simdLevel, -1, level);
+        level = uatomic_int_get(&simdLevel);
+    }
+    return level;
+}
+
+
+int SHPSetSIMDLevel(int level)
+{
+    int levelMax;
+
+    SHPGetSIMDLevel();
+    levelMax = uatomic_int_get(&simdLevelMax);
+
+    if (level < 0 || level > levelMax) {
+        level = levelMax;
+    }
+    uatomic_int_set(&simdLevel, level);
+    return level;
+}
+
+
+/* -------------------------------------------------------------------- */
+/*      dispatch: n points, closed ring for area                        */
+/* -------------------------------------------------------------------- */
+double SHPKernelAreaOfPoints(const SHPPointType *pt, int n)
+{
+    if (n < 3) {
+        return 0;
+    }
+#ifdef SHP_KERNEL_X86
+    switch (SHPGetSIMDLevel()) {
+    case SHP_SIMD_AVX2:
+        return AreaOfPointsAVX2(pt, 1, n - 1);
+    case SHP_SIMD_SSE2:
+        return AreaOfPointsSSE2(pt, 1, n - 1);
+    }
+#endif
+    return AreaOfPointsScalar(pt, 1, n - 1);
+}
+
+
+double SHPKernelAreaOfXYs(const double *pX, const double *pY, int n)
+{
+    if (n < 3) {
+        return 0;
+    }
+#ifdef SHP_KERNEL_X86
+    switch (SHPGetSIMDLevel()) {
+    case SHP_SIMD_AVX2:
+        return AreaOfXYsAVX2(pX, pY, 1, n - 1);
+    case SHP_SIMD_SSE2:
+        return AreaOfXYsSSE2(pX, pY, 1, n - 1);
+    }
+#endif
+    return AreaOfXYsScalar(pX, pY, 1, n - 1);
+}
+
+
+double SHPKernelLengthOfPoints(const SHPPointType *pt, int n)
+{
+    if (n < 2) {
+        return 0;
+    }
+#ifdef SHP_KERNEL_X86
+    switch (SHPGetSIMDLevel()) {
+    case SHP_SIMD_AVX2:
+        return LengthOfPointsAVX2(pt, 0, n - 1);
+    case SHP_SIMD_SSE2:
+        return LengthOfPointsSSE2(pt, 0, n - 1);
+    }
+#endif
+    return LengthOfPointsScalar(pt, 0, n - 1);
+}
+
+
+double SHPKernelLengthOfXYs(const double *pX, const double *pY, int n)
+{
+    if (n < 2) {
+        return 0;
+    }
+#ifdef SHP_KERNEL_X86
+    switch (SHPGetSIMDLevel()) {
+    case SHP_SIMD_AVX2:
+        return LengthOfXYsAVX2(pX, pY, 0, n - 1);
+    case SHP_SIMD_SSE2:
+        return LengthOfXYsSSE2(pX, pY, 0, n - 1);
+    }
+#endif
+    return LengthOfXYsScalar(pX, pY, 0, n - 1);
+}
+
+
+/* -------------------------------------------------------------------- */
+/*      dispatch: byte swap of n dwords or qwords                       */
+/* -------------------------------------------------------------------- */
+void SHPKernelSwap32(void *dst, const void *src, int n)
+{
+#ifdef SHP_KERNEL_X86
+    if (n >= 4) {
+        switch (SHPGetSIMDLevel()) {
+        case SHP_SIMD_AVX2:
+            Swap32AVX2((ub1 *) dst, (const ub1 *) src, n);
+            return;
+        case SHP_SIMD_SSE2:
+            Swap32SSE2((ub1 *) dst, (const ub1 *) src, n);
+            return;
+        }
+    }
+#endif
+    Swap32Scalar((ub1 *) dst, (const ub1 *) src, 0, n);
+}
+
+
+void SHPKernelSwap64(void *dst, const void *src, int n)
+{
+#ifdef SHP_KERNEL_X86
+    if (n >= 2) {
+        switch (SHPGetSIMDLevel()) {
+        case SHP_SIMD_AVX2:
+            Swap64AVX2((ub1 *) dst, (const ub1 *) src, n);
+            return;
+        case SHP_SIMD_SSE2:
+            Swap64SSE2((ub1 *) dst, (const ub1 *) src, n);
+            return;
+        }
+    }
+#endif
+    Swap64Scalar((ub1 *) dst, (const ub1 *) src, 0, n);
+}
@@ -0,0 +1,605 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shpnest.c
+ * @brief Ring nesting of polygons: parents of rings by containment,
+ *   winding and order repair.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-25 10:21:40
+ * @date 2024-11-25 21:08:13
+ *
+ * @note
+ *   1) 环的外接矩形建 SHPTree (环少时不建), 环按面积从大到小排序.
+ *   2) 环 r 的父环是包含 r 的面积最小的环: 只在外接矩形包含 r 的,
+ *      面积更大的环中找, 用 r 的 3 个顶点做射线测试 (多数为准).
+ *   3) 被测试的大环按 y 分带建边索引, 射线测试只看一个带的边.
+ *   深度为偶数的是外环 (shapefile 要求顺时针), 奇数的是洞 (逆时针).
+ */
+#include "shapefile_i.h"
+
+
+/* polygons with more rings than this search candidate parents by SHPTree */
+#define SHP_NEST_TREERINGS  16
+
+/* rings with more edges than this are tested by bands of edges */
+#define SHP_NEST_BANDEDGES  32
+
+/* edges per band, about */
+#define SHP_NEST_BANDSIZE   4
+
+
+typedef struct
+{
+    int         nBands;
+    double      dfY0;
+    double      dfBandH;
+
+    /* edges (index of first vertex) in band b: [panBandStart[b], panBandStart[b+1]) */
+    int        *panBandStart;
+    int        *panEdges;
+} SHPRingBands;
+
+
+typedef struct
+{
+    double      dfAbsArea;
+    int         nRank;          /* order by area, larger first */
+    SHPRingBands *psBands;
+} SHPNestRing;
+
+
+typedef struct
+{
+    int         nParts;
+    const int  *panPartStart;
+    const double *pdX;
+    const double *pdY;
+    int         nStride;
+
+    SHPNestRing *pRings;
+    SHPEnvelope *pEnvs;
+
+    /* ranks of candidate parents of ring iRing */
+    int         iRing;
+    int         nCandidates;
+    int         nCandidatesMax;
+    int        *panCandidates;
+} SHPNestContext;
+
+
+#define NEST_X(ctx, i)  ((ctx)->pdX[(size_t)(i) * (ctx)->nStride])
+#define NEST_Y(ctx, i)  ((ctx)->pdY[(size_t)(i) * (ctx)->nStride])
+
+
+static SHPRingBands * SHPRingBandsCreate(const SHPNestContext *ctx, int iRing)
+{
+    int b, i, k, nEdges, start = ctx->panPartStart[iRing];
+    const SHPEnvelope *env = &ctx->pEnvs[iRing];
+    SHPRingBands *psBands = (SHPRingBands *) calloc(1, sizeof(SHPRingBands));
+
+    nEdges = ctx->panPartStart[iRing+1] - start;
+
+    psBands->nBands = MAX_V2(1, nEdges / SHP_NEST_BANDSIZE);
+    psBands->dfY0 = env->YMin;
+    psBands->dfBandH = (env->YMax - env->YMin) / psBands->nBands;
+    if (! (psBands->dfBandH > 0)) {
+        psBands->nBands = 1;
+        psBands->dfBandH = 1;
+    }
+    psBands->panBandStart = (int *) calloc(psBands->nBands + 1, sizeof(int));
+
+    /* 2 passes: count edges of bands, then fill them */
+    for (b = 0; b < 2; b++) {
+        for (i = 0; i < nEdges; i++) {
+            int k0, k1;
+            double y0 = NEST_Y(ctx, start + i);
+            double y1 = NEST_Y(ctx, start + (i + 1) % nEdges);
+
+            k0 = (int) ((MIN_V2(y0, y1) - psBands->dfY0) / psBands->dfBandH);
+            k1 = (int) ((MAX_V2(y0, y1) - psBands->dfY0) / psBands->dfBandH);
+            k0 = MAX_V2(0, MIN_V2(k0, psBands->nBands - 1));
+            k1 = MAX_V2(0, MIN_V2(k1, psBands->nBands - 1));
+
+            for (k = k0; k <= k1; k++) {
+                if (b == 0) {
+                    psBands->panBandStart[k + 1]++;
+                } else {
+                    psBands->panEdges[psBands->panBandStart[k]++] = i;
+                }
+            }
+        }
+
+        if (b == 0) {
+            for (k = 0; k < psBands->nBands; k++) {
+                psBands->panBandStart[k + 1] += psBands->panBandStart[k];
+            }
+            psBands->panEdges = (int *) SfRealloc(0, sizeof(int) * MAX_V2(1, psBands->panBandStart[psBands->nBands]));
+        } else {
+            /* panBandStart[k] was moved to start of band k+1 */
+            memmove(psBands->panBandStart + 1, psBands->panBandStart, sizeof(int) * psBands->nBands);
+            psBands->panBandStart[0] = 0;
+        }
+    }
+
+    return psBands;
+}
+
+
+static void SHPRingBandsDestroy(SHPRingBands *psBands)
+{
+    if (psBands) {
+        free(psBands->panBandStart);
+        free(psBands->panEdges);
+        free(psBands);
+    }
+}
+
+
+/* ray to the left of (x, y) crosses edge i of ring at start with n edges */
+static int SHPRingEdgeCrossed(const SHPNestContext *ctx, int start, int n, int i, double x, double y)
+{
+    double x0 = NEST_X(ctx, start + i);
+    double y0 = NEST_Y(ctx, start + i);
+    double x1 = NEST_X(ctx, start + (i + 1) % n);
+    double y1 = NEST_Y(ctx, start + (i + 1) % n);
+
+    if ((y0 < y && y1 >= y) || (y1 < y && y0 >= y)) {
+        return (x0 + (y - y0) / (y1 - y0) * (x1 - x0) < x);
+    }
+    return 0;
+}
+
+
+static int SHPRingContainsXY(SHPNestContext *ctx, int iRing, double x, double y)
+{
+    int i, bInside = 0;
+    int start = ctx->panPartStart[iRing];
+    int n = ctx->panPartStart[iRing+1] - start;
+    SHPNestRing *ring = &ctx->pRings[iRing];
+
+    if (n > SHP_NEST_BANDEDGES && ! ring->psBands) {
+        ring->psBands = SHPRingBandsCreate(ctx, iRing);
+    }
+
+    if (ring->psBands) {
+        const SHPRingBands *psBands = ring->psBands;
+        int b = (int) ((y - psBands->dfY0) / psBands->dfBandH);
+
+        b = MAX_V2(0, MIN_V2(b, psBands->nBands - 1));
+        for (i = psBands->panBandStart[b]; i < psBands->panBandStart[b + 1]; i++) {
+            bInside ^= SHPRingEdgeCrossed(ctx, start, n, psBands->panEdges[i], x, y);
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            bInside ^= SHPRingEdgeCrossed(ctx, start, n, i, x, y);
+        }
+    }
+    return bInside;
+}
+
+
+/* ring iOuter contains ring iInner: most of 3 vertices of iInner inside */
+static int SHPRingContainsRing(SHPNestContext *ctx, int iOuter, int iInner)
+{
+    int k, nTests, nInside = 0;
+    int start = ctx->panPartStart[iInner];
+    int n = ctx->panPartStart[iInner+1] - start;
+
+    nTests = (n >= 3)? 3 : 1;
+    for (k = 0; k < nTests; k++) {
+        int i = start + n * k / 3;
+        nInside += SHPRingContainsXY(ctx, iOuter, NEST_X(ctx, i), NEST_Y(ctx, i));
+    }
+    return nInside * 2 > nTests;
+}
+
+
+/* larger rings whose bounds contain bounds of ring iRing are candidates */
+static void SHPNestAddCandidate(SHPNestContext *ctx, int iCheck)
+{
+    const SHPEnvelope *check = &ctx->pEnvs[iCheck];
+    const SHPEnvelope *env = &ctx->pEnvs[ctx->iRing];
+
+    if (ctx->pRings[iCheck].nRank < ctx->pRings[ctx->iRing].nRank &&
+        check->XMin <= env->XMin && check->YMin <= env->YMin && check->XMax >= env->XMax && check->YMax >= env->YMax) {
+        if (ctx->nCandidates == ctx->nCandidatesMax) {
+            ctx->nCandidatesMax = MAX_V2(16, ctx->nCandidatesMax * 2);
+            ctx->panCandidates = (int *) SfRealloc(ctx->panCandidates, sizeof(int) * ctx->nCandidatesMax);
+        }
+        ctx->panCandidates[ctx->nCandidates++] = ctx->pRings[iCheck].nRank;
+    }
+}
+
+
+static int SHPNestRankCmp(const void *a, const void *b)
+{
+    int ra = *(const int *) a;
+    int rb = *(const int *) b;
+    return (ra < rb) - (ra > rb);
+}
+
+
+typedef struct
+{
+    double  dfAbsArea;
+    int     iRing;
+} SHPNestAreaKey;
+
+
+static int SHPNestAreaCmp(const void *a, const void *b)
+{
+    const SHPNestAreaKey *ka = (const SHPNestAreaKey *) a;
+    const SHPNestAreaKey *kb = (const SHPNestAreaKey *) b;
+
+    if (ka->dfAbsArea != kb->dfAbsArea) {
+        return (ka->dfAbsArea < kb->dfAbsArea)? 1 : -1;
+    }
+    return (ka->iRing > kb->iRing) - (ka->iRing < kb->iRing);
+}
+
+
+int SHPNestRings(int nParts, const int *panPartStart, const double *pdX, const double *pdY, int nStride,
+    int *panParent, int *panDepth, double *padfArea)
+{
+    int i, k, iPart;
+    SHPNestContext ctx;
+    SHPNestAreaKey *pKeys;
+    SHPTreeHandle hTree = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.nParts = nParts;
+    ctx.panPartStart = panPartStart;
+    ctx.pdX = pdX;
+    ctx.pdY = pdY;
+    ctx.nStride = nStride;
+
+    ctx.pRings = (SHPNestRing *) calloc(MAX_V2(1, nParts), sizeof(SHPNestRing));
+    ctx.pEnvs = (SHPEnvelope *) SfRealloc(0, sizeof(SHPEnvelope) * MAX_V2(1, nParts));
+    pKeys = (SHPNestAreaKey *) SfRealloc(0, sizeof(SHPNestAreaKey) * MAX_V2(1, nParts));
+
+    for (iPart = 0; iPart < nParts; iPart++) {
+        SHPNestRing *ring = &ctx.pRings[iPart];
+        SHPEnvelope *env = &ctx.pEnvs[iPart];
+        int start = panPartStart[iPart];
+        int n = panPartStart[iPart+1] - start;
+
+        panParent[iPart] = -1;
+        panDepth[iPart] = 0;
+        padfArea[iPart] = 0;
+
+        /* empty ring: XMin > XMax */
+        env->XMin = env->YMin = 1;
+        env->XMax = env->YMax = -1;
+
+        if (n > 0) {
+            env->XMin = env->XMax = NEST_X(&ctx, start);
+            env->YMin = env->YMax = NEST_Y(&ctx, start);
+
+            for (i = start + 1; i < start + n; i++) {
+                env->XMin = MIN_V2(env->XMin, NEST_X(&ctx, i));
+                env->YMin = MIN_V2(env->YMin, NEST_Y(&ctx, i));
+                env->XMax = MAX_V2(env->XMax, NEST_X(&ctx, i));
+                env->YMax = MAX_V2(env->YMax, NEST_Y(&ctx, i));
+            }
+
+            if (nStride == 2) {
+                padfArea[iPart] = SHPKernelAreaOfPoints((const SHPPointType *) pdX + start, n);
+            } else {
+                padfArea[iPart] = SHPKernelAreaOfXYs(pdX + start, pdY + start, n);
+            }
+
+            if (n > 2 && (NEST_X(&ctx, start + n - 1) != NEST_X(&ctx, start) || NEST_Y(&ctx, start + n - 1) != NEST_Y(&ctx, start))) {
+                /* ring not closed: last term of closed ring */
+                padfArea[iPart] += (NEST_X(&ctx, start + n - 1) - NEST_X(&ctx, start)) * (NEST_Y(&ctx, start) - NEST_Y(&ctx, start + n - 2));
+            }
+        }
+
+        ring->dfAbsArea = fabs(padfArea[iPart]);
+        pKeys[iPart].dfAbsArea = ring->dfAbsArea;
+        pKeys[iPart].iRing = iPart;
+    }
+
+    qsort(pKeys, nParts, sizeof(SHPNestAreaKey), SHPNestAreaCmp);
+    for (k = 0; k < nParts; k++) {
+        ctx.pRings[pKeys[k].iRing].nRank = k;
+    }
+
+    if (nParts > SHP_NEST_TREERINGS) {
+        hTree = SHPCreateTreeFromBounds(nParts, ctx.pEnvs, 0, 0, 0, 1);
+    }
+
+    /* parents are placed before children */
+    for (k = 0; k < nParts; k++) {
+        int iRing = pKeys[k].iRing;
+
+        if (panPartStart[iRing+1] <= panPartStart[iRing]) {
+            continue;
+        }
+
+        ctx.iRing = iRing;
+        ctx.nCandidates = 0;
+
+        if (hTree) {
+            int nFound = 0, *panFound;
+            double adfMin[4] = {ctx.pEnvs[iRing].XMin, ctx.pEnvs[iRing].YMin, 0, 0};
+            double adfMax[4] = {ctx.pEnvs[iRing].XMax, ctx.pEnvs[iRing].YMax, 0, 0};
+
+            panFound = SHPTreeFindLikelyShapes(hTree, adfMin, adfMax, &nFound);
+            for (i = 0; i < nFound; i++) {
+                SHPNestAddCandidate(&ctx, panFound[i]);
+            }
+            free(panFound);
+        } else {
+            for (i = 0; i < nParts; i++) {
+                SHPNestAddCandidate(&ctx, i);
+            }
+        }
+
+        /* smaller candidates first: the first one containing ring is parent */
+        if (ctx.nCandidates > 1) {
+            qsort(ctx.panCandidates, ctx.nCandidates, sizeof(int), SHPNestRankCmp);
+        }
+
+        for (i = 0; i < ctx.nCandidates; i++) {
+            int iCheck = pKeys[ctx.panCandidates[i]].iRing;
+            if (SHPRingContainsRing(&ctx, iCheck, iRing)) {
+                panParent[iRing] = iCheck;
+                panDepth[iRing] = panDepth[iCheck] + 1;
+                break;
+            }
+        }
+    }
+
+    for (iPart = 0; iPart < nParts; iPart++) {
+        SHPRingBandsDestroy(ctx.pRings[iPart].psBands);
+    }
+    if (hTree) {
+        SHPDestroyTree(hTree);
+    }
+    free(ctx.panCandidates);
+    free(ctx.pEnvs);
+    free(ctx.pRings);
+    free(pKeys);
+    return 0;
+}
+
+
+static void SHPReverseRing(double *pdX, double *pdY, int nStride, double *padfZ, double *padfM, int start, int end)
+{
+    int i, j;
+    double t;
+
+    for (i = start, j = end - 1; i < j; i++, j--) {
+        t = pdX[(size_t) i * nStride];
+        pdX[(size_t) i * nStride] = pdX[(size_t) j * nStride];
+        pdX[(size_t) j * nStride] = t;
+
+        t = pdY[(size_t) i * nStride];
+        pdY[(size_t) i * nStride] = pdY[(size_t) j * nStride];
+        pdY[(size_t) j * nStride] = t;
+
+        if (padfZ) {
+            t = padfZ[i];
+            padfZ[i] = padfZ[j];
+            padfZ[j] = t;
+        }
+        if (padfM) {
+            t = padfM[i];
+            padfM[i] = padfM[j];
+            padfM[j] = t;
+        }
+    }
+}
+
+
+int SHPRewindRings(int nParts, const int *panPartStart, double *pdX, double *pdY, int nStride, double *padfZ, double *padfM,
+    int *panParent, int *panDepth)
+{
+    int iPart, bAltered = 0;
+    int *panNest = 0;
+    double *padfArea;
+
+    if (! panParent) {
+        panNest = (int *) SfRealloc(0, sizeof(int) * 2 * MAX_V2(1, nParts));
+        panParent = panNest;
+        panDepth = panNest + nParts;
+    }
+    padfArea = (double *) SfRealloc(0, sizeof(double) * MAX_V2(1, nParts));
+
+    SHPNestRings(nParts, panPartStart, pdX, pdY, nStride, panParent, panDepth, padfArea);
+
+    /* outer rings (even depth) clockwise, holes counter clockwise */
+    for (iPart = 0; iPart < nParts; iPart++) {
+        int bInner = panDepth[iPart] & 1;
+
+        if ((padfArea[iPart] < 0 && bInner) || (padfArea[iPart] > 0 && !bInner)) {
+            SHPReverseRing(pdX, pdY, nStride, padfZ, padfM, panPartStart[iPart], panPartStart[iPart+1]);
+            bAltered++;
+        }
+    }
+
+    free(panNest);
+    free(padfArea);
+    return bAltered;
+}
+
+
+/**
+ * rewind rings as SHPRewindRings and put every outer ring before its
+ *   holes. returns number of rings reversed or moved.
+ */
+static int SHPFixRings(int nParts, int *panPartStart, int *panPartType, int nVertices,
+    double *pdX, double *pdY, int nStride, double *padfZ, double *padfM)
+{
+    int i, k, iPart, nOrdered = 0, nAltered;
+    int *panParent, *panDepth, *panOrder, *panHoleStart, *panHoles;
+    ub1 *pabyEmitted;
+
+    panParent = (int *) SfRealloc(0, sizeof(int) * (5 * nParts + 1));
+    panDepth = panParent + nParts;
+    panOrder = panDepth + nParts;
+    panHoles = panOrder + nParts;
+    panHoleStart = panHoles + nParts;
+    pabyEmitted = (ub1 *) calloc(MAX_V2(1, nParts), 1);
+
+    nAltered = SHPRewindRings(nParts, panPartStart, pdX, pdY, nStride, padfZ, padfM, panParent, panDepth);
+
+    /* holes of outer ring i: panHoles[panHoleStart[i], panHoleStart[i+1]) */
+    memset(panHoleStart, 0, sizeof(int) * (nParts + 1));
+    for (iPart = 0; iPart < nParts; iPart++) {
+        if (panDepth[iPart] & 1) {
+            panHoleStart[panParent[iPart] + 1]++;
+        }
+    }
+    for (iPart = 0; iPart < nParts; iPart++) {
+        panHoleStart[iPart + 1] += panHoleStart[iPart];
+    }
+    for (iPart = 0; iPart < nParts; iPart++) {
+        if (panDepth[iPart] & 1) {
+            panHoles[panHoleStart[panParent[iPart]]++] = iPart;
+        }
+    }
+    memmove(panHoleStart + 1, panHoleStart, sizeof(int) * nParts);
+    panHoleStart[0] = 0;
+
+    /* groups in order of their first ring */
+    for (iPart = 0; iPart < nParts; iPart++) {
+        int iOuter = (panDepth[iPart] & 1)? panParent[iPart] : iPart;
+
+        if (! pabyEmitted[iOuter]) {
+            pabyEmitted[iOuter] = 1;
+            panOrder[nOrdered++] = iOuter;
+            for (k = panHoleStart[iOuter]; k < panHoleStart[iOuter + 1]; k++) {
+                pabyEmitted[panHoles[k]] = 1;
+                panOrder[nOrdered++] = panHoles[k];
+            }
+        }
+    }
+
+    for (iPart = 0; iPart < nParts && panOrder[iPart] == iPart; iPart++) {
+        /* nothing */
+    }
+
+    if (iPart < nParts) {
+        /* move rings into new order */
+        double *pdCopy = (double *) SfRealloc(0, sizeof(double) * 4 * MAX_V2(1, nVertices));
+        int *panStartCopy = (int *) SfRealloc(0, sizeof(int) * 2 * (nParts + 1));
+        int *panTypeCopy = panStartCopy + nParts + 1;
+        int iVert = 0;
+
+        for (i = 0; i < nVertices; i++) {
+            pdCopy[4*i] = pdX[(size_t) i * nStride];
+            pdCopy[4*i + 1] = pdY[(size_t) i * nStride];
+            pdCopy[4*i + 2] = padfZ? padfZ[i] : 0;
+            pdCopy[4*i + 3] = padfM? padfM[i] : 0;
+        }
+        memcpy(panStartCopy, panPartStart, sizeof(int) * (nParts + 1));
+        if (panPartType) {
+            memcpy(panTypeCopy, panPartType, sizeof(int) * nParts);
+        }
+
+        for (k = 0; k < nParts; k++) {
+            int iRing = panOrder[k];
+
+            if (panOrder[k] != k) {
+                nAltered++;
+            }
+
+            panPartStart[k] = iVert;
+            if (panPartType) {
+                panPartType[k] = panTypeCopy[iRing];
+            }
+
+            for (i = panStartCopy[iRing]; i < panStartCopy[iRing + 1]; i++, iVert++) {
+                pdX[(size_t) iVert * nStride] = pdCopy[4*i];
+                pdY[(size_t) iVert * nStride] = pdCopy[4*i + 1];
+                if (padfZ) {
+                    padfZ[iVert] = pdCopy[4*i + 2];
+                }
+                if (padfM) {
+                    padfM[iVert] = pdCopy[4*i + 3];
+                }
+            }
+        }
+
+        free(pdCopy);
+        free(panStartCopy);
+    }
+
+    free(pabyEmitted);
+    free(panParent);
+    return nAltered;
+}
+
+
+static int SHPIsPolygonType(int nSHPType)
+{
+    return (nSHPType == SHPT_POLYGON || nSHPType == SHPT_POLYGONZ || nSHPType == SHPT_POLYGONM);
+}
+
+
+int SHPObjectExNestRings(const SHPObjectEx *psObject, int *panParent, int *panDepth)
+{
+    double *padfArea;
+
+    if (! SHPIsPolygonType(psObject->nSHPType)) {
+        return -1;
+    }
+
+    padfArea = (double *) SfRealloc(0, sizeof(double) * MAX_V2(1, psObject->nParts));
+    SHPNestRings(psObject->nParts, psObject->panPartStart, &psObject->pPoints[0].x, &psObject->pPoints[0].y, 2,
+        panParent, panDepth, padfArea);
+    free(padfArea);
+
+    return psObject->nParts;
+}
+
+
+int SHPObjectFixRings(SHPObject *psObject)
+{
+    if (! SHPIsPolygonType(psObject->nSHPType)) {
+        return -1;
+    }
+    if (psObject->nVertices == 0 || psObject->nParts == 0) {
+        return 0;
+    }
+    return SHPFixRings(psObject->nParts, psObject->panPartStart, psObject->panPartType, psObject->nVertices,
+        psObject->padfX, psObject->padfY, 1, psObject->padfZ, psObject->padfM);
+}
+
+
+int SHPObjectExFixRings(SHPObjectEx *psObject)
+{
+    if (! SHPIsPolygonType(psObject->nSHPType)) {
+        return -1;
+    }
+    if (psObject->nVertices == 0 || psObject->nParts == 0) {
+        return 0;
+    }
+    return SHPFixRings(psObject->nParts, psObject->panPartStart, psObject->panPartType, psObject->nVertices,
+        &psObject->pPoints[0].x, &psObject->pPoints[0].y, 2, psObject->padfZ, psObject->padfM);
+}
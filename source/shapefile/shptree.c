@@ -37,6 +37,13 @@
  *****************************************************************************/
 #include "shapefile_i.h"
 
+#include <pthread.h>
+
+#if defined(_MSC_VER)
+  // link to pthread-w32 lib for MS Windows with MSVC
+  # pragma comment(lib, "pthreadVC2.lib")
+#endif
+
 
 typedef struct shape_tree_node
 {
@@ -47,14 +54,29 @@ typedef struct shape_tree_node
     /* list of shapes stored at this node.  The papsShapeObj pointers
      or the whole list can be NULL */
     int         nShapeCount;
+    int         nShapeMax;
     int         *panShapeIds;
     SHPObject   **papsShapeObj;
 
     int         nSubNodes;
     struct shape_tree_node *apsSubNode[MAX_SUBNODE];
+
+    /* node is in a SHPTreeArena, not malloc'd */
+    int         bInArena;
 } SHPTreeNode;
 
 
+/* nodes allocated in blocks, freed with the tree */
+#define SHP_TREE_ARENA_NODES  1024
+
+typedef struct shape_tree_arena
+{
+    struct shape_tree_arena *psNext;
+    int         nUsed;
+    SHPTreeNode asNodes[SHP_TREE_ARENA_NODES];
+} SHPTreeArena;
+
+
 typedef struct shape_tree_root
 {
     SHPHandle   hSHP;
@@ -64,6 +86,9 @@ typedef struct shape_tree_root
     int         nTotalCount;
 
     SHPTreeNode *psRoot;
+
+    /* arenas of nodes built by SHPCreateTreeFromBounds */
+    SHPTreeArena *psArenas;
 } SHPTree;
 
 
@@ -75,20 +100,20 @@ typedef struct shape_tree_root
 
 #define SHP_SPLIT_RATIO  0.55
 
+static void SHPTreeInsertBounds (SHPTree *psTree, int nShapes, const SHPEnvelope *pEnvelopes, int nThreads);
+
 /**
  * Initialize a tree node
  */
-static SHPTreeNode *SHPTreeNodeCreate (double *padfBoundsMin, double *padfBoundsMax)
+static SHPTreeNode *SHPTreeNodeInit (SHPTreeNode *psTreeNode, double *padfBoundsMin, double *padfBoundsMax)
 {
-    SHPTreeNode  *psTreeNode;
-
-    psTreeNode = (SHPTreeNode *) malloc(sizeof(SHPTreeNode));
-
     psTreeNode->nShapeCount = 0;
+    psTreeNode->nShapeMax = 0;
     psTreeNode->panShapeIds = 0;
     psTreeNode->papsShapeObj = 0;
 
     psTreeNode->nSubNodes = 0;
+    psTreeNode->bInArena = 0;
 
     if (padfBoundsMin != 0) {
         memcpy(psTreeNode->adfBoundsMin, padfBoundsMin, sizeof(double) * 4);
@@ -100,6 +125,46 @@ static SHPTreeNode *SHPTreeNodeCreate (double *padfBoundsMin, double *padfBounds
     return psTreeNode;
 }
 
+
+static SHPTreeNode *SHPTreeNodeCreate (double *padfBoundsMin, double *padfBoundsMax)
+{
+    return SHPTreeNodeInit((SHPTreeNode *) malloc(sizeof(SHPTreeNode)), padfBoundsMin, padfBoundsMax);
+}
+
+
+/**
+ * Allocate a node from arena, or malloc it if ppsArena is NULL
+ */
+static SHPTreeNode *SHPTreeNodeAlloc (SHPTreeArena **ppsArena, double *padfBoundsMin, double *padfBoundsMax)
+{
+    SHPTreeNode *psTreeNode;
+
+    if (ppsArena == 0) {
+        return SHPTreeNodeCreate(padfBoundsMin, padfBoundsMax);
+    }
+
+    if (*ppsArena == 0 || (*ppsArena)->nUsed == SHP_TREE_ARENA_NODES) {
+        SHPTreeArena *psArena = (SHPTreeArena *) SfRealloc(0, sizeof(SHPTreeArena));
+        psArena->psNext = *ppsArena;
+        psArena->nUsed = 0;
+        *ppsArena = psArena;
+    }
+
+    psTreeNode = SHPTreeNodeInit(&(*ppsArena)->asNodes[(*ppsArena)->nUsed++], padfBoundsMin, padfBoundsMax);
+    psTreeNode->bInArena = 1;
+    return psTreeNode;
+}
+
+
+static void SHPTreeArenaFree (SHPTreeArena *psArena)
+{
+    while (psArena) {
+        SHPTreeArena *psNext = psArena->psNext;
+        free(psArena);
+        psArena = psNext;
+    }
+}
+
 /**
  * Create Tree
  */
@@ -117,6 +182,8 @@ SHPTreeHandle SHPCreateTree (SHPHandle hSHP, int nDimension, int nMaxDepth, doub
     psTree->hSHP = hSHP;
     psTree->nMaxDepth = nMaxDepth;
     psTree->nDimension = nDimension;
+    psTree->nTotalCount = 0;
+    psTree->psArenas = 0;
 
     /* If no max depth was defined, try to select a reasonable one that implies approximately 8 shapes per node */
     if (psTree->nMaxDepth == 0 && hSHP != 0) {
@@ -143,14 +210,27 @@ SHPTreeHandle SHPCreateTree (SHPHandle hSHP, int nDimension, int nMaxDepth, doub
     }
 
     /* If we have a file, insert all it's shapes into the tree */
-    if (hSHP != 0) {
+    if (hSHP != 0 && nDimension == 2) {
+        /* only X/Y bounds needed: read the bounding box of records */
+        int  nShapeCount;
+        SHPEnvelope *pEnvelopes;
+
+        SHPGetInfo(hSHP, &nShapeCount, 0, 0, 0);
+        pEnvelopes = (SHPEnvelope *) SfRealloc(0, sizeof(SHPEnvelope) * (nShapeCount + 1));
+        SHPReadObjectEnvelopes(hSHP, pEnvelopes, 0);
+
+        SHPTreeInsertBounds(psTree, nShapeCount, pEnvelopes, 1);
+        free(pEnvelopes);
+    } else if (hSHP != 0) {
         int  iShape, nShapeCount;
         SHPGetInfo(hSHP, &nShapeCount, 0, 0, 0);
         for (iShape = 0; iShape < nShapeCount; iShape++) {
             SHPObject  *psShape;
             psShape = SHPReadObject(hSHP, iShape);
-            SHPTreeAddShapeId(psTree, psShape);
-            SHPDestroyObject(psShape);
+            if (psShape) {
+                SHPTreeAddShapeId(psTree, psShape);
+                SHPDestroyObject(psShape);
+            }
         }
     }
     return psTree;
@@ -183,7 +263,9 @@ static void SHPDestroyTreeNode (SHPTreeNode * psTreeNode)
         free(psTreeNode->papsShapeObj);
     }
 
-    free(psTreeNode);
+    if (! psTreeNode->bInArena) {
+        free(psTreeNode);
+    }
 }
 
 /**
@@ -192,6 +274,7 @@ static void SHPDestroyTreeNode (SHPTreeNode * psTreeNode)
 void SHPDestroyTree (SHPTreeHandle psTree)
 {
     SHPDestroyTreeNode(psTree->psRoot);
+    SHPTreeArenaFree(psTree->psArenas);
     free(psTree);
 }
 
@@ -213,30 +296,31 @@ int SHPCheckBoundsOverlap (double *padfBox1Min, double *padfBox1Max, double *pad
 }
 
 /**
- * Does the given shape fit within the indicated extents?
+ * Does the given shape bounds (X, Y, Z, M) fit within the indicated extents?
  */
 static int SHPCheckObjectContained (
-    SHPObject * psObject,
+    const double *padfShapeMin,
+    const double *padfShapeMax,
     int nDimension,
     double *padfBoundsMin,
     double *padfBoundsMax)
 {
-    if (psObject->dfXMin < padfBoundsMin[0] || psObject->dfXMax > padfBoundsMax[0]) {
+    if (padfShapeMin[0] < padfBoundsMin[0] || padfShapeMax[0] > padfBoundsMax[0]) {
         return SHAPEFILE_FALSE;
     }
-    if (psObject->dfYMin < padfBoundsMin[1] || psObject->dfYMax > padfBoundsMax[1]) {
+    if (padfShapeMin[1] < padfBoundsMin[1] || padfShapeMax[1] > padfBoundsMax[1]) {
         return SHAPEFILE_FALSE;
     }
     if (nDimension == 2) {
         return SHAPEFILE_TRUE;
     }
-    if (psObject->dfZMin < padfBoundsMin[2] || psObject->dfZMax < padfBoundsMax[2]) {
+    if (padfShapeMin[2] < padfBoundsMin[2] || padfShapeMax[2] < padfBoundsMax[2]) {
         return SHAPEFILE_FALSE;
     }
     if (nDimension == 3) {
         return SHAPEFILE_TRUE;
     }
-    if (psObject->dfMMin < padfBoundsMin[3] || psObject->dfMMax < padfBoundsMax[3]) {
+    if (padfShapeMin[3] < padfBoundsMin[3] || padfShapeMax[3] < padfBoundsMax[3]) {
         return SHAPEFILE_FALSE;
     }
 
@@ -274,97 +358,144 @@ void SHPTreeSplitBounds (
 }
 
 /**
- * Tree Node Add ShapeId
+ * Create the four subnodes of a node (two if MAX_SUBNODE == 2)
+ */
+static void SHPTreeNodeSplit (SHPTreeNode *psTreeNode, SHPTreeArena **ppsArena)
+{
+#if MAX_SUBNODE == 4
+    double  adfBoundsMinH1[4], adfBoundsMaxH1[4];
+    double  adfBoundsMinH2[4], adfBoundsMaxH2[4];
+    double  adfBoundsMin1[4], adfBoundsMax1[4];
+    double  adfBoundsMin2[4], adfBoundsMax2[4];
+    double  adfBoundsMin3[4], adfBoundsMax3[4];
+    double  adfBoundsMin4[4], adfBoundsMax4[4];
+
+    SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
+        adfBoundsMinH1, adfBoundsMaxH1, adfBoundsMinH2, adfBoundsMaxH2);
+
+    SHPTreeSplitBounds(adfBoundsMinH1, adfBoundsMaxH1,
+        adfBoundsMin1, adfBoundsMax1, adfBoundsMin2, adfBoundsMax2);
+
+    SHPTreeSplitBounds(adfBoundsMinH2, adfBoundsMaxH2,
+        adfBoundsMin3, adfBoundsMax3, adfBoundsMin4, adfBoundsMax4);
+
+    psTreeNode->nSubNodes = 4;
+    psTreeNode->apsSubNode[0] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin1, adfBoundsMax1);
+    psTreeNode->apsSubNode[1] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin2, adfBoundsMax2);
+    psTreeNode->apsSubNode[2] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin3, adfBoundsMax3);
+    psTreeNode->apsSubNode[3] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin4, adfBoundsMax4);
+#endif /* MAX_SUBNODE == 4 */
+
+#if MAX_SUBNODE == 2
+    double  adfBoundsMin1[4], adfBoundsMax1[4];
+    double  adfBoundsMin2[4], adfBoundsMax2[4];
+
+    SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
+        adfBoundsMin1, adfBoundsMax1, adfBoundsMin2, adfBoundsMax2);
+
+    psTreeNode->nSubNodes = 2;
+    psTreeNode->apsSubNode[0] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin1, adfBoundsMax1);
+    psTreeNode->apsSubNode[1] = SHPTreeNodeAlloc(ppsArena, adfBoundsMin2, adfBoundsMax2);
+#endif /* MAX_SUBNODE == 2 */
+}
+
+
+/**
+ * Would the shape fit into one of the subnodes if the node were split?
+ */
+static int SHPTreeNodeCanSplit (SHPTreeNode *psTreeNode, const double *padfShapeMin, const double *padfShapeMax, int nDimension)
+{
+    double  adfBoundsMin[MAX_SUBNODE][4], adfBoundsMax[MAX_SUBNODE][4];
+    int  i;
+
+#if MAX_SUBNODE == 4
+    double  adfBoundsMinH1[4], adfBoundsMaxH1[4];
+    double  adfBoundsMinH2[4], adfBoundsMaxH2[4];
+
+    SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
+        adfBoundsMinH1, adfBoundsMaxH1, adfBoundsMinH2, adfBoundsMaxH2);
+
+    SHPTreeSplitBounds(adfBoundsMinH1, adfBoundsMaxH1,
+        adfBoundsMin[0], adfBoundsMax[0], adfBoundsMin[1], adfBoundsMax[1]);
+
+    SHPTreeSplitBounds(adfBoundsMinH2, adfBoundsMaxH2,
+        adfBoundsMin[2], adfBoundsMax[2], adfBoundsMin[3], adfBoundsMax[3]);
+#endif /* MAX_SUBNODE == 4 */
+
+#if MAX_SUBNODE == 2
+    SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
+        adfBoundsMin[0], adfBoundsMax[0], adfBoundsMin[1], adfBoundsMax[1]);
+#endif /* MAX_SUBNODE == 2 */
+
+    for (i = 0; i < MAX_SUBNODE; i++) {
+        if (SHPCheckObjectContained(padfShapeMin, padfShapeMax, nDimension, adfBoundsMin[i], adfBoundsMax[i])) {
+            return SHAPEFILE_TRUE;
+        }
+    }
+    return SHAPEFILE_FALSE;
+}
+
+
+/**
+ * Tree Node Add ShapeId by bounds of shape.
+ *   new nodes are allocated from *ppsArena, or malloc'd if ppsArena is NULL
  */
-static int SHPTreeNodeAddShapeId (
+static int SHPTreeNodeAddBounds (
     SHPTreeNode *psTreeNode,
-    SHPObject *psObject,
+    int nShapeId,
+    const double *padfShapeMin,
+    const double *padfShapeMax,
     int nMaxDepth,
-    int nDimension)
+    int nDimension,
+    SHPTreeArena **ppsArena)
 {
     int    i;
 
-    /* If there are subnodes, then consider wiether this object will fit in them */
-    if (nMaxDepth > 1 && psTreeNode->nSubNodes > 0) {
-        for (i = 0; i < psTreeNode->nSubNodes; i++) {
-            if (SHPCheckObjectContained(psObject, nDimension,
-                psTreeNode->apsSubNode[i]->adfBoundsMin,
-                psTreeNode->apsSubNode[i]->adfBoundsMax)) {
-                return SHPTreeNodeAddShapeId(psTreeNode->apsSubNode[i], psObject, nMaxDepth-1, nDimension);
-            }
+    for (;;) {
+        SHPTreeNode *psSubNode = 0;
+
+        /* Otherwise, consider creating subnodes if could fit into them,
+         * and adding to the appropriate subnode */
+        if (nMaxDepth > 1 && psTreeNode->nSubNodes == 0 &&
+            SHPTreeNodeCanSplit(psTreeNode, padfShapeMin, padfShapeMax, nDimension)) {
+            SHPTreeNodeSplit(psTreeNode, ppsArena);
         }
-    }
-#if MAX_SUBNODE == 4
-    else if (nMaxDepth > 1 && psTreeNode->nSubNodes == 0) {
-        /* Otherwise, consider creating four subnodes if could fit into them,
-        * and adding to the appropriate subnode */
-        double  adfBoundsMinH1[4], adfBoundsMaxH1[4];
-        double  adfBoundsMinH2[4], adfBoundsMaxH2[4];
-        double  adfBoundsMin1[4], adfBoundsMax1[4];
-        double  adfBoundsMin2[4], adfBoundsMax2[4];
-        double  adfBoundsMin3[4], adfBoundsMax3[4];
-        double  adfBoundsMin4[4], adfBoundsMax4[4];
-
-        SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
-            adfBoundsMinH1, adfBoundsMaxH1, adfBoundsMinH2, adfBoundsMaxH2);
-
-        SHPTreeSplitBounds(adfBoundsMinH1, adfBoundsMaxH1,
-            adfBoundsMin1, adfBoundsMax1, adfBoundsMin2, adfBoundsMax2);
-
-        SHPTreeSplitBounds(adfBoundsMinH2, adfBoundsMaxH2,
-            adfBoundsMin3, adfBoundsMax3, adfBoundsMin4, adfBoundsMax4);
-
-        if (SHPCheckObjectContained(psObject, nDimension, adfBoundsMin1, adfBoundsMax1) ||
-            SHPCheckObjectContained(psObject, nDimension, adfBoundsMin2, adfBoundsMax2) ||
-            SHPCheckObjectContained(psObject, nDimension, adfBoundsMin3, adfBoundsMax3) ||
-            SHPCheckObjectContained(psObject, nDimension, adfBoundsMin4, adfBoundsMax4)) {
-            psTreeNode->nSubNodes = 4;
-            psTreeNode->apsSubNode[0] = SHPTreeNodeCreate(adfBoundsMin1, adfBoundsMax1);
-            psTreeNode->apsSubNode[1] = SHPTreeNodeCreate(adfBoundsMin2, adfBoundsMax2);
-            psTreeNode->apsSubNode[2] = SHPTreeNodeCreate(adfBoundsMin3, adfBoundsMax3);
-            psTreeNode->apsSubNode[3] = SHPTreeNodeCreate(adfBoundsMin4, adfBoundsMax4);
-
-            /* recurse back on this node now that it has subnodes */
-            return SHPTreeNodeAddShapeId(psTreeNode, psObject, nMaxDepth, nDimension);
+
+        /* If there are subnodes, then consider wiether this object will fit in them */
+        if (nMaxDepth > 1) {
+            for (i = 0; i < psTreeNode->nSubNodes; i++) {
+                if (SHPCheckObjectContained(padfShapeMin, padfShapeMax, nDimension,
+                    psTreeNode->apsSubNode[i]->adfBoundsMin,
+                    psTreeNode->apsSubNode[i]->adfBoundsMax)) {
+                    psSubNode = psTreeNode->apsSubNode[i];
+                    break;
+                }
+            }
         }
-    }
-#endif /* MAX_SUBNODE == 4 */
 
-#if MAX_SUBNODE == 2
-    else if (nMaxDepth > 1 && psTreeNode->nSubNodes == 0) {
-        /* Otherwise, consider creating two subnodes if could fit into them,
-     *  and adding to the appropriate subnode */
-        double  adfBoundsMin1[4], adfBoundsMax1[4];
-        double  adfBoundsMin2[4], adfBoundsMax2[4];
-
-        SHPTreeSplitBounds(psTreeNode->adfBoundsMin, psTreeNode->adfBoundsMax,
-            adfBoundsMin1, adfBoundsMax1, adfBoundsMin2, adfBoundsMax2);
-
-        if (SHPCheckObjectContained(psObject, nDimension, adfBoundsMin1, adfBoundsMax1)) {
-            psTreeNode->nSubNodes = 2;
-            psTreeNode->apsSubNode[0] = SHPTreeNodeCreate(adfBoundsMin1, adfBoundsMax1);
-            psTreeNode->apsSubNode[1] = SHPTreeNodeCreate(adfBoundsMin2, adfBoundsMax2);
-
-            return SHPTreeNodeAddShapeId(psTreeNode->apsSubNode[0], psObject, nMaxDepth - 1, nDimension);
-        } else if (SHPCheckObjectContained(psObject, nDimension, adfBoundsMin2, adfBoundsMax2)) {
-            psTreeNode->nSubNodes = 2;
-            psTreeNode->apsSubNode[0] = SHPTreeNodeCreate(adfBoundsMin1, adfBoundsMax1);
-            psTreeNode->apsSubNode[1] = SHPTreeNodeCreate(adfBoundsMin2, adfBoundsMax2);
-            return(SHPTreeNodeAddShapeId(psTreeNode->apsSubNode[1], psObject, nMaxDepth - 1, nDimension));
+        if (! psSubNode) {
+            break;
         }
+
+        psTreeNode = psSubNode;
+        nMaxDepth--;
     }
-#endif /* MAX_SUBNODE == 2 */
 
     /* If none of that worked, just add it to this nodes list */
-    psTreeNode->nShapeCount++;
+    if (psTreeNode->nShapeCount == psTreeNode->nShapeMax) {
+        psTreeNode->nShapeMax = psTreeNode->nShapeMax? psTreeNode->nShapeMax * 2 : 4;
+        psTreeNode->panShapeIds = SfRealloc(psTreeNode->panShapeIds, sizeof(int) * psTreeNode->nShapeMax);
 
-    psTreeNode->panShapeIds = SfRealloc(psTreeNode->panShapeIds, sizeof(int) * psTreeNode->nShapeCount);
-    psTreeNode->panShapeIds[psTreeNode->nShapeCount-1] = psObject->nShapeId;
+        if (psTreeNode->papsShapeObj != 0) {
+            psTreeNode->papsShapeObj = SfRealloc(psTreeNode->papsShapeObj, sizeof(void *) * psTreeNode->nShapeMax);
+        }
+    }
 
+    psTreeNode->panShapeIds[psTreeNode->nShapeCount] = nShapeId;
     if (psTreeNode->papsShapeObj != 0) {
-        psTreeNode->papsShapeObj = SfRealloc(psTreeNode->papsShapeObj, sizeof(void *) * psTreeNode->nShapeCount);
-        psTreeNode->papsShapeObj[psTreeNode->nShapeCount-1] = 0;
+        psTreeNode->papsShapeObj[psTreeNode->nShapeCount] = 0;
     }
+    psTreeNode->nShapeCount++;
 
     return SHAPEFILE_TRUE;
 }
@@ -375,7 +506,266 @@ static int SHPTreeNodeAddShapeId (
 int SHPTreeAddShapeId(SHPTreeHandle psTree, SHPObject * psObject)
 
 {
-    return(SHPTreeNodeAddShapeId(psTree->psRoot, psObject, psTree->nMaxDepth, psTree->nDimension));
+    double adfShapeMin[4] = {psObject->dfXMin, psObject->dfYMin, psObject->dfZMin, psObject->dfMMin};
+    double adfShapeMax[4] = {psObject->dfXMax, psObject->dfYMax, psObject->dfZMax, psObject->dfMMax};
+
+    psTree->nTotalCount++;
+    return SHPTreeNodeAddBounds(psTree->psRoot, psObject->nShapeId, adfShapeMin, adfShapeMax, psTree->nMaxDepth, psTree->nDimension, &psTree->psArenas);
+}
+
+
+/**
+ * subtree under a node of split levels, built by one thread
+ */
+typedef struct
+{
+    SHPTreeNode *psNode;
+    SHPTreeArena *psArena;
+
+    int nShapes;
+    int *panShapeIds;
+} SHPTreeBuildTask;
+
+
+typedef struct
+{
+    SHPTreeBuildTask *pTasks;
+    int nTasks;
+    int nMaxDepth;
+    const SHPEnvelope *pEnvelopes;
+
+    pthread_mutex_t lock;
+    int nNextTask;
+} SHPTreeBuildJob;
+
+
+static void SHPTreeBuildTaskRun (SHPTreeBuildJob *job, SHPTreeBuildTask *task)
+{
+    int i;
+
+    for (i = 0; i < task->nShapes; i++) {
+        const SHPEnvelope *env = &job->pEnvelopes[task->panShapeIds[i]];
+        double adfShapeMin[4] = {env->XMin, env->YMin, 0, 0};
+        double adfShapeMax[4] = {env->XMax, env->YMax, 0, 0};
+
+        SHPTreeNodeAddBounds(task->psNode, task->panShapeIds[i], adfShapeMin, adfShapeMax, job->nMaxDepth, 2, &task->psArena);
+    }
+}
+
+
+static void * SHPTreeBuildThread (void *arg)
+{
+    SHPTreeBuildJob *job = (SHPTreeBuildJob *) arg;
+
+    for (;;) {
+        int iTask;
+
+        pthread_mutex_lock(&job->lock);
+        iTask = job->nNextTask++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (iTask >= job->nTasks) {
+            break;
+        }
+        SHPTreeBuildTaskRun(job, &job->pTasks[iTask]);
+    }
+    return 0;
+}
+
+
+/**
+ * Insert 2D envelopes (id = index) into tree.
+ *   nodes of top nSplit levels are created first, shapes not fit into them
+ *   are added here in id order, others are added to subtrees of the split
+ *   nodes by threads. every node gets shapes in id order as serial adding.
+ */
+static void SHPTreeInsertBounds (SHPTree *psTree, int nShapes, const SHPEnvelope *pEnvelopes, int nThreads)
+{
+    int i, j, iLevel, nSplit = 0, nTasks = 1;
+    SHPTreeNode **ppsNodes;
+    SHPTreeBuildJob job;
+    int *panTaskIds;
+
+    /* 4^nSplit subtrees, at least twice of threads for balance */
+    while (nThreads > 1 && nTasks < nThreads * 2 && nSplit + 1 < psTree->nMaxDepth) {
+        nSplit++;
+        nTasks *= MAX_SUBNODE;
+    }
+
+    /* nodes of split level in breadth-first order */
+    ppsNodes = (SHPTreeNode **) SfRealloc(0, sizeof(SHPTreeNode *) * nTasks);
+    ppsNodes[0] = psTree->psRoot;
+
+    for (iLevel = 0, j = 1; iLevel < nSplit; iLevel++) {
+        int nNodes = j;
+        for (i = nNodes - 1; i >= 0; i--) {
+            SHPTreeNode *psNode = ppsNodes[i];
+            int k;
+            if (psNode->nSubNodes == 0) {
+                SHPTreeNodeSplit(psNode, &psTree->psArenas);
+            }
+            for (k = 0; k < MAX_SUBNODE; k++) {
+                ppsNodes[i * MAX_SUBNODE + k] = psNode->apsSubNode[k];
+            }
+        }
+        j = nNodes * MAX_SUBNODE;
+    }
+
+    /* which subtree each shape goes to */
+    job.pTasks = (SHPTreeBuildTask *) SfRealloc(0, sizeof(SHPTreeBuildTask) * nTasks);
+    memset(job.pTasks, 0, sizeof(SHPTreeBuildTask) * nTasks);
+
+    panTaskIds = (int *) SfRealloc(0, sizeof(int) * (nShapes + 1));
+
+    for (i = 0; i < nShapes; i++) {
+        const SHPEnvelope *env = &pEnvelopes[i];
+        double adfShapeMin[4] = {env->XMin, env->YMin, 0, 0};
+        double adfShapeMax[4] = {env->XMax, env->YMax, 0, 0};
+        SHPTreeNode *psNode = psTree->psRoot;
+        int iTask = 0;
+
+        panTaskIds[i] = -1;
+        if (env->XMin > env->XMax) {
+            /* null shape */
+            continue;
+        }
+        psTree->nTotalCount++;
+
+        for (iLevel = 0; iLevel < nSplit; iLevel++) {
+            int k;
+            for (k = 0; k < MAX_SUBNODE; k++) {
+                if (SHPCheckObjectContained(adfShapeMin, adfShapeMax, 2,
+                    psNode->apsSubNode[k]->adfBoundsMin, psNode->apsSubNode[k]->adfBoundsMax)) {
+                    break;
+                }
+            }
+            if (k == MAX_SUBNODE) {
+                break;
+            }
+            psNode = psNode->apsSubNode[k];
+            iTask = iTask * MAX_SUBNODE + k;
+        }
+
+        if (iLevel < nSplit) {
+            /* stays in the split levels */
+            SHPTreeNodeAddBounds(psNode, i, adfShapeMin, adfShapeMax, 1, 2, 0);
+        } else {
+            panTaskIds[i] = iTask;
+            job.pTasks[iTask].nShapes++;
+        }
+    }
+
+    for (j = 0; j < nTasks; j++) {
+        job.pTasks[j].psNode = ppsNodes[j];
+        job.pTasks[j].panShapeIds = (int *) SfRealloc(0, sizeof(int) * (job.pTasks[j].nShapes + 1));
+        job.pTasks[j].nShapes = 0;
+    }
+
+    for (i = 0; i < nShapes; i++) {
+        if (panTaskIds[i] != -1) {
+            SHPTreeBuildTask *task = &job.pTasks[panTaskIds[i]];
+            task->panShapeIds[task->nShapes++] = i;
+        }
+    }
+    free(panTaskIds);
+    free(ppsNodes);
+
+    job.nTasks = nTasks;
+    job.nMaxDepth = psTree->nMaxDepth - nSplit;
+    job.pEnvelopes = pEnvelopes;
+    job.nNextTask = 0;
+
+    if (nTasks == 1) {
+        SHPTreeBuildTaskRun(&job, &job.pTasks[0]);
+    } else {
+        pthread_t *threads = (pthread_t *) SfRealloc(0, sizeof(pthread_t) * nThreads);
+        int nStarted = 0;
+
+        pthread_mutex_init(&job.lock, 0);
+
+        for (i = 0; i < nThreads; i++) {
+            if (pthread_create(&threads[nStarted], 0, SHPTreeBuildThread, &job) == 0) {
+                nStarted++;
+            }
+        }
+
+        /* run remaining tasks here if threads not started */
+        SHPTreeBuildThread(&job);
+
+        for (i = 0; i < nStarted; i++) {
+            pthread_join(threads[i], 0);
+        }
+
+        pthread_mutex_destroy(&job.lock);
+        free(threads);
+    }
+
+    /* arenas of subtrees are owned by tree */
+    for (j = 0; j < nTasks; j++) {
+        SHPTreeArena *psArena = job.pTasks[j].psArena;
+        while (psArena) {
+            SHPTreeArena *psNext = psArena->psNext;
+            psArena->psNext = psTree->psArenas;
+            psTree->psArenas = psArena;
+            psArena = psNext;
+        }
+        free(job.pTasks[j].panShapeIds);
+    }
+    free(job.pTasks);
+}
+
+
+/**
+ * Create 2D tree from envelopes of shapes
+ */
+SHPTreeHandle SHPCreateTreeFromBounds (int nShapes, const SHPEnvelope *pEnvelopes, int nMaxDepth, double *padfBoundsMin, double *padfBoundsMax, int nThreads)
+{
+    SHPTree  *psTree;
+    int i;
+
+    psTree = (SHPTree *) malloc(sizeof(SHPTree));
+
+    psTree->hSHP = 0;
+    psTree->nMaxDepth = nMaxDepth;
+    psTree->nDimension = 2;
+    psTree->nTotalCount = 0;
+    psTree->psArenas = 0;
+
+    /* approximately 8 shapes per node as SHPCreateTree */
+    if (psTree->nMaxDepth == 0) {
+        int  nMaxNodeCount = 1;
+        while (nMaxNodeCount*4 < nShapes) {
+            psTree->nMaxDepth += 1;
+            nMaxNodeCount = nMaxNodeCount * 2;
+        }
+    }
+
+    psTree->psRoot = SHPTreeNodeCreate(padfBoundsMin, padfBoundsMax);
+
+    if (padfBoundsMin == 0) {
+        int bFirst = 1;
+        for (i = 0; i < nShapes; i++) {
+            const SHPEnvelope *env = &pEnvelopes[i];
+            if (env->XMin > env->XMax) {
+                continue;
+            }
+            if (bFirst) {
+                psTree->psRoot->adfBoundsMin[0] = env->XMin;
+                psTree->psRoot->adfBoundsMin[1] = env->YMin;
+                psTree->psRoot->adfBoundsMax[0] = env->XMax;
+                psTree->psRoot->adfBoundsMax[1] = env->YMax;
+                bFirst = 0;
+            } else {
+                psTree->psRoot->adfBoundsMin[0] = MIN_V2(psTree->psRoot->adfBoundsMin[0], env->XMin);
+                psTree->psRoot->adfBoundsMin[1] = MIN_V2(psTree->psRoot->adfBoundsMin[1], env->YMin);
+                psTree->psRoot->adfBoundsMax[0] = MAX_V2(psTree->psRoot->adfBoundsMax[0], env->XMax);
+                psTree->psRoot->adfBoundsMax[1] = MAX_V2(psTree->psRoot->adfBoundsMax[1], env->YMax);
+            }
+        }
+    }
+
+    SHPTreeInsertBounds(psTree, nShapes, pEnvelopes, nThreads);
+    return psTree;
 }
 
 /**
@@ -419,6 +809,11 @@ void SHPTreeCollectShapeIds (
     }
 }
 
+static int SHPTreeCompareInts (const void *a, const void *b)
+{
+    return (*(const int *) a > *(const int *) b) - (*(const int *) a < *(const int *) b);
+}
+
 /**
  * Find all shapes within tree nodes for which the tree node
  *  bounding box overlaps the search box.  The return value is
@@ -429,7 +824,6 @@ void SHPTreeCollectShapeIds (
 int* SHPTreeFindLikelyShapes(SHPTreeHandle hTree, double *padfBoundsMin, double *padfBoundsMax, int *pnShapeCount)
 {
     int  *panShapeList=0, nMaxShapes = 0;
-    int  i, j, tempId;
 
     /* Perform the search by recursive descent */
     *pnShapeCount = 0;
@@ -437,16 +831,8 @@ int* SHPTreeFindLikelyShapes(SHPTreeHandle hTree, double *padfBoundsMin, double
     SHPTreeCollectShapeIds(hTree, hTree->psRoot, padfBoundsMin, padfBoundsMax,
         pnShapeCount, &nMaxShapes, &panShapeList);
 
-    /*??TODO: For now I just use a bubble sort to order the shapeids,
-   * but this should really be a quicksort */
-    for (i = 0; i < *pnShapeCount-1; i++) {
-        for (j = 0; j < (*pnShapeCount) - i - 1; j++) {
-            if (panShapeList[j] > panShapeList[j+1]) {
-                tempId = panShapeList[j];
-                panShapeList[j] = panShapeList[j+1];
-                panShapeList[j+1] = tempId;
-            }
-        }
+    if (*pnShapeCount > 1) {
+        qsort(panShapeList, *pnShapeCount, sizeof(int), SHPTreeCompareInts);
     }
     return panShapeList;
 }
@@ -0,0 +1,197 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file benchclip.c
+ * @brief benchmark of drawing shapes at deep zoom: clipped and unclipped paths.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-28 09:40:12
+ * @date 2024-11-28 09:40:12
+ *
+ * @note
+ *   一个大多边形 (州界) 与一条长线, 在其边界点处逐级放大绘制,
+ *   比较裁剪到视图框 (默认) 与不裁剪 (noClip) 的绘制时间.
+ */
+#include "shapetool-common.h"
+#include "drawshape.h"
+
+#include <common/timeut.h>
+
+#include <math.h>
+
+
+#define BENCH_CLIP_VERTICES  200000
+#define BENCH_CLIP_EXTENT    1000000.0   // 数据范围 (米)
+#define BENCH_CLIP_REPEATS   10
+
+#define BENCH_CLIP_PI  3.14159265358979323846
+
+
+// 锯齿状的闭合外环 (多边形) 或开放的线, 点数 nv, 交错 x, y
+static void bench_clip_outline(double *xy, int nv, double r, int closed)
+{
+    int i;
+    unsigned int seed = 20241128;
+
+    for (i = 0; i < nv; i++) {
+        double t = 2 * BENCH_CLIP_PI * i / (closed? nv - 1 : nv + nv / 8);
+        double noise, rr;
+
+        seed = seed * 1103515245 + 12345;
+        noise = ((seed >> 8) & 0xffff) / 65536.0 - 0.5;
+        rr = r * (1 + 0.08 * sin(37 * t) + 0.03 * sin(301 * t) + 0.002 * noise);
+
+        xy[2 * i] = BENCH_CLIP_EXTENT / 2 + rr * cos(t);
+        xy[2 * i + 1] = BENCH_CLIP_EXTENT / 2 + rr * sin(t);
+    }
+
+    if (closed) {
+        // 外环顺时针
+        for (i = 0; i < nv / 2; i++) {
+            double x = xy[2 * i], y = xy[2 * i + 1];
+            xy[2 * i] = xy[2 * (nv - 1 - i)];
+            xy[2 * i + 1] = xy[2 * (nv - 1 - i) + 1];
+            xy[2 * (nv - 1 - i)] = x;
+            xy[2 * (nv - 1 - i) + 1] = y;
+        }
+        xy[2 * (nv - 1)] = xy[0];
+        xy[2 * (nv - 1) + 1] = xy[1];
+    }
+}
+
+
+static void bench_clip_view(SHPGeomView *shapeView, int nSHPType, const int *panPartStart, const double *xy, int nv)
+{
+    int i;
+
+    bzero(shapeView, sizeof(*shapeView));
+
+    shapeView->nSHPType = nSHPType;
+    shapeView->nParts = 1;
+    shapeView->panPartStart = panPartStart;
+    shapeView->nVertices = nv;
+    shapeView->padfXY = xy;
+
+    shapeView->dfXMin = shapeView->dfXMax = xy[0];
+    shapeView->dfYMin = shapeView->dfYMax = xy[1];
+
+    for (i = 1; i < nv; i++) {
+        shapeView->dfXMin = fmin(shapeView->dfXMin, xy[2 * i]);
+        shapeView->dfXMax = fmax(shapeView->dfXMax, xy[2 * i]);
+        shapeView->dfYMin = fmin(shapeView->dfYMin, xy[2 * i + 1]);
+        shapeView->dfYMax = fmax(shapeView->dfYMax, xy[2 * i + 1]);
+    }
+}
+
+
+// 绘制 BENCH_CLIP_REPEATS 次, 返回毫秒
+static int64_t bench_clip_draw(cairoDrawCtx *CDC, const SHPGeomView *shapeView, int noClip)
+{
+    int i;
+    struct timespec t0, t1;
+
+    CDC->noClip = noClip;
+
+    getnowtimeofday(&t0);
+    for (i = 0; i < BENCH_CLIP_REPEATS; i++) {
+        drawShapeView(shapeView, CDC);
+    }
+    getnowtimeofday(&t1);
+
+    CDC->noClip = 0;
+    return difftime_msec(&t0, &t1);
+}
+
+
+int benchshpclip(shapetool_flags *flags, shapetool_options *options)
+{
+    int k;
+    double baseScale;
+    static const int partStart[1] = {0};
+    static const double zooms[] = {1, 16, 256, 4096, 65536};
+
+    cairoDrawCtx CDC;
+    SHPGeomView polygon, line;
+
+    double *polygonXY = (double *) mem_alloc_zero(BENCH_CLIP_VERTICES * 2, sizeof(double));
+    double *lineXY = (double *) mem_alloc_zero(BENCH_CLIP_VERTICES * 2, sizeof(double));
+
+    bench_clip_outline(polygonXY, BENCH_CLIP_VERTICES, BENCH_CLIP_EXTENT * 0.4, 1);
+    bench_clip_outline(lineXY, BENCH_CLIP_VERTICES, BENCH_CLIP_EXTENT * 0.3, 0);
+
+    bench_clip_view(&polygon, SHPT_POLYGON, partStart, polygonXY, BENCH_CLIP_VERTICES);
+    bench_clip_view(&line, SHPT_ARC, partStart, lineXY, BENCH_CLIP_VERTICES);
+
+    CGBox2D dataBox = {
+        .Xmin = 0,
+        .Ymin = 0,
+        .Xmax = BENCH_CLIP_EXTENT,
+        .Ymax = BENCH_CLIP_EXTENT
+    };
+    CGSize2D viewSize = {
+        .W = flags->width? options->width : CAIRO_DRAW_WIDTH_DEFAULT,
+        .H = flags->height? options->height : CAIRO_DRAW_HEIGHT_DEFAULT
+    };
+
+    if (cairoDrawCtxInit(&CDC, dataBox, viewSize, dot_logical_px, flags->dpi? (float)options->dpi : dpi_high_display)) {
+        mem_free(polygonXY);
+        mem_free(lineXY);
+        return SHAPETOOL_RES_ERR;
+    }
+
+    baseScale = CDC.viewport.XScale;
+
+    printf("Info: benchclip: %d vertices polygon and line, %gx%g view, %d repeats\n",
+        BENCH_CLIP_VERTICES, viewSize.W, viewSize.H, BENCH_CLIP_REPEATS);
+
+    for (k = 0; k < (int) (sizeof(zooms) / sizeof(zooms[0])); k++) {
+        int64_t msPolygon, msPolygonNoClip, msLine, msLineNoClip;
+
+        // 放大到多边形与线的边界点
+        CDC.viewport.dataCP.X = polygonXY[0];
+        CDC.viewport.dataCP.Y = polygonXY[1];
+        ViewportSetScale(&CDC.viewport, baseScale * zooms[k]);
+
+        msPolygon = bench_clip_draw(&CDC, &polygon, 0);
+        msPolygonNoClip = bench_clip_draw(&CDC, &polygon, 1);
+
+        CDC.viewport.dataCP.X = lineXY[2 * (BENCH_CLIP_VERTICES / 2)];
+        CDC.viewport.dataCP.Y = lineXY[2 * (BENCH_CLIP_VERTICES / 2) + 1];
+
+        msLine = bench_clip_draw(&CDC, &line, 0);
+        msLineNoClip = bench_clip_draw(&CDC, &line, 1);
+
+        printf("Info: zoom %-6g polygon: %lld ms (noclip: %lld ms), line: %lld ms (noclip: %lld ms)\n",
+            CDC.viewport.XScale / baseScale,
+            (long long) msPolygon, (long long) msPolygonNoClip, (long long) msLine, (long long) msLineNoClip);
+    }
+
+    cairoDrawCtxFinal(&CDC);
+
+    mem_free(polygonXY);
+    mem_free(lineXY);
+    return SHAPETOOL_RES_SOK;
+}
@@ -0,0 +1,424 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file benchgeodb.c
+ * @brief benchmarks of geodb: spatial index and cipher settings.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-05 18:12:40
+ * @date 2024-11-07 14:55:10
+ *
+ * @note
+ */
+#include "shapetool-common.h"
+
+#include <geodbapi/geodbapi.h>
+#include <common/timeut.h>
+
+#include <sqlite3mc/sqlite3mc.h>
+
+
+#define BENCH_QUERIES  2000
+
+static int bench_on_shape(int64_t shapeid, void *userarg)
+{
+    (void) shapeid;
+    (void) userarg;
+    return 0;
+}
+
+
+// 随机查询窗口: 宽高为图层范围的 0.1% ~ 10%
+static void bench_query_boxes(const double bounds[4], int numboxes, double (*boxes)[4])
+{
+    int i;
+    unsigned int seed = 20241105;
+
+    double dx = bounds[2] - bounds[0];
+    double dy = bounds[3] - bounds[1];
+
+    for (i = 0; i < numboxes; i++) {
+        double w, h, x, y;
+
+        seed = seed * 1103515245 + 12345;
+        w = dx * (0.001 + 0.099 * ((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        h = dy * (0.001 + 0.099 * ((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        x = bounds[0] + (dx - w) * (((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        y = bounds[1] + (dy - h) * (((seed >> 8) & 0xffff) / 65535.0);
+
+        boxes[i][0] = x;
+        boxes[i][1] = y;
+        boxes[i][2] = x + w;
+        boxes[i][3] = y + h;
+    }
+}
+
+
+static int bench_layer(geodb_conn conn, int64_t layerid, int numboxes, double (*boxes)[4], int64_t *total)
+{
+    int i, count;
+    int64_t indexbytes = 0;
+    struct timespec t0, t1;
+    geodb_layer layer;
+    shape_filter filter;
+
+    if (geodb_layer_open(conn, layerid, &layer) != GEODB_RES_SOK) {
+        return SHAPETOOL_RES_ERR;
+    }
+
+    *total = 0;
+
+    getnowtimeofday(&t0);
+    for (i = 0; i < numboxes; i++) {
+        shape_filter_new(boxes[i][0], boxes[i][1], boxes[i][2], boxes[i][3], bench_on_shape, 0, &filter);
+        count = geodb_query_shapes(conn, layer, filter);
+        shape_filter_free(filter);
+
+        if (count < 0) {
+            geodb_layer_free(layer);
+            return SHAPETOOL_RES_ERR;
+        }
+        *total += count;
+    }
+    getnowtimeofday(&t1);
+
+    if (geodb_layer_index_size(conn, layer, &indexbytes) != GEODB_RES_SOK) {
+        printf("Warn: index size not available (sqlite built without SQLITE_ENABLE_DBSTAT_VTAB)\n");
+        indexbytes = -1;
+    }
+
+    printf("Info: %5s: %d queries, %lld shapes, avg %.3f ms/query, index %lld KB\n",
+        geodb_layer_index_mode(layer) == geodb_index_rtree? "rtree" : "grid",
+        numboxes, (long long) *total, (double) difftime_msec(&t0, &t1) / numboxes,
+        (long long) (indexbytes < 0? -1 : indexbytes / 1024));
+
+    geodb_layer_free(layer);
+    return SHAPETOOL_RES_SOK;
+}
+
+
+// 比较网格索引和 rtree 索引: 查询延时和索引大小
+int benchgeodbindex(shapetool_flags *flags, shapetool_options *options)
+{
+    int ret = SHAPETOOL_RES_ERR;
+    int64_t gridlayer = 0, rtreelayer = 0, gridtotal = 0, rtreetotal = 0;
+    double bounds[4];
+    double (*boxes)[4] = 0;
+    geodb_conn conn = 0;
+    geodb_layer layer;
+
+    if (geodb_import_shpfile(CBSTR(options->geodb), CBSTR(options->shpfile), "benchindex_grid",
+            geodb_index_grid, options->level_min, options->level_max, 0, &gridlayer) != GEODB_RES_SOK ||
+        geodb_import_shpfile(CBSTR(options->geodb), CBSTR(options->shpfile), "benchindex_rtree",
+            geodb_index_rtree, options->level_min, options->level_max, 0, &rtreelayer) != GEODB_RES_SOK) {
+        printf("Error: import failed (use a new geodb file): %s\n", CBSTR(options->geodb));
+        return SHAPETOOL_RES_ERR;
+    }
+
+    if (geodb_conn_new(0, &conn) != GEODB_RES_SOK ||
+        geodb_conn_open(conn, CBSTR(options->geodb), GEODB_OPEN_READONLY) != GEODB_RES_SOK ||
+        geodb_layer_open(conn, gridlayer, &layer) != GEODB_RES_SOK) {
+        goto bench_exit;
+    }
+    geodb_layer_get_bounds(layer, bounds);
+    geodb_layer_free(layer);
+
+    boxes = (double (*)[4]) mem_alloc_zero(BENCH_QUERIES, sizeof(double) * 4);
+    bench_query_boxes(bounds, BENCH_QUERIES, boxes);
+
+    if (bench_layer(conn, gridlayer, BENCH_QUERIES, boxes, &gridtotal) == SHAPETOOL_RES_SOK &&
+        bench_layer(conn, rtreelayer, BENCH_QUERIES, boxes, &rtreetotal) == SHAPETOOL_RES_SOK) {
+        if (gridtotal != rtreetotal) {
+            printf("Error: results not match: grid=%lld, rtree=%lld\n", (long long) gridtotal, (long long) rtreetotal);
+        } else {
+            ret = SHAPETOOL_RES_SOK;
+        }
+    }
+
+bench_exit:
+    mem_free(boxes);
+    geodb_conn_free(conn);
+    return ret;
+}
+
+
+#define BENCH_LAYERS_MAX   64
+#define BENCH_CACHE_KB   2048
+#define BENCH_KEY        "geodb-bench-key"
+
+// cipher = NULL: unencrypted
+static const char *bench_ciphers[] = {
+    "chacha20",
+    "aes128cbc",
+    "aes256cbc",
+    "sqlcipher",
+    "rc4",
+    "ascon128",
+    0
+};
+
+
+static int bench_copy_file(const char *srcfile, const char *dstfile, int64_t *bytes)
+{
+    char buf[65536];
+    size_t cb;
+    FILE *src, *dst;
+
+    src = fopen(srcfile, "rb");
+    if (! src) {
+        printf("Error: open file failed: %s\n", srcfile);
+        return SHAPETOOL_RES_ERR;
+    }
+    dst = fopen(dstfile, "wb");
+    if (! dst) {
+        printf("Error: create file failed: %s\n", dstfile);
+        fclose(src);
+        return SHAPETOOL_RES_ERR;
+    }
+
+    *bytes = 0;
+    while ((cb = fread(buf, 1, sizeof(buf), src)) > 0) {
+        if (fwrite(buf, 1, cb, dst) != cb) {
+            printf("Error: write file failed: %s\n", dstfile);
+            break;
+        }
+        *bytes += cb;
+    }
+
+    fclose(src);
+    fclose(dst);
+    return cb? SHAPETOOL_RES_ERR : SHAPETOOL_RES_SOK;
+}
+
+
+/**
+ * 读出图层全部 shape 的 BLOB (含溢出页), 返回 shape 数, 出错返回 -1
+ *   只取 shapeid 或 length(shape) 时 sqlite 不读溢出页, 测不出解密吞吐量
+ */
+static int bench_scan_shapes(geodb_conn conn, int64_t layerid, int64_t *blobbytes)
+{
+    int rc, count = 0;
+    char sql[128];
+    geodb_stmt stmt;
+    sqlite3_stmt *pstmt;
+
+    if (geodb_conn_prepare(conn, "SELECT shape_table FROM geodb_layers WHERE layer_id=?1", -1, &stmt) != GEODB_RES_SOK) {
+        return -1;
+    }
+    pstmt = (sqlite3_stmt *) geodb_stmt_handle(stmt);
+    sqlite3_bind_int64(pstmt, 1, (sqlite3_int64) layerid);
+
+    if (sqlite3_step(pstmt) != SQLITE_ROW) {
+        printf("Error: layer not found: %lld\n", (long long) layerid);
+        geodb_stmt_release(stmt);
+        return -1;
+    }
+    snprintf(sql, sizeof(sql), "SELECT shape FROM %s", (const char *) sqlite3_column_text(pstmt, 0));
+    geodb_stmt_release(stmt);
+
+    if (geodb_conn_prepare(conn, sql, -1, &stmt) != GEODB_RES_SOK) {
+        return -1;
+    }
+    pstmt = (sqlite3_stmt *) geodb_stmt_handle(stmt);
+
+    while ((rc = sqlite3_step(pstmt)) == SQLITE_ROW) {
+        if (sqlite3_column_blob(pstmt, 0)) {
+            *blobbytes += sqlite3_column_bytes(pstmt, 0);
+        }
+        count++;
+    }
+    geodb_stmt_release(stmt);
+
+    if (rc != SQLITE_DONE) {
+        printf("Error: scan layer failed: %lld\n", (long long) layerid);
+        return -1;
+    }
+    return count;
+}
+
+
+/**
+ * 复制 geodb 并用 cipher 加密, 然后以 cipher 打开, 测试全图层扫描和随机窗口查询
+ */
+static int bench_cipher(const char *geodbfile, const char *cipher, int usemmap, int64_t *layerids, int numlayers,
+    int numboxes, double (*boxes)[4])
+{
+    int ret = SHAPETOOL_RES_ERR;
+    int i, count;
+    int64_t filebytes = 0, blobbytes = 0, scanned = 0, queried = 0;
+    double scanms, queryms;
+    struct timespec t0, t1, t2;
+    geodb_attr attr = 0;
+    geodb_conn conn = 0;
+    geodb_layer layer;
+    shape_filter filter;
+
+    cstrbuf benchfile = cstrbufCat(0, "%s.%s.bench", geodbfile, cipher? cipher : (usemmap? "mmap" : "none"));
+    cstrbuf walfile = cstrbufCat(0, "%.*s-wal", CBSTRLEN(benchfile), CBSTR(benchfile));
+    cstrbuf shmfile = cstrbufCat(0, "%.*s-shm", CBSTRLEN(benchfile), CBSTR(benchfile));
+
+    if (bench_copy_file(geodbfile, CBSTR(benchfile), &filebytes) != SHAPETOOL_RES_SOK) {
+        goto bench_exit;
+    }
+
+    if (cipher) {
+        if (geodb_conn_new(0, &conn) != GEODB_RES_SOK ||
+            geodb_conn_open(conn, CBSTR(benchfile), GEODB_OPEN_READWRITE) != GEODB_RES_SOK ||
+            geodb_conn_rekey(conn, cipher, BENCH_KEY, (int) strlen(BENCH_KEY)) != GEODB_RES_SOK) {
+            goto bench_exit;
+        }
+        geodb_conn_free(conn);
+        conn = 0;
+    }
+
+    geodb_attr_new(&attr);
+    geodb_attr_set_integer(attr, conn_attr_cache_size, BENCH_CACHE_KB);
+    if (cipher) {
+        geodb_attr_set_bytes(attr, conn_attr_cipher, cipher, -1);
+        geodb_attr_set_bytes(attr, conn_attr_key, BENCH_KEY, -1);
+    }
+    if (usemmap) {
+        geodb_attr_set_integer(attr, conn_attr_mmap_size, filebytes);
+    }
+
+    if (geodb_conn_new(attr, &conn) != GEODB_RES_SOK ||
+        geodb_conn_open(conn, CBSTR(benchfile), GEODB_OPEN_READONLY) != GEODB_RES_SOK) {
+        goto bench_exit;
+    }
+
+    // full scan: every shape blob read, so every page of shape table decoded
+    getnowtimeofday(&t0);
+    for (i = 0; i < numlayers; i++) {
+        count = bench_scan_shapes(conn, layerids[i], &blobbytes);
+        if (count < 0) {
+            goto bench_exit;
+        }
+        scanned += count;
+    }
+    getnowtimeofday(&t1);
+
+    // random windows on the first layer
+    if (geodb_layer_open(conn, layerids[0], &layer) != GEODB_RES_SOK) {
+        goto bench_exit;
+    }
+    for (i = 0; i < numboxes; i++) {
+        shape_filter_new(boxes[i][0], boxes[i][1], boxes[i][2], boxes[i][3], bench_on_shape, 0, &filter);
+        count = geodb_query_shapes(conn, layer, filter);
+        shape_filter_free(filter);
+
+        if (count < 0) {
+            break;
+        }
+        queried += count;
+    }
+    geodb_layer_free(layer);
+    getnowtimeofday(&t2);
+
+    if (i == numboxes) {
+        scanms = (double) difftime_msec(&t0, &t1);
+        queryms = (double) difftime_msec(&t1, &t2);
+
+        printf("Info: %-10s: scan %lld shapes (%.1f MB blobs) %.0f ms (%.1f MB/s), %d queries %lld shapes avg %.3f ms/query\n",
+            cipher? cipher : (usemmap? "none+mmap" : "none"),
+            (long long) scanned, blobbytes / 1048576.0, scanms, scanms > 0? blobbytes / 1048576.0 / (scanms / 1000.0) : 0.0,
+            numboxes, (long long) queried, queryms / numboxes);
+        ret = SHAPETOOL_RES_SOK;
+    }
+
+bench_exit:
+    geodb_conn_free(conn);
+    geodb_attr_free(attr);
+
+    remove(CBSTR(benchfile));
+    remove(CBSTR(walfile));
+    remove(CBSTR(shmfile));
+    cstrbufFree(&benchfile);
+    cstrbufFree(&walfile);
+    cstrbufFree(&shmfile);
+    return ret;
+}
+
+
+// 比较各种加密设置的读吞吐量: 不加密, 不加密 + mmap, 以及每种 cipher
+int benchgeodbcipher(shapetool_flags *flags, shapetool_options *options)
+{
+    int ret = SHAPETOOL_RES_ERR;
+    int i, numlayers;
+    int64_t layerids[BENCH_LAYERS_MAX];
+    double bounds[4];
+    double (*boxes)[4] = 0;
+    geodb_conn conn = 0;
+    geodb_layer layer;
+
+    // checkpoint WAL so that copy of main db file is complete
+    if (geodb_conn_new(0, &conn) != GEODB_RES_SOK ||
+        geodb_conn_open(conn, CBSTR(options->geodb), GEODB_OPEN_READWRITE) != GEODB_RES_SOK ||
+        geodb_execute_sql(conn, "PRAGMA wal_checkpoint(TRUNCATE)", -1) != GEODB_RES_SOK) {
+        goto bench_exit;
+    }
+
+    numlayers = geodb_list_layers(conn, layerids, BENCH_LAYERS_MAX);
+    if (numlayers <= 0) {
+        printf("Error: no layers in geodb: %s\n", CBSTR(options->geodb));
+        goto bench_exit;
+    }
+    if (numlayers > BENCH_LAYERS_MAX) {
+        numlayers = BENCH_LAYERS_MAX;
+    }
+
+    if (geodb_layer_open(conn, layerids[0], &layer) != GEODB_RES_SOK) {
+        goto bench_exit;
+    }
+    geodb_layer_get_bounds(layer, bounds);
+    geodb_layer_free(layer);
+
+    geodb_conn_free(conn);
+    conn = 0;
+
+    boxes = (double (*)[4]) mem_alloc_zero(BENCH_QUERIES, sizeof(double) * 4);
+    bench_query_boxes(bounds, BENCH_QUERIES, boxes);
+
+    if (bench_cipher(CBSTR(options->geodb), 0, 0, layerids, numlayers, BENCH_QUERIES, boxes) != SHAPETOOL_RES_SOK ||
+        bench_cipher(CBSTR(options->geodb), 0, 1, layerids, numlayers, BENCH_QUERIES, boxes) != SHAPETOOL_RES_SOK) {
+        goto bench_exit;
+    }
+
+    for (i = 0; bench_ciphers[i]; i++) {
+        if (bench_cipher(CBSTR(options->geodb), bench_ciphers[i], 0, layerids, numlayers, BENCH_QUERIES, boxes) != SHAPETOOL_RES_SOK) {
+            goto bench_exit;
+        }
+    }
+
+    ret = SHAPETOOL_RES_SOK;
+
+bench_exit:
+    mem_free(boxes);
+    geodb_conn_free(conn);
+    return ret;
+}
@@ -0,0 +1,504 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file benchshape.c
+ * @brief benchmarks of shapefile: spatial tree build, area and length.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-12 10:20:36
+ * @date 2024-11-22 18:10:26
+ *
+ * @note
+ */
+#include "shapetool-common.h"
+
+#include <shapefile/shapefile_api.h>
+#include <common/timeut.h>
+
+#include <math.h>
+
+
+#define BENCH_TREE_QUERIES  1000
+
+#define BENCH_GEOM_GRID       30  // 30x30 个带洞多边形
+#define BENCH_GEOM_VERTICES  128  // 外环顶点数, 内环为一半
+#define BENCH_GEOM_REPEATS   200
+
+#define BENCH_GEOM_PI  3.14159265358979323846
+
+#define BENCH_COAST_VERTICES  100000  // 大陆外环顶点数
+#define BENCH_COAST_ISLANDS    60000  // 海岛, 与湖, 湖中岛共 100k 个环
+#define BENCH_COAST_LAKES      30000
+#define BENCH_COAST_LAKEISLES  10000
+#define BENCH_COAST_RINGVERTS     12
+#define BENCH_COAST_CELL           6  // 海岛与湖各占一个网格单元, 互不重叠
+#define BENCH_COAST_EXTENT      2000
+
+
+// 与 SHPCreateTree 相同: 每个节点约 8 个图形
+static int bench_tree_depth(int numshapes)
+{
+    int depth = 0, maxnodes = 1;
+    while (maxnodes * 4 < numshapes) {
+        depth++;
+        maxnodes *= 2;
+    }
+    return depth;
+}
+
+
+// 随机查询窗口: 宽高为图层范围的 0.1% ~ 10%
+static void bench_tree_boxes(const double bmin[4], const double bmax[4], int numboxes, double (*boxes)[4])
+{
+    int i;
+    unsigned int seed = 20241112;
+
+    double dx = bmax[0] - bmin[0];
+    double dy = bmax[1] - bmin[1];
+
+    for (i = 0; i < numboxes; i++) {
+        double w, h;
+
+        seed = seed * 1103515245 + 12345;
+        w = dx * (0.001 + 0.099 * ((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        h = dy * (0.001 + 0.099 * ((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        boxes[i][0] = bmin[0] + (dx - w) * (((seed >> 8) & 0xffff) / 65535.0);
+        seed = seed * 1103515245 + 12345;
+        boxes[i][1] = bmin[1] + (dy - h) * (((seed >> 8) & 0xffff) / 65535.0);
+
+        boxes[i][2] = boxes[i][0] + w;
+        boxes[i][3] = boxes[i][1] + h;
+    }
+}
+
+
+// 两棵树对每个窗口查出的 shapeid 必须完全相同
+static int bench_tree_compare(SHPTreeHandle tree1, SHPTreeHandle tree2, int numboxes, double (*boxes)[4], int64_t *total)
+{
+    int i, count1, count2, ok = 1;
+
+    *total = 0;
+    for (i = 0; i < numboxes && ok; i++) {
+        double bmin[4] = {boxes[i][0], boxes[i][1], 0, 0};
+        double bmax[4] = {boxes[i][2], boxes[i][3], 0, 0};
+
+        int *ids1 = SHPTreeFindLikelyShapes(tree1, bmin, bmax, &count1);
+        int *ids2 = SHPTreeFindLikelyShapes(tree2, bmin, bmax, &count2);
+
+        if (count1 != count2 || (count1 && memcmp(ids1, ids2, sizeof(int) * count1))) {
+            printf("Error: results not match at query %d: %d != %d\n", i, count1, count2);
+            ok = 0;
+        }
+        *total += count1;
+
+        free(ids1);
+        free(ids2);
+    }
+    return ok;
+}
+
+
+/**
+ * 比较 SHPTree 建树: 逐个 SHPReadObject 插入 (原方式) 与只读外接矩形并多线程建子树
+ */
+int benchshptree(shapetool_flags *flags, shapetool_options *options)
+{
+    int ret = SHAPETOOL_RES_ERR;
+    int i, numshapes, depth, numvalid;
+    int64_t total = 0;
+    double bmin[4], bmax[4];
+    double (*boxes)[4] = 0;
+    struct timespec t0, t1, t2, t3, t4;
+    SHPEnvelope *envelopes = 0;
+    SHPTreeHandle serialtree = 0, tree1 = 0, treeN = 0;
+
+    SHPHandle hSHP = SHPOpen(CBSTR(options->shpfile), "rb");
+    if (! hSHP) {
+        printf("Error: open shp file failed: %s\n", CBSTR(options->shpfile));
+        return SHAPETOOL_RES_ERR;
+    }
+
+    SHPGetInfo(hSHP, &numshapes, 0, bmin, bmax);
+    depth = bench_tree_depth(numshapes);
+
+    printf("Info: benchshptree: %d shapes, depth=%d, threads=%d\n", numshapes, depth, options->threads);
+
+    // 原方式: 每个图形读出整个 SHPObject
+    getnowtimeofday(&t0);
+    serialtree = SHPCreateTree(0, 2, depth, bmin, bmax);
+    for (i = 0; i < numshapes; i++) {
+        SHPObject *psShape = SHPReadObject(hSHP, i);
+        if (psShape) {
+            if (psShape->nSHPType != SHPT_NULL && psShape->nVertices > 0) {
+                SHPTreeAddShapeId(serialtree, psShape);
+            }
+            SHPDestroyObject(psShape);
+        }
+    }
+    getnowtimeofday(&t1);
+
+    // 只读每个记录头部的外接矩形
+    envelopes = (SHPEnvelope *) mem_alloc_zero(numshapes + 1, sizeof(SHPEnvelope));
+    numvalid = SHPReadObjectEnvelopes(hSHP, envelopes, 0);
+    getnowtimeofday(&t2);
+
+    tree1 = SHPCreateTreeFromBounds(numshapes, envelopes, depth, bmin, bmax, 1);
+    getnowtimeofday(&t3);
+
+    treeN = SHPCreateTreeFromBounds(numshapes, envelopes, depth, bmin, bmax, options->threads);
+    getnowtimeofday(&t4);
+
+    printf("Info: SHPReadObject + SHPTreeAddShapeId: %.1f ms\n", (double) difftime_msec(&t0, &t1));
+    printf("Info: SHPReadObjectEnvelopes: %.1f ms (%d not null)\n", (double) difftime_msec(&t1, &t2), numvalid);
+    printf("Info: SHPCreateTreeFromBounds (1 thread): %.1f ms\n", (double) difftime_msec(&t2, &t3));
+    printf("Info: SHPCreateTreeFromBounds (%d threads): %.1f ms\n", options->threads, (double) difftime_msec(&t3, &t4));
+
+    boxes = (double (*)[4]) mem_alloc_zero(BENCH_TREE_QUERIES, sizeof(double) * 4);
+    bench_tree_boxes(bmin, bmax, BENCH_TREE_QUERIES, boxes);
+
+    if (bench_tree_compare(serialtree, tree1, BENCH_TREE_QUERIES, boxes, &total) &&
+        bench_tree_compare(serialtree, treeN, BENCH_TREE_QUERIES, boxes, &total)) {
+        printf("Info: %d queries, %lld shapes: results match\n", BENCH_TREE_QUERIES, (long long) total);
+        ret = SHAPETOOL_RES_SOK;
+    }
+
+    mem_free(boxes);
+    mem_free(envelopes);
+    SHPDestroyTree(serialtree);
+    SHPDestroyTree(tree1);
+    SHPDestroyTree(treeN);
+    SHPClose(hSHP);
+    return ret;
+}
+
+
+// 格网中每格一个外环 (逆时针, 需要反转) 和一个内环 (顺时针, 也需要反转)
+static SHPObjectEx * bench_geom_multipolygon(void)
+{
+    int i, j, k, iPart = 0, iVert = 0;
+    int nParts = BENCH_GEOM_GRID * BENCH_GEOM_GRID * 2;
+    int nVertices = BENCH_GEOM_GRID * BENCH_GEOM_GRID * (BENCH_GEOM_VERTICES + 1 + BENCH_GEOM_VERTICES/2 + 1);
+    SHPObjectEx *psShape;
+
+    SHPCreateObjectEx(&psShape);
+    psShape->nSHPType = SHPT_POLYGON;
+    psShape->nParts = nParts;
+    psShape->nPartsSize = nParts + 1;
+    psShape->panPartStart = (int *) mem_alloc_zero(nParts + 1, sizeof(int));
+    psShape->panPartType = (int *) mem_alloc_zero(nParts + 1, sizeof(int));
+    psShape->nVertices = nVertices;
+    psShape->nPointsSize = nVertices;
+    psShape->pPoints = (SHPPointType *) mem_alloc_zero(nVertices, sizeof(SHPPointType));
+
+    for (i = 0; i < BENCH_GEOM_GRID; i++) {
+        for (j = 0; j < BENCH_GEOM_GRID; j++) {
+            int ring, nv;
+            for (ring = 0; ring < 2; ring++) {
+                double r = ring? 0.2 : 0.45;
+                double dir = ring? -1 : 1;
+                nv = ring? BENCH_GEOM_VERTICES/2 : BENCH_GEOM_VERTICES;
+
+                psShape->panPartStart[iPart++] = iVert;
+                for (k = 0; k <= nv; k++) {
+                    double a = dir * 2 * BENCH_GEOM_PI * (k % nv) / nv;
+                    psShape->pPoints[iVert].x = i + 0.5 + r * cos(a);
+                    psShape->pPoints[iVert].y = j + 0.5 + r * sin(a);
+                    iVert++;
+                }
+            }
+        }
+    }
+    psShape->panPartStart[nParts] = nVertices;
+    return psShape;
+}
+
+
+// 原方式: 每个环的首点对所有其它环做射线测试
+static int bench_geom_isinner(const SHPObjectEx *psShape, int iOpRing)
+{
+    int iCheckRing, iEdge, bInner = 0;
+    double x = psShape->pPoints[psShape->panPartStart[iOpRing]].x;
+    double y = psShape->pPoints[psShape->panPartStart[iOpRing]].y;
+
+    for (iCheckRing = 0; iCheckRing < psShape->nParts; iCheckRing++) {
+        const SHPPointType *pt = psShape->pPoints + psShape->panPartStart[iCheckRing];
+        int n = psShape->panPartStart[iCheckRing+1] - psShape->panPartStart[iCheckRing];
+
+        if (iCheckRing == iOpRing) {
+            continue;
+        }
+        for (iEdge = 0; iEdge < n; iEdge++) {
+            const SHPPointType *a = &pt[iEdge], *b = &pt[(iEdge + 1) % n];
+            if (((a->y < y && b->y >= y) || (b->y < y && a->y >= y)) && a->x + (y - a->y) / (b->y - a->y) * (b->x - a->x) < x) {
+                bInner = !bInner;
+            }
+        }
+    }
+    return bInner;
+}
+
+
+static int bench_geom_close(double a, double b)
+{
+    return fabs(a - b) <= 1e-9 * (fabs(a) > fabs(b)? fabs(a) : fabs(b));
+}
+
+
+static unsigned int bench_coast_seed = 20241125;
+
+static double bench_coast_rand(void)
+{
+    bench_coast_seed = bench_coast_seed * 1103515245 + 12345;
+    return ((bench_coast_seed >> 8) & 0xffff) / 65536.0;
+}
+
+
+static void bench_coast_ring(SHPObjectEx *psShape, int *iPart, int *iVert, double cx, double cy, double r, int nv, int ccw)
+{
+    int k;
+    psShape->panPartStart[(*iPart)++] = *iVert;
+    for (k = 0; k <= nv; k++) {
+        double a = (ccw? 1 : -1) * 2 * BENCH_GEOM_PI * (k % nv) / nv;
+        double rr = r * (1 + 0.05 * sin(a * 7));
+        psShape->pPoints[*iVert].x = cx + rr * cos(a);
+        psShape->pPoints[*iVert].y = cy + rr * sin(a);
+        (*iVert)++;
+    }
+}
+
+
+// 随机取圆环 rmin-rmax 内一个未占用的网格单元, 返回其中心 (带抖动)
+static void bench_coast_cell(unsigned char *cells, double rmin, double rmax, double *cx, double *cy)
+{
+    int ncols = 2 * BENCH_COAST_EXTENT / BENCH_COAST_CELL;
+
+    for (;;) {
+        int col = (int) (bench_coast_rand() * ncols);
+        int row = (int) (bench_coast_rand() * ncols);
+        double x = (col + 0.5) * BENCH_COAST_CELL - BENCH_COAST_EXTENT;
+        double y = (row + 0.5) * BENCH_COAST_CELL - BENCH_COAST_EXTENT;
+        double d = sqrt(x * x + y * y);
+
+        if (d >= rmin && d <= rmax && ! cells[row * ncols + col]) {
+            cells[row * ncols + col] = 1;
+            *cx = x + 0.5 * (bench_coast_rand() - 0.5);
+            *cy = y + 0.5 * (bench_coast_rand() - 0.5);
+            return;
+        }
+    }
+}
+
+
+// 海岸线: 大陆 (半径 1000) 内有湖, 湖中有岛, 大陆外有海岛. 环的次序打乱, 方向随机
+static SHPObjectEx * bench_coast_multipolygon(void)
+{
+    int i, iPart = 0, iVert = 0;
+    int nParts = 1 + BENCH_COAST_ISLANDS + BENCH_COAST_LAKES + BENCH_COAST_LAKEISLES;
+    int nVertices = BENCH_COAST_VERTICES + 1 + (nParts - 1) * (BENCH_COAST_RINGVERTS + 1);
+    int ncols = 2 * BENCH_COAST_EXTENT / BENCH_COAST_CELL;
+    unsigned char *cells = (unsigned char *) mem_alloc_zero(ncols * ncols, 1);
+    SHPObjectEx *psShape;
+
+    SHPCreateObjectEx(&psShape);
+    psShape->nSHPType = SHPT_POLYGON;
+    psShape->nParts = nParts;
+    psShape->nPartsSize = nParts + 1;
+    psShape->panPartStart = (int *) mem_alloc_zero(nParts + 1, sizeof(int));
+    psShape->panPartType = (int *) mem_alloc_zero(nParts + 1, sizeof(int));
+    psShape->nVertices = nVertices;
+    psShape->nPointsSize = nVertices;
+    psShape->pPoints = (SHPPointType *) mem_alloc_zero(nVertices, sizeof(SHPPointType));
+
+    // 海岛在前, 大陆在中间, 湖与湖中岛交错在后
+    for (i = 0; i < BENCH_COAST_ISLANDS; i++) {
+        double cx, cy;
+        bench_coast_cell(cells, 1100, BENCH_COAST_EXTENT - BENCH_COAST_CELL, &cx, &cy);
+        bench_coast_ring(psShape, &iPart, &iVert, cx, cy, 1 + bench_coast_rand(), BENCH_COAST_RINGVERTS, i & 1);
+    }
+
+    bench_coast_ring(psShape, &iPart, &iVert, 0, 0, 1000, BENCH_COAST_VERTICES, 1);
+
+    for (i = 0; i < BENCH_COAST_LAKES; i++) {
+        double cx, cy;
+        bench_coast_cell(cells, 0, 850, &cx, &cy);
+        bench_coast_ring(psShape, &iPart, &iVert, cx, cy, 2, BENCH_COAST_RINGVERTS, i & 1);
+        if (i % (BENCH_COAST_LAKES / BENCH_COAST_LAKEISLES) == 0) {
+            bench_coast_ring(psShape, &iPart, &iVert, cx + 0.3, cy, 0.5, BENCH_COAST_RINGVERTS, i & 2);
+        }
+    }
+
+    psShape->panPartStart[nParts] = nVertices;
+    mem_free(cells);
+    return psShape;
+}
+
+
+// 修复后: 各深度的环数与构造的相同, 再修复无变化
+static int bench_coast_check(SHPObjectEx *psShape)
+{
+    int i, ok = 1, counts[4] = {0};
+    int *panParent = (int *) mem_alloc_zero(psShape->nParts, sizeof(int));
+    int *panDepth = (int *) mem_alloc_zero(psShape->nParts, sizeof(int));
+
+    SHPObjectExNestRings(psShape, panParent, panDepth);
+    for (i = 0; i < psShape->nParts; i++) {
+        counts[panDepth[i] < 3? panDepth[i] : 3]++;
+    }
+
+    if (counts[0] != 1 + BENCH_COAST_ISLANDS || counts[1] != BENCH_COAST_LAKES || counts[2] != BENCH_COAST_LAKEISLES || counts[3]) {
+        printf("Error: ring depths: %d %d %d %d\n", counts[0], counts[1], counts[2], counts[3]);
+        ok = 0;
+    }
+    if ((i = SHPObjectExFixRings(psShape)) != 0) {
+        printf("Error: %d rings changed by fixing again\n", i);
+        ok = 0;
+    }
+
+    mem_free(panParent);
+    mem_free(panDepth);
+    return ok;
+}
+
+
+/**
+ * 面积, 长度 (SHPPointType 与 padfX/padfY 两种布局) 各 SIMD 级别的耗时,
+ * SHPRewindObjectEx 与逐环全量射线测试的比较, 以及 100k 个环的海岸线嵌套修复
+ */
+int benchshpgeom(shapetool_flags *flags, shapetool_options *options)
+{
+    int ret = SHAPETOOL_RES_SOK;
+    int i, level, levelMax, iPart;
+    int64_t msNaive, msRewind;
+    double area0 = 0, length0 = 0, areaXY0 = 0, lengthXY0 = 0;
+    double *padfX, *padfY;
+    struct timespec t0, t1, t2, t3, t4;
+    static const char *levelNames[] = {"scalar", "sse2", "avx2"};
+
+    SHPObjectEx *psShape = bench_geom_multipolygon();
+    SHPObject *psObject;
+    int *isInner = (int *) mem_alloc_zero(psShape->nParts, sizeof(int));
+
+    padfX = (double *) mem_alloc_zero(psShape->nVertices, sizeof(double));
+    padfY = (double *) mem_alloc_zero(psShape->nVertices, sizeof(double));
+    for (i = 0; i < psShape->nVertices; i++) {
+        padfX[i] = psShape->pPoints[i].x;
+        padfY[i] = psShape->pPoints[i].y;
+    }
+    psObject = SHPCreateObject(SHPT_POLYGON, 0, psShape->nParts, psShape->panPartStart, 0, psShape->nVertices, padfX, padfY, 0, 0);
+
+    levelMax = SHPSetSIMDLevel(-1);
+
+    printf("Info: benchgeom: %d rings, %d vertices, %d repeats, simd=%s\n", psShape->nParts, psShape->nVertices, BENCH_GEOM_REPEATS, levelNames[levelMax]);
+
+    for (level = SHP_SIMD_NONE; level <= levelMax; level++) {
+        double area = 0, length = 0, areaXY = 0, lengthXY = 0;
+
+        SHPSetSIMDLevel(level);
+
+        getnowtimeofday(&t0);
+        for (i = 0; i < BENCH_GEOM_REPEATS; i++) {
+            area += SHPObjectExGetArea(psShape);
+        }
+        getnowtimeofday(&t1);
+        for (i = 0; i < BENCH_GEOM_REPEATS; i++) {
+            length += SHPObjectExGetLength(psShape);
+        }
+        getnowtimeofday(&t2);
+        for (i = 0; i < BENCH_GEOM_REPEATS; i++) {
+            areaXY += SHPObjectGetArea(psObject);
+        }
+        getnowtimeofday(&t3);
+        for (i = 0; i < BENCH_GEOM_REPEATS; i++) {
+            lengthXY += SHPObjectGetLength(psObject);
+        }
+        getnowtimeofday(&t4);
+
+        printf("Info: %-6s area: %lld ms, length: %lld ms (points); area: %lld ms, length: %lld ms (xys)\n", levelNames[level],
+            (long long) difftime_msec(&t0, &t1), (long long) difftime_msec(&t1, &t2),
+            (long long) difftime_msec(&t2, &t3), (long long) difftime_msec(&t3, &t4));
+
+        if (level == SHP_SIMD_NONE) {
+            area0 = area;
+            length0 = length;
+            areaXY0 = areaXY;
+            lengthXY0 = lengthXY;
+        } else if (! bench_geom_close(area, area0) || ! bench_geom_close(length, length0) ||
+            ! bench_geom_close(areaXY, areaXY0) || ! bench_geom_close(lengthXY, lengthXY0)) {
+            printf("Error: %s results not match scalar\n", levelNames[level]);
+            ret = SHAPETOOL_RES_ERR;
+        }
+    }
+    SHPSetSIMDLevel(-1);
+
+    getnowtimeofday(&t0);
+    for (iPart = 0; iPart < psShape->nParts; iPart++) {
+        isInner[iPart] = bench_geom_isinner(psShape, iPart);
+    }
+    getnowtimeofday(&t1);
+    i = SHPRewindObjectEx(psShape);
+    getnowtimeofday(&t2);
+
+    msNaive = difftime_msec(&t0, &t1);
+    msRewind = difftime_msec(&t1, &t2);
+    printf("Info: ring nesting (all rings): %lld ms; SHPRewindObjectEx: %lld ms, %d rings reversed\n",
+        (long long) msNaive, (long long) msRewind, i);
+
+    // 外环顺时针, 内环逆时针
+    for (iPart = 0; iPart < psShape->nParts; iPart++) {
+        int ccw = 0;
+        SHPAreaOfPoints(psShape->pPoints, psShape->panPartStart[iPart], psShape->panPartStart[iPart+1], &ccw);
+        if ((ccw > 0) != (isInner[iPart] != 0)) {
+            printf("Error: ring#%d has wrong winding after SHPRewindObjectEx\n", iPart);
+            ret = SHAPETOOL_RES_ERR;
+            break;
+        }
+    }
+
+    SHPDestroyObjectEx(psShape);
+
+    // 海岸线多边形: 嵌套分析, 方向与次序修复
+    psShape = bench_coast_multipolygon();
+
+    getnowtimeofday(&t0);
+    i = SHPObjectExFixRings(psShape);
+    getnowtimeofday(&t1);
+
+    printf("Info: coastline %d rings, %d vertices: SHPObjectExFixRings: %lld ms, %d rings reversed or moved\n",
+        psShape->nParts, psShape->nVertices, (long long) difftime_msec(&t0, &t1), i);
+
+    if (! bench_coast_check(psShape)) {
+        ret = SHAPETOOL_RES_ERR;
+    }
+
+    mem_free(isInner);
+    mem_free(padfX);
+    mem_free(padfY);
+    SHPDestroyObject(psObject);
+    SHPDestroyObjectEx(psShape);
+    return ret;
+}
@@ -75,6 +75,7 @@ extern "C" {
 
 
 #include <common/viewport.h>
+#include <common/clippath.h>
 
 #include "cssdrawstyle.h"
 
@@ -89,6 +90,16 @@ extern "C" {
 #   define CAIRO_DRAW_HEIGHT_MIN      96
 #endif
 
+// 粗画时相邻点最小像素距离 (精画为 0.5)
+#ifndef CAIRO_COARSE_TOLERANCE
+#   define CAIRO_COARSE_TOLERANCE     2.0
+#endif
+
+// 裁剪框超出画布的像素 (大于线宽), 裁剪产生的边不会画出来
+#ifndef CAIRO_CLIP_PADDING
+#   define CAIRO_CLIP_PADDING         8.0
+#endif
+
 #ifndef CAIRO_DRAW_WIDTH_DEFAULT
 // default 15.6 in, 4K display
 #   define CAIRO_DRAW_WIDTH_DEFAULT   3840
@@ -125,15 +136,32 @@ typedef struct
     cairo_surface_t *surface;
     cairo_t *cr;
 
-    ///CssPolygonStyle  polygonStyle;
-
     // paint viewport
     Viewport2D viewport;
 
+    // fill and border of shapes: cairoDrawCtxSetStyle
     CssDrawStyle drawStyles;
+
+    // css_bitflag_zoomin, css_bitflag_zoomout: coarse drawing during zoom
+    //   (simplified geometry, no strokes)
+    int drawFlags;
+
+    // 1: paths not clipped to view box (benchclip)
+    int noClip;
 } cairoDrawCtx;
 
 
+#define cairoDrawCtxIsCoarse(CDC)    ((CDC)->drawFlags & (css_bitflag_zoomin | css_bitflag_zoomout))
+
+
+// view box with CAIRO_CLIP_PADDING
+static void cairoDrawCtxGetClipBox(const cairoDrawCtx *CDC, CGBox2D *clipBox)
+{
+    *clipBox = CDC->viewport.viewBox;
+    CGBoxInflate((*clipBox), CAIRO_CLIP_PADDING);
+}
+
+
 static int cairoDrawCtxInit(cairoDrawCtx *CDC, CGBox2D dataBox, CGSize2D drawSize, cairoDotUnit dotUnit, float drawDPI)
 {
     CGBox2D viewBox = {
@@ -145,6 +173,8 @@ static int cairoDrawCtxInit(cairoDrawCtx *CDC, CGBox2D dataBox, CGSize2D drawSiz
 
     CGSize2D viewDPI = {drawDPI, drawDPI};
 
+    bzero(CDC, sizeof(cairoDrawCtx));
+
     cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (int)drawSize.W, (int)drawSize.H);
     if (! surface) {
         printf("Error: cairo_image_surface_create()\n");
@@ -161,9 +191,7 @@ static int cairoDrawCtxInit(cairoDrawCtx *CDC, CGBox2D dataBox, CGSize2D drawSiz
 
     ViewportInitAll(&CDC->viewport, dataBox, viewBox, viewDPI, 1.0f);
 
-    // TODO:
-    ///CDC->polygonStyle.border_color.red = 128;
-    ///CDC->polygonStyle.fill_color.blue = 128;
+    cssDrawStyleInit(&CDC->drawStyles);
 
     return 0;
 }
@@ -186,14 +214,14 @@ static void cairoDrawCtxFinal(cairoDrawCtx *CDC)
 }
 
 
+// drawStyles of CDC from styleClass in cssStyleKeys. call after drawFlags set
 static void cairoDrawCtxSetStyle(cairoDrawCtx *CDC, const CssKeyArray cssStyleKeys, cstrbuf styleClass)
 {
-    CssKeyArrayNode classNodes[32] = { 0 };
-    int Nodes = CssKeyArrayQueryClass(cssStyleKeys, css_type_class, styleClass->str, styleClass->len, classNodes);
-
-    // TODO: set CDC with style
-
+    cssDrawStyleInit(&CDC->drawStyles);
 
+    if (cssStyleKeys && styleClass) {
+        cssDrawStyleApplyClass(&CDC->drawStyles, cssStyleKeys, styleClass, CDC->drawFlags);
+    }
 }
 
 
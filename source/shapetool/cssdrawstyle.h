@@ -43,6 +43,9 @@ extern "C" {
 #include <common/cstrbuf.h>
 #include <common/cssparse.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 
 typedef struct {
     float red;
@@ -87,6 +90,284 @@ typedef struct
 } CssDrawStyle;
 
 
+// 未给出样式时的画法
+static void cssDrawStyleInit(CssDrawStyle *style)
+{
+    style->border_width = 1;
+    style->border_style = CSS_BORDER_SOLID;
+    style->border_color.red = 0;
+    style->border_color.green = 160 / 255.0f;
+    style->border_color.blue = 35 / 255.0f;
+
+    style->fill_opacity = 100;
+    style->fill_style = CSS_FILL_SOLID;
+    style->fill_color.red = 128 / 255.0f;
+    style->fill_color.green = 0;
+    style->fill_color.blue = 128 / 255.0f;
+}
+
+
+// #rgb, #rrggbb, rgb(r, g, b) or name. returns 0 if not a color
+static int cssDrawStyleParseColor(const char *value, int len, CssColorRGB *color)
+{
+    static const struct {
+        const char *name;
+        unsigned int rgb;
+    } namedColors[] = {
+        {"black", 0x000000}, {"white", 0xffffff}, {"gray", 0x808080}, {"grey", 0x808080},
+        {"red", 0xff0000}, {"green", 0x008000}, {"blue", 0x0000ff}, {"yellow", 0xffff00},
+        {"cyan", 0x00ffff}, {"magenta", 0xff00ff}, {"orange", 0xffa500}, {"purple", 0x800080}
+    };
+
+    char buf[CSS_VALUELEN_INVALID_256];
+    unsigned int rgb;
+    char *end;
+    int i;
+
+    if (len <= 0 || len >= (int) sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, value, len);
+    buf[len] = 0;
+
+    if (buf[0] == '#') {
+        if ((len != 4 && len != 7) || (int) strspn(buf + 1, "0123456789abcdefABCDEF") != len - 1) {
+            return 0;
+        }
+        rgb = (unsigned int) strtoul(buf + 1, 0, 16);
+        if (len == 4) {
+            // #rgb => #rrggbb
+            rgb = ((rgb >> 8) & 0xf) * 0x110000 + ((rgb >> 4) & 0xf) * 0x1100 + (rgb & 0xf) * 0x11;
+        }
+    } else if (! strncmp(buf, "rgb(", 4)) {
+        long r, g, b;
+        r = strtol(buf + 4, &end, 10);
+        end += strspn(end, " ,");
+        g = strtol(end, &end, 10);
+        end += strspn(end, " ,");
+        b = strtol(end, &end, 10);
+        if (*end != ')' || r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
+            return 0;
+        }
+        rgb = (unsigned int) (r << 16 | g << 8 | b);
+    } else {
+        for (i = 0; i < (int) (sizeof(namedColors) / sizeof(namedColors[0])); i++) {
+            if (! strcmp(buf, namedColors[i].name)) {
+                break;
+            }
+        }
+        if (i == (int) (sizeof(namedColors) / sizeof(namedColors[0]))) {
+            return 0;
+        }
+        rgb = namedColors[i].rgb;
+    }
+
+    color->red = ((rgb >> 16) & 0xff) / 255.0f;
+    color->green = ((rgb >> 8) & 0xff) / 255.0f;
+    color->blue = (rgb & 0xff) / 255.0f;
+    return 1;
+}
+
+
+// border-width: 3, 3px, thin, medium, thick. returns 0 if not a width
+static int cssDrawStyleParseWidth(const char *value, int len, int *width)
+{
+    char buf[CSS_VALUELEN_INVALID_256];
+    char *end;
+    double w;
+
+    if (len <= 0 || len >= (int) sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, value, len);
+    buf[len] = 0;
+
+    if (! strcmp(buf, "thin")) {
+        *width = 1;
+    } else if (! strcmp(buf, "medium")) {
+        *width = 3;
+    } else if (! strcmp(buf, "thick")) {
+        *width = 5;
+    } else {
+        w = strtod(buf, &end);
+        if (end == buf || (*end && strcmp(end, "px")) || w < 0) {
+            return 0;
+        }
+        *width = (int) (w + 0.5);
+    }
+    return 1;
+}
+
+
+// fill-opacity: 0 (透明) ... 1 (不透明), or 0% ... 100%. returns 0 if not a number
+static int cssDrawStyleParseOpacity(const char *value, int len, int *opacity)
+{
+    char buf[CSS_VALUELEN_INVALID_256];
+    char *end;
+    double v;
+
+    if (len <= 0 || len >= (int) sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, value, len);
+    buf[len] = 0;
+
+    v = strtod(buf, &end);
+    if (end == buf) {
+        return 0;
+    }
+    if (*end == '%' && ! end[1]) {
+        v /= 100;
+    } else if (*end) {
+        return 0;
+    }
+    *opacity = v <= 0? 0 : (v >= 1? 100 : (int) (v * 100 + 0.5));
+    return 1;
+}
+
+
+static int cssDrawStyleParseBorderStyle(const char *value, int len, CssBorderStyle *borderStyle)
+{
+    if ((len == 4 && ! strncmp(value, "none", 4)) || (len == 6 && ! strncmp(value, "hidden", 6))) {
+        *borderStyle = CSS_BORDER_NONE;
+    } else if (len == 6 && ! strncmp(value, "dashed", 6)) {
+        *borderStyle = CSS_BORDER_DASHED;
+    } else if (len == 5 && ! strncmp(value, "solid", 5)) {
+        *borderStyle = CSS_BORDER_SOLID;
+    } else if ((len == 6 && ! strncmp(value, "dotted", 6)) || (len == 6 && ! strncmp(value, "double", 6)) ||
+        (len == 5 && ! strncmp(value, "inset", 5)) || (len == 6 && ! strncmp(value, "outset", 6)) ||
+        (len == 5 && ! strncmp(value, "ridge", 5)) || (len == 6 && ! strncmp(value, "groove", 6))) {
+        // 当前仅支持: none|dashed|solid
+        *borderStyle = CSS_BORDER_SOLID;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+
+static int cssDrawStyleParseFillStyle(const char *value, int len, CssFillStyle *fillStyle)
+{
+    if (len == 4 && ! strncmp(value, "none", 4)) {
+        *fillStyle = CSS_FILL_NONE;
+    } else if (len == 5 && ! strncmp(value, "solid", 5)) {
+        *fillStyle = CSS_FILL_SOLID;
+    } else if (len == 6 && ! strncmp(value, "dashed", 6)) {
+        *fillStyle = CSS_FILL_DASHED;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+
+// 下一个以空格分开的值, rgb(...) 中可有空格. 返回值的长度, 0 为没有了
+static int cssDrawStyleNextToken(const char **value, const char *end)
+{
+    const char *p = *value;
+    const char *q;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    q = p;
+    if (end - p > 4 && ! strncmp(p, "rgb(", 4)) {
+        while (q < end && *q != ')') {
+            q++;
+        }
+        if (q < end) {
+            q++;
+        }
+    } else {
+        while (q < end && *q != ' ') {
+            q++;
+        }
+    }
+    *value = p;
+    return (int) (q - p);
+}
+
+
+/**
+ * 设置样式的一个属性 (见 CSS_polygon.md):
+ *   border-color, border-style, border-width, border: width style color
+ *   fill-opacity, fill-style, fill-color, fill: opacity style color
+ * 不认识的属性或值被忽略.
+ */
+static void cssDrawStyleSetKey(CssDrawStyle *style, const char *key, int keylen, const char *value, int vallen)
+{
+    const char *end = value + vallen;
+    int len;
+
+    if (keylen == 12 && ! strncmp(key, "border-color", 12)) {
+        cssDrawStyleParseColor(value, vallen, &style->border_color);
+    } else if (keylen == 12 && ! strncmp(key, "border-style", 12)) {
+        cssDrawStyleParseBorderStyle(value, vallen, &style->border_style);
+    } else if (keylen == 12 && ! strncmp(key, "border-width", 12)) {
+        cssDrawStyleParseWidth(value, vallen, &style->border_width);
+    } else if (keylen == 6 && ! strncmp(key, "border", 6)) {
+        while ((len = cssDrawStyleNextToken(&value, end)) > 0) {
+            if (! cssDrawStyleParseWidth(value, len, &style->border_width) &&
+                ! cssDrawStyleParseBorderStyle(value, len, &style->border_style)) {
+                cssDrawStyleParseColor(value, len, &style->border_color);
+            }
+            value += len;
+        }
+    } else if (keylen == 12 && ! strncmp(key, "fill-opacity", 12)) {
+        cssDrawStyleParseOpacity(value, vallen, &style->fill_opacity);
+    } else if (keylen == 10 && ! strncmp(key, "fill-style", 10)) {
+        cssDrawStyleParseFillStyle(value, vallen, &style->fill_style);
+    } else if (keylen == 10 && ! strncmp(key, "fill-color", 10)) {
+        cssDrawStyleParseColor(value, vallen, &style->fill_color);
+    } else if (keylen == 4 && ! strncmp(key, "fill", 4)) {
+        while ((len = cssDrawStyleNextToken(&value, end)) > 0) {
+            if (! cssDrawStyleParseOpacity(value, len, &style->fill_opacity) &&
+                ! cssDrawStyleParseFillStyle(value, len, &style->fill_style)) {
+                cssDrawStyleParseColor(value, len, &style->fill_color);
+            }
+            value += len;
+        }
+    }
+}
+
+
+/**
+ * 按样式类 styleClass 在 cssKeys 中的声明设置 style. 先用没有状态的类,
+ * 再用状态标志都在 drawFlags 中的类 (如 .polygon zoomin {...}), 后面的覆盖前面的.
+ */
+static void cssDrawStyleApplyClass(CssDrawStyle *style, const CssKeyArray cssKeys, cstrbuf styleClass, int drawFlags)
+{
+    CssKeyArrayNode classNodes[32] = { 0 };
+    int numKeys = CssKeyArrayGetUsed(cssKeys);
+    int numNodes = CssKeyArrayQueryClass(cssKeys, css_type_class, styleClass->str, styleClass->len, classNodes);
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int n = 0; n < numNodes; n++) {
+            int flag = CssKeyGetFlag(classNodes[n]);
+            int keyIndex = CssClassGetKeyIndex(classNodes[n]);
+
+            if (pass == 0? flag != 0 : (flag == 0 || (flag & drawFlags) != flag)) {
+                continue;
+            }
+
+            while (keyIndex >= 0 && keyIndex < numKeys - 1) {
+                int keyoffs, valoffs, keylen, vallen;
+                CssKeyArrayNode keyNode = CssKeyArrayGetNode(cssKeys, keyIndex++);
+                if (CssKeyTypeIsClass(keyNode)) {
+                    break;
+                }
+                CssKeyArrayNode valNode = CssKeyArrayGetNode(cssKeys, keyIndex++);
+
+                keylen = CssKeyOffsetLength(keyNode, &keyoffs);
+                vallen = CssKeyOffsetLength(valNode, &valoffs);
+
+                cssDrawStyleSetKey(style, CssKeyArrayGetString(cssKeys, keyoffs), keylen, CssKeyArrayGetString(cssKeys, valoffs), vallen);
+            }
+        }
+    }
+}
+
+
 static CssKeyArray cssStyleLoadString(const char* cssarg, int csslen)
 {
     CssString cssString = CssStringNew(cssarg, csslen);
@@ -127,6 +408,80 @@ static CssKeyArray cssStyleLoadFile(const char* csspathfile)
     return 0;
 }
 
+
+// 不退出, 不打印: 用于运行中重新加载, 文件有错时保留原样式
+static CssKeyArray cssStyleReloadFile(const char* csspathfile)
+{
+    CssKeyArray keys = 0;
+    FILE * cssfile = fopen(csspathfile, "r");
+    if (cssfile) {
+        CssString cssString = CssStringNewFromFile(cssfile);
+        fclose(cssfile);
+
+        if (cssString) {
+            keys = CssStringParse(cssString);
+            if (!keys) {
+                CssStringFree(cssString);
+            }
+        }
+    }
+    return keys;
+}
+
+
+static uint64_t cssStyleHashBytes(uint64_t hash, const char* str, int len)
+{
+    // FNV-1a
+    while (len-- > 0) {
+        hash ^= (unsigned char) *str++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/**
+ * 样式类 styleClass 在 cssKeys 中的全部声明 (含状态标志) 的摘要.
+ * 两个样式表中同一个类的摘要相同, 则按该类画出的图形相同.
+ */
+static uint64_t cssStyleClassDigest(const CssKeyArray cssKeys, cstrbuf styleClass)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    if (cssKeys && styleClass) {
+        CssKeyArrayNode classNodes[32] = { 0 };
+        int numKeys = CssKeyArrayGetUsed(cssKeys);
+        int numNodes = CssKeyArrayQueryClass(cssKeys, css_type_class, styleClass->str, styleClass->len, classNodes);
+
+        for (int n = 0; n < numNodes; n++) {
+            int offset, length, flag = CssKeyGetFlag(classNodes[n]);
+            int keyIndex = CssClassGetKeyIndex(classNodes[n]);
+
+            length = CssKeyOffsetLength(classNodes[n], &offset);
+            hash = cssStyleHashBytes(hash, CssKeyArrayGetString(cssKeys, offset), length);
+            hash = cssStyleHashBytes(hash, (const char *) &flag, sizeof(flag));
+
+            while (keyIndex >= 0 && keyIndex < numKeys - 1) {
+                CssKeyArrayNode keyNode = CssKeyArrayGetNode(cssKeys, keyIndex++);
+                if (CssKeyTypeIsClass(keyNode)) {
+                    break;
+                }
+                CssKeyArrayNode valNode = CssKeyArrayGetNode(cssKeys, keyIndex++);
+
+                length = CssKeyOffsetLength(keyNode, &offset);
+                hash = cssStyleHashBytes(hash, CssKeyArrayGetString(cssKeys, offset), length);
+                hash = cssStyleHashBytes(hash, ":", 1);
+
+                length = CssKeyOffsetLength(valNode, &offset);
+                hash = cssStyleHashBytes(hash, CssKeyArrayGetString(cssKeys, offset), length);
+                hash = cssStyleHashBytes(hash, ";", 1);
+            }
+        }
+    }
+
+    return hash;
+}
+
 #ifdef  __cplusplus
 }
 #endif
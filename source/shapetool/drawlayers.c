@@ -40,226 +40,289 @@
 #include <geodbapi/geodbapi.h>
 
 
-static int load_maplayers_cfg(const char * cfgfile, shapetool_options* options, struct MapLayersCfg * maplayers)
+static int load_maplayers_cfg(const char * cfgfile, cstrbuf mapid, struct MapLayersCfg * maplayers, mem_arena_t * arena)
 {
-    // 读环境变量
-    ConfVariables vars = { 0 };
-    int numvars = ConfReadSectionVariables(cfgfile, "environments", &vars);
-    if (numvars > 0) {
-        for (int i = 0; i < numvars; i++) {
-            printf("<%.*s> : {%.*s}\n", vars.keylens[i], vars.keys[i], vars.valuelens[i], vars.values[i]);
-        }
+    // 一次读入整个配置文件, 环境变量已替换
+    CONF_parsed cfg = ConfParseFile(cfgfile, "environments");
+    if (!cfg) {
+        printf("Error: failed to open config: %s\n", cfgfile);
+        return 0;
+    }
+
+    const ConfVariables* vars = ConfParsedGetVariables(cfg);
+    for (int i = 0; i < vars->count; i++) {
+        printf("<%.*s> : {%.*s}\n", vars->keylens[i], vars->keys[i], vars->valuelens[i], vars->values[i]);
     }
 
     // 读 [map:MAPID]
-    void* sections = 0;
-    int secs = ConfGetSectionList(cfgfile, &sections);
-    if (secs > 0) {
-        char buffer[READCONF_MAX_LINESIZE];
-        int buflen;
+    if (ConfParsedHasSection2(cfg, "map", mapid->str, mapid->len)) {
+        const char* value;
+        int vallen;
 
-        char layerbuf[SHAPETOOL_PATHLEN_INVALID];
-        int layerbuflen;
+        printf("[map:%.*s]\n", mapid->len, mapid->str);
 
-        for (int i = 0; i < secs; ++i) {
-            char* sec, * family, * qualifier;
+        maplayers->mapid = cstrbufDup(maplayers->mapid, mapid->str, mapid->len);
 
-            sec = ConfSectionListGetAt(sections, i);
-            if (ConfSectionParse(sec, &family, &qualifier) == 2) {
-                if (!cstr_compare_len(family, -1, "map", 3, 0) && !cstr_compare_len(qualifier, -1, options->mapid->str, options->mapid->len, 0)) {
-                    printf("[%s:%s]\n", family, qualifier);
+        value = ConfParsedGetValue2(cfg, "map", mapid->str, mapid->len, "description", &vallen);
+        if (value) {
+            maplayers->description = cstrbufDup(maplayers->description, value, vallen);
+        }
 
-                    maplayers->mapid = cstrbufDup(maplayers->mapid, options->mapid->str, options->mapid->len);
+        value = ConfParsedGetValue2(cfg, "map", mapid->str, mapid->len, "proj4def", &vallen);
+        if (value) {
+            maplayers->proj4def = cstrbufDup(maplayers->proj4def, value, vallen);
+        }
 
-                    buflen = ConfReadValueParsed(cfgfile, "map", options->mapid->str, "description", buffer, sizeof(buffer));
-                    if (buflen) {
-                        maplayers->description = cstrbufDup(maplayers->description, buffer, buflen);
-                    }
+        value = ConfParsedGetValue2(cfg, "map", mapid->str, mapid->len, "layers", &vallen);
+        if (value) {
+            char* layerids[SHAPETOOL_LAYERS_MAX];
+            int idlens[SHAPETOOL_LAYERS_MAX];
 
-                    buflen = ConfReadValueParsed(cfgfile, "map", options->mapid->str, "proj4def", buffer, sizeof(buffer));
-                    if (buflen) {
-                        maplayers->proj4def = cstrbufDup(maplayers->proj4def, buffer, buflen);
-                    }
+            // 分割时不修改原串, 但接口需要 char *
+            char* idsbuf = mem_arena_strdup_len(arena, value, vallen);
+            int layers = cstr_slpit_chr_nodup(idsbuf, vallen, 32, layerids, idlens, sizeof(idlens) / sizeof(idlens[0]));
 
-                    char* layerids[SHAPETOOL_LAYERS_MAX];
-                    int idlens[SHAPETOOL_LAYERS_MAX];
-                    int layers = 0;
-
-                    buflen = ConfReadValueParsed(cfgfile, "map", options->mapid->str, "layers", buffer, sizeof(buffer));
-                    if (buflen) {
-                        layers = cstr_slpit_chr_nodup(buffer, buflen, 32, layerids, idlens, sizeof(idlens) / sizeof(idlens[0]));
-
-                        for (int k = 0; k < layers; k++) {
-                            char* output = 0;
-                            int outlen;
-
-                            struct MapLayerData layerdata;
-                            MapLayerDataInit(&layerdata);
-
-                            layerdata.layerid = cstrbufDup(0, layerids[k], idlens[k]);
-
-                            // shpfile
-                            layerbuflen = ConfReadValueParsed2(cfgfile, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "shpfile", layerbuf, sizeof(layerbuf));
-                            if (layerbuflen > 0) {
-                                outlen = ConfVariablesReplace(layerbuf, layerbuflen, &vars, &output);
-                                if (outlen) {
-                                    layerdata.shpfile = cstrbufDup(layerdata.shpfile, output, outlen);
-                                    ConfMemFree(output);
-                                }
-                            }
-
-                            // stylefile
-                            layerbuflen = ConfReadValueParsed2(cfgfile, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "stylefile", layerbuf, sizeof(layerbuf));
-                            if (layerbuflen > 0) {
-                                outlen = ConfVariablesReplace(layerbuf, layerbuflen, &vars, &output);
-                                if (outlen) {
-                                    layerdata.stylefile = cstrbufDup(layerdata.stylefile, output, outlen);
-                                    ConfMemFree(output);
-                                }
-                            }
-
-                            // styleclass
-                            layerbuflen = ConfReadValueParsed2(cfgfile, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "styleclass", layerbuf, sizeof(layerbuf));
-                            if (layerbuflen > 0) {
-                                outlen = ConfVariablesReplace(layerbuf, layerbuflen, &vars, &output);
-                                if (outlen) {
-                                    layerdata.styleclass = cstrbufDup(layerdata.styleclass, output, outlen);
-                                    ConfMemFree(output);
-                                }
-                            }
-
-                            // groups
-                            layerbuflen = ConfReadValueParsed2(cfgfile, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "groups", layerbuf, sizeof(layerbuf));
-                            if (layerbuflen > 0) {
-                                outlen = ConfVariablesReplace(layerbuf, layerbuflen, &vars, &output);
-                                if (outlen) {
-                                    // layerdata.groups = cstrbufDup(layerdata.groups, output, outlen);
-                                    ConfMemFree(output);
-                                }
-                            }
-
-                            // states
-                            layerbuflen = ConfReadValueParsed2(cfgfile, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "states", layerbuf, sizeof(layerbuf));
-                            if (layerbuflen > 0) {
-                                outlen = ConfVariablesReplace(layerbuf, layerbuflen, &vars, &output);
-                                if (outlen) {
-                                    // layerdata.states = cstrbufDup(layerdata.states, output, outlen);
-                                    ConfMemFree(output);
-                                }
-                            }
-
-                            MapLayersCfgAddLayer(maplayers, &layerdata);
-                        }
-                    }
+            for (int k = 0; k < layers; k++) {
+                if (idlens[k] == 0) {
+                    // 连续空格
+                    continue;
+                }
+
+                struct MapLayerData layerdata;
+                MapLayerDataInit(&layerdata);
+
+                layerdata.layerid = cstrbufDup(0, layerids[k], idlens[k]);
+
+                if (!ConfParsedHasSection2(cfg, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid))) {
+                    printf("Warn: layer not found: %.*s\n", CBSTRLEN(layerdata.layerid), CBSTR(layerdata.layerid));
+                }
+
+                // shpfile
+                value = ConfParsedGetValue2(cfg, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "shpfile", &vallen);
+                if (value && vallen) {
+                    layerdata.shpfile = cstrbufDup(layerdata.shpfile, value, vallen);
+                }
+
+                // stylefile
+                value = ConfParsedGetValue2(cfg, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "stylefile", &vallen);
+                if (value && vallen) {
+                    layerdata.stylefile = cstrbufDup(layerdata.stylefile, value, vallen);
+                }
+
+                // styleclass
+                value = ConfParsedGetValue2(cfg, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "styleclass", &vallen);
+                if (value && vallen) {
+                    layerdata.styleclass = cstrbufDup(layerdata.styleclass, value, vallen);
+                }
+
+                // proj4def: crs of shpfile
+                value = ConfParsedGetValue2(cfg, "layer", CBSTR(layerdata.layerid), CBSTRLEN(layerdata.layerid), "proj4def", &vallen);
+                if (value && vallen) {
+                    layerdata.proj4def = cstrbufDup(layerdata.proj4def, value, vallen);
                 }
+
+                // TODO: groups, states
+
+                MapLayersCfgAddLayer(maplayers, &layerdata);
             }
         }
     }
 
-    ConfSectionListFree(sections);
-    ConfVariablesClear(&vars);
+    ConfParsedFree(cfg);
 
     return MapLayersCfgGetLayers(maplayers);
 }
 
 
-static int load_maplayers_json(const char * jsonfile, shapetool_options* options, struct MapLayersCfg* maplayers)
+// "layer" 下的图层对象按 layerid 建哈希, 只建一次
+struct MapLayerJson {
+    UT_hash_handle hh;
+    const cJSON* item;
+};
+
+
+static cstrbuf maplayers_json_value(cstrbuf dst, const cJSON* obj, const char* key, const ConfVariables* vars)
 {
-    filehandle_t fh = file_open_read(jsonfile);
-    if (fh != filehandle_invalid) {
-        sb8 cb = file_size(fh);
-        if (cb > 0 && cb < 8192*1024) {
-            file_seek(fh, 0, fseek_pos_set);
-            cstrbuf jsonbuf = cstrbufNew((ub4)(cb + 1), 0, 0);
-            jsonbuf->len = file_readbytes(fh, jsonbuf->str, jsonbuf->maxsz);
-            if (jsonbuf->len < jsonbuf->maxsz) {
-                cJSON * json = cJSON_ParseWithLength(jsonbuf->str, jsonbuf->len);
-
-                if (!json) {
-                    const char* errstr = cJSON_GetErrorPtr();
-                    if (errstr) {
-                        fprintf(stderr, "Error before: %s\n", errstr);
-                    }
-                    cstrbufFree(&jsonbuf);
-                    file_close(&fh);
-                    return 0;
-                }
+    const char* str = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(obj, key));
+    if (str && *str) {
+        char* output = 0;
+        int outlen = ConfVariablesReplace(str, (int)strlen(str), vars, &output);
+        dst = cstrbufDup(dst, output, outlen);
+        ConfMemFree(output);
+    }
+    return dst;
+}
 
-                char * jsonstring = cJSON_Print(json);
-                printf("%s\n", jsonstring);
-                cJSON_free(jsonstring);
-
-                // parse json to maplayers
-                cJSON * envs = cJSON_GetObjectItemCaseSensitive(json, "environments");
-                if (envs) {
-                    cJSON* var = 0;
-                    cJSON_ArrayForEach(var, envs)
-                    {
-                        printf("%s: %s\n", var->string, cJSON_GetStringValue(var));
-                    }
+
+static void maplayers_json_add_layer(struct MapLayersCfg* maplayers, const char* layerid, int idlen, struct MapLayerJson* layerHash, const ConfVariables* vars)
+{
+    struct MapLayerJson* found = 0;
+
+    struct MapLayerData layerdata;
+    MapLayerDataInit(&layerdata);
+
+    layerdata.layerid = cstrbufDup(0, layerid, idlen);
+
+    HASH_FIND(hh, layerHash, layerid, idlen, found);
+    if (found) {
+        layerdata.shpfile = maplayers_json_value(layerdata.shpfile, found->item, "shpfile", vars);
+        layerdata.stylefile = maplayers_json_value(layerdata.stylefile, found->item, "stylefile", vars);
+        layerdata.styleclass = maplayers_json_value(layerdata.styleclass, found->item, "styleclass", vars);
+        layerdata.proj4def = maplayers_json_value(layerdata.proj4def, found->item, "proj4def", vars);
+
+        // TODO: groups, states
+    } else {
+        printf("Warn: layer not found: %.*s\n", idlen, layerid);
+    }
+
+    MapLayersCfgAddLayer(maplayers, &layerdata);
+}
+
+
+/**
+ * 与 .cfg 相同的结构:
+ * {
+ *   "environments": { "KEY": "value", ... },
+ *   "map": { "MAPID": { "description": "", "proj4def": "", "layers": ["id", ...] } },
+ *   "layer": { "id": { "shpfile": "$(KEY)/a.shp", "stylefile": "", "styleclass": "", "proj4def": "" }, ... }
+ * }
+ * "layers" 也可以是空格分隔的字符串.
+ */
+static int load_maplayers_json(const char * jsonfile, cstrbuf mapid, struct MapLayersCfg* maplayers, mem_arena_t* arena)
+{
+    filemap_t fm;
+    if (file_mmap_read(jsonfile, &fm) != 0) {
+        printf("Error: failed to open config: %s\n", jsonfile);
+        return 0;
+    }
+
+    cJSON* json = cJSON_ParseWithLength(fm.addr, (size_t)fm.size);
+    if (!json) {
+        const char* errstr = cJSON_GetErrorPtr();
+        if (errstr && errstr >= fm.addr && errstr < fm.addr + fm.size) {
+            printf("Error: bad json at offset %d: %s\n", (int)(errstr - fm.addr), jsonfile);
+        } else {
+            printf("Error: bad json: %s\n", jsonfile);
+        }
+        file_munmap(&fm);
+        return 0;
+    }
+
+    // 环境变量
+    ConfVariables vars = { 0 };
+    cJSON* var = 0;
+    cJSON_ArrayForEach(var, cJSON_GetObjectItemCaseSensitive(json, "environments"))
+    {
+        const char* value = cJSON_GetStringValue(var);
+        if (var->string && value) {
+            ConfVariablesAdd(&vars, var->string, (int)strlen(var->string), value, (int)strlen(value));
+        }
+    }
+    ConfVariablesResolve(&vars);
+
+    for (int i = 0; i < vars.count; i++) {
+        printf("<%.*s> : {%.*s}\n", vars.keylens[i], vars.keys[i], vars.valuelens[i], vars.values[i]);
+    }
+
+    // 读 map.MAPID
+    const cJSON* mapItem = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(json, "map"), CBSTR(mapid));
+    if (cJSON_IsObject(mapItem)) {
+        printf("[map:%.*s]\n", mapid->len, mapid->str);
+
+        maplayers->mapid = cstrbufDup(maplayers->mapid, mapid->str, mapid->len);
+        maplayers->description = maplayers_json_value(maplayers->description, mapItem, "description", &vars);
+        maplayers->proj4def = maplayers_json_value(maplayers->proj4def, mapItem, "proj4def", &vars);
+
+        struct MapLayerJson* layerHash = 0, * entries = 0, * entry;
+        int numEntries = 0;
+
+        const cJSON* layerRoot = cJSON_GetObjectItemCaseSensitive(json, "layer");
+        if (cJSON_IsObject(layerRoot)) {
+            cJSON_ArrayForEach(var, layerRoot) {
+                if (cJSON_IsObject(var) && var->string) {
+                    numEntries++;
                 }
+            }
+        }
 
-                // map
-                cJSON * maps = cJSON_GetObjectItemCaseSensitive(json, "map");
-                if (maps) {
-                    cJSON* mapItem = cJSON_GetObjectItemCaseSensitive(maps, CBSTR(options->mapid));
-                    if (mapItem) {
-                        cJSON *mDescription = cJSON_GetObjectItemCaseSensitive(mapItem, "description");
-                        cJSON *mProj4def = cJSON_GetObjectItemCaseSensitive(mapItem, "proj4def");
-                        cJSON *mLayers = cJSON_GetObjectItemCaseSensitive(mapItem, "layers");
-                        if (mLayers) {
-                            cJSON * layerid = 0;
-                            cJSON_ArrayForEach(layerid, mLayers)
-                            {
-                                printf("%s\n", layerid->valuestring);
-                                cJSON * layerRoot = cJSON_GetObjectItemCaseSensitive(json, "layer");
-                                if (layerRoot) {
-                                    cJSON* layerElt = cJSON_GetObjectItemCaseSensitive(layerRoot, cJSON_GetStringValue(layerid));
-                                    if (layerElt) {
-                                        cJSON* shpfile = cJSON_GetObjectItemCaseSensitive(layerElt, "shpfile");
-                                        cJSON* groups = cJSON_GetObjectItemCaseSensitive(layerElt, "groups");
-                                        cJSON* states = cJSON_GetObjectItemCaseSensitive(layerElt, "states");
-
-                                        if (shpfile) {
-                                            printf("%s: %s\n", shpfile->string, cJSON_GetStringValue(shpfile));
-                                        }
-                                        if (groups) {
-
-                                        }
-                                        if (states) {
-                                        }
-                                    }
-                                }
-                            }
-                        }
+        if (numEntries) {
+            entries = (struct MapLayerJson*)mem_arena_alloc_zero(arena, numEntries, sizeof(struct MapLayerJson));
+
+            numEntries = 0;
+            cJSON_ArrayForEach(var, layerRoot) {
+                if (cJSON_IsObject(var) && var->string) {
+                    // 重复的 layerid 以第一个为准 (同 .cfg)
+                    entry = 0;
+                    HASH_FIND_STR(layerHash, var->string, entry);
+                    if (!entry) {
+                        entry = &entries[numEntries++];
+                        entry->item = var;
+                        HASH_ADD_KEYPTR(hh, layerHash, var->string, strlen(var->string), entry);
                     }
                 }
+            }
+        }
 
-                cJSON_Delete(json);
+        const cJSON* mLayers = cJSON_GetObjectItemCaseSensitive(mapItem, "layers");
+        if (cJSON_IsArray(mLayers)) {
+            const cJSON* layerid = 0;
+            cJSON_ArrayForEach(layerid, mLayers) {
+                const char* id = cJSON_GetStringValue(layerid);
+                if (id && *id && MapLayersCfgGetLayers(maplayers) < SHAPETOOL_LAYERS_MAX) {
+                    maplayers_json_add_layer(maplayers, id, (int)strlen(id), layerHash, &vars);
+                }
+            }
+        } else if (cJSON_IsString(mLayers)) {
+            char* layerids[SHAPETOOL_LAYERS_MAX];
+            int idlens[SHAPETOOL_LAYERS_MAX];
+
+            int layers = cstr_slpit_chr_nodup(mLayers->valuestring, (int)strlen(mLayers->valuestring), 32, layerids, idlens, sizeof(idlens) / sizeof(idlens[0]));
+            for (int k = 0; k < layers; k++) {
+                if (idlens[k]) {
+                    maplayers_json_add_layer(maplayers, layerids[k], idlens[k], layerHash, &vars);
+                }
             }
-            cstrbufFree(&jsonbuf);
         }
-        file_close(&fh);
+
+        HASH_CLEAR(hh, layerHash);
     }
 
-    return 0;
+    ConfVariablesClear(&vars);
+    cJSON_Delete(json);
+    file_munmap(&fm);
+
+    return MapLayersCfgGetLayers(maplayers);
 }
 
 
-int maplayers2png(shapetool_flags *flags, shapetool_options *options)
+int load_maplayers_file(const char * layersfile, cstrbuf mapid, struct MapLayersCfg* maplayers)
 {
-    struct MapLayersCfg maplayers;
-    MapLayersCfgInit(&maplayers);
+    int layers;
 
-    int layers = 0;
+    // 读配置时的临时块在线程的 arena 上, 读完收回
+    mem_arena_t* arena = mem_arena_default();
+    mem_arena_mark_t mark;
+    mem_arena_mark(arena, &mark);
 
-    if (cstr_endwith(CBSTR(options->maplayers), CBSTRLEN(options->maplayers), ".cfg", 4)) {
-        layers = load_maplayers_cfg(CBSTR(options->maplayers), options, &maplayers);
+    if (cstr_endwith(layersfile, (int)strlen(layersfile), ".cfg", 4)) {
+        layers = load_maplayers_cfg(layersfile, mapid, maplayers, arena);
     }
     else {
-        layers = load_maplayers_json(CBSTR(options->maplayers), options, &maplayers);
+        layers = load_maplayers_json(layersfile, mapid, maplayers, arena);
     }
 
+    mem_arena_rewind(arena, &mark);
+    return layers;
+}
+
+
+int maplayers2png(shapetool_flags *flags, shapetool_options *options)
+{
+    struct MapLayersCfg maplayers;
+    MapLayersCfgInit(&maplayers);
+
+    int layers = load_maplayers_file(CBSTR(options->maplayers), options->mapid, &maplayers);
+
     if (layers > 0) {
         MapLayersCfgPrint(&maplayers);
     }
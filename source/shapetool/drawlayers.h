@@ -43,6 +43,10 @@ extern "C" {
 #include "shapetool-common.h"
 
 
+// load layers of [map:MAPID] from maplayers file (.cfg or .json). returns number of layers
+int load_maplayers_file(const char * layersfile, cstrbuf mapid, struct MapLayersCfg* maplayers);
+
+
 
 
 
@@ -36,16 +36,45 @@
  *
  */
 #include "drawshape.h"
+#include "shapeproj.h"
+
+
+static void shpfile2pngClose(shapeFileInfo *shpInfo, shapeFileEntry *shpEntry, shapeProjEntry *projEntry)
+{
+    if (shpEntry) {
+        shapeProjCacheRelease(projEntry);
+        shapeProjCacheTrim();
+        shapeFileCacheRelease(shpEntry);
+        shapeFileCacheTrim();
+    } else {
+        shapeFileInfoClose(shpInfo);
+    }
+}
 
 
 int shpfile2png(shapetool_flags *flags, shapetool_options *options)
 {
     shapeFileInfo shpInfo;
+    shapeFileInfo *pInfo = &shpInfo;
     cairoDrawCtx CDC;
     cairo_status_t status;
 
+    // reprojected shapes: --srcproj, --proj4def
+    shapeFileEntry *shpEntry = 0;
+    shapeProjEntry *projEntry = 0;
+
     // load shp file: file:///path/to/some.shp
-    if (shapeFileInfoOpen(&shpInfo, CBSTR(options->shpfile)) != 0) {
+    if (flags->srcproj && flags->proj4def) {
+        // 变换后的外接矩形和 MBR 树在缓存条目上
+        shpEntry = shapeFileCacheAcquire(CBSTR(options->shpfile));
+        if (! shpEntry) {
+            return SHAPETOOL_RES_ERR;
+        }
+        pInfo = &shpEntry->shpInfo;
+
+        projEntry = shapeProjCacheAcquire(shpEntry, CBSTR(options->srcproj), CBSTR(options->proj4def));
+        printf("Info: crs: %s => %s%s\n", CBSTR(options->srcproj), CBSTR(options->proj4def), projEntry? "" : " (not reprojected)");
+    } else if (shapeFileInfoOpen(&shpInfo, CBSTR(options->shpfile)) != 0) {
         return SHAPETOOL_RES_ERR;
     }
 
@@ -54,13 +83,13 @@ int shpfile2png(shapetool_flags *flags, shapetool_options *options)
         // if css file provided, check css class
         if (!flags->styleclass) {
             // if not class given , set default class name by type of shape
-            if (shpInfo.nShpTypeMask == SHAPE_TYPE_POLYGON) {
+            if (pInfo->nShpTypeMask == SHAPE_TYPE_POLYGON) {
                 options->styleclass = cstrbufDup(options->styleclass, ".polygon", 8);
             }
-            else if (shpInfo.nShpTypeMask == SHAPE_TYPE_LINE) {
+            else if (pInfo->nShpTypeMask == SHAPE_TYPE_LINE) {
                 options->styleclass = cstrbufDup(options->styleclass, ".line", 5);
             }
-            else if (shpInfo.nShpTypeMask == SHAPE_TYPE_POINT) {
+            else if (pInfo->nShpTypeMask == SHAPE_TYPE_POINT) {
                 options->styleclass = cstrbufDup(options->styleclass, ".point", 6);
             }
             flags->styleclass = 1;
@@ -69,18 +98,21 @@ int shpfile2png(shapetool_flags *flags, shapetool_options *options)
 
     // create cairo draw context
     CGBox2D dataBox = {
-        .Xmin = shpInfo.minBounds[0],
-        .Ymin = shpInfo.minBounds[1],
-        .Xmax = shpInfo.maxBounds[0],
-        .Ymax = shpInfo.maxBounds[1]
+        .Xmin = pInfo->minBounds[0],
+        .Ymin = pInfo->minBounds[1],
+        .Xmax = pInfo->maxBounds[0],
+        .Ymax = pInfo->maxBounds[1]
     };
+    if (projEntry) {
+        dataBox = projEntry->dataBox;
+    }
     CGSize2D viewSize = {
         .W = options->width,
         .H = options->height
     };
 
     if (cairoDrawCtxInit(&CDC, dataBox, viewSize, dot_logical_px, (float)options->dpi)) {
-        shapeFileInfoClose(&shpInfo);
+        shpfile2pngClose(pInfo, shpEntry, projEntry);
         exit(1);
     }
 
@@ -90,13 +122,20 @@ int shpfile2png(shapetool_flags *flags, shapetool_options *options)
     }
 
     // draw shapes onto cairo
-    shapeFileInfoDraw(&shpInfo, &CDC);
+    drawJob job;
+    drawJobInit(&job, options->timeout_ms, 0);
+
+    if ((projEntry? shapeProjEntryDrawJob(projEntry, &CDC, &job) : shapeFileInfoDrawJob(pInfo, &CDC, &job)) == draw_job_timedout) {
+        printf("Warn: draw timed out after %d ms: %d shapes drawn\n", options->timeout_ms, job.numDrawn);
+    } else {
+        printf("Info: %d shapes drawn\n", job.numDrawn);
+    }
 
     status = cairoDrawCtxOutputPng(&CDC, 0, CBSTR(options->outpng));
 
     cairoDrawCtxFinal(&CDC);
 
-    shapeFileInfoClose(&shpInfo);
+    shpfile2pngClose(pInfo, shpEntry, projEntry);
 
     if (status != CAIRO_STATUS_SUCCESS) {
         return SHAPETOOL_RES_ERR;
@@ -106,32 +145,134 @@ int shpfile2png(shapetool_flags *flags, shapetool_options *options)
 }
 
 
-void drawPolygonShape(const SHPObjectEx* hShpRef, cairoDrawCtx* cdc)
+// 部分的视图坐标, 去掉与前一点距离小于 tolerance 的点. 返回点数
+static int drawViewPoints(const Viewport2D* vwp, const double* points, int npp, double tolerance, double* xy)
 {
-    int i, part, cnt;
+    int i, n = 1;
+
+    DataToViewXY(vwp, points[0], points[1], &xy[0], &xy[1]);
+
+    for (i = 1; i < npp; i++) {
+        double* pt = &xy[2 * n];
+
+        DataToViewXY(vwp, points[2 * i], points[2 * i + 1], &pt[0], &pt[1]);
+
+        if (CGPointNotEqual(pt[0], pt[1], pt[-2], pt[-1], tolerance)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+
+/**
+ * 图形超出裁剪框时 (深度放大), 各部分先裁剪到裁剪框再生成路径,
+ * cairo 不再光栅化画布外的巨大路径. 裁剪结果在线程的 arena 上, 生成路径后收回.
+ * 返回生成的路径部分数
+ */
+static int drawClippedParts(const SHPGeomView* shapeView, cairoDrawCtx* cdc, const CGBox2D* clipBox, int isLine, double tolerance)
+{
+    int i, part, maxPoints = 0;
+    double* xy = 0;
+
+    cairo_t* cr = cdc->cr;
+
+    ClipPath clip;
+    mem_arena_t* arena = mem_arena_default();
+    mem_arena_mark_t mark;
+
+    mem_arena_mark(arena, &mark);
+    ClipPathInit(&clip, arena);
+
+    for (part = 0; part < shapeView->nParts; part++) {
+        int start = shapeView->panPartStart[part];
+        int npp = (part + 1 < shapeView->nParts? shapeView->panPartStart[part + 1] : shapeView->nVertices) - start;
+
+        if (npp > 0) {
+            int n;
+
+            if (npp > maxPoints) {
+                maxPoints = npp;
+                xy = (double*) mem_arena_alloc(arena, sizeof(double) * 2 * maxPoints);
+            }
+
+            n = drawViewPoints(&cdc->viewport, &shapeView->padfXY[start * 2], npp, tolerance, xy);
+
+            if (isLine) {
+                ClipPathAddLine(&clip, clipBox, xy, n);
+            } else {
+                ClipPathAddRing(&clip, clipBox, xy, n);
+            }
+        }
+    }
+
+    for (part = 0; part < clip.numParts; part++) {
+        const double* pt = &clip.points[2 * clip.partStart[part]];
+        int n = clip.partStart[part + 1] - clip.partStart[part];
+
+        if (part == 0) {
+            cairo_new_path(cr);
+        } else {
+            cairo_new_sub_path(cr);
+        }
+
+        cairo_move_to(cr, pt[0], pt[1]);
+        for (i = 1; i < n; i++) {
+            cairo_line_to(cr, pt[2 * i], pt[2 * i + 1]);
+        }
+
+        if (! isLine) {
+            cairo_close_path(cr);
+        }
+    }
+
+    part = clip.numParts;
+    mem_arena_rewind(arena, &mark);
+    return part;
+}
+
+
+/**
+ * 生成图形的路径: 多边形的环闭合, 线不闭合. 图形在裁剪框内时直接生成.
+ * 返回生成的路径部分数
+ */
+static int drawShapeParts(const SHPGeomView* shapeView, cairoDrawCtx* cdc, int isLine, double tolerance)
+{
+    int i, part;
     double X0, Y0, X, Y;
 
-    SHPPointType* points, * ppt;
+    const double* points, * ppt;
 
     cairo_t* cr = cdc->cr;
     Viewport2D* vwp = &(cdc->viewport);
 
-    ///CssPolygonStyle * polygon = &cdc->polygonStyle;
+    if (! cdc->noClip) {
+        CGBox2D clipBox, shapeBox;
+        CGBox2D dataBox = {
+            .Xmin = shapeView->dfXMin,
+            .Ymin = shapeView->dfYMin,
+            .Xmax = shapeView->dfXMax,
+            .Ymax = shapeView->dfYMax
+        };
 
-    cairo_save(cr);
+        cairoDrawCtxGetClipBox(cdc, &clipBox);
+        DataToViewBox(vwp, dataBox, &shapeBox);
 
-    for (part = 0; part < hShpRef->nParts; part++) {
-        /* start index of points of current part */
-        int start = hShpRef->panPartStart[part];
+        if (! CGBoxIsInside(shapeBox, clipBox)) {
+            return drawClippedParts(shapeView, cdc, &clipBox, isLine, tolerance);
+        }
+    }
 
-        /* type of current part */
-        int parttype = hShpRef->panPartType[part];
+    for (part = 0; part < shapeView->nParts; part++) {
+        /* start index of points of current part */
+        int start = shapeView->panPartStart[part];
 
         /* number of points of part */
-        int npp = hShpRef->panPartStart[part + 1] - start;
+        int npp = (part + 1 < shapeView->nParts? shapeView->panPartStart[part + 1] : shapeView->nVertices) - start;
 
         if (npp > 0) {
-            points = &hShpRef->pPoints[start];
+            /* x, y pairs in record */
+            points = &shapeView->padfXY[start * 2];
 
             if (part == 0) {
                 /* first part as contour path */
@@ -142,41 +283,78 @@ void drawPolygonShape(const SHPObjectEx* hShpRef, cairoDrawCtx* cdc)
                 cairo_new_sub_path(cr);
             }
 
-            i = cnt = 0;
-            ppt = &points[i++];
+            i = 0;
+            ppt = &points[2 * i++];
 
-            DataToViewXY(vwp, ppt->x, ppt->y, &X0, &Y0);
+            DataToViewXY(vwp, ppt[0], ppt[1], &X0, &Y0);
 
             cairo_move_to(cr, X0, Y0);
 
             while (i < npp) {
-                ppt = &points[i++];
+                ppt = &points[2 * i++];
 
-                DataToViewXY(vwp, ppt->x, ppt->y, &X, &Y);
+                DataToViewXY(vwp, ppt[0], ppt[1], &X, &Y);
 
-                if (CGPointNotEqual(X, Y, X0, Y0, 0.5)) {
+                if (CGPointNotEqual(X, Y, X0, Y0, tolerance)) {
                     cairo_line_to(cr, X, Y);
                     X0 = X;
                     Y0 = Y;
                 }
             }
 
-            cairo_close_path(cr);
+            if (! isLine) {
+                cairo_close_path(cr);
+            }
         }
         else {
             // empty path
         }
     }
 
-    if (part) {
-        // success returns 0
-        /// cairo_set_source_rgb(cr, polygon->fill_color.red, polygon->fill_color.green, polygon->fill_color.blue);
-        cairo_set_source_rgb(cr, 128, 0, 128);
-        cairo_fill_preserve(cr);
+    return part;
+}
+
+
+// 边框或线的颜色, 线宽和线型. 返回 0 不画边框
+static int drawSetBorder(cairo_t* cr, const CssDrawStyle* style)
+{
+    if (style->border_style == CSS_BORDER_NONE || style->border_width <= 0) {
+        return 0;
+    }
+
+    cairo_set_source_rgb(cr, style->border_color.red, style->border_color.green, style->border_color.blue);
+    cairo_set_line_width(cr, style->border_width);
+
+    if (style->border_style == CSS_BORDER_DASHED) {
+        double dashes[2] = {4.0 * style->border_width, 2.0 * style->border_width};
+        cairo_set_dash(cr, dashes, 2, 0);
+    }
+    return 1;
+}
+
+
+void drawPolygonShape(const SHPGeomView* shapeView, cairoDrawCtx* cdc)
+{
+    cairo_t* cr = cdc->cr;
+    const CssDrawStyle* style = &cdc->drawStyles;
+
+    int coarse = cairoDrawCtxIsCoarse(cdc);
+    double tolerance = coarse? CAIRO_COARSE_TOLERANCE : 0.5;
+
+    cairo_save(cr);
+
+    if (drawShapeParts(shapeView, cdc, 0, tolerance)) {
+        if (style->fill_style != CSS_FILL_NONE && style->fill_opacity > 0) {
+            cairo_set_source_rgba(cr, style->fill_color.red, style->fill_color.green, style->fill_color.blue, style->fill_opacity / 100.0);
+            cairo_fill_preserve(cr);
+        }
 
-        ///cairo_set_source_rgb(cr, polygon->border_color.red, polygon->border_color.green, polygon->border_color.blue);
-        cairo_set_source_rgb(cr, 0, 160, 35);
-        cairo_stroke(cr);
+        // no border when coarse
+        if (! coarse && drawSetBorder(cr, style)) {
+            cairo_stroke(cr);
+        } else {
+            cairo_new_path(cr);
+        }
     }
     else {
         // empty shape
@@ -184,3 +362,39 @@ void drawPolygonShape(const SHPObjectEx* hShpRef, cairoDrawCtx* cdc)
 
     cairo_restore(cr);
 }
+
+
+void drawLineShape(const SHPGeomView* shapeView, cairoDrawCtx* cdc)
+{
+    cairo_t* cr = cdc->cr;
+
+    double tolerance = cairoDrawCtxIsCoarse(cdc)? CAIRO_COARSE_TOLERANCE : 0.5;
+
+    cairo_save(cr);
+
+    // lines are drawn with border of style
+    if (drawShapeParts(shapeView, cdc, 1, tolerance)) {
+        if (drawSetBorder(cr, &cdc->drawStyles)) {
+            cairo_stroke(cr);
+        } else {
+            cairo_new_path(cr);
+        }
+    }
+
+    cairo_restore(cr);
+}
+
+
+void drawShapeView(const SHPGeomView* shapeView, cairoDrawCtx* cdc)
+{
+    switch (shapeView->nSHPType) {
+    case SHPT_ARC:
+    case SHPT_ARCZ:
+    case SHPT_ARCM:
+        drawLineShape(shapeView, cdc);
+        break;
+    default:
+        drawPolygonShape(shapeView, cdc);
+        break;
+    }
+}
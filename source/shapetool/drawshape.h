@@ -51,6 +51,41 @@ extern "C" {
 
 #include "shapetool-common.h"
 
+#include <common/timeut.h>
+#include <common/uatomic.h>
+
+
+// 每画多少个图形检查一次取消和超时
+#define DRAW_JOB_CHECK_SHAPES    256
+
+
+typedef enum
+{
+    draw_job_completed = 0,
+    draw_job_cancelled = 1,
+    draw_job_timedout = 2
+} drawJobStatus;
+
+
+/**
+ * 绘制任务: shapeFileInfoDrawJob 每画 checkShapes 个图形检查一次取消标志和截止时间.
+ * 一个任务可以依次画多个图层, 停止后不再画. 任何线程都可以调用 drawJobCancel.
+ */
+typedef struct
+{
+    uatomic_int cancel;
+
+    // 0 for no deadline
+    int timeoutMs;
+    struct timespec startTime;
+
+    int checkShapes;
+
+    // result
+    drawJobStatus status;
+    int numDrawn;
+} drawJob;
+
 
 typedef struct
 {
@@ -68,11 +103,23 @@ typedef struct
     int hasZ;
     int hasM;
 
+    // 1: envelopes of shapes in SHPMBRTree (shapeFileInfoBuildMBRTree)
+    int hasMBRTree;
+
+    // envelope of each shape, XMin > XMax for SHPT_NULL.
+    // NULL if not read (shapeFileCacheAcquire reads them)
+    SHPEnvelope *envelopes;
+
     char shapefile[256];
 } shapeFileInfo;
 
 
-void drawPolygonShape(const SHPObjectEx *hShpRef, cairoDrawCtx *cdc);
+void drawPolygonShape(const SHPGeomView *shapeView, cairoDrawCtx *cdc);
+
+void drawLineShape(const SHPGeomView *shapeView, cairoDrawCtx *cdc);
+
+// lines (SHPT_ARC*) by drawLineShape, others by drawPolygonShape
+void drawShapeView(const SHPGeomView *shapeView, cairoDrawCtx *cdc);
 
 
 static void shapeFileInfoClose(shapeFileInfo *shpInfo)
@@ -112,48 +159,268 @@ static int shapeFileInfoOpen(shapeFileInfo *shpInfo, const char *shapefile)
 }
 
 
-static void shapeFileInfoDraw(shapeFileInfo *shpInfo, cairoDrawCtx *CDC)
+static void drawJobInit(drawJob *job, int timeoutMs, int checkShapes)
+{
+    bzero(job, sizeof(drawJob));
+    job->timeoutMs = timeoutMs;
+    job->checkShapes = (checkShapes > 0? checkShapes : DRAW_JOB_CHECK_SHAPES);
+    getnowtimeofday(&job->startTime);
+    uatomic_int_zero(&job->cancel);
+}
+
+
+static void drawJobCancel(drawJob *job)
+{
+    uatomic_int_set(&job->cancel, 1);
+}
+
+
+// returns draw_job_completed to go on drawing
+static drawJobStatus drawJobCheck(drawJob *job)
+{
+    if (job->status == draw_job_completed) {
+        if (uatomic_int_get(&job->cancel)) {
+            job->status = draw_job_cancelled;
+        } else if (job->timeoutMs > 0) {
+            struct timespec now;
+            getnowtimeofday(&now);
+            if (difftime_msec(&job->startTime, &now) >= job->timeoutMs) {
+                job->status = draw_job_timedout;
+            }
+        }
+    }
+    return job->status;
+}
+
+
+/**
+ * 读所有图形的外接矩形建立 MBR 树. 之后 shapeFileInfoDraw 只读取和视口相交的图形.
+ * 树中保存 shapeId + 1 (RTree 不接受 NULL)
+ */
+static int shapeFileInfoBuildMBRTree(shapeFileInfo *shpInfo)
 {
     int nShapeId;
+    SHPEnvelope shapeEnv;
+    SHPMBRTree mbrTree;
+
+    SHPMBRTreeReset(shpInfo->hSHP, 0);
+    mbrTree = SHPGetMBRTree(shpInfo->hSHP);
+
+    for (nShapeId = 0; nShapeId < shpInfo->nEntities; nShapeId++) {
+        if (shpInfo->envelopes) {
+            shapeEnv = shpInfo->envelopes[nShapeId];
+            if (shapeEnv.XMin > shapeEnv.XMax) {
+                continue;
+            }
+        } else if (SHPReadObjectEnvelope(shpInfo->hSHP, nShapeId, &shapeEnv, 0) == SHPT_NULL) {
+            continue;
+        }
+        SHPMBRTreeAddShape(mbrTree, &shapeEnv, (void *) (uintptr_t) (nShapeId + 1), 0);
+    }
+
+    shpInfo->hasMBRTree = 1;
+    return 0;
+}
 
-    CGBox2D shapeEnv;   // data rect
+
+// returns 1 if shape of envelope shapeEnv would be drawn in view of CDC
+static int shapeFileInfoShapeVisible(const shapeFileInfo *shpInfo, const SHPEnvelope *shapeEnv, const cairoDrawCtx *CDC)
+{
     CGBox2D drawRect;    // draw rect
 
-    SHPObjectEx * shapeReadRef = 0;
-    if (! SHPCreateObjectEx(&shapeReadRef)) {
-        // out of memory
-        abort();
+    // convert to canvas box
+    DataToViewBox(&CDC->viewport, *((const CGBox2D *) shapeEnv), &drawRect);
+
+    if (shpInfo->nShpTypeMask == SHAPE_TYPE_LINE) {
+        // horizontal or vertical lines have zero height or width box
+        return CGBoxIsTouched(CDC->viewport.viewBox, drawRect);
     }
 
-    int nShpTypeMask = shpInfo->nShpTypeMask;
+    // test if overlapped of canvas with shape
+    if (CGBoxIsOverlap(CDC->viewport.viewBox, drawRect)) {
+        if (shpInfo->nShpTypeMask == SHAPE_TYPE_POLYGON) {
+            return (CGBoxGetDX(drawRect) > 0 && CGBoxGetDY(drawRect) > 0);
+        } else if (shpInfo->nShpTypeMask == SHAPE_TYPE_POINT) {
 
-    for (nShapeId = 0; nShapeId < shpInfo->nEntities; nShapeId++) {
-        // read bounding rect of shape
-        if (SHPReadObjectEnvelope(shpInfo->hSHP, nShapeId, (SHPEnvelope *) &shapeEnv, 0) != SHPT_NULL) {
-            // convert to canvas box
-            DataToViewBox(&CDC->viewport, shapeEnv, &drawRect);
-
-            // test if overlapped of canvas with shape
-            if (CGBoxIsOverlap(CDC->viewport.viewBox, drawRect)) {
-                if (nShpTypeMask == SHAPE_TYPE_POLYGON) {
-                    if (CGBoxGetDX(drawRect) > 0 && CGBoxGetDY(drawRect) > 0) {
-                        // polygon shape is visible
-                        if (SHPReadObjectEx(shpInfo->hSHP, nShapeId, shapeReadRef)) {
-                            drawPolygonShape(shapeReadRef, CDC);
-                        } else {
-                            printf("Warn: SHPReadObjectEx() failed on shape#%d\n", nShapeId);
-                        }
-                    }
-                } else if (nShpTypeMask == SHAPE_TYPE_LINE) {
-
-                } else if (nShpTypeMask == SHAPE_TYPE_POINT) {
-
-                }
+        }
+    }
+    return 0;
+}
+
+
+// returns 1 if shape drawn. reads with readCtx, so threads can draw from one shpInfo
+static int shapeFileInfoDrawShape(shapeFileInfo *shpInfo, int nShapeId, SHPReadContext *readCtx, cairoDrawCtx *CDC)
+{
+    SHPEnvelope shapeEnv;   // data rect
+    SHPGeomView shapeView;  // record in readCtx
+
+    // read bounding rect of shape
+    if (shpInfo->envelopes) {
+        shapeEnv = shpInfo->envelopes[nShapeId];
+        if (shapeEnv.XMin > shapeEnv.XMax) {
+            return 0;
+        }
+    } else if (SHPReadObjectEnvelopeR(shpInfo->hSHP, readCtx, nShapeId, &shapeEnv, 0) == SHPT_NULL) {
+        return 0;
+    }
+
+    if (shapeFileInfoShapeVisible(shpInfo, &shapeEnv, CDC)) {
+        // polygon shape is visible
+        if (SHPReadGeomViewR(shpInfo->hSHP, readCtx, nShapeId, &shapeView)) {
+            drawShapeView(&shapeView, CDC);
+            return 1;
+        } else {
+            printf("Warn: SHPReadGeomViewR() failed on shape#%d\n", nShapeId);
+        }
+    }
+    return 0;
+}
+
+
+typedef struct
+{
+    mem_arena_t *arena;
+    int *shapeIds;
+    int count;
+    int capacity;
+} shapeIdList;
+
+
+static int shapeIdListOnSearch(void *shapeData, void *userParam)
+{
+    shapeIdList *list = (shapeIdList *) userParam;
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity? list->capacity * 2 : 256;
+        list->shapeIds = (int *) mem_arena_realloc(list->arena, list->shapeIds, sizeof(int) * list->count, sizeof(int) * list->capacity);
+    }
+    list->shapeIds[list->count++] = (int) (uintptr_t) shapeData - 1;
+
+    // continue search
+    return 1;
+}
+
+
+static int shapeIdCmp(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+
+typedef struct
+{
+    cairoDrawCtx *CDC;
+    drawJob *job;
+    int numDrawn;
+} shapeFetchDraw;
+
+
+static int shapeFetchDrawOnShape(const SHPGeomView *shapeView, void *userParam)
+{
+    shapeFetchDraw *fetch = (shapeFetchDraw *) userParam;
+    drawJob *job = fetch->job;
+
+    if (job && fetch->numDrawn % job->checkShapes == 0 && fetch->numDrawn && drawJobCheck(job) != draw_job_completed) {
+        // stop fetching
+        return 0;
+    }
+
+    drawShapeView(shapeView, fetch->CDC);
+    fetch->numDrawn++;
+    return 1;
+}
+
+
+/**
+ * shapeFileInfoDrawJob
+ *   draw shapes of layer in view of CDC. stops when job is cancelled or timed out.
+ *   job: NULL to draw all. adds number of shapes drawn to job->numDrawn
+ * Returns:
+ *   job->status, draw_job_completed if job is NULL
+ */
+static drawJobStatus shapeFileInfoDrawJob(shapeFileInfo *shpInfo, cairoDrawCtx *CDC, drawJob *job)
+{
+    int i, count, numDrawn = 0;
+    int checkShapes = (job? job->checkShapes : 0);
+    int *shapeIds = 0;
+
+    // 图形 id 和读记录的缓冲都在线程的 arena 上, 画完一起收回
+    mem_arena_t *arena = mem_arena_default();
+    mem_arena_mark_t mark;
+
+    SHPReadContext readCtx;
+
+    if (job && drawJobCheck(job) != draw_job_completed) {
+        return job->status;
+    }
+
+    mem_arena_mark(arena, &mark);
+
+    SHPReadContextInit(&readCtx);
+    readCtx.pArena = arena;
+
+    if (shpInfo->hasMBRTree) {
+        CGBox2D viewData;
+        shapeIdList list = {arena, 0, 0, 0};
+
+        ViewToDataBox(&CDC->viewport, CDC->viewport.viewBox, &viewData);
+
+        SHPMBRTreeSearch(SHPGetMBRTree(shpInfo->hSHP), (const SHPEnvelope *) &viewData, shapeIdListOnSearch, &list);
+
+        // draw in order of shapes as without MBRTree
+        if (list.count > 1) {
+            qsort(list.shapeIds, list.count, sizeof(int), shapeIdCmp);
+        }
+
+        shapeIds = list.shapeIds;
+        count = list.count;
+    } else {
+        count = shpInfo->nEntities;
+    }
+
+    if (shpInfo->envelopes) {
+        // 外接矩形已在内存: 先选出要画的图形, 再按文件位置合并读取
+        shapeFetchDraw fetch = {CDC, job, 0};
+        int numVisible = 0;
+
+        if (! shapeIds) {
+            shapeIds = (int *) mem_arena_alloc(arena, sizeof(int) * (count + 1));
+            for (i = 0; i < count; i++) {
+                shapeIds[i] = i;
+            }
+        }
+        for (i = 0; i < count; i++) {
+            const SHPEnvelope *shapeEnv = &shpInfo->envelopes[shapeIds[i]];
+            if (shapeEnv->XMin <= shapeEnv->XMax && shapeFileInfoShapeVisible(shpInfo, shapeEnv, CDC)) {
+                shapeIds[numVisible++] = shapeIds[i];
+            }
+        }
+
+        SHPFetchGeomViews(shpInfo->hSHP, &readCtx, shapeIds, numVisible, shapeFetchDrawOnShape, &fetch);
+        numDrawn = fetch.numDrawn;
+    } else {
+        for (i = 0; i < count; i++) {
+            if (checkShapes && i % checkShapes == 0 && i && drawJobCheck(job) != draw_job_completed) {
+                break;
             }
+            numDrawn += shapeFileInfoDrawShape(shpInfo, (shapeIds? shapeIds[i] : i), &readCtx, CDC);
         }
     }
 
-    SHPDestroyObjectEx(shapeReadRef);
+    SHPReadContextFinal(&readCtx);
+    mem_arena_rewind(arena, &mark);
+
+    if (job) {
+        job->numDrawn += numDrawn;
+        return job->status;
+    }
+    return draw_job_completed;
+}
+
+
+static void shapeFileInfoDraw(shapeFileInfo *shpInfo, cairoDrawCtx *CDC)
+{
+    shapeFileInfoDrawJob(shpInfo, CDC, 0);
 }
 
 
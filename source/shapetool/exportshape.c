@@ -0,0 +1,157 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file exportshape.c
+ * @brief export shapes of shapefile into WKB or WKT file.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-20 14:05:12
+ * @date 2024-11-20 14:05:12
+ *
+ * @note
+ *   .wkb: 每个图形为 4 字节 (little-endian) 长度 + WKB, 空图形长度为 0
+ *   .wkt: 每个图形一行 WKT, 空图形为空行
+ */
+#include "shapetool-common.h"
+
+#include <shapefile/shapefile_api.h>
+#include <common/crsproj.h>
+#include <common/timeut.h>
+
+
+#define EXPORT_DECIMALS_XY   8
+#define EXPORT_DECIMALS_ZM   3
+
+#define EXPORT_FILE_BUFSIZE  1048576
+
+
+typedef struct {
+    FILE *fp;
+    int format;
+    int64_t bytes;
+} export_ctx;
+
+
+static int onExportShape(int shapeId, const void *data, int cbData, void *userParam)
+{
+    export_ctx *ctx = (export_ctx *) userParam;
+
+    if (ctx->format == SHP_EXPORT_WKB) {
+        unsigned char len[4];
+
+        len[0] = (unsigned char) (cbData & 0xff);
+        len[1] = (unsigned char) ((cbData >> 8) & 0xff);
+        len[2] = (unsigned char) ((cbData >> 16) & 0xff);
+        len[3] = (unsigned char) ((cbData >> 24) & 0xff);
+
+        if (fwrite(len, 4, 1, ctx->fp) != 1) {
+            printf("Error: write shape#%d failed\n", shapeId);
+            return 0;
+        }
+        ctx->bytes += 4;
+    }
+
+    if (cbData > 0 && fwrite(data, cbData, 1, ctx->fp) != 1) {
+        printf("Error: write shape#%d failed\n", shapeId);
+        return 0;
+    }
+    ctx->bytes += cbData;
+
+    if (ctx->format == SHP_EXPORT_WKT) {
+        fputc('\n', ctx->fp);
+        ctx->bytes++;
+    }
+
+    return 1;
+}
+
+
+static void onTransformXY(double *xy, int count, void *userParam)
+{
+    CRSTransformPoints((CRSTransform *) userParam, xy, count);
+}
+
+
+/**
+ * 按记录顺序导出全部图形. --threads N (N > 1): 读, 转换, 写流水线,
+ * 输出与单线程完全相同.
+ */
+int shpfile2wkx(shapetool_flags* flags, shapetool_options* options)
+{
+    int numshapes, numexported;
+    struct timespec t0, t1;
+    SHPExportOptions exportOpts = { 0 };
+    export_ctx ctx = { 0 };
+    CRSTransform trans;
+
+    SHPHandle hSHP = SHPOpen(CBSTR(options->shpfile), "rb");
+    if (! hSHP) {
+        printf("Error: open shp file failed: %s\n", CBSTR(options->shpfile));
+        return SHAPETOOL_RES_ERR;
+    }
+
+    ctx.format = cstr_endwith(CBSTR(options->outfile), CBSTRLEN(options->outfile), ".wkt", 4)? SHP_EXPORT_WKT : SHP_EXPORT_WKB;
+    ctx.fp = fopen(CBSTR(options->outfile), "wb");
+    if (! ctx.fp) {
+        printf("Error: create file failed: %s\n", CBSTR(options->outfile));
+        SHPClose(hSHP);
+        return SHAPETOOL_RES_ERR;
+    }
+    setvbuf(ctx.fp, 0, _IOFBF, EXPORT_FILE_BUFSIZE);
+
+    exportOpts.nFormat = ctx.format;
+    exportOpts.nThreads = options->threads;
+    exportOpts.nDecimalsXY = EXPORT_DECIMALS_XY;
+    exportOpts.nDecimalsZ = EXPORT_DECIMALS_ZM;
+    exportOpts.nDecimalsM = EXPORT_DECIMALS_ZM;
+
+    // --srcproj, --proj4def: 导出前重投影每个图形的全部点
+    if (CRSTransformInit(&trans, flags->srcproj? CBSTR(options->srcproj) : 0, flags->proj4def? CBSTR(options->proj4def) : 0) != 0) {
+        printf("Warn: crs not reprojected: %s => %s\n", CBSTR(options->srcproj), CBSTR(options->proj4def));
+    }
+    if (! CRSTransformIsIdentity(&trans)) {
+        exportOpts.pfnTransformXY = onTransformXY;
+        exportOpts.pTransformData = &trans;
+    }
+
+    SHPGetInfo(hSHP, &numshapes, 0, 0, 0);
+
+    getnowtimeofday(&t0);
+    numexported = SHPExportShapes(hSHP, &exportOpts, onExportShape, &ctx);
+    getnowtimeofday(&t1);
+
+    fclose(ctx.fp);
+    SHPClose(hSHP);
+    CRSTransformFinal(&trans);
+
+    if (numexported != numshapes) {
+        printf("Error: %d of %d shapes exported\n", numexported, numshapes);
+        return SHAPETOOL_RES_ERR;
+    }
+
+    printf("Info: %d shapes (%lld bytes) exported in %.1f ms\n", numexported, (long long) ctx.bytes, (double) difftime_msec(&t0, &t1));
+    return SHAPETOOL_RES_SOK;
+}
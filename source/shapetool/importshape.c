@@ -0,0 +1,61 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file importshape.c
+ * @brief import shape file into geodb.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-03 18:40:22
+ * @date 2024-11-05 18:12:40
+ *
+ * @note
+ */
+#include "shapetool-common.h"
+
+#include <geodbapi/geodbapi.h>
+#include <common/timeut.h>
+
+
+int shpfile2geodb(shapetool_flags *flags, shapetool_options *options)
+{
+    int64_t layerid = 0;
+    struct timespec t0, t1;
+
+    getnowtimeofday(&t0);
+
+    if (geodb_import_shpfile(CBSTR(options->geodb), CBSTR(options->shpfile), 0,
+            options->index_rtree? geodb_index_rtree : geodb_index_grid,
+            options->level_min, options->level_max, 0, &layerid) != GEODB_RES_SOK) {
+        printf("Error: import failed: %s\n", CBSTR(options->shpfile));
+        return SHAPETOOL_RES_ERR;
+    }
+
+    getnowtimeofday(&t1);
+
+    printf("Info: import success: layer_id=%lld, elapsed %lld ms\n", (long long) layerid, (long long) difftime_msec(&t0, &t1));
+    return SHAPETOOL_RES_SOK;
+}
+
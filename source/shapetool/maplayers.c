@@ -98,6 +98,9 @@ void MapLayersCfgPrint(const struct MapLayersCfg* layersCfg)
         if (layer->styleclass) {
             printf("styleclass = %.*s\n", CBSTRLEN(layer->styleclass), CBSTR(layer->styleclass));
         }
+        if (layer->proj4def) {
+            printf("proj4def = %.*s\n", CBSTRLEN(layer->proj4def), CBSTR(layer->proj4def));
+        }
 
         /* TODO:
         if (layer->groups) {
@@ -54,6 +54,9 @@ struct MapLayerData {
     cstrbuf stylefile;
     cstrbuf styleclass;
 
+    // crs of shpfile, reprojected into proj4def of map. none: same as map
+    cstrbuf proj4def;
+
     // UT_hash_handle hh; /* makes this structure hashable */
 };
 
@@ -84,6 +87,7 @@ static void MapLayerDataCopy(void * _dst, const void * _src)
     dst->shpfile = src->shpfile;
     dst->stylefile = src->stylefile;
     dst->styleclass = src->styleclass;
+    dst->proj4def = src->proj4def;
 }
 
 
@@ -94,6 +98,7 @@ static void MapLayerDataDtor(void* _elt)
     cstrbufFree(&elt->shpfile);
     cstrbufFree(&elt->stylefile);
     cstrbufFree(&elt->styleclass);
+    cstrbufFree(&elt->proj4def);
 }
 
 
@@ -0,0 +1,228 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shapecache.c
+ * @brief process-wide cache of opened shape files.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-13 10:05:41
+ * @date 2024-11-13 18:22:09
+ *
+ * @note
+ */
+#include "shapecache.h"
+
+#include <sys/stat.h>
+
+
+static pthread_mutex_t shapeCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static shapeFileEntry *shapeCacheTable = NULL;
+
+
+static int shapeFileCachePath(const char *shapefile, char *path, size_t size)
+{
+#if defined(_MSC_VER)
+    return _fullpath(path, shapefile, size) != NULL;
+#else
+    char *real = realpath(shapefile, NULL);
+    if (! real) {
+        return 0;
+    }
+    if (strlen(real) >= size) {
+        free(real);
+        return 0;
+    }
+    strcpy(path, real);
+    free(real);
+    return 1;
+#endif
+}
+
+
+static void shapeFileCacheStat(const char *path, int64_t *mtime, int64_t *size)
+{
+#if defined(_MSC_VER)
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) {
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+#endif
+        *mtime = -1;
+        *size = -1;
+        return;
+    }
+
+#ifdef __LINUX__
+    *mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    *mtime = (int64_t) st.st_mtime;
+#endif
+    *size = (int64_t) st.st_size;
+}
+
+
+static void shapeFileEntryClose(shapeFileEntry *entry)
+{
+    shapeFileInfoClose(&entry->shpInfo);
+    mem_free(entry->shpInfo.envelopes);
+    mem_free(entry);
+}
+
+
+static shapeFileEntry * shapeFileEntryOpen(const char *path, int64_t mtime, int64_t size)
+{
+    SHPEnvelope *envelopes;
+    shapeFileEntry *entry = (shapeFileEntry *) mem_alloc_zero(1, sizeof(shapeFileEntry));
+
+    if (shapeFileInfoOpen(&entry->shpInfo, path) != 0) {
+        mem_free(entry);
+        return NULL;
+    }
+
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    snprintf(entry->shpInfo.shapefile, sizeof(entry->shpInfo.shapefile), "%s", path);
+    entry->mtime = mtime;
+    entry->size = size;
+
+    SHPGetRecordTable(entry->shpInfo.hSHP, &entry->recOffsets, &entry->recSizes);
+
+    // 外接矩形读一次, 之后画图和建树都不再读文件
+    envelopes = (SHPEnvelope *) mem_alloc_zero(entry->shpInfo.nEntities + 1, sizeof(SHPEnvelope));
+    SHPReadObjectEnvelopes(entry->shpInfo.hSHP, envelopes, 0);
+    entry->shpInfo.envelopes = envelopes;
+
+    shapeFileInfoBuildMBRTree(&entry->shpInfo);
+
+    return entry;
+}
+
+
+shapeFileEntry * shapeFileCacheAcquire(const char *shapefile)
+{
+    char path[256];
+    int64_t mtime, size;
+    shapeFileEntry *entry, *opened, *closing = NULL;
+
+    if (! shapeFileCachePath(shapefile, path, sizeof(path))) {
+        printf("Error: Cannot open shp file: %s\n", shapefile);
+        return NULL;
+    }
+    shapeFileCacheStat(path, &mtime, &size);
+
+    pthread_mutex_lock(&shapeCacheLock);
+    HASH_FIND_STR(shapeCacheTable, path, entry);
+    if (entry && entry->mtime == mtime && entry->size == size) {
+        entry->refcount++;
+        pthread_mutex_unlock(&shapeCacheLock);
+        return entry;
+    }
+    pthread_mutex_unlock(&shapeCacheLock);
+
+    // 打开大文件要读全部外接矩形, 不持有锁, 其他文件的 Acquire 不必等待
+    opened = shapeFileEntryOpen(path, mtime, size);
+    if (! opened) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&shapeCacheLock);
+    HASH_FIND_STR(shapeCacheTable, path, entry);
+    if (entry && entry->mtime == mtime && entry->size == size) {
+        // another thread opened it meanwhile
+        entry->refcount++;
+        closing = opened;
+    } else {
+        if (entry) {
+            // file changed: old entry is closed by the last reference
+            HASH_DEL(shapeCacheTable, entry);
+            entry->stale = 1;
+            if (! entry->refcount) {
+                closing = entry;
+            }
+        }
+        entry = opened;
+        entry->refcount = 1;
+        HASH_ADD_STR(shapeCacheTable, path, entry);
+    }
+    pthread_mutex_unlock(&shapeCacheLock);
+
+    if (closing) {
+        shapeFileEntryClose(closing);
+    }
+    return entry;
+}
+
+
+void shapeFileCacheRetain(shapeFileEntry *entry)
+{
+    pthread_mutex_lock(&shapeCacheLock);
+    entry->refcount++;
+    pthread_mutex_unlock(&shapeCacheLock);
+}
+
+
+void shapeFileCacheRelease(shapeFileEntry *entry)
+{
+    int closing;
+
+    if (! entry) {
+        return;
+    }
+
+    pthread_mutex_lock(&shapeCacheLock);
+    closing = (--entry->refcount == 0 && entry->stale);
+    pthread_mutex_unlock(&shapeCacheLock);
+
+    if (closing) {
+        shapeFileEntryClose(entry);
+    }
+}
+
+
+int shapeFileCacheTrim(void)
+{
+    int count = 0;
+    shapeFileEntry *entry, *tmp, *unused = NULL;
+
+    pthread_mutex_lock(&shapeCacheLock);
+    HASH_ITER(hh, shapeCacheTable, entry, tmp) {
+        if (! entry->refcount) {
+            HASH_DEL(shapeCacheTable, entry);
+            entry->hh.next = unused;
+            unused = entry;
+        }
+    }
+    pthread_mutex_unlock(&shapeCacheLock);
+
+    while (unused) {
+        entry = unused;
+        unused = (shapeFileEntry *) entry->hh.next;
+        shapeFileEntryClose(entry);
+        count++;
+    }
+    return count;
+}
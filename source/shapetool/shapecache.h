@@ -0,0 +1,99 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shapecache.h
+ * @brief process-wide cache of opened shape files.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-13 10:05:41
+ * @date 2024-11-13 18:22:09
+ *
+ * @note
+ *   同一个 shp 文件 (realpath + 修改时间) 只打开一次, 地图和请求之间共享句柄,
+ *   记录偏移表, 图形外接矩形数组和 MBR 树. 条目建好后只读, 多个线程可以同时
+ *   查询 MBR 树和 envelopes; 读 hSHP/hDBF 用各自的 SHPReadContext/DBFReadContext.
+ *   文件修改后再 Acquire 得到新条目, 旧条目在最后一个引用释放时关闭.
+ */
+#ifndef SHAPE_CACHE_H__
+#define SHAPE_CACHE_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include "drawshape.h"
+
+#include <common/uthash/uthash.h>
+
+#include <pthread.h>
+
+
+typedef struct _shapeFileEntry
+{
+    // key: canonical path of shp file
+    char path[256];
+
+    // modified time (nanoseconds on Linux) and size of shp file when opened
+    int64_t mtime;
+    int64_t size;
+
+    // opened with envelopes and MBRTree built
+    shapeFileInfo shpInfo;
+
+    // record offset table of shp file, owned by shpInfo.hSHP
+    const int *recOffsets;
+    const int *recSizes;
+
+    // guarded by lock of cache
+    int refcount;
+
+    // 1: file changed, not in cache any more
+    int stale;
+
+    UT_hash_handle hh;
+} shapeFileEntry;
+
+
+/**
+ * shapeFileCacheAcquire
+ *   get shared entry of shapefile, opens it if not cached or file changed.
+ * Returns:
+ *   entry with one more reference, NULL if failed
+ */
+extern shapeFileEntry * shapeFileCacheAcquire (const char *shapefile);
+
+// one more reference of entry already acquired
+extern void shapeFileCacheRetain (shapeFileEntry *entry);
+
+extern void shapeFileCacheRelease (shapeFileEntry *entry);
+
+// close entries not referenced, returns number of entries closed
+extern int shapeFileCacheTrim (void);
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* SHAPE_CACHE_H__ */
@@ -0,0 +1,420 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shapeproj.c
+ * @brief process-wide cache of shape files reprojected into a map crs.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-29 14:12:05
+ * @date 2024-11-29 14:12:05
+ *
+ * @note
+ */
+#include "shapeproj.h"
+
+
+static pthread_mutex_t shapeProjLock = PTHREAD_MUTEX_INITIALIZER;
+
+static shapeProjEntry *shapeProjTable = NULL;
+
+// bytes of geoms of all entries in table (guarded by shapeProjLock)
+static int64_t shapeProjBytes = 0;
+
+
+static char * shapeProjKey(const shapeFileEntry *shpEntry, const char *srcdef, const char *dstdef)
+{
+    size_t len = 40 + strlen(srcdef) + strlen(dstdef);
+    char *key = (char *) mem_alloc_unset(len);
+    snprintf(key, len, "%p|%s|%s", (const void *) shpEntry, srcdef, dstdef);
+    return key;
+}
+
+
+static void shapeProjEntryClose(shapeProjEntry *entry)
+{
+    int i;
+
+    for (i = 0; i < entry->shpEntry->shpInfo.nEntities; i++) {
+        mem_free(entry->geoms[i]);
+    }
+    mem_free(entry->geoms);
+
+    RTreeDestroy(entry->rtree);
+    mem_free(entry->envelopes);
+
+    CRSTransformFinal(&entry->trans);
+    shapeFileCacheRelease(entry->shpEntry);
+
+    mem_free(entry->key);
+    mem_free(entry);
+}
+
+
+/**
+ * 变换全部外接矩形并建立 MBR 树, 坐标系相同时返回 NULL. 内置变换对每个坐标轴单调, 外接矩形的两个角点
+ * 作为一个数组一次变换; PROJ 变换逐个沿边取点.
+ */
+static shapeProjEntry * shapeProjEntryOpen(shapeFileEntry *shpEntry, const char *srcdef, const char *dstdef, char *key)
+{
+    int i, numBoxes = 0;
+    const shapeFileInfo *shpInfo = &shpEntry->shpInfo;
+    shapeProjEntry *entry = (shapeProjEntry *) mem_alloc_zero(1, sizeof(shapeProjEntry));
+
+    if (CRSTransformInit(&entry->trans, srcdef, dstdef) != 0 || CRSTransformIsIdentity(&entry->trans)) {
+        CRSTransformFinal(&entry->trans);
+        mem_free(entry);
+        mem_free(key);
+        return NULL;
+    }
+
+    shapeFileCacheRetain(shpEntry);
+    entry->key = key;
+    entry->shpEntry = shpEntry;
+
+    entry->envelopes = (SHPEnvelope *) mem_alloc_zero(shpInfo->nEntities + 1, sizeof(SHPEnvelope));
+    entry->geoms = (void **) mem_alloc_zero(shpInfo->nEntities + 1, sizeof(void *));
+    entry->rtree = RTreeCreate(0);
+
+    if (entry->trans.pj) {
+        for (i = 0; i < shpInfo->nEntities; i++) {
+            const SHPEnvelope *env = &shpInfo->envelopes[i];
+            if (env->XMin <= env->XMax) {
+                CRSTransformBox(&entry->trans, (const CGBox2D *) env, (CGBox2D *) &entry->envelopes[i]);
+            }
+        }
+    } else {
+        memcpy(entry->envelopes, shpInfo->envelopes, sizeof(SHPEnvelope) * shpInfo->nEntities);
+        CRSTransformPoints(&entry->trans, (double *) entry->envelopes, shpInfo->nEntities * 2);
+    }
+
+    for (i = 0; i < shpInfo->nEntities; i++) {
+        SHPEnvelope *env = &entry->envelopes[i];
+
+        if (shpInfo->envelopes[i].XMin > shpInfo->envelopes[i].XMax || ! (env->XMin <= env->XMax && env->YMin <= env->YMax)) {
+            // null shape or out of crs
+            env->XMin = 1;
+            env->XMax = -1;
+            continue;
+        }
+
+        RTreeInsertMbr(entry->rtree, (RTREE_MBR *) env, (void *) (uintptr_t) (i + 1), 0);
+
+        if (! numBoxes++) {
+            entry->dataBox = *((const CGBox2D *) env);
+        } else {
+            entry->dataBox.Xmin = fmin(entry->dataBox.Xmin, env->XMin);
+            entry->dataBox.Ymin = fmin(entry->dataBox.Ymin, env->YMin);
+            entry->dataBox.Xmax = fmax(entry->dataBox.Xmax, env->XMax);
+            entry->dataBox.Ymax = fmax(entry->dataBox.Ymax, env->YMax);
+        }
+    }
+
+    return entry;
+}
+
+
+shapeProjEntry * shapeProjCacheAcquire(shapeFileEntry *shpEntry, const char *srcdef, const char *dstdef)
+{
+    char *key;
+    shapeProjEntry *entry, *opened, *closing = NULL;
+
+    if (! shpEntry || ! srcdef || ! dstdef) {
+        return NULL;
+    }
+
+    key = shapeProjKey(shpEntry, srcdef, dstdef);
+
+    pthread_mutex_lock(&shapeProjLock);
+    HASH_FIND_STR(shapeProjTable, key, entry);
+    if (entry) {
+        entry->refcount++;
+        pthread_mutex_unlock(&shapeProjLock);
+        mem_free(key);
+        return entry;
+    }
+    pthread_mutex_unlock(&shapeProjLock);
+
+    // 变换全部外接矩形, 不持有锁. 坐标系相同时不建条目
+    opened = shapeProjEntryOpen(shpEntry, srcdef, dstdef, key);
+    if (! opened) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&shapeProjLock);
+    HASH_FIND_STR(shapeProjTable, opened->key, entry);
+    if (entry) {
+        // another thread opened it meanwhile
+        closing = opened;
+    } else {
+        entry = opened;
+        HASH_ADD_KEYPTR(hh, shapeProjTable, entry->key, strlen(entry->key), entry);
+    }
+    entry->refcount++;
+    pthread_mutex_unlock(&shapeProjLock);
+
+    if (closing) {
+        shapeProjEntryClose(closing);
+    }
+    return entry;
+}
+
+
+void shapeProjCacheRelease(shapeProjEntry *entry)
+{
+    if (entry) {
+        pthread_mutex_lock(&shapeProjLock);
+        entry->refcount--;
+        pthread_mutex_unlock(&shapeProjLock);
+    }
+}
+
+
+int shapeProjCacheTrim(void)
+{
+    int count = 0;
+    shapeProjEntry *entry, *tmp, *unused = NULL;
+
+    pthread_mutex_lock(&shapeProjLock);
+    HASH_ITER(hh, shapeProjTable, entry, tmp) {
+        if (! entry->refcount) {
+            HASH_DEL(shapeProjTable, entry);
+            shapeProjBytes -= entry->geomBytes;
+            entry->hh.next = unused;
+            unused = entry;
+        }
+    }
+    pthread_mutex_unlock(&shapeProjLock);
+
+    while (unused) {
+        entry = unused;
+        unused = (shapeProjEntry *) entry->hh.next;
+        shapeProjEntryClose(entry);
+        count++;
+    }
+    return count;
+}
+
+
+/**
+ * 从没有在画的条目中淘汰图形, 直到总量不超过 SHAPE_PROJ_CACHE_BYTES 的 3/4.
+ * clock: 指针经过时画过的图形清除 used, 再次经过仍未画过的释放. 持有 shapeProjLock 调用.
+ */
+static void shapeProjCacheEvict(void)
+{
+    const int64_t lowBytes = SHAPE_PROJ_CACHE_BYTES / 4 * 3;
+    shapeProjEntry *entry, *tmp;
+
+    HASH_ITER(hh, shapeProjTable, entry, tmp) {
+        int steps, numShapes = entry->shpEntry->shpInfo.nEntities;
+
+        if (shapeProjBytes <= lowBytes) {
+            break;
+        }
+        if (entry->drawing || ! entry->geomBytes) {
+            continue;
+        }
+
+        for (steps = 0; steps < 2 * numShapes && shapeProjBytes > lowBytes; steps++) {
+            shapeProjGeom *geom = (shapeProjGeom *) entry->geoms[entry->clockHand];
+
+            if (geom) {
+                if (geom->used) {
+                    geom->used = 0;
+                } else {
+                    entry->geoms[entry->clockHand] = 0;
+                    entry->geomBytes -= geom->bytes;
+                    shapeProjBytes -= geom->bytes;
+                    mem_free(geom);
+                }
+            }
+
+            if (++entry->clockHand == numShapes) {
+                entry->clockHand = 0;
+            }
+        }
+    }
+}
+
+
+typedef struct
+{
+    shapeProjEntry *entry;
+    drawJob *job;
+    int numFetched;
+
+    // bytes of geoms added by this fetch
+    int64_t bytes;
+} shapeProjFetch;
+
+
+// copy record of view and transform all its points at once
+static int shapeProjOnFetch(const SHPGeomView *view, void *userParam)
+{
+    shapeProjFetch *fetch = (shapeProjFetch *) userParam;
+    shapeProjEntry *entry = fetch->entry;
+    drawJob *job = fetch->job;
+
+    shapeProjGeom *geom;
+    int *partStart;
+    double *xy;
+    size_t partBytes = sizeof(int) * ((view->nParts + 1) & ~1);
+    size_t geomBytes;
+
+    if (job && fetch->numFetched % job->checkShapes == 0 && fetch->numFetched && drawJobCheck(job) != draw_job_completed) {
+        return 0;
+    }
+    fetch->numFetched++;
+
+    geomBytes = sizeof(shapeProjGeom) + partBytes + sizeof(double) * 2 * view->nVertices;
+    geom = (shapeProjGeom *) mem_alloc_unset(geomBytes);
+    geom->bytes = (int64_t) geomBytes;
+    geom->used = 0;
+    partStart = (int *) (geom + 1);
+    xy = (double *) ((char *) partStart + partBytes);
+
+    memcpy(partStart, view->panPartStart, sizeof(int) * view->nParts);
+    memcpy(xy, view->padfXY, sizeof(double) * 2 * view->nVertices);
+    CRSTransformPoints(&entry->trans, xy, view->nVertices);
+
+    geom->view = *view;
+    geom->view.panPartStart = partStart;
+    geom->view.panPartType = 0;
+    geom->view.padfXY = xy;
+    geom->view.padfZ = 0;
+    geom->view.padfM = 0;
+
+    geom->view.dfXMin = entry->envelopes[view->nShapeId].XMin;
+    geom->view.dfYMin = entry->envelopes[view->nShapeId].YMin;
+    geom->view.dfXMax = entry->envelopes[view->nShapeId].XMax;
+    geom->view.dfYMax = entry->envelopes[view->nShapeId].YMax;
+
+    if (uatomic_ptr_comp_exch(&entry->geoms[view->nShapeId], 0, geom) != 0) {
+        // drawn by another thread meanwhile
+        mem_free(geom);
+    } else {
+        fetch->bytes += geom->bytes;
+    }
+    return 1;
+}
+
+
+drawJobStatus shapeProjEntryDrawJob(shapeProjEntry *entry, cairoDrawCtx *CDC, drawJob *job)
+{
+    int i, numVisible = 0, numMissing = 0, numDrawn = 0;
+    int checkShapes = (job? job->checkShapes : 0);
+    int *missing;
+
+    shapeFileInfo *shpInfo = &entry->shpEntry->shpInfo;
+
+    mem_arena_t *arena = mem_arena_default();
+    mem_arena_mark_t mark;
+
+    CGBox2D viewData;
+    shapeIdList list;
+    shapeProjFetch fetch = {entry, job, 0, 0};
+
+    if (job && drawJobCheck(job) != draw_job_completed) {
+        return job->status;
+    }
+
+    // geoms of entry are not evicted until drawing done
+    pthread_mutex_lock(&shapeProjLock);
+    entry->drawing++;
+    pthread_mutex_unlock(&shapeProjLock);
+
+    mem_arena_mark(arena, &mark);
+
+    bzero(&list, sizeof(list));
+    list.arena = arena;
+
+    ViewToDataBox(&CDC->viewport, CDC->viewport.viewBox, &viewData);
+    RTreeSearchMbr(entry->rtree, (const RTREE_MBR *) &viewData, shapeIdListOnSearch, &list);
+
+    // draw in order of shapes
+    if (list.count > 1) {
+        qsort(list.shapeIds, list.count, sizeof(int), shapeIdCmp);
+    }
+
+    missing = (int *) mem_arena_alloc(arena, sizeof(int) * (list.count + 1));
+
+    for (i = 0; i < list.count; i++) {
+        int nShapeId = list.shapeIds[i];
+
+        if (shapeFileInfoShapeVisible(shpInfo, &entry->envelopes[nShapeId], CDC)) {
+            list.shapeIds[numVisible++] = nShapeId;
+
+            if (! uatomic_ptr_get(&entry->geoms[nShapeId])) {
+                missing[numMissing++] = nShapeId;
+            }
+        }
+    }
+
+    if (numMissing) {
+        // 没画过的图形按文件位置合并读取后变换
+        SHPReadContext readCtx;
+
+        SHPReadContextInit(&readCtx);
+        readCtx.pArena = arena;
+
+        SHPFetchGeomViews(shpInfo->hSHP, &readCtx, missing, numMissing, shapeProjOnFetch, &fetch);
+
+        SHPReadContextFinal(&readCtx);
+    }
+
+    for (i = 0; i < numVisible; i++) {
+        shapeProjGeom *geom;
+
+        if (checkShapes && i % checkShapes == 0 && i && drawJobCheck(job) != draw_job_completed) {
+            break;
+        }
+
+        // NULL if fetching stopped
+        geom = (shapeProjGeom *) uatomic_ptr_get(&entry->geoms[list.shapeIds[i]]);
+        if (geom) {
+            // read by clock hand after drawing done
+            uatomic_int_set(&geom->used, 1);
+            drawShapeView(&geom->view, CDC);
+            numDrawn++;
+        }
+    }
+
+    mem_arena_rewind(arena, &mark);
+
+    pthread_mutex_lock(&shapeProjLock);
+    entry->drawing--;
+    entry->geomBytes += fetch.bytes;
+    shapeProjBytes += fetch.bytes;
+    if (shapeProjBytes > SHAPE_PROJ_CACHE_BYTES) {
+        shapeProjCacheEvict();
+    }
+    pthread_mutex_unlock(&shapeProjLock);
+
+    if (job) {
+        job->numDrawn += numDrawn;
+        return job->status;
+    }
+    return draw_job_completed;
+}
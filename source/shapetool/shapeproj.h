@@ -0,0 +1,127 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file shapeproj.h
+ * @brief process-wide cache of shape files reprojected into a map crs.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-29 14:12:05
+ * @date 2024-11-29 14:12:05
+ *
+ * @note
+ *   按 (shp 缓存条目, 数据坐标系, 地图坐标系) 共享. 打开时变换全部外接矩形并建
+ *   MBR 树; 图形第一次画时整个坐标数组一起变换, 之后平移和缩放不再计算.
+ *   全部条目的变换结果超过 SHAPE_PROJ_CACHE_BYTES 时, 从没有在画的条目中
+ *   按 clock 淘汰最近没画过的图形. 坐标系不变的图层 (未给出或相同) 不用此缓存.
+ */
+#ifndef SHAPE_PROJ_H__
+#define SHAPE_PROJ_H__
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+#include "shapecache.h"
+
+#include <common/crsproj.h>
+#include <common/rtree.h>
+
+
+// bytes of projected shapes kept by all entries
+#ifndef SHAPE_PROJ_CACHE_BYTES
+#   define SHAPE_PROJ_CACHE_BYTES   ((int64_t) 256 * 1024 * 1024)
+#endif
+
+
+// projected shape: view arrays follow the struct
+typedef struct
+{
+    SHPGeomView view;
+
+    // allocated bytes
+    int64_t bytes;
+
+    // 1: drawn since last pass of clock hand
+    int used;
+} shapeProjGeom;
+
+
+typedef struct _shapeProjEntry
+{
+    // key: shpEntry address, srcdef and dstdef
+    char *key;
+
+    // referenced entry of shapeFileCache
+    shapeFileEntry *shpEntry;
+
+    CRSTransform trans;
+
+    // projected envelopes, XMin > XMax for SHPT_NULL
+    SHPEnvelope *envelopes;
+    RTREE_ROOT rtree;
+
+    // projected bounds of layer
+    CGBox2D dataBox;
+
+    // shapeProjGeom of each shape, NULL until drawn or after evicted (uatomic_ptr_*)
+    void **geoms;
+
+    // guarded by lock of cache
+    int refcount;
+
+    // geoms are evicted only while no thread is drawing (guarded by lock of cache)
+    int drawing;
+    int clockHand;
+    int64_t geomBytes;
+
+    UT_hash_handle hh;
+} shapeProjEntry;
+
+
+/**
+ * shapeProjCacheAcquire
+ *   get shared entry of shpEntry reprojected from srcdef into dstdef.
+ * Returns:
+ *   entry with one more reference, NULL if transform is identity or failed
+ */
+extern shapeProjEntry * shapeProjCacheAcquire (shapeFileEntry *shpEntry, const char *srcdef, const char *dstdef);
+
+extern void shapeProjCacheRelease (shapeProjEntry *entry);
+
+// close entries not referenced (before shapeFileCacheTrim), returns number of entries closed
+extern int shapeProjCacheTrim (void);
+
+/**
+ * shapeProjEntryDrawJob
+ *   same as shapeFileInfoDrawJob for projected shapes. shapes not drawn
+ *   before are read and transformed first.
+ */
+extern drawJobStatus shapeProjEntryDrawJob (shapeProjEntry *entry, cairoDrawCtx *CDC, drawJob *job);
+
+#ifdef    __cplusplus
+}
+#endif
+#endif /* SHAPE_PROJ_H__ */
@@ -78,10 +78,24 @@ extern "C" {
 #define SHAPETOOL_PATHLEN_INVALID  256  // 文件全路径最大长度(char)
 #define SHAPETOOL_LAYERS_MAX      1024  // 最多的图层数
 
+#define SHAPETOOL_LEVEL_MIN_DEFAULT  4  // 默认网格索引层级 (import)
+#define SHAPETOOL_LEVEL_MAX_DEFAULT 12
+
+#define SHAPETOOL_THREADS_DEFAULT    4  // 默认线程数 (benchshptree, export)
+#define SHAPETOOL_THREADS_MAX       64
+
 
 static const char* commands[] = {
     "drawshape",
     "drawlayers",
+    "import",
+    "benchindex",
+    "benchcipher",
+    "benchshptree",
+    "export",
+    "benchgeom",
+    "validate",
+    "benchclip",
     0
 };
 
@@ -90,6 +104,14 @@ typedef enum {
     command_first_pos = 0,
     command_drawshape = command_first_pos,
     command_drawlayers,
+    command_import,
+    command_benchindex,
+    command_benchcipher,
+    command_benchshptree,
+    command_export,
+    command_benchgeom,
+    command_validate,
+    command_benchclip,
     command_end_npos
 } shapetool_command;
 
@@ -103,7 +125,16 @@ typedef enum {
     optarg_height,         // height in dots
     optarg_dpi,            // dots per inch
     optarg_styleclass,     // style class names
-    optarg_stylecss        // style css file (/path/to/style.css)
+    optarg_stylecss,       // style css file (/path/to/style.css)
+    optarg_geodb,          // geodb file (/path/to/file.geodb)
+    optarg_levels,         // grid index levels: MIN-MAX
+    optarg_index,          // spatial index: grid or rtree
+    optarg_timeout,        // draw deadline in milliseconds
+    optarg_threads,        // number of threads
+    optarg_outfile,        // output file (.wkb or .wkt)
+    optarg_fix,            // fix invalid shapes (validate)
+    optarg_srcproj,        // crs of shpfile (proj4def)
+    optarg_proj4def        // crs of output: png or wkb/wkt
 } shapetool_optarg;
 
 
@@ -116,6 +147,15 @@ typedef struct {
     unsigned int dpi : 1;
     unsigned int styleclass : 1;
     unsigned int style : 1;
+    unsigned int geodb : 1;
+    unsigned int levels : 1;
+    unsigned int index : 1;
+    unsigned int timeout : 1;
+    unsigned int threads : 1;
+    unsigned int outfile : 1;
+    unsigned int fix : 1;
+    unsigned int srcproj : 1;
+    unsigned int proj4def : 1;
 } shapetool_flags;
 
 
@@ -134,6 +174,20 @@ typedef struct {
     float   width;      // width in dots
     float   height;     // height in dots
     int     dpi;
+
+    cstrbuf geodb;       // geodb file for import
+    int     level_min;   // grid index levels
+    int     level_max;
+    int     index_rtree; // 0: grid index, 1: rtree index
+
+    int     timeout_ms;  // stop drawing after milliseconds, 0 for none
+
+    int     threads;     // number of threads for benchmarks and export
+
+    cstrbuf outfile;     // export output file (.wkb or .wkt)
+
+    cstrbuf srcproj;     // crs of shpfile: EPSG:4326, +proj=..., none for same as output
+    cstrbuf proj4def;    // crs of output, none for no reprojection
 } shapetool_options;
 
 
@@ -141,6 +195,22 @@ int shpfile2png(shapetool_flags *flags, shapetool_options* options);
 
 int maplayers2png(shapetool_flags* flags, shapetool_options* options);
 
+int shpfile2geodb(shapetool_flags* flags, shapetool_options* options);
+
+int benchgeodbindex(shapetool_flags* flags, shapetool_options* options);
+
+int benchgeodbcipher(shapetool_flags* flags, shapetool_options* options);
+
+int benchshptree(shapetool_flags* flags, shapetool_options* options);
+
+int shpfile2wkx(shapetool_flags* flags, shapetool_options* options);
+
+int benchshpgeom(shapetool_flags* flags, shapetool_options* options);
+
+int shpfilevalidate(shapetool_flags* flags, shapetool_options* options);
+
+int benchshpclip(shapetool_flags* flags, shapetool_options* options);
+
 #ifdef    __cplusplus
 }
 #endif
@@ -35,8 +35,6 @@
  */
 #include "shapetool-common.h"
 
-#include <proj.h>
-
 shapetool_flags flags = { 0 };
 shapetool_options options = { 0 };
 
@@ -50,6 +48,10 @@ static void onexit_cleanup(void)
     cstrbufFree(&options.shpfile);
     cstrbufFree(&options.outpng);
     cstrbufFree(&options.styleclass);
+    cstrbufFree(&options.geodb);
+    cstrbufFree(&options.outfile);
+    cstrbufFree(&options.srcproj);
+    cstrbufFree(&options.proj4def);
 
     cstrbufFree(&options.abscurdir);
 }
@@ -116,7 +118,31 @@ static void print_usage()
  *
  *   $ shapetool drawshape --shpfile ../../../shps/area.shp --outpng ../../../output/area2.png --stylecss ".polygon { border: 3 solid #000FFF; fill: 1 solid #CFF000}"
  *
+ *   $ shapetool drawshape --shpfile ../../../shps/area.shp --outpng ../../../output/area2.png --timeout 500
+ *
+ *   $ shapetool drawshape --shpfile ../../../shps/area.shp --outpng ../../../output/area3857.png --srcproj EPSG:4326 --proj4def EPSG:3857
+ *
  *   $ shapetool drawlayers --maplayers maplayers.json --mapid default --outpng ../../../output/map-default.png
+ *
+ *   $ shapetool import --shpfile ../../../shps/area.shp --geodb ../../../output/test.geodb --levels 4-12
+ *
+ *   $ shapetool import --shpfile ../../../shps/area.shp --geodb ../../../output/test.geodb --index rtree
+ *
+ *   $ shapetool benchindex --shpfile ../../../shps/area.shp --geodb ../../../output/bench.geodb --levels 4-12
+ *
+ *   $ shapetool benchcipher --geodb ../../../output/test.geodb
+ *
+ *   $ shapetool benchshptree --shpfile ../../../shps/area.shp --threads 8
+ *
+ *   $ shapetool export --shpfile ../../../shps/area.shp --outfile ../../../output/area.wkt --threads 4
+ *
+ *   $ shapetool export --shpfile ../../../shps/area.shp --outfile ../../../output/area3857.wkb --srcproj EPSG:4326 --proj4def EPSG:3857
+ *
+ *   $ shapetool benchgeom
+ *
+ *   $ shapetool validate --shpfile ../../../shps/area.shp --fix
+ *
+ *   $ shapetool benchclip --width 1920 --height 1080
  */
 int main(int argc, char* argv[])
 {
@@ -126,11 +152,6 @@ int main(int argc, char* argv[])
 
     printf("CURDIR=%.*s\n", CBSTRLEN(options.abscurdir), CBSTR(options.abscurdir));
 
-    // TEST:
-    PJ_CONTEXT *pjctx = proj_context_create();
-    proj_context_destroy(pjctx);
-
-
     int opt, optindex, flag, blen;
 
     // 从命令行解析命令名 cmdname:
@@ -151,6 +172,15 @@ int main(int argc, char* argv[])
         ,{"dpi", required_argument, &flag, optarg_dpi}
         ,{"styleclass", required_argument, &flag, optarg_styleclass}
         ,{"stylecss", required_argument, &flag, optarg_stylecss}
+        ,{"geodb", required_argument, &flag, optarg_geodb}
+        ,{"levels", required_argument, &flag, optarg_levels}
+        ,{"index", required_argument, &flag, optarg_index}
+        ,{"timeout", required_argument, &flag, optarg_timeout}
+        ,{"threads", required_argument, &flag, optarg_threads}
+        ,{"outfile", required_argument, &flag, optarg_outfile}
+        ,{"fix", no_argument, &flag, optarg_fix}
+        ,{"srcproj", required_argument, &flag, optarg_srcproj}
+        ,{"proj4def", required_argument, &flag, optarg_proj4def}
         ,{0, 0, 0, 0}
     };
 
@@ -272,6 +302,65 @@ int main(int argc, char* argv[])
                     flags.style = 1;
                 }
                 break;
+            case optarg_geodb:
+                options.geodb = check_pathfile_arg(optarg, ".geodb", 0);
+                if (options.geodb) {
+                    flags.geodb = 1;
+                }
+                break;
+            case optarg_levels:
+                if (sscanf(optarg, "%d-%d", &options.level_min, &options.level_max) != 2 ||
+                    options.level_min < 0 || options.level_min > options.level_max) {
+                    printf("Error: invalid levels=%s (use: --levels MIN-MAX)\n", optarg);
+                    exit(1);
+                }
+                flags.levels = 1;
+                break;
+            case optarg_index:
+                if (! strcmp(optarg, "grid")) {
+                    options.index_rtree = 0;
+                } else if (! strcmp(optarg, "rtree")) {
+                    options.index_rtree = 1;
+                } else {
+                    printf("Error: invalid index=%s (use: --index grid|rtree)\n", optarg);
+                    exit(1);
+                }
+                flags.index = 1;
+                break;
+            case optarg_timeout:
+                options.timeout_ms = atoi(optarg);
+                if (options.timeout_ms < 0) {
+                    printf("Error: invalid timeout=%s (use: --timeout MS)\n", optarg);
+                    exit(1);
+                }
+                flags.timeout = 1;
+                break;
+            case optarg_threads:
+                options.threads = atoi(optarg);
+                if (options.threads < 1 || options.threads > SHAPETOOL_THREADS_MAX) {
+                    printf("Error: invalid threads=%s (use: --threads 1-%d)\n", optarg, SHAPETOOL_THREADS_MAX);
+                    exit(1);
+                }
+                flags.threads = 1;
+                break;
+            case optarg_outfile:
+                blen = cstr_length(optarg, SHAPETOOL_PATHLEN_INVALID);
+                options.outfile = check_pathfile_arg(optarg, cstr_endwith(optarg, blen, ".wkt", 4)? ".wkt" : ".wkb", -1);
+                if (options.outfile) {
+                    flags.outfile = 1;
+                }
+                break;
+            case optarg_fix:
+                flags.fix = 1;
+                break;
+            case optarg_srcproj:
+                options.srcproj = cstrbufDup(options.srcproj, optarg, cstrbuf_error_size_len);
+                flags.srcproj = 1;
+                break;
+            case optarg_proj4def:
+                options.proj4def = cstrbufDup(options.proj4def, optarg, cstrbuf_error_size_len);
+                flags.proj4def = 1;
+                break;
             }
             break;
         }
@@ -344,6 +433,116 @@ int main(int argc, char* argv[])
 
         maplayers2png(&flags, &options);
     }
+    else if (command == command_import) {
+        if (!flags.shpfile) {
+            printf("Error: no input shp file specified (use: --shpfile SHPFILE).\n");
+            exit(1);
+        }
+
+        if (!flags.geodb) {
+            printf("Error: no geodb file specified (use: --geodb GEODBFILE)\n");
+            exit(1);
+        }
+
+        if (!flags.levels) {
+            options.level_min = SHAPETOOL_LEVEL_MIN_DEFAULT;
+            options.level_max = SHAPETOOL_LEVEL_MAX_DEFAULT;
+        }
+
+        printf("Info: shpfile2geodb: %s => %s\n", CBSTR(options.shpfile), CBSTR(options.geodb));
+        printf("      levels: %d-%d, index: %s\n", options.level_min, options.level_max, options.index_rtree? "rtree" : "grid");
+
+        if (shpfile2geodb(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_benchindex) {
+        if (!flags.shpfile) {
+            printf("Error: no input shp file specified (use: --shpfile SHPFILE).\n");
+            exit(1);
+        }
+
+        if (!flags.geodb) {
+            printf("Error: no geodb file specified (use: --geodb GEODBFILE)\n");
+            exit(1);
+        }
+
+        if (!flags.levels) {
+            options.level_min = SHAPETOOL_LEVEL_MIN_DEFAULT;
+            options.level_max = SHAPETOOL_LEVEL_MAX_DEFAULT;
+        }
+
+        if (benchgeodbindex(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_benchcipher) {
+        if (!flags.geodb) {
+            printf("Error: no geodb file specified (use: --geodb GEODBFILE)\n");
+            exit(1);
+        }
+
+        if (benchgeodbcipher(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_benchshptree) {
+        if (!flags.shpfile) {
+            printf("Error: no input shp file specified (use: --shpfile SHPFILE).\n");
+            exit(1);
+        }
+
+        if (!flags.threads) {
+            options.threads = SHAPETOOL_THREADS_DEFAULT;
+        }
+
+        if (benchshptree(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_export) {
+        if (!flags.shpfile) {
+            printf("Error: no input shp file specified (use: --shpfile SHPFILE).\n");
+            exit(1);
+        }
+
+        if (!flags.outfile) {
+            printf("Error: no output file specified (use: --outfile WKBFILE|WKTFILE)\n");
+            exit(1);
+        }
+
+        if (!flags.threads) {
+            options.threads = SHAPETOOL_THREADS_DEFAULT;
+        }
+
+        printf("Info: shpfile2wkx: %s => %s (threads=%d)\n", CBSTR(options.shpfile), CBSTR(options.outfile), options.threads);
+
+        if (shpfile2wkx(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_benchgeom) {
+        if (benchshpgeom(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_validate) {
+        if (!flags.shpfile) {
+            printf("Error: no input shp file specified (use: --shpfile SHPFILE).\n");
+            exit(1);
+        }
+
+        printf("Info: shpfilevalidate: %s%s\n", CBSTR(options.shpfile), flags.fix? " (fix)" : "");
+
+        if (shpfilevalidate(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
+    else if (command == command_benchclip) {
+        if (benchshpclip(&flags, &options) != SHAPETOOL_RES_SOK) {
+            exit(1);
+        }
+    }
 
     // TODO: others
 
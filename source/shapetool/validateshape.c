@@ -0,0 +1,100 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file validateshape.c
+ * @brief validate (and fix) rings of polygon shapes in shapefile.
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2024-11-25 10:16:40
+ * @date 2024-11-25 10:16:40
+ *
+ * @note
+ *   由环的嵌套关系检查: 外环顺时针, 洞逆时针, 每个外环之后紧跟其洞.
+ *   --fix: 修复后原位写回 (记录大小不变).
+ */
+#include "shapetool-common.h"
+
+#include <shapefile/shapefile_api.h>
+#include <common/timeut.h>
+
+
+/**
+ * 检查全部多边形图形的环. 返回 SHAPETOOL_RES_ERR 如果有无效图形 (--fix 时修复)
+ */
+int shpfilevalidate(shapetool_flags* flags, shapetool_options* options)
+{
+    int i, numshapes, shapetype, numinvalid = 0, numrings = 0, ret = SHAPETOOL_RES_SOK;
+    struct timespec t0, t1;
+
+    SHPHandle hSHP = SHPOpen(CBSTR(options->shpfile), flags->fix? "rb+" : "rb");
+    if (! hSHP) {
+        printf("Error: open shp file failed: %s\n", CBSTR(options->shpfile));
+        return SHAPETOOL_RES_ERR;
+    }
+
+    SHPGetInfo(hSHP, &numshapes, &shapetype, 0, 0);
+    if (shapetype != SHPT_POLYGON && shapetype != SHPT_POLYGONZ && shapetype != SHPT_POLYGONM) {
+        printf("Info: not polygon shp file (type=%d)\n", shapetype);
+        SHPClose(hSHP);
+        return SHAPETOOL_RES_SOK;
+    }
+
+    getnowtimeofday(&t0);
+
+    for (i = 0; i < numshapes; i++) {
+        int changed;
+        SHPObject *psShape = SHPReadObject(hSHP, i);
+        if (! psShape) {
+            /* null or empty shape */
+            continue;
+        }
+
+        changed = SHPObjectFixRings(psShape);
+        if (changed > 0) {
+            numinvalid++;
+            numrings += changed;
+
+            if (flags->fix && SHPWriteObject(hSHP, i, psShape) != i) {
+                printf("Error: write shape#%d failed\n", i);
+                ret = SHAPETOOL_RES_ERR;
+                SHPDestroyObject(psShape);
+                break;
+            }
+        }
+        SHPDestroyObject(psShape);
+    }
+
+    getnowtimeofday(&t1);
+    SHPClose(hSHP);
+
+    printf("Info: %d of %d shapes invalid (%d rings reversed or moved)%s in %.1f ms\n", numinvalid, numshapes, numrings,
+        (flags->fix && numinvalid)? ", fixed" : "", (double) difftime_msec(&t0, &t1));
+
+    if (numinvalid && ! flags->fix) {
+        ret = SHAPETOOL_RES_ERR;
+    }
+    return ret;
+}